@@ -26,6 +26,7 @@
 #include "api.h"
 #include "tcp.h"
 #include "input.h"
+#include "parsers/parsers.h"
 
 static int
 api_status_inputs
@@ -171,6 +172,40 @@ api_status_input_clear_stats
   return 0;
 }
 
+#if ENABLE_MPEGTS
+static int
+api_status_demux
+  ( access_t *perm, void *opaque, const char *op, htsmsg_t *args, htsmsg_t **resp )
+{
+  int c = 0;
+  htsmsg_t *l = mpegts_demux_status();
+  htsmsg_field_t *f;
+
+  HTSMSG_FOREACH(f, l)
+    c++;
+  *resp = htsmsg_create_map();
+  htsmsg_add_msg(*resp, "entries", l);
+  htsmsg_add_u32(*resp, "totalCount", c);
+  return 0;
+}
+#endif
+
+static int
+api_status_parsers
+  ( access_t *perm, void *opaque, const char *op, htsmsg_t *args, htsmsg_t **resp )
+{
+  int c = 0;
+  htsmsg_t *l = parser_workers_status();
+  htsmsg_field_t *f;
+
+  HTSMSG_FOREACH(f, l)
+    c++;
+  *resp = htsmsg_create_map();
+  htsmsg_add_msg(*resp, "entries", l);
+  htsmsg_add_u32(*resp, "totalCount", c);
+  return 0;
+}
+
 void api_status_init ( void )
 {
   static api_hook_t ah[] = {
@@ -178,6 +213,10 @@ void api_status_init ( void )
     { "status/subscriptions", ACCESS_ADMIN, api_status_subscriptions, NULL },
     { "status/inputs",        ACCESS_ADMIN, api_status_inputs, NULL },
     { "status/inputclrstats", ACCESS_ADMIN, api_status_input_clear_stats, NULL },
+#if ENABLE_MPEGTS
+    { "status/demux",         ACCESS_ADMIN, api_status_demux, NULL },
+#endif
+    { "status/parsers",       ACCESS_ADMIN, api_status_parsers, NULL },
     { "connections/cancel",   ACCESS_ADMIN, api_connections_cancel, NULL },
     { NULL },
   };
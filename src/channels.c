@@ -55,7 +55,8 @@ static void channel_epg_update_all ( channel_t *ch );
 static int
 ch_id_cmp ( channel_t *a, channel_t *b )
 {
-  return channel_get_id(a) - channel_get_id(b);
+  uint32_t x = channel_get_id(a), y = channel_get_id(b);
+  return x < y ? -1 : (x > y ? 1 : 0);
 }
 
 static void
@@ -694,6 +695,18 @@ channel_find_by_id ( uint32_t i )
   return RB_FIND(&channels, &skel, ch_link, ch_id_cmp);
 }
 
+/*
+ * First channel with the id greater or equal (cursors)
+ */
+channel_t *
+channel_find_by_id_ge ( uint32_t i )
+{
+  channel_t skel;
+  memcpy(skel.ch_id.in_uuid.bin, &i, sizeof(i));
+
+  return RB_FIND_GE(&channels, &skel, ch_link, ch_id_cmp);
+}
+
 channel_t *
 channel_find_by_number ( const char *no )
 {
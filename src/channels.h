@@ -148,6 +148,7 @@ channel_t *channel_find_by_name_bouquet_fuzzy(const char *name, const struct bou
   (channel_t*)idnode_find(u, &channel_class, NULL)
 
 channel_t *channel_find_by_id(uint32_t id);
+channel_t *channel_find_by_id_ge(uint32_t id);
 
 channel_t *channel_find_by_number(const char *no);
 
@@ -2525,6 +2525,19 @@ const idclass_t config_class = {
       .off    = offsetof(config_t, iptv_tpool_count),
       .group  = 7,
     },
+    {
+      .type   = PT_INT,
+      .id     = "demux_threads",
+      .name   = N_("Demux threads"),
+      .desc   = N_("Set the number of threads delivering the MPEG-TS "
+                   "data to the services (parsing, descrambling). "
+                   "Each tuned mux is handled by one thread, so the "
+                   "load is split per mux. Zero means that the input "
+                   "threads do this job. A restart is required."),
+      .off    = offsetof(config_t, demux_threads),
+      .opts   = PO_EXPERT,
+      .group  = 7,
+    },
     {
       .type   = PT_INT,
       .id     = "dscp",
@@ -2552,6 +2565,19 @@ const idclass_t config_class = {
       .opts   = PO_EXPERT,
       .group  = 7,
     },
+    {
+      .type   = PT_INT,
+      .id     = "descrambler_threads",
+      .name   = N_("CSA descrambler threads"),
+      .desc   = N_("Set the number of threads decrypting the CSA "
+                   "scrambled packets. The packet clusters of all "
+                   "services are spread across these threads. Zero "
+                   "means that the packets are decrypted in the input "
+                   "threads. A restart is required."),
+      .off    = offsetof(config_t, descrambler_threads),
+      .opts   = PO_EXPERT,
+      .group  = 7,
+    },
     {
       .type   = PT_BOOL,
       .id     = "parser_backlog",
@@ -2563,6 +2589,20 @@ const idclass_t config_class = {
       .opts   = PO_EXPERT,
       .group  = 7,
     },
+    {
+      .type   = PT_INT,
+      .id     = "parser_threads",
+      .name   = N_("Parser threads"),
+      .desc   = N_("Set the number of threads parsing the elementary "
+                   "streams (video, audio, subtitles) for the "
+                   "subscriptions. Each subscription is handled by one "
+                   "thread and the input threads only queue the "
+                   "MPEG-TS data. Zero means that the input threads "
+                   "parse the streams. A restart is required."),
+      .off    = offsetof(config_t, parser_threads),
+      .opts   = PO_EXPERT,
+      .group  = 7,
+    },
     {
       .type   = PT_STR,
       .id     = "muxconfpath",
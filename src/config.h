@@ -62,12 +62,15 @@ typedef struct config {
   uint32_t cookie_expires;
   int dscp;
   uint32_t descrambler_buffer;
+  int descrambler_threads;
   int caclient_ui;
   int parser_backlog;
+  int parser_threads;
   int epg_compress;
   uint32_t epg_cut_window;
   uint32_t epg_update_window;
   int iptv_tpool_count;
+  int demux_threads;
   char *date_mask;
   int label_formatting;
   uint32_t ticket_expires;
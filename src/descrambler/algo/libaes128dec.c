@@ -10,25 +10,40 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#include "openssl/aes.h"
+#include "openssl/evp.h"
 
 #include "libaes128dec.h"
 
+/*
+ * The EVP interface is used to get the hardware accelerated (AES-NI,
+ * VAES) implementation, the whole payload is decrypted in one call.
+ */
+
 /* key structure */
 typedef struct aes128_priv {
-  AES_KEY keys[2]; /* 0 = even, 1 = odd */
+  EVP_CIPHER_CTX *ctx[2]; /* 0 = even, 1 = odd */
+  int valid[2];           /* the key is set */
 } aes128_priv_t;
 
+static void aes128_set_key(aes128_priv_t *priv, int ev_od, const uint8_t *pk)
+{
+  EVP_CIPHER_CTX *ctx = priv->ctx[ev_od];
+
+  priv->valid[ev_od] =
+    EVP_DecryptInit_ex(ctx, EVP_aes_128_ecb(), NULL, pk, NULL) == 1 &&
+    EVP_CIPHER_CTX_set_padding(ctx, 0) == 1;
+}
+
 /* even cw represents one full 128-bit AES key */
 void aes128_set_even_control_word(void *keys, const uint8_t *pk)
 {
-  AES_set_decrypt_key(pk, 128, &((aes128_priv_t *) keys)->keys[0]);
+  aes128_set_key(keys, 0, pk);
 }
 
 /* odd cw represents one full 128-bit AES key */
 void aes128_set_odd_control_word(void *keys, const uint8_t *pk)
 {
-  AES_set_decrypt_key(pk, 128, &((aes128_priv_t *) keys)->keys[1]);
+  aes128_set_key(keys, 1, pk);
 }
 
 /* set control words */
@@ -36,8 +51,8 @@ void aes128_set_control_words(void *keys,
                            const uint8_t *ev,
                            const uint8_t *od)
 {
-  AES_set_decrypt_key(ev, 128, &((aes128_priv_t *) keys)->keys[0]);
-  AES_set_decrypt_key(od, 128, &((aes128_priv_t *) keys)->keys[1]);
+  aes128_set_key(keys, 0, ev);
+  aes128_set_key(keys, 1, od);
 }
 
 /* allocate key structure */
@@ -48,6 +63,12 @@ void * aes128_get_priv_struct(void)
   keys = (aes128_priv_t *) malloc(sizeof(aes128_priv_t));
   if (keys) {
     static const uint8_t pk[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    keys->ctx[0] = EVP_CIPHER_CTX_new();
+    keys->ctx[1] = EVP_CIPHER_CTX_new();
+    if (keys->ctx[0] == NULL || keys->ctx[1] == NULL) {
+      aes128_free_priv_struct(keys);
+      return NULL;
+    }
     aes128_set_control_words(keys, pk, pk);
   }
   return keys;
@@ -56,33 +77,63 @@ void * aes128_get_priv_struct(void)
 /* free key structure */
 void aes128_free_priv_struct(void *keys)
 {
-  free(keys);
+  aes128_priv_t *priv = keys;
+
+  if (priv) {
+    EVP_CIPHER_CTX_free(priv->ctx[0]);
+    EVP_CIPHER_CTX_free(priv->ctx[1]);
+    free(priv);
+  }
 }
 
-/* decrypt */
-void aes128_decrypt_packet(void *keys, const uint8_t *pkt)
+/*
+ * decrypt, the packet is not modified on error (EVP fails on the
+ * argument and context checks before the output is written)
+ */
+static inline int aes128_decrypt(aes128_priv_t *priv, uint8_t *pkt)
 {
   uint_fast8_t ev_od = 0;
   uint_fast8_t xc0, offset;
-  AES_KEY *k;
+  int len, size;
 
   // skip reserved and not encrypted pkt
   if (((xc0 = pkt[3]) & 0x80) == 0)
-    return;
+    return 0;
 
   ev_od = (xc0 & 0x40) >> 6; // 0 even, 1 odd
-  ((uint8_t *)pkt)[3] = xc0 & 0x3f;  // consider it decrypted now
+  if (!priv->valid[ev_od])
+    return -1;
   if (xc0 & 0x20) { // incomplete packet
     offset = 4 + pkt[4] + 1;
     if (offset + 16 > 188) { // decrypted==encrypted!
-      return;  // this doesn't need more processing
+      pkt[3] = xc0 & 0x3f;
+      return 0;  // this doesn't need more processing
     }
   } else {
     offset = 4;
   }
 
-  k = &((aes128_priv_t *) keys)->keys[ev_od];
-  for (; offset <= (188 - 16); offset += 16) {
-    AES_ecb_encrypt(pkt + offset, (uint8_t *)(pkt + offset), k, AES_DECRYPT);
-  }
+  /* all full 16-byte blocks, the residue is not encrypted */
+  size = (188 - offset) & ~15;
+  if (EVP_DecryptUpdate(priv->ctx[ev_od], pkt + offset, &len,
+                        pkt + offset, size) != 1)
+    return -1;
+  pkt[3] = xc0 & 0x3f;  // decrypted now
+  return 0;
+}
+
+int aes128_decrypt_packet(void *keys, const uint8_t *pkt)
+{
+  return aes128_decrypt(keys, (uint8_t *)pkt);
+}
+
+/* returns -1 when a packet failed (left scrambled) */
+int aes128_decrypt_packets(void *keys, const uint8_t *tsb, int len)
+{
+  const uint8_t *end = tsb + len;
+  int r = 0;
+
+  for ( ; tsb < end; tsb += 188)
+    r |= aes128_decrypt(keys, (uint8_t *)tsb);
+  return r;
 }
@@ -18,7 +18,8 @@ void aes128_free_priv_struct(void *keys);
 void aes128_set_control_words(void *keys, const uint8_t *even, const uint8_t *odd);
 void aes128_set_even_control_word(void *keys, const uint8_t *even);
 void aes128_set_odd_control_word(void *keys, const uint8_t *odd);
-void aes128_decrypt_packet(void *keys, const uint8_t *pkt);
+int aes128_decrypt_packet(void *keys, const uint8_t *pkt);
+int aes128_decrypt_packets(void *keys, const uint8_t *tsb, int len);
 
 #else
 
@@ -28,7 +29,8 @@ static inline void aes128_free_priv_struct(void *keys) { return; };
 static inline void aes128_set_control_words(void *keys, const uint8_t *even, const uint8_t *odd) { return; };
 static inline void aes128_set_even_control_word(void *keys, const uint8_t *even) { return; };
 static inline void aes128_set_odd_control_word(void *keys, const uint8_t *odd) { return; };
-static inline void aes128_decrypt_packet(void *keys, const uint8_t *pkt) { return; };
+static inline int aes128_decrypt_packet(void *keys, const uint8_t *pkt) { return -1; };
+static inline int aes128_decrypt_packets(void *keys, const uint8_t *tsb, int len) { return -1; };
 
 #endif
 
@@ -85,3 +85,11 @@ void aes_decrypt_packet(void *keys, const uint8_t *pkt)
     AES_ecb_encrypt(pkt + offset, (uint8_t *)(pkt + offset), k, AES_DECRYPT);
   }
 }
+
+void aes_decrypt_packets(void *keys, const uint8_t *tsb, int len)
+{
+  const uint8_t *end = tsb + len;
+
+  for ( ; tsb < end; tsb += 188)
+    aes_decrypt_packet(keys, tsb);
+}
@@ -19,6 +19,7 @@ void aes_set_control_words(void *keys, const uint8_t *even, const uint8_t *odd);
 void aes_set_even_control_word(void *keys, const uint8_t *even);
 void aes_set_odd_control_word(void *keys, const uint8_t *odd);
 void aes_decrypt_packet(void *keys, const uint8_t *pkt);
+void aes_decrypt_packets(void *keys, const uint8_t *tsb, int len);
 
 #else
 
@@ -29,6 +30,7 @@ static inline void aes_set_control_words(void *keys, const uint8_t *even, const
 static inline void aes_set_even_control_word(void *keys, const uint8_t *even) { return; };
 static inline void aes_set_odd_control_word(void *keys, const uint8_t *odd) { return; };
 static inline void aes_decrypt_packet(void *keys, const uint8_t *pkt) { return; };
+static inline void aes_decrypt_packets(void *keys, const uint8_t *tsb, int len) { return; };
 
 #endif
 
@@ -94,3 +94,11 @@ void des_decrypt_packet(void *priv, const uint8_t *pkt)
     }
   }
 }
+
+void des_decrypt_packets(void *priv, const uint8_t *tsb, int len)
+{
+  const uint8_t *end = tsb + len;
+
+  for ( ; tsb < end; tsb += 188)
+    des_decrypt_packet(priv, tsb);
+}
@@ -16,6 +16,7 @@ void des_set_control_words(void *priv, const uint8_t *even, const uint8_t *odd);
 void des_set_even_control_word(void *priv, const uint8_t *even);
 void des_set_odd_control_word(void *priv, const uint8_t *odd);
 void des_decrypt_packet(void *priv, const uint8_t *pkt);
+void des_decrypt_packets(void *priv, const uint8_t *tsb, int len);
 
 #else
 
@@ -26,6 +27,7 @@ static inline void des_set_control_words(void *priv, const uint8_t *even, const
 static inline void des_set_even_control_word(void *priv, const uint8_t *even) { return; };
 static inline void des_set_odd_control_word(void *priv, const uint8_t *odd) { return; };
 static inline void des_decrypt_packet(void *priv, const uint8_t *pkt) { return; };
+static inline void des_decrypt_packets(void *priv, const uint8_t *tsb, int len) { return; };
 
 #endif
 
@@ -42,10 +42,16 @@
 #define ECM_PARITY_80EVEN_81ODD		1
 #define ECM_PARITY_81EVEN_80ODD         2
 
+/*
+ * The pending (not yet descrambled) TS packets are kept in a preallocated
+ * ring buffer (dr_buf), the queue entries (dr_queue) are the contiguous
+ * packet runs in this buffer (dd_len > 0) or the key switch points
+ * (dd_len == 0, dd_key is set).
+ */
 typedef struct th_descrambler_data {
-  TAILQ_ENTRY(th_descrambler_data) dd_link;
   int64_t dd_timestamp;
-  sbuf_t dd_sbuf;
+  uint32_t dd_off;
+  uint32_t dd_len;
   th_descrambler_key_t *dd_key;
   uint8_t dd_key_changed;
 } th_descrambler_data_t;
@@ -62,7 +68,6 @@ typedef struct th_descrambler_hint {
   uint32_t dh_multipid: 1;
 } th_descrambler_hint_t;
 
-TAILQ_HEAD(th_descrambler_queue, th_descrambler_data);
 static TAILQ_HEAD( , th_descrambler_hint) ca_hints;
 
 static int ca_hints_quickecm;
@@ -85,60 +90,219 @@ static inline const char *keystr(const uint8_t *tsb)
 }
 #endif
 
+/*
+ * Queue entries (ring of descriptors, dr_queue_alloc is power of two)
+ */
+static inline th_descrambler_data_t *
+descrambler_data_nth(th_descrambler_runtime_t *dr, uint32_t i)
+{
+  if (i >= dr->dr_queue_count)
+    return NULL;
+  return &dr->dr_queue[(dr->dr_queue_head + i) & (dr->dr_queue_alloc - 1)];
+}
+
+static inline uint32_t
+descrambler_data_index(th_descrambler_runtime_t *dr, th_descrambler_data_t *dd)
+{
+  return ((dd - dr->dr_queue) - dr->dr_queue_head) & (dr->dr_queue_alloc - 1);
+}
+
+static inline th_descrambler_data_t *
+descrambler_data_first(th_descrambler_runtime_t *dr)
+{
+  return descrambler_data_nth(dr, 0);
+}
+
+static inline th_descrambler_data_t *
+descrambler_data_next(th_descrambler_runtime_t *dr, th_descrambler_data_t *dd)
+{
+  return descrambler_data_nth(dr, descrambler_data_index(dr, dd) + 1);
+}
+
+static inline uint8_t *
+descrambler_data_ptr(th_descrambler_runtime_t *dr, th_descrambler_data_t *dd)
+{
+  return dr->dr_buf + dd->dd_off;
+}
+
+static th_descrambler_data_t *
+descrambler_data_first_packets(th_descrambler_runtime_t *dr)
+{
+  th_descrambler_data_t *dd;
+  uint32_t i;
+
+  for (i = 0; (dd = descrambler_data_nth(dr, i)) != NULL; i++)
+    if (dd->dd_len) return dd;
+  return NULL;
+}
+
+static th_descrambler_data_t *
+descrambler_data_last_packets(th_descrambler_runtime_t *dr)
+{
+  th_descrambler_data_t *dd;
+  uint32_t i;
+
+  for (i = dr->dr_queue_count; i > 0; i--)
+    if ((dd = descrambler_data_nth(dr, i - 1))->dd_len) return dd;
+  return NULL;
+}
+
+static th_descrambler_data_t *
+descrambler_data_new(th_descrambler_runtime_t *dr, int head)
+{
+  th_descrambler_data_t *q;
+  uint32_t i, alloc;
+
+  if (dr->dr_queue_count == dr->dr_queue_alloc) {
+    alloc = MAX(64, dr->dr_queue_alloc * 2);
+    q = malloc(alloc * sizeof(*q));
+    for (i = 0; i < dr->dr_queue_count; i++)
+      q[i] = *descrambler_data_nth(dr, i);
+    free(dr->dr_queue);
+    dr->dr_queue = q;
+    dr->dr_queue_alloc = alloc;
+    dr->dr_queue_head = 0;
+  }
+  if (head)
+    dr->dr_queue_head = (dr->dr_queue_head - 1) & (dr->dr_queue_alloc - 1);
+  dr->dr_queue_count++;
+  return head ? descrambler_data_first(dr) :
+                descrambler_data_nth(dr, dr->dr_queue_count - 1);
+}
+
 /*
  *
  */
 static void
 descrambler_data_destroy(th_descrambler_runtime_t *dr, th_descrambler_data_t *dd, int skip)
 {
+  uint32_t i, mask;
+
   if (dd) {
-    if (skip && dr->dr_skip)
+    if (skip && dr->dr_skip && dd->dd_len)
       ts_skip_packet2((mpegts_service_t *)dr->dr_service,
-                      dd->dd_sbuf.sb_data, dd->dd_sbuf.sb_ptr);
-    dr->dr_queue_total -= dd->dd_sbuf.sb_ptr;
-    TAILQ_REMOVE(&dr->dr_queue, dd, dd_link);
-    sbuf_free(&dd->dd_sbuf);
-    free(dd);
+                      descrambler_data_ptr(dr, dd), dd->dd_len);
+    dr->dr_queue_total -= dd->dd_len;
+    /* usually the head, shift the preceding entries otherwise */
+    mask = dr->dr_queue_alloc - 1;
+    for (i = descrambler_data_index(dr, dd); i > 0; i--)
+      dr->dr_queue[(dr->dr_queue_head + i) & mask] =
+        dr->dr_queue[(dr->dr_queue_head + i - 1) & mask];
+    dr->dr_queue_head = (dr->dr_queue_head + 1) & mask;
+    dr->dr_queue_count--;
 #if ENABLE_TRACE
-    if (TAILQ_EMPTY(&dr->dr_queue))
+    if (dr->dr_queue_count == 0)
       assert(dr->dr_queue_total == 0);
 #endif
   }
 }
 
+static void
+descrambler_data_clean(th_descrambler_runtime_t *dr)
+{
+  free(dr->dr_queue);
+  free(dr->dr_buf);
+  dr->dr_queue = NULL;
+  dr->dr_buf = NULL;
+  dr->dr_queue_head = dr->dr_queue_count = dr->dr_queue_alloc = 0;
+  dr->dr_buf_size = 0;
+  dr->dr_queue_total = 0;
+}
+
+static void descrambler_data_cut(th_descrambler_runtime_t *dr, int len);
+
+/*
+ * Find the place for the new packets in the ring buffer, the stored
+ * packets are consumed in the FIFO order, so the used space is from
+ * the first to the last packet run (with the wrap-around).
+ */
+static int
+descrambler_data_space(th_descrambler_runtime_t *dr, uint32_t len, uint32_t *off)
+{
+  th_descrambler_data_t *dd;
+  uint32_t head, tail;
+
+  if (dr->dr_queue_total == 0) {
+    *off = 0;
+    return len <= dr->dr_buf_size;
+  }
+  dd = descrambler_data_first_packets(dr);
+  head = dd->dd_off;
+  dd = descrambler_data_last_packets(dr);
+  tail = dd->dd_off + dd->dd_len;
+  if (tail > head) {
+    if (dr->dr_buf_size - tail >= len) {
+      *off = tail;
+      return 1;
+    }
+    *off = 0;
+    return len < head;
+  }
+  *off = tail;
+  return tail + len < head;
+}
+
+static uint32_t
+descrambler_data_alloc(th_descrambler_runtime_t *dr, uint32_t len)
+{
+  uint32_t off, size;
+
+  while (!descrambler_data_space(dr, len, &off)) {
+    if (dr->dr_queue_total == 0) {
+      /* the ring size is given by the descrambler buffer configuration */
+      size = MAX(300, config.descrambler_buffer);
+      size = MAX((size + size / 5) * 188, 2 * len);
+      free(dr->dr_buf);
+      dr->dr_buf = malloc(size);
+      dr->dr_buf_size = size;
+      continue;
+    }
+    /* drop the oldest packets */
+    descrambler_data_cut(dr, len);
+  }
+  return off;
+}
+
 static void
 descrambler_data_append(th_descrambler_runtime_t *dr, const uint8_t *tsb, int len)
 {
   th_descrambler_data_t *dd;
   const uint8_t *tsb0;
   uint16_t pid1, pid2;
+  uint32_t off;
 
   if (len == 0)
     return;
-  dd = TAILQ_LAST(&dr->dr_queue, th_descrambler_queue);
-  if (dd && (tsb0 = dd->dd_sbuf.sb_data) != NULL) {
+  dd = descrambler_data_nth(dr, dr->dr_queue_count - 1);
+  if (dd && dd->dd_len) {
+    tsb0 = descrambler_data_ptr(dr, dd);
     if (dr->dr_key_multipid) {
       pid1 = extractpid(tsb0);
       pid2 = extractpid(tsb);
     } else {
       pid1 = pid2 = 0;
     }
-    if (dd && monocmpfastsec(dd->dd_timestamp, mclk()) &&
+    if (monocmpfastsec(dd->dd_timestamp, mclk()) &&
         (tsb0[3] & 0xc0) == (tsb[3] & 0xc0) && /* key match */
-        pid1 == pid2) {
+        pid1 == pid2 &&
+        descrambler_data_space(dr, len, &off) &&
+        off == dd->dd_off + dd->dd_len) {
       debug2("%p: data append %d, timestamp %ld, %s[%d]", dr, len, dd->dd_timestamp, keystr(tsb0), extractpid(tsb0));
-      sbuf_append(&dd->dd_sbuf, tsb, len);
+      memcpy(dr->dr_buf + off, tsb, len);
+      dd->dd_len += len;
       dr->dr_queue_total += len;
       return;
     }
   }
-  dd = malloc(sizeof(*dd));
+  off = descrambler_data_alloc(dr, len);
+  dd = descrambler_data_new(dr, 0);
   dd->dd_key = NULL;
+  dd->dd_key_changed = 0;
   dd->dd_timestamp = mclk();
   debug2("%p: data append2 %d, timestamp %ld, %s[%d]", dr, len, dd->dd_timestamp, keystr(tsb), extractpid(tsb));
-  sbuf_init(&dd->dd_sbuf);
-  sbuf_append(&dd->dd_sbuf, tsb, len);
-  TAILQ_INSERT_TAIL(&dr->dr_queue, dd, dd_link);
+  dd->dd_off = off;
+  dd->dd_len = len;
+  memcpy(dr->dr_buf + off, tsb, len);
   dr->dr_queue_total += len;
 }
 
@@ -147,15 +311,13 @@ descrambler_data_add_key(th_descrambler_runtime_t *dr, th_descrambler_key_t *tk,
 {
   th_descrambler_data_t *dd;
 
-  dd = calloc(1, sizeof(*dd));
+  dd = descrambler_data_new(dr, head);
   dd->dd_timestamp = mclk();
+  dd->dd_off = 0;
+  dd->dd_len = 0;
   dd->dd_key = tk;
   dd->dd_key_changed = change;
   debug2("%p: data %s key %d, timestamp %ld", dr, head ? "insert" : "append", tk->key_pid, dd->dd_timestamp);
-  if (head)
-    TAILQ_INSERT_HEAD(&dr->dr_queue, dd, dd_link);
-  else
-    TAILQ_INSERT_TAIL(&dr->dr_queue, dd, dd_link);
 }
 
 static void
@@ -164,19 +326,19 @@ descrambler_data_cut(th_descrambler_runtime_t *dr, int len)
   th_descrambler_data_t *dd;
 
   while (len > 0) {
-    TAILQ_FOREACH(dd, &dr->dr_queue, dd_link)
-      if (dd && dd->dd_sbuf.sb_data) break;
+    dd = descrambler_data_first_packets(dr);
     if (dd == NULL) return;
     if (dr->dr_skip)
       ts_skip_packet2((mpegts_service_t *)dr->dr_service,
-                      dd->dd_sbuf.sb_data, MIN(len, dd->dd_sbuf.sb_ptr));
-    if (len < dd->dd_sbuf.sb_ptr) {
-      sbuf_cut(&dd->dd_sbuf, len);
+                      descrambler_data_ptr(dr, dd), MIN(len, dd->dd_len));
+    if (len < dd->dd_len) {
+      dd->dd_off += len;
+      dd->dd_len -= len;
       dr->dr_queue_total -= len;
       break;
     }
-    len -= dd->dd_sbuf.sb_ptr;
-    descrambler_data_destroy(dr, dd, 1);
+    len -= dd->dd_len;
+    descrambler_data_destroy(dr, dd, 0);
   }
 }
 
@@ -184,23 +346,25 @@ static int
 descrambler_data_key_check(th_descrambler_runtime_t *dr, uint8_t key, int len)
 {
   th_descrambler_data_t *dd;
+  const uint8_t *tsb;
   int off = 0, l;
   uint_fast8_t ki;
 
-  if ((dd = TAILQ_FIRST(&dr->dr_queue)) == NULL)
+  if ((dd = descrambler_data_first(dr)) == NULL)
     return len;
   while (len > 0) {
-    while (dd && dd->dd_sbuf.sb_data == NULL)
-      dd = TAILQ_NEXT(dd, dd_link);
+    while (dd && dd->dd_len == 0)
+      dd = descrambler_data_next(dr, dd);
     if (dd == NULL) break;
-    l = dd->dd_sbuf.sb_ptr;
+    tsb = descrambler_data_ptr(dr, dd);
+    l = dd->dd_len;
     for (off = 0; off < l && len > 0; off += 188, l -= 188) {
-      ki = dd->dd_sbuf.sb_data[off + 3];
+      ki = tsb[off + 3];
       if (ki == 0) continue;
       if ((ki & 0xc0) != key) return -1;
       len -= 188;
     }
-    dd = TAILQ_NEXT(dd, dd_link);
+    dd = descrambler_data_next(dr, dd);
   }
   return len;
 }
@@ -213,11 +377,11 @@ descrambler_data_analyze(th_descrambler_runtime_t *dr,
   const uint8_t *tsb0;
   int packets = 0, blocks = 0;
 
-  for (dd2 = TAILQ_NEXT(dd, dd_link); dd2; dd2 = TAILQ_NEXT(dd2, dd_link)) {
-    tsb0 = dd->dd_sbuf.sb_data;
-    if (tsb0 == NULL || dd->dd_sbuf.sb_ptr == 0) continue;
+  for (dd2 = descrambler_data_next(dr, dd); dd2; dd2 = descrambler_data_next(dr, dd2)) {
+    if (dd->dd_len == 0) continue;
+    tsb0 = descrambler_data_ptr(dr, dd);
     if ((tsb0[3] & 0x80) != 0 && (tsb0[3] & 0x40) == (ki & 0x40)) {
-      packets += dd2->dd_sbuf.sb_ptr;
+      packets += dd2->dd_len;
       if (packets >= dr->dr_paritycheck)
         return 1;
     } else {
@@ -336,6 +500,7 @@ descrambler_init ( void )
   TAILQ_INIT(&ca_hints);
   ca_hints_quickecm = 0;
 
+  tvhcsa_workers_init();
   caclient_init();
 
   if ((c = hts_settings_load("descrambler")) != NULL) {
@@ -352,6 +517,7 @@ descrambler_done ( void )
   th_descrambler_hint_t *hint;
 
   caclient_done();
+  tvhcsa_workers_done();
   while ((hint = TAILQ_FIRST(&ca_hints)) != NULL) {
     TAILQ_REMOVE(&ca_hints, hint, dh_link);
     free(hint);
@@ -443,7 +609,6 @@ descrambler_service_start ( service_t *t )
   if (t->s_descramble == NULL) {
     t->s_descramble = dr = calloc(1, sizeof(th_descrambler_runtime_t));
     dr->dr_service = t;
-    TAILQ_INIT(&dr->dr_queue);
     for (i = 0; i < DESCRAMBLER_MAX_KEYS; i++) {
       tk = &dr->dr_keys[i];
       tk->key_index = 0xff;
@@ -478,7 +643,6 @@ descrambler_service_stop ( service_t *t )
   th_descrambler_t *td;
   th_descrambler_runtime_t *dr;
   th_descrambler_key_t *tk;
-  th_descrambler_data_t *dd;
   void *p;
   int i;
 
@@ -498,8 +662,7 @@ descrambler_service_stop ( service_t *t )
       tvhcsa_destroy(&tk->key_csa);
       if (!dr->dr_key_multipid) break;
     }
-    while ((dd = TAILQ_FIRST(&dr->dr_queue)) != NULL)
-      descrambler_data_destroy(dr, dd, 0);
+    descrambler_data_clean(dr);
     free(dr);
   }
 }
@@ -1038,13 +1201,12 @@ descrambler_descramble ( service_t *t,
 {
   th_descrambler_runtime_t *dr = t->s_descramble;
   th_descrambler_key_t *tk;
-  th_descrambler_data_t *dd, *dd_next;
+  th_descrambler_data_t *dd;
   int len2, len3, r, flush_data, update_tk;
   uint32_t dbuflen;
-  const uint8_t *tsb2;
-  int64_t now;
+  const uint8_t *tsb0, *tsb2;
+  int64_t now, timestamp;
   uint_fast8_t ki;
-  sbuf_t *sb;
 
   lock_assert(&t->s_stream_mutex);
 
@@ -1082,12 +1244,10 @@ descrambler_descramble ( service_t *t,
   flush_data = 0;
   if (dr->dr_ca_resolved > 0) {
 
-    /* process the queued TS packets or key updates */
-    for (dd = TAILQ_FIRST(&dr->dr_queue); dd; dd = dd_next) {
-      dd_next = TAILQ_NEXT(dd, dd_link);
-      sb = &dd->dd_sbuf;
-      tsb2 = sb->sb_data;
-      len2 = sb->sb_ptr;
+    /* process the queued TS packets or key updates (always the first entry) */
+    while ((dd = descrambler_data_first(dr)) != NULL) {
+      tsb0 = tsb2 = descrambler_data_ptr(dr, dd);
+      len2 = dd->dd_len;
       if (dd->dd_key) {
         key_flush(dr, dd->dd_key, dd->dd_key_changed, t);
         dd->dd_key = NULL;
@@ -1143,7 +1303,7 @@ descrambler_descramble ( service_t *t,
             r = descrambler_data_analyze(dr, dd, ki);
             if (r == 0) {
               /* wait for more data to decide */
-              descrambler_data_cut(dr, tsb2 - sb->sb_data);
+              descrambler_data_cut(dr, tsb2 - tsb0);
               descrambler_data_append(dr, tsb, len);
               goto end;
             } else if (r == 2)
@@ -1151,18 +1311,21 @@ descrambler_descramble ( service_t *t,
             tvhtrace(LS_DESCRAMBLER, "stream key[%d] changed to %s for service \"%s\"",
                                     tk->key_pid, (ki & 0x40) ? "odd" : "even",
                                     ((mpegts_service_t *)t)->s_dvb_svcname);
-            if (key_late(dr, tk, ki, dd->dd_timestamp)) {
+            timestamp = dd->dd_timestamp;
+            if (key_late(dr, tk, ki, timestamp)) {
               descrambler_notify_nokey(dr);
               tvh_mutex_unlock(&t->s_stream_mutex);
               r = ecm_reset(t, dr);
               tvh_mutex_lock(&t->s_stream_mutex);
               if (r) {
-                descrambler_data_cut(dr, tsb2 - sb->sb_data);
+                descrambler_data_cut(dr, tsb2 - tsb0);
                 flush_data = 1;
                 goto queue;
               }
+              /* the key entries might be added meanwhile */
+              dd = descrambler_data_first_packets(dr);
             }
-            key_update(t, tk, ki, dd->dd_timestamp);
+            key_update(t, tk, ki, timestamp);
           }
         }
 doit:
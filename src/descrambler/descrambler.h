@@ -107,8 +107,13 @@ typedef struct th_descrambler_runtime {
   int64_t  dr_force_skip;
   th_descrambler_key_t dr_keys[DESCRAMBLER_MAX_KEYS];
   th_descrambler_key_t *dr_key_last;
-  TAILQ_HEAD(, th_descrambler_data) dr_queue;
+  struct th_descrambler_data *dr_queue; /* packet runs and key switch points */
+  uint32_t dr_queue_head;
+  uint32_t dr_queue_count;
+  uint32_t dr_queue_alloc;
   uint32_t dr_queue_total;
+  uint8_t *dr_buf;                      /* pending TS packets (ring) */
+  uint32_t dr_buf_size;
   uint32_t dr_paritycheck;
   uint32_t dr_initial_paritycheck;
   tvhlog_limit_t dr_loglimit_key;
@@ -19,6 +19,7 @@
 #include "tvhcsa.h"
 #include "input.h"
 #include "input/mpegts/tsdemux.h"
+#include "config.h"
 
 #include "descrambler/algo/libaesdec.h"
 #include "descrambler/algo/libaes128dec.h"
@@ -28,6 +29,359 @@
 #include <unistd.h>
 #include <assert.h>
 
+#if ENABLE_DVBCSA
+
+/*
+ * CSA worker threads
+ *
+ * The full even/odd clusters are handed to the worker pool, the input
+ * thread takes the finished clusters back in the submit order for each
+ * descrambler and passes them to ts_recv_packet2(). The worker which
+ * finishes the oldest cluster passes it (and the following finished
+ * ones) itself when the service stream lock is free, so the output does
+ * not wait for the next input. The clusters own their buffers and keys,
+ * so the key changes and the descrambler destruction do not wait for
+ * the workers. When the workers are stopped, the clusters are decrypted
+ * in the input thread.
+ */
+
+#define TVHCSA_JOBS_MAX 8 /* max in-flight clusters per descrambler */
+
+typedef enum {
+  TVHCSA_JOB_QUEUED,
+  TVHCSA_JOB_RUNNING,
+  TVHCSA_JOB_DONE
+} tvhcsa_job_state_t;
+
+typedef struct tvhcsa_job {
+  TAILQ_ENTRY(tvhcsa_job)    job_link;   // csa_jobs
+  TAILQ_ENTRY(tvhcsa_job)    job_qlink;  // tvhcsa_queue
+  tvhcsa_job_state_t         job_state;
+  int                        job_orphan; // descrambler destroyed
+  tvhcsa_t                  *job_csa;
+  uint8_t                   *job_tsbcluster;
+  int                        job_fill;
+  struct dvbcsa_bs_batch_s  *job_tsbbatch_even;
+  struct dvbcsa_bs_batch_s  *job_tsbbatch_odd;
+  int                        job_fill_even;
+  int                        job_fill_odd;
+  tvhcsa_bskey_t            *job_key_even;
+  tvhcsa_bskey_t            *job_key_odd;
+} tvhcsa_job_t;
+
+static tvh_mutex_t                tvhcsa_lock;
+static tvh_cond_t                 tvhcsa_cond;      // new jobs
+static tvh_cond_t                 tvhcsa_done_cond; // finished jobs
+static TAILQ_HEAD(,tvhcsa_job)    tvhcsa_queue;
+static pthread_t                 *tvhcsa_threads;
+static int                        tvhcsa_threads_count;
+static int                        tvhcsa_running;
+
+static tvhcsa_bskey_t *
+tvhcsa_key_alloc ( void )
+{
+  tvhcsa_bskey_t *k = malloc(sizeof(*k));
+  k->refcnt = 1;
+  k->key = dvbcsa_bs_key_alloc();
+  return k;
+}
+
+static inline tvhcsa_bskey_t *
+tvhcsa_key_ref ( tvhcsa_bskey_t *k )
+{
+  atomic_add(&k->refcnt, 1);
+  return k;
+}
+
+static void
+tvhcsa_key_unref ( tvhcsa_bskey_t *k )
+{
+  if (k && atomic_dec(&k->refcnt, 1) == 1) {
+    dvbcsa_bs_key_free(k->key);
+    free(k);
+  }
+}
+
+/* the key is modified only when no queued cluster uses it */
+static tvhcsa_bskey_t *
+tvhcsa_key_writable ( tvhcsa_bskey_t *k )
+{
+  if (atomic_get(&k->refcnt) == 1)
+    return k;
+  tvhcsa_key_unref(k);
+  return tvhcsa_key_alloc();
+}
+
+static tvhcsa_job_t *
+tvhcsa_job_alloc ( tvhcsa_t *csa )
+{
+  tvhcsa_job_t *job = calloc(1, sizeof(*job));
+  job->job_tsbcluster    = malloc(csa->csa_fill_size * 188);
+  job->job_tsbbatch_even = malloc((csa->csa_cluster_size + 1) *
+                                  sizeof(struct dvbcsa_bs_batch_s));
+  job->job_tsbbatch_odd  = malloc((csa->csa_cluster_size + 1) *
+                                  sizeof(struct dvbcsa_bs_batch_s));
+  return job;
+}
+
+static void
+tvhcsa_job_release_keys ( tvhcsa_job_t *job )
+{
+  tvhcsa_key_unref(job->job_key_even);
+  tvhcsa_key_unref(job->job_key_odd);
+  job->job_key_even = job->job_key_odd = NULL;
+}
+
+static void
+tvhcsa_job_free ( tvhcsa_job_t *job )
+{
+  if (job == NULL)
+    return;
+  tvhcsa_job_release_keys(job);
+  free(job->job_tsbcluster);
+  free(job->job_tsbbatch_even);
+  free(job->job_tsbbatch_odd);
+  free(job);
+}
+
+static void
+tvhcsa_job_decrypt ( tvhcsa_job_t *job )
+{
+  if (job->job_fill_even) {
+    job->job_tsbbatch_even[job->job_fill_even].data = NULL;
+    dvbcsa_bs_decrypt(job->job_key_even->key, job->job_tsbbatch_even, 184);
+  }
+  if (job->job_fill_odd) {
+    job->job_tsbbatch_odd[job->job_fill_odd].data = NULL;
+    dvbcsa_bs_decrypt(job->job_key_odd->key, job->job_tsbbatch_odd, 184);
+  }
+}
+
+static void tvhcsa_job_deliver ( tvhcsa_t *csa, struct mpegts_service *s, int wait );
+
+/*
+ * Called with tvhcsa_lock, the lock order is s_stream_mutex and
+ * tvhcsa_lock, so the stream lock is only tried here. When it is busy,
+ * the input thread passes the cluster with the next input.
+ */
+static void
+tvhcsa_job_finished ( tvhcsa_job_t *job )
+{
+  tvhcsa_t *csa = job->job_csa;
+  mpegts_service_t *s = (mpegts_service_t *)csa->csa_service;
+
+  tvh_cond_signal(&tvhcsa_done_cond, 1);
+  if (job != TAILQ_FIRST(&csa->csa_jobs) || csa->csa_delivering)
+    return;
+  if (tvh_mutex_trylock(&s->s_stream_mutex))
+    return;
+  /* tvhcsa_jobs_destroy waits until the delivery is finished */
+  csa->csa_delivering = 1;
+  tvh_mutex_unlock(&tvhcsa_lock);
+  if (s->s_descramble)
+    tvhcsa_job_deliver(csa, (struct mpegts_service *)s, 0);
+  tvh_mutex_lock(&tvhcsa_lock);
+  csa->csa_delivering = 0;
+  tvh_cond_signal(&tvhcsa_done_cond, 1);
+  tvh_mutex_unlock(&s->s_stream_mutex);
+}
+
+static void *
+tvhcsa_thread ( void *aux )
+{
+  tvhcsa_job_t *job;
+
+  tvh_mutex_lock(&tvhcsa_lock);
+  while (1) {
+    if ((job = TAILQ_FIRST(&tvhcsa_queue)) == NULL) {
+      if (!tvhcsa_running)
+        break;
+      tvh_cond_wait(&tvhcsa_cond, &tvhcsa_lock);
+      continue;
+    }
+    TAILQ_REMOVE(&tvhcsa_queue, job, job_qlink);
+    job->job_state = TVHCSA_JOB_RUNNING;
+    tvh_mutex_unlock(&tvhcsa_lock);
+    tvhcsa_job_decrypt(job);
+    tvh_mutex_lock(&tvhcsa_lock);
+    job->job_state = TVHCSA_JOB_DONE;
+    if (job->job_orphan) {
+      tvh_mutex_unlock(&tvhcsa_lock);
+      tvhcsa_job_free(job);
+      tvh_mutex_lock(&tvhcsa_lock);
+    } else {
+      tvhcsa_job_finished(job);
+    }
+  }
+  tvh_mutex_unlock(&tvhcsa_lock);
+  return NULL;
+}
+
+/*
+ * Pass the finished clusters to the service in the submit order (with
+ * s_stream_mutex), wait for the oldest ones when too many clusters are
+ * in flight
+ */
+static void
+tvhcsa_job_deliver ( tvhcsa_t *csa, struct mpegts_service *s, int wait )
+{
+  tvhcsa_job_t *job;
+
+  tvh_mutex_lock(&tvhcsa_lock);
+  while ((job = TAILQ_FIRST(&csa->csa_jobs)) != NULL) {
+    if (job->job_state != TVHCSA_JOB_DONE) {
+      if (!wait || csa->csa_jobs_count <= TVHCSA_JOBS_MAX)
+        break;
+      tvh_cond_wait(&tvhcsa_done_cond, &tvhcsa_lock);
+      continue;
+    }
+    TAILQ_REMOVE(&csa->csa_jobs, job, job_link);
+    csa->csa_jobs_count--;
+    tvh_mutex_unlock(&tvhcsa_lock);
+    ts_recv_packet2(s, job->job_tsbcluster, job->job_fill * 188);
+    tvhcsa_job_release_keys(job);
+    if (csa->csa_spare == NULL)
+      csa->csa_spare = job;
+    else
+      tvhcsa_job_free(job);
+    tvh_mutex_lock(&tvhcsa_lock);
+  }
+  tvh_mutex_unlock(&tvhcsa_lock);
+}
+
+static void
+tvhcsa_job_submit ( tvhcsa_t *csa, struct mpegts_service *s )
+{
+  tvhcsa_job_t *job;
+  uint8_t *cluster;
+  struct dvbcsa_bs_batch_s *batch;
+  int running;
+
+  if (csa->csa_fill == 0)
+    goto deliver;
+
+  if ((job = csa->csa_spare) != NULL)
+    csa->csa_spare = NULL;
+  else
+    job = tvhcsa_job_alloc(csa);
+
+  /* swap the buffers - the job takes the filled cluster */
+  cluster = job->job_tsbcluster;
+  job->job_tsbcluster = csa->csa_tsbcluster;
+  csa->csa_tsbcluster = cluster;
+  batch = job->job_tsbbatch_even;
+  job->job_tsbbatch_even = csa->csa_tsbbatch_even;
+  csa->csa_tsbbatch_even = batch;
+  batch = job->job_tsbbatch_odd;
+  job->job_tsbbatch_odd = csa->csa_tsbbatch_odd;
+  csa->csa_tsbbatch_odd = batch;
+
+  job->job_fill      = csa->csa_fill;
+  job->job_fill_even = csa->csa_fill_even;
+  job->job_fill_odd  = csa->csa_fill_odd;
+  job->job_key_even  = job->job_fill_even ? tvhcsa_key_ref(csa->csa_key_even) : NULL;
+  job->job_key_odd   = job->job_fill_odd ? tvhcsa_key_ref(csa->csa_key_odd) : NULL;
+  job->job_state     = TVHCSA_JOB_QUEUED;
+  job->job_orphan    = 0;
+  job->job_csa       = csa;
+  csa->csa_fill = csa->csa_fill_even = csa->csa_fill_odd = 0;
+
+  tvh_mutex_lock(&tvhcsa_lock);
+  running = tvhcsa_running;
+  if (!running) {
+    /* tvhcsa_workers_done - no workers, decrypt here */
+    tvh_mutex_unlock(&tvhcsa_lock);
+    tvhcsa_job_decrypt(job);
+    job->job_state = TVHCSA_JOB_DONE;
+    tvh_mutex_lock(&tvhcsa_lock);
+  }
+  TAILQ_INSERT_TAIL(&csa->csa_jobs, job, job_link);
+  csa->csa_jobs_count++;
+  if (running) {
+    TAILQ_INSERT_TAIL(&tvhcsa_queue, job, job_qlink);
+    tvh_cond_signal(&tvhcsa_cond, 0);
+  }
+  tvh_mutex_unlock(&tvhcsa_lock);
+
+deliver:
+  tvhcsa_job_deliver(csa, s, 1);
+}
+
+static void
+tvhcsa_jobs_destroy ( tvhcsa_t *csa )
+{
+  tvhcsa_job_t *job;
+  TAILQ_HEAD(,tvhcsa_job) done;
+
+  TAILQ_INIT(&done);
+  tvh_mutex_lock(&tvhcsa_lock);
+  while (csa->csa_delivering)
+    tvh_cond_wait(&tvhcsa_done_cond, &tvhcsa_lock);
+  while ((job = TAILQ_FIRST(&csa->csa_jobs)) != NULL) {
+    TAILQ_REMOVE(&csa->csa_jobs, job, job_link);
+    if (job->job_state == TVHCSA_JOB_QUEUED)
+      TAILQ_REMOVE(&tvhcsa_queue, job, job_qlink);
+    if (job->job_state == TVHCSA_JOB_RUNNING)
+      job->job_orphan = 1; /* freed by the worker */
+    else
+      TAILQ_INSERT_TAIL(&done, job, job_link);
+  }
+  csa->csa_jobs_count = 0;
+  tvh_mutex_unlock(&tvhcsa_lock);
+  while ((job = TAILQ_FIRST(&done)) != NULL) {
+    TAILQ_REMOVE(&done, job, job_link);
+    tvhcsa_job_free(job);
+  }
+  tvhcsa_job_free(csa->csa_spare);
+  csa->csa_spare = NULL;
+}
+
+void
+tvhcsa_workers_init ( void )
+{
+  int i;
+
+  tvh_mutex_init(&tvhcsa_lock, NULL);
+  tvh_cond_init(&tvhcsa_cond, 1);
+  tvh_cond_init(&tvhcsa_done_cond, 1);
+  TAILQ_INIT(&tvhcsa_queue);
+  tvhcsa_threads_count = MINMAX(config.descrambler_threads, 0, 64);
+  if (tvhcsa_threads_count == 0)
+    return;
+  tvhcsa_running = 1;
+  tvhcsa_threads = calloc(tvhcsa_threads_count, sizeof(pthread_t));
+  for (i = 0; i < tvhcsa_threads_count; i++)
+    tvh_thread_create(&tvhcsa_threads[i], NULL, tvhcsa_thread, NULL, "csa");
+  tvhinfo(LS_CSA, "started %d CSA worker(s), batch size %d",
+          tvhcsa_threads_count, dvbcsa_bs_batch_size());
+}
+
+void
+tvhcsa_workers_done ( void )
+{
+  int i;
+
+  if (tvhcsa_threads_count == 0)
+    return;
+  /* the workers finish the queued clusters before exit */
+  tvh_mutex_lock(&tvhcsa_lock);
+  tvhcsa_running = 0;
+  tvh_cond_signal(&tvhcsa_cond, 1);
+  tvh_mutex_unlock(&tvhcsa_lock);
+  for (i = 0; i < tvhcsa_threads_count; i++)
+    pthread_join(tvhcsa_threads[i], NULL);
+  free(tvhcsa_threads);
+  tvhcsa_threads = NULL;
+  tvhcsa_threads_count = 0;
+}
+
+#else
+
+void tvhcsa_workers_init ( void ) { }
+void tvhcsa_workers_done ( void ) { }
+
+#endif
+
 static void
 tvhcsa_empty_flush
   ( tvhcsa_t *csa, struct mpegts_service *s )
@@ -39,10 +393,7 @@ static void
 tvhcsa_aes_ecb_descramble
   ( tvhcsa_t *csa, struct mpegts_service *s, const uint8_t *tsb, int len )
 {
-  const uint8_t *tsb2, *end2;
-
-  for (tsb2 = tsb, end2 = tsb + len; tsb2 < end2; tsb2 += 188)
-    aes_decrypt_packet(csa->csa_priv, tsb2);
+  aes_decrypt_packets(csa->csa_priv, tsb, len);
   ts_recv_packet2(s, tsb, len);
 }
 
@@ -50,10 +401,10 @@ static void
 tvhcsa_aes128_ecb_descramble
   ( tvhcsa_t *csa, struct mpegts_service *s, const uint8_t *tsb, int len )
 {
-  const uint8_t *tsb2, *end2;
-
-  for (tsb2 = tsb, end2 = tsb + len; tsb2 < end2; tsb2 += 188)
-    aes128_decrypt_packet(csa->csa_priv, tsb2);
+  if (aes128_decrypt_packets(csa->csa_priv, tsb, len) < 0 &&
+      tvhlog_limit(&csa->tvhcsa_loglimit, 30))
+    tvhwarn(LS_CSA, "AES128 decryption failed for service \"%s\"",
+                    ((mpegts_service_t *)s)->s_dvb_svcname);
   ts_recv_packet2(s, tsb, len);
 }
 
@@ -61,10 +412,7 @@ static void
 tvhcsa_des_ncb_descramble
   ( tvhcsa_t *csa, struct mpegts_service *s, const uint8_t *tsb, int len )
 {
-  const uint8_t *tsb2, *end2;
-
-  for (tsb2 = tsb, end2 = tsb + len; tsb2 < end2; tsb2 += 188)
-    des_decrypt_packet(csa->csa_priv, tsb2);
+  des_decrypt_packets(csa->csa_priv, tsb, len);
   ts_recv_packet2(s, tsb, len);
 }
 
@@ -76,14 +424,19 @@ tvhcsa_csa_cbc_flush
   tvhtrace(LS_CSA, "%p: CSA flush - descramble packets for service \"%s\" MAX=%d even=%d odd=%d fill=%d",
            csa,((mpegts_service_t *)s)->s_dvb_svcname, csa->csa_cluster_size,csa->csa_fill_even,csa->csa_fill_odd,csa->csa_fill);
 
+  if(csa->csa_threaded) {
+    tvhcsa_job_submit(csa, s);
+    return;
+  }
+
   if(csa->csa_fill_even) {
     csa->csa_tsbbatch_even[csa->csa_fill_even].data = NULL;
-    dvbcsa_bs_decrypt(csa->csa_key_even, csa->csa_tsbbatch_even, 184);
+    dvbcsa_bs_decrypt(csa->csa_key_even->key, csa->csa_tsbbatch_even, 184);
     csa->csa_fill_even = 0;
   }
   if(csa->csa_fill_odd) {
     csa->csa_tsbbatch_odd[csa->csa_fill_odd].data = NULL;
-    dvbcsa_bs_decrypt(csa->csa_key_odd, csa->csa_tsbbatch_odd, 184);
+    dvbcsa_bs_decrypt(csa->csa_key_odd->key, csa->csa_tsbbatch_odd, 184);
     csa->csa_fill_odd = 0;
   }
 
@@ -110,6 +463,10 @@ tvhcsa_csa_cbc_descramble
   int_fast16_t len;
   int_fast16_t offset;
 
+  /* pass the clusters finished by the workers meanwhile */
+  if(csa->csa_threaded && csa->csa_jobs_count)
+    tvhcsa_job_deliver(csa, s, 1);
+
   for ( ; tsb < tsb_end; tsb += 188) {
 
    pkt = csa->csa_tsbcluster + csa->csa_fill * 188;
@@ -188,8 +545,11 @@ tvhcsa_set_type( tvhcsa_t *csa, struct mpegts_service *s, int type )
                                     sizeof(struct dvbcsa_bs_batch_s));
     csa->csa_tsbbatch_odd  = malloc((csa->csa_cluster_size + 1) *
                                     sizeof(struct dvbcsa_bs_batch_s));
-    csa->csa_key_even      = dvbcsa_bs_key_alloc();
-    csa->csa_key_odd       = dvbcsa_bs_key_alloc();
+    csa->csa_key_even      = tvhcsa_key_alloc();
+    csa->csa_key_odd       = tvhcsa_key_alloc();
+    csa->csa_threaded      = tvhcsa_threads_count > 0;
+    csa->csa_service       = s;
+    TAILQ_INIT(&csa->csa_jobs);
 #endif
     break;
   case DESCRAMBLER_DES_NCB:
@@ -223,7 +583,8 @@ void tvhcsa_set_key_even( tvhcsa_t *csa, const uint8_t *even )
   switch (csa->csa_type) {
   case DESCRAMBLER_CSA_CBC:
 #if ENABLE_DVBCSA
-    dvbcsa_bs_key_set(even, csa->csa_key_even);
+    csa->csa_key_even = tvhcsa_key_writable(csa->csa_key_even);
+    dvbcsa_bs_key_set(even, csa->csa_key_even->key);
 #endif
     break;
   case DESCRAMBLER_DES_NCB:
@@ -245,7 +606,8 @@ void tvhcsa_set_key_odd( tvhcsa_t *csa, const uint8_t *odd )
   switch (csa->csa_type) {
   case DESCRAMBLER_CSA_CBC:
 #if ENABLE_DVBCSA
-    dvbcsa_bs_key_set(odd, csa->csa_key_odd);
+    csa->csa_key_odd = tvhcsa_key_writable(csa->csa_key_odd);
+    dvbcsa_bs_key_set(odd, csa->csa_key_odd->key);
 #endif
     break;
   case DESCRAMBLER_DES_NCB:
@@ -273,10 +635,10 @@ void
 tvhcsa_destroy ( tvhcsa_t *csa )
 {
 #if ENABLE_DVBCSA
-  if (csa->csa_key_odd)
-    dvbcsa_bs_key_free(csa->csa_key_odd);
-  if (csa->csa_key_even)
-    dvbcsa_bs_key_free(csa->csa_key_even);
+  if (csa->csa_threaded)
+    tvhcsa_jobs_destroy(csa);
+  tvhcsa_key_unref(csa->csa_key_odd);
+  tvhcsa_key_unref(csa->csa_key_even);
   if (csa->csa_tsbbatch_odd)
     free(csa->csa_tsbbatch_odd);
   if (csa->csa_tsbbatch_even)
@@ -28,6 +28,17 @@ struct elementary_stream;
 #include <dvbcsa/dvbcsa.h>
 #endif
 #include "tvhlog.h"
+#include "queue.h"
+
+#if ENABLE_DVBCSA
+/* refcounted key - the queued clusters keep the key used for them */
+typedef struct tvhcsa_bskey {
+  int                     refcnt;
+  struct dvbcsa_bs_key_s *key;
+} tvhcsa_bskey_t;
+#endif
+
+struct tvhcsa_job;
 
 typedef struct tvhcsa
 {
@@ -54,8 +65,16 @@ typedef struct tvhcsa
   int csa_fill_even;
   int csa_fill_odd;
 
-  struct dvbcsa_bs_key_s *csa_key_even;
-  struct dvbcsa_bs_key_s *csa_key_odd;
+  tvhcsa_bskey_t *csa_key_even;
+  tvhcsa_bskey_t *csa_key_odd;
+
+  /* CSA worker threads - submitted clusters in the output order */
+  int csa_threaded;
+  TAILQ_HEAD(,tvhcsa_job) csa_jobs;
+  int csa_jobs_count;
+  int csa_delivering;  /* a worker passes the clusters to the service */
+  struct tvhcsa_job *csa_spare;
+  struct mpegts_service *csa_service;
 #endif
   void *csa_priv;
   tvhlog_limit_t tvhcsa_loglimit;
@@ -72,6 +91,9 @@ void tvhcsa_set_key_odd ( tvhcsa_t *csa, const uint8_t *odd );
 void tvhcsa_init    ( tvhcsa_t *csa );
 void tvhcsa_destroy ( tvhcsa_t *csa );
 
+void tvhcsa_workers_init ( void );
+void tvhcsa_workers_done ( void );
+
 #else
 
 static inline int tvhcsa_set_type( tvhcsa_t *csa, struct mpegts_service *s, int type ) { return -1; }
@@ -82,6 +104,9 @@ static inline void tvhcsa_set_key_odd ( tvhcsa_t *csa, const uint8_t *odd ) { };
 static inline void tvhcsa_init ( tvhcsa_t *csa ) { };
 static inline void tvhcsa_destroy ( tvhcsa_t *csa ) { };
 
+static inline void tvhcsa_workers_init ( void ) { };
+static inline void tvhcsa_workers_done ( void ) { };
+
 #endif
 
 #endif /* __TVH_CSA_H__ */
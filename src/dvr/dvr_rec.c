@@ -1662,11 +1662,12 @@ dvr_thread(void *aux)
 
   TAILQ_INIT(&backlog);
 
-  tvh_mutex_lock(&sq->sq_mutex);
   while(run) {
-    sm = TAILQ_FIRST(&sq->sq_queue);
+    sm = streaming_queue_first(sq);
     if(sm == NULL) {
-      tvh_cond_wait(&sq->sq_cond, &sq->sq_mutex);
+      tvh_mutex_lock(&sq->sq_mutex);
+      streaming_queue_wait(sq);
+      tvh_mutex_unlock(&sq->sq_mutex);
       continue;
     }
     streaming_queue_remove(sq, sm);
@@ -1698,8 +1699,6 @@ dvr_thread(void *aux)
       tvhtrace(LS_DVR, "%s - running flag changed from %d to %d",
                idnode_uuid_as_str(&de->de_id, ubuf), old_epg_running, epg_running);
 
-    tvh_mutex_unlock(&sq->sq_mutex);
-
     switch(sm->sm_type) {
 
     case SMT_PACKET:
@@ -1914,9 +1913,7 @@ fin:
     }
 
     streaming_msg_free(sm);
-    tvh_mutex_lock(&sq->sq_mutex);
   }
-  tvh_mutex_unlock(&sq->sq_mutex);
 
   streaming_queue_clear(&backlog);
 
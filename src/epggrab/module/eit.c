@@ -915,6 +915,42 @@ _eit_process_immediate(void *m, const void *ptr, uint32_t len, eit_data_t *ed)
     epg_updated();
 }
 
+/*
+ * Drop the repeated sections (carousel) before the CRC and parsing,
+ * the check uses the section state of the table (see _eit_callback).
+ * The present/following sections (0x4e) are always processed (running
+ * state). While the OTA grab of the mux is not complete, the sections
+ * of the complete tables are passed, they signal the completion.
+ */
+static int
+_eit_precheck
+  (mpegts_psi_table_t *mt, const uint8_t *sec, int len)
+{
+  epggrab_ota_map_t *map = mt->mt_opaque;
+  int tableid = sec[0], r;
+  uint32_t extraid;
+
+  if (len < 14 || tableid <= 0x4e || tableid > 0x6f || (sec[5] & 1) == 0)
+    return 0;
+  extraid = ((uint32_t)(sec[8] << 8 | sec[9]) << 16) | (sec[3] << 8 | sec[4]);
+  r = dvb_table_seen(mt, tableid, extraid, sec[6], (sec[5] >> 1) & 0x1F);
+  if (r == 2 && !map->om_complete)
+    r = 0;
+  tprofile_hit(&((mpegts_table_t *)mt)->mt_profile, r != 0);
+  return r != 0;
+}
+
+static int
+_eit_has_schedule(mpegts_psi_table_t *mt)
+{
+  mpegts_psi_table_state_t *st;
+
+  RB_FOREACH(st, &mt->mt_state, link)
+    if (st->tableid >= 0x50 && st->tableid < 0x60)
+      return 1;
+  return 0;
+}
+
 static int
 _eit_callback
   (mpegts_table_t *mt, const uint8_t *ptr, int len, int tableid)
@@ -1090,8 +1126,16 @@ svc_ok:
 done:
   r = dvb_table_end((mpegts_psi_table_t *)mt, st, sect);
 complete:
-  if (ota && !r && (tableid >= 0x50 && tableid < 0x60))
-    epggrab_ota_complete((epggrab_module_ota_t*)mod, ota);
+  /* The repeated sections are dropped in _eit_precheck once the grab
+   * is complete, the completion may come from a present/following
+   * section, so register the mux here */
+  if (!r && ((tableid >= 0x50 && tableid < 0x60) ||
+             _eit_has_schedule((mpegts_psi_table_t *)mt))) {
+    if (ota == NULL)
+      ota = epggrab_ota_register((epggrab_module_ota_t*)mod, NULL, mt->mt_mux);
+    if (ota)
+      epggrab_ota_complete((epggrab_module_ota_t*)mod, ota);
+  }
   
   return r;
 }
@@ -1103,6 +1147,14 @@ complete:
 static int _eit_start
   ( epggrab_ota_map_t *map, mpegts_mux_t *dm )
 {
+  mpegts_table_t *mt;
+
+  /* New grab on the tuned mux, start with the fresh section state */
+  tvh_mutex_lock(&dm->mm_tables_lock);
+  LIST_FOREACH(mt, &dm->mm_tables, mt_link)
+    if (mt->mt_callback == _eit_callback && mt->mt_opaque == map)
+      mpegts_table_reset(mt);
+  tvh_mutex_unlock(&dm->mm_tables_lock);
   return 0;
 }
 
@@ -1111,6 +1163,7 @@ static void _eit_install_one_handler
 {
   epggrab_module_ota_t *m = map->om_module;
   eit_private_t *priv = m->opaque;
+  mpegts_table_t *mt;
   int pid = priv->pid;
   int opts = 0;
 
@@ -1120,8 +1173,10 @@ static void _eit_install_one_handler
     opts = MT_RECORD;
   }
 
-  mpegts_table_add(dm, 0, 0, _eit_callback, map, map->om_module->id, LS_TBL_EIT,
-                   MT_CRC | opts, pid, MPS_WEIGHT_EIT);
+  mt = mpegts_table_add(dm, 0, 0, _eit_callback, map, map->om_module->id,
+                        LS_TBL_EIT, MT_CRC | opts, pid, MPS_WEIGHT_EIT);
+  if (mt)
+    mt->mt_precheck = _eit_precheck;
   tvhdebug(m->subsys, "%s: installed table handler (pid %d)", m->id, pid);
 }
 
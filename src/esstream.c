@@ -53,8 +53,9 @@ void elementary_set_init
   TAILQ_INIT(&set->set_all);
   TAILQ_INIT(&set->set_filter);
   set->set_nicename = NULL;
-  set->set_last_pid = -1;
-  set->set_last_es = NULL;
+  set->set_index = NULL;
+  set->set_index_mask = 0;
+  set->set_index_dirty = 0;
   set->set_service = t;
   elementary_set_update_nicename(set, nicename);
 }
@@ -69,6 +70,10 @@ void elementary_set_clean(elementary_set_t *set, service_t *t, int keep_nicename
   TAILQ_INIT(&set->set_filter);
   while ((st = TAILQ_FIRST(&set->set_all)) != NULL)
     elementary_set_stream_destroy(set, st);
+  free(set->set_index);
+  set->set_index = NULL;
+  set->set_index_mask = 0;
+  set->set_index_dirty = 0;
   if (!keep_nicename) {
     free(set->set_nicename);
     set->set_nicename = NULL;
@@ -150,10 +155,8 @@ elementary_set_stream_destroy(elementary_set_t *set, elementary_stream_t *es)
   elementary_stream_t *es1;
   caid_t *c;
 
-  if (set->set_last_es == es) {
-    set->set_last_pid = -1;
-    set->set_last_es = NULL;
-  }
+  set->set_index_dirty = 1;
+  set->set_index_gen++;
 
   TAILQ_REMOVE(&set->set_all, es, es_link);
   TAILQ_FOREACH(es1, &set->set_filter, es_filter_link)
@@ -474,6 +477,8 @@ create:
   st->es_service = set->set_service;
 
   st->es_pid = pid;
+  set->set_index_dirty = 1;
+  set->set_index_gen++;
   st->es_parent_pid = parent_pid > 0 ? parent_pid : 0;
 
   elementary_stream_make_nicename(st, set->set_nicename);
@@ -482,21 +487,45 @@ create:
 }
 
 /**
- * Find an elementary stream in a service
+ * Rebuild the PID lookup index
+ *
+ * The table has at least twice more slots than streams, so the linear
+ * probing is short. For the duplicate PIDs, the first stream in set_all
+ * wins (like the list walk).
  */
-elementary_stream_t *
-elementary_stream_find_(elementary_set_t *set, int pid)
+void
+elementary_set_index_build(elementary_set_t *set)
 {
-  elementary_stream_t *st;
+  elementary_stream_t *st, *st2;
+  uint32_t i, size = 8, num = 0;
 
+  set->set_index_dirty = 0;
+  TAILQ_FOREACH(st, &set->set_all, es_link)
+    num++;
+  if (num == 0) {
+    free(set->set_index);
+    set->set_index = NULL;
+    set->set_index_mask = 0;
+    return;
+  }
+  while (size < num * 2)
+    size <<= 1;
+  if (set->set_index == NULL || set->set_index_mask + 1 != size) {
+    free(set->set_index);
+    set->set_index = malloc(size * sizeof(elementary_stream_t *));
+    set->set_index_mask = size - 1;
+  }
+  memset(set->set_index, 0, size * sizeof(elementary_stream_t *));
   TAILQ_FOREACH(st, &set->set_all, es_link) {
-    if(st->es_pid == pid) {
-      set->set_last_es = st;
-      set->set_last_pid = pid;
-      return st;
+    i = elementary_set_index_hash(st->es_pid);
+    while ((st2 = set->set_index[i & set->set_index_mask]) != NULL) {
+      if (st2->es_pid == st->es_pid)
+        break;
+      i++;
     }
+    if (st2 == NULL)
+      set->set_index[i & set->set_index_mask] = st;
   }
-  return NULL;
 }
 
 /**
@@ -539,8 +568,11 @@ elementary_stream_type_modify(elementary_set_t *set, int pid,
   elementary_stream_t *es = elementary_stream_type_find(set, type);
   if (!es)
     return elementary_stream_create(set, pid, type);
-  if (es->es_pid != pid)
+  if (es->es_pid != pid) {
     es->es_pid = pid;
+    set->set_index_dirty = 1;
+    set->set_index_gen++;
+  }
   return es;
 }
 
@@ -617,6 +649,7 @@ elementary_set_sort_streams(elementary_set_t *set)
   TAILQ_INIT(&set->set_all);
   for(i = 0; i < num; i++)
     TAILQ_INSERT_TAIL(&set->set_all, v[i], es_link);
+  set->set_index_dirty = 1;
 }
 
 /**
@@ -673,6 +706,7 @@ elementary_stream_create_from_start
     elementary_stream_make_nicename(st, set->set_nicename);
     TAILQ_INSERT_TAIL(&set->set_all, st, es_link);
   }
+  set->set_index_dirty = 1;
 
   set->set_pcr_pid = ss->ss_pcr_pid;
   set->set_pmt_pid = ss->ss_pmt_pid;
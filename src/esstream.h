@@ -152,9 +152,11 @@ struct elementary_set {
   char *set_nicename;
   service_t *set_service;
 
-  /* Cache lookups */
-  uint16_t set_last_pid;
-  elementary_stream_t *set_last_es;
+  /* PID lookup index (open addressing, rebuilt after changes) */
+  elementary_stream_t **set_index;
+  uint32_t set_index_mask;
+  int set_index_dirty;
+  uint32_t set_index_gen;    /* changed with each stream add/remove/PID change */
 };
 
 /*
@@ -173,17 +175,29 @@ elementary_stream_t *elementary_stream_create_parent
 static inline elementary_stream_t *elementary_stream_create
   (elementary_set_t *set, int pid, streaming_component_type_t type)
 { return elementary_stream_create_parent(set, pid, -1, type); }
-elementary_stream_t *elementary_stream_find_(elementary_set_t *set, int pid);
-elementary_stream_t *elementary_stream_type_find
-  (elementary_set_t *set, streaming_component_type_t type);
+void elementary_set_index_build(elementary_set_t *set);
+static inline uint32_t elementary_set_index_hash(int pid)
+  { return (uint32_t)pid ^ ((uint32_t)pid >> 5); }
 static inline elementary_stream_t *elementary_stream_find
   (elementary_set_t *set, int pid)
   {
-    if (set->set_last_pid != (pid))
-      return elementary_stream_find_(set, pid);
-    else
-      return set->set_last_es;
+    elementary_stream_t *st;
+    uint32_t i;
+
+    if (set->set_index_dirty)
+      elementary_set_index_build(set);
+    if (set->set_index == NULL)
+      return NULL;
+    i = elementary_set_index_hash(pid);
+    while ((st = set->set_index[i & set->set_index_mask]) != NULL) {
+      if (st->es_pid == pid)
+        return st;
+      i++;
+    }
+    return NULL;
   }
+elementary_stream_t *elementary_stream_type_find
+  (elementary_set_t *set, streaming_component_type_t type);
 elementary_stream_t *elementary_stream_find_parent(elementary_set_t *set, int pid, int parent_pid);
 elementary_stream_t *elementary_stream_type_modify
   (elementary_set_t *set, int pid, streaming_component_type_t type);
@@ -18,6 +18,9 @@
 
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
 #include "tvheadend.h"
 #include "atomic.h"
@@ -38,6 +41,7 @@
 #include "htsmsg_json.h"
 #include "string_list.h"
 #include "lang_codes.h"
+#include "sbuf.h"
 #if ENABLE_TIMESHIFT
 #include "timeshift.h"
 #endif
@@ -50,7 +54,7 @@
 
 static void *htsp_server, *htsp_server_2;
 
-#define HTSP_PROTO_VERSION 34
+#define HTSP_PROTO_VERSION 35
 
 #define HTSP_ASYNC_OFF  0x00
 #define HTSP_ASYNC_ON   0x01
@@ -76,10 +80,13 @@ static void htsp_streaming_input(void *opaque, streaming_message_t *sm);
 static htsmsg_t *htsp_streaming_input_info(void *opaque, htsmsg_t *list);
 const char * _htsp_get_subscription_status(int smcode);
 static void htsp_epg_send_waiting(struct htsp_connection *, int64_t mintime);
+static void htsp_epg_sync_run(void *aux);
+static void htsp_initial_sync_completed(struct htsp_connection *);
 
 static streaming_ops_t htsp_streaming_input_ops = {
-  .st_cb   = htsp_streaming_input,
-  .st_info = htsp_streaming_input_info
+  .st_cb     = htsp_streaming_input,
+  .st_info   = htsp_streaming_input_info,
+  .st_shared = 1
 };
 
 /**
@@ -96,6 +103,11 @@ typedef struct htsp_msg {
 			   hm_msg can contain messages that points
 			   to packet payload so to avoid copy we
 			   keep a reference here */
+
+  int64_t hm_dts;       /* muxpkt dts (queue delay) */
+  int hm_hdrlen;        /* Serialized muxpkt header (without hm_msg),
+			   the payload follows from hm_pb */
+  uint8_t hm_hdr[0];
 } htsp_msg_t;
 
 
@@ -112,6 +124,15 @@ typedef struct htsp_msg_q {
   int hmq_dead;
 } htsp_msg_q_t;
 
+/**
+ * EPG string dictionary entry (eventBatch)
+ */
+typedef struct htsp_epg_string {
+  RB_ENTRY(htsp_epg_string) hes_link;
+  uint32_t hes_index;
+  char    *hes_str;
+} htsp_epg_string_t;
+
 /**
  *
  */
@@ -120,6 +141,8 @@ typedef struct htsp_connection {
 
   int htsp_fd;
   struct sockaddr_storage *htsp_peer;
+  htsbuf_queue_t htsp_input;  // read by the tcp reactor
+  uint32_t htsp_input_need;   // complete message size, 0 = unknown
 
   uint32_t htsp_version;
 
@@ -133,6 +156,29 @@ typedef struct htsp_connection {
   int64_t  htsp_epg_lastupdate;  // last update time for async epg events
   mtimer_t htsp_epg_timer;       // timer for async epg updates
 
+  /**
+   * Paged async EPG sync (see htsp_epg_sync_page)
+   */
+  int      htsp_epg_sync;         // sync in progress (global_lock)
+  int      htsp_epg_sync_initial; // send initialSyncCompleted when done
+  uint32_t htsp_epg_sync_chid;    // cursor - channel id
+  int64_t  htsp_epg_sync_start;   // cursor - start of the last sent event
+  int64_t  htsp_epg_sync_mintime;
+  int64_t  htsp_epg_sync_maxtime;
+  int      htsp_epg_sync_wait;    // waiting for the queue drain (out mutex)
+  int      htsp_epg_sync_busy;    // page task queued or running (out mutex)
+  tcp_task_t htsp_epg_sync_task;
+
+  /**
+   * Columnar EPG event batches (see htsp_event_batch_add), global_lock
+   */
+  int      htsp_epg_batch;        // client wants eventBatch messages
+  int      htsp_epg_dict_reset;   // the next batch resets the client dictionary
+  uint32_t htsp_epg_dict_count;
+  RB_HEAD(, htsp_epg_string) htsp_epg_dict;
+  struct htsp_event_batch *htsp_epg_live;  // pending live updates
+  mtimer_t htsp_epg_live_timer;
+
   /**
    * Async mode
    */
@@ -140,11 +186,21 @@ typedef struct htsp_connection {
   LIST_ENTRY(htsp_connection) htsp_async_link;
 
   /**
-   * Writer thread
+   * Writer (tcp worker pool task)
+   *
+   * While the connection has subscriptions, the writer keeps its
+   * (dedicated) worker and waits for the next messages.
    */
-  pthread_t htsp_writer_thread;
+  tcp_task_t htsp_writer_task;
 
   int htsp_writer_run;
+  int htsp_writer_busy;
+  int htsp_writer_stream;  // subscriptions are active
+  int htsp_writer_wait;    // the writer waits for messages
+
+  uint64_t htsp_write_calls;  /* statistics (out mutex) */
+  uint64_t htsp_write_msgs;
+  uint64_t htsp_write_bytes;
 
   struct htsp_msg_q_queue htsp_active_output_queues;
 
@@ -152,7 +208,6 @@ typedef struct htsp_connection {
   tvh_cond_t htsp_out_cond;
 
   htsp_msg_q_t htsp_hmq_ctrl;
-  htsp_msg_q_t htsp_hmq_epg;
   htsp_msg_q_t htsp_hmq_qstatus;
 
   struct htsp_subscription_list htsp_subscriptions;
@@ -164,6 +219,12 @@ typedef struct htsp_connection {
 
   uint8_t htsp_challenge[32];
 
+  /**
+   * Connection (tcp server)
+   */
+  void *htsp_tcp_id;
+  int htsp_streaming;
+
 } htsp_connection_t;
 
 
@@ -375,6 +436,20 @@ htsp_image(htsp_connection_t *htsp, const char *image,
   return ret;
 }
 
+/**
+ * Update the writer mode when the subscriptions are changed
+ * (global_lock held)
+ */
+static void
+htsp_writer_stream_update(htsp_connection_t *htsp)
+{
+  tvh_mutex_lock(&htsp->htsp_out_mutex);
+  htsp->htsp_writer_stream = !LIST_EMPTY(&htsp->htsp_subscriptions);
+  if (htsp->htsp_writer_wait)
+    tvh_cond_signal(&htsp->htsp_out_cond, 1);
+  tvh_mutex_unlock(&htsp->htsp_out_mutex);
+}
+
 /**
  *
  */
@@ -388,6 +463,7 @@ htsp_subscription_destroy(htsp_connection_t *htsp, htsp_subscription_t *hs)
 
   LIST_REMOVE(hs, hs_link);
   LIST_INSERT_HEAD(&htsp->htsp_dead_subscriptions, hs, hs_link);
+  htsp_writer_stream_update(htsp);
 
   subscription_unsubscribe(ts, UNSUBSCRIBE_FINAL);
 
@@ -412,17 +488,8 @@ htsp_subscription_free(htsp_connection_t *htsp, htsp_subscription_t *hs)
  *
  */
 static void
-htsp_send(htsp_connection_t *htsp, htsmsg_t *m, pktbuf_t *pb,
-	  htsp_msg_q_t *hmq, int payloadsize)
+htsp_send_queue(htsp_connection_t *htsp, htsp_msg_t *hm, htsp_msg_q_t *hmq)
 {
-  htsp_msg_t *hm = malloc(sizeof(htsp_msg_t));
-
-  hm->hm_msg = m;
-  hm->hm_pb = pb;
-  if(pb != NULL)
-    pktbuf_ref_inc(pb);
-  hm->hm_payloadsize = payloadsize;
-  
   tvh_mutex_lock(&htsp->htsp_out_mutex);
 
   assert(!hmq->hmq_dead);
@@ -440,11 +507,37 @@ htsp_send(htsp_connection_t *htsp, htsmsg_t *m, pktbuf_t *pb,
   }
 
   hmq->hmq_length++;
-  hmq->hmq_payload += payloadsize;
-  tvh_cond_signal(&htsp->htsp_out_cond, 0);
+  hmq->hmq_payload += hm->hm_payloadsize;
+  if (htsp->htsp_writer_wait) {
+    tvh_cond_signal(&htsp->htsp_out_cond, 1);
+  } else if (!htsp->htsp_writer_busy && htsp->htsp_writer_run) {
+    htsp->htsp_writer_busy = 1;
+    tcp_task_submit(&htsp->htsp_writer_task);
+  }
   tvh_mutex_unlock(&htsp->htsp_out_mutex);
 }
 
+/**
+ *
+ */
+static void
+htsp_send(htsp_connection_t *htsp, htsmsg_t *m, pktbuf_t *pb,
+	  htsp_msg_q_t *hmq, int payloadsize)
+{
+  htsp_msg_t *hm = malloc(sizeof(htsp_msg_t));
+
+  hm->hm_msg = m;
+  hm->hm_pb = pb;
+  if(pb != NULL)
+    pktbuf_ref_inc(pb);
+  hm->hm_payloadsize = payloadsize;
+  hm->hm_dts = PTS_UNSET;
+  hm->hm_hdrlen = 0;
+
+  htsp_send_queue(htsp, hm, hmq);
+}
+
+
 /**
  *
  */
@@ -1325,6 +1418,306 @@ htsp_build_event
   return out;
 }
 
+/**
+ * Columnar EPG event batches
+ *
+ * When the client enables the batches (enableAsyncMetadata with
+ * epgBatch=1, HTSP v35, "epgbatch" server capability), the events
+ * are sent as one eventBatch message per sync page (eventAdd) or per
+ * group of live updates (eventAdd/eventUpdate with update=1, see
+ * htsp_epg_live_add) instead of one map per event. The message has
+ * "count" rows and the columns:
+ *
+ *   eventId, channelId, contentType, nextEventId, seasonNumber,
+ *   episodeNumber        bin, u32 per row (big endian), 0 = not set
+ *   start, stop          bin, s64 per row (big endian)
+ *   title, subtitle      bin, u32 string index per row, 0 = not set
+ *   categoryCount        bin, u8 per row
+ *   category             bin, u32 string index per category (all rows)
+ *   summary, description list of str, "" = not set
+ *   extra                list of maps with the other eventAdd fields
+ *                        (credits, episode, image, dvrId...) and "row"
+ *
+ * The string indexes refer to the per connection dictionary. The new
+ * strings are appended in "strings" (the first one has "dictIndex",
+ * the indexes start at 1), "dictReset" tells the client to drop the
+ * dictionary before the strings from this message are added. All
+ * batches use the control queue, so the client sees the dictionary
+ * updates in order.
+ */
+#define HTSP_EPG_DICT_MAX 16384
+
+typedef struct htsp_event_batch {
+  int       heb_rows;
+  int       heb_update;
+  uint32_t  heb_dict_index;
+  sbuf_t    heb_u32[6];
+  sbuf_t    heb_time[2];          /* start, stop */
+  sbuf_t    heb_str[2];           /* title, subtitle */
+  sbuf_t    heb_category_count;
+  sbuf_t    heb_category;
+  htsmsg_t *heb_text[2];          /* summary, description */
+  htsmsg_t *heb_extra;
+  htsmsg_t *heb_strings;
+} htsp_event_batch_t;
+
+static const char *htsp_event_batch_u32[6] = {
+  "eventId", "channelId", "contentType", "nextEventId",
+  "seasonNumber", "episodeNumber"
+};
+static const char *htsp_event_batch_time[2] = { "start", "stop" };
+static const char *htsp_event_batch_str[2] = { "title", "subtitle" };
+static const char *htsp_event_batch_text[2] = { "summary", "description" };
+
+static int
+htsp_epg_string_cmp(const void *a, const void *b)
+{
+  return strcmp(((htsp_epg_string_t *)a)->hes_str,
+                ((htsp_epg_string_t *)b)->hes_str);
+}
+
+static void
+htsp_epg_dict_clear(htsp_connection_t *htsp)
+{
+  htsp_epg_string_t *hes;
+
+  while ((hes = RB_FIRST(&htsp->htsp_epg_dict)) != NULL) {
+    RB_REMOVE(&htsp->htsp_epg_dict, hes, hes_link);
+    free(hes->hes_str);
+    free(hes);
+  }
+  htsp->htsp_epg_dict_count = 0;
+  htsp->htsp_epg_dict_reset = 1;
+}
+
+static uint32_t
+htsp_epg_dict_get
+  (htsp_connection_t *htsp, htsp_event_batch_t *heb, const char *str)
+{
+  htsp_epg_string_t *hes, skel;
+
+  if (str == NULL)
+    return 0;
+  skel.hes_str = (char *)str;
+  hes = RB_FIND(&htsp->htsp_epg_dict, &skel, hes_link, htsp_epg_string_cmp);
+  if (hes)
+    return hes->hes_index;
+  hes = malloc(sizeof(*hes));
+  hes->hes_str = strdup(str);
+  hes->hes_index = ++htsp->htsp_epg_dict_count;
+  RB_INSERT_SORTED(&htsp->htsp_epg_dict, hes, hes_link, htsp_epg_string_cmp);
+  if (heb->heb_strings == NULL) {
+    heb->heb_strings = htsmsg_create_list();
+    heb->heb_dict_index = hes->hes_index;
+  }
+  htsmsg_add_str(heb->heb_strings, NULL, str);
+  return hes->hes_index;
+}
+
+static void
+htsp_event_batch_init(htsp_event_batch_t *heb, int update)
+{
+  int i;
+
+  memset(heb, 0, sizeof(*heb));
+  heb->heb_update = update;
+  for (i = 0; i < ARRAY_SIZE(heb->heb_u32); i++)
+    sbuf_init(&heb->heb_u32[i]);
+  for (i = 0; i < ARRAY_SIZE(heb->heb_time); i++)
+    sbuf_init(&heb->heb_time[i]);
+  for (i = 0; i < ARRAY_SIZE(heb->heb_str); i++)
+    sbuf_init(&heb->heb_str[i]);
+  sbuf_init(&heb->heb_category_count);
+  sbuf_init(&heb->heb_category);
+  for (i = 0; i < ARRAY_SIZE(heb->heb_text); i++)
+    heb->heb_text[i] = htsmsg_create_list();
+}
+
+/**
+ * Add one event, the columns are taken from the eventAdd map, so
+ * the values are same as for the legacy messages (language, version)
+ */
+static void
+htsp_event_batch_add
+  (htsp_connection_t *htsp, htsp_event_batch_t *heb, epg_broadcast_t *e)
+{
+  htsmsg_t *m, *l;
+  htsmsg_field_t *f;
+  const char *str;
+  int64_t s64;
+  int i, n;
+
+  lock_assert(&global_lock);
+
+  m = htsp_build_event(e, NULL, htsp->htsp_language, 0, htsp);
+  if (m == NULL)
+    return;
+
+  if (heb->heb_rows == 0 && htsp->htsp_epg_dict_count >= HTSP_EPG_DICT_MAX)
+    htsp_epg_dict_clear(htsp);
+
+  for (i = 0; i < ARRAY_SIZE(heb->heb_u32); i++) {
+    sbuf_put_be32(&heb->heb_u32[i],
+                  htsmsg_get_u32_or_default(m, htsp_event_batch_u32[i], 0));
+    htsmsg_delete_field(m, htsp_event_batch_u32[i]);
+  }
+  for (i = 0; i < ARRAY_SIZE(heb->heb_time); i++) {
+    s64 = htsmsg_get_s64_or_default(m, htsp_event_batch_time[i], 0);
+    sbuf_put_be32(&heb->heb_time[i], (uint64_t)s64 >> 32);
+    sbuf_put_be32(&heb->heb_time[i], s64 & 0xffffffff);
+    htsmsg_delete_field(m, htsp_event_batch_time[i]);
+  }
+  for (i = 0; i < ARRAY_SIZE(heb->heb_str); i++) {
+    str = htsmsg_get_str(m, htsp_event_batch_str[i]);
+    sbuf_put_be32(&heb->heb_str[i], htsp_epg_dict_get(htsp, heb, str));
+    htsmsg_delete_field(m, htsp_event_batch_str[i]);
+  }
+  n = 0;
+  if ((l = htsmsg_get_list(m, "category")) != NULL) {
+    HTSMSG_FOREACH(f, l) {
+      if (n == 255) break;
+      if ((str = htsmsg_field_get_str(f)) == NULL) continue;
+      sbuf_put_be32(&heb->heb_category, htsp_epg_dict_get(htsp, heb, str));
+      n++;
+    }
+    htsmsg_delete_field(m, "category");
+  }
+  sbuf_put_byte(&heb->heb_category_count, n);
+  for (i = 0; i < ARRAY_SIZE(heb->heb_text); i++) {
+    str = htsmsg_get_str(m, htsp_event_batch_text[i]);
+    htsmsg_add_str(heb->heb_text[i], NULL, str ?: "");
+    htsmsg_delete_field(m, htsp_event_batch_text[i]);
+  }
+
+  if (htsmsg_is_empty(m)) {
+    htsmsg_destroy(m);
+  } else {
+    htsmsg_add_u32(m, "row", heb->heb_rows);
+    if (heb->heb_extra == NULL)
+      heb->heb_extra = htsmsg_create_list();
+    htsmsg_add_msg(heb->heb_extra, NULL, m);
+  }
+  heb->heb_rows++;
+}
+
+/**
+ * Build the eventBatch message (NULL for no rows) and free the batch
+ */
+static htsmsg_t *
+htsp_event_batch_finish(htsp_connection_t *htsp, htsp_event_batch_t *heb)
+{
+  htsmsg_t *m = NULL;
+  int i;
+
+  if (heb->heb_rows > 0) {
+    m = htsmsg_create_map();
+    htsmsg_add_str(m, "method", "eventBatch");
+    if (heb->heb_update)
+      htsmsg_add_u32(m, "update", 1);
+    if (htsp->htsp_epg_dict_reset) {
+      htsmsg_add_u32(m, "dictReset", 1);
+      htsp->htsp_epg_dict_reset = 0;
+    }
+    if (heb->heb_strings) {
+      htsmsg_add_u32(m, "dictIndex", heb->heb_dict_index);
+      htsmsg_add_msg(m, "strings", heb->heb_strings);
+      heb->heb_strings = NULL;
+    }
+    htsmsg_add_u32(m, "count", heb->heb_rows);
+    for (i = 0; i < ARRAY_SIZE(heb->heb_u32); i++)
+      htsmsg_add_bin(m, htsp_event_batch_u32[i],
+                     heb->heb_u32[i].sb_data, heb->heb_u32[i].sb_ptr);
+    for (i = 0; i < ARRAY_SIZE(heb->heb_time); i++)
+      htsmsg_add_bin(m, htsp_event_batch_time[i],
+                     heb->heb_time[i].sb_data, heb->heb_time[i].sb_ptr);
+    for (i = 0; i < ARRAY_SIZE(heb->heb_str); i++)
+      htsmsg_add_bin(m, htsp_event_batch_str[i],
+                     heb->heb_str[i].sb_data, heb->heb_str[i].sb_ptr);
+    htsmsg_add_bin(m, "categoryCount", heb->heb_category_count.sb_data,
+                   heb->heb_category_count.sb_ptr);
+    if (heb->heb_category.sb_ptr > 0)
+      htsmsg_add_bin(m, "category", heb->heb_category.sb_data,
+                     heb->heb_category.sb_ptr);
+    for (i = 0; i < ARRAY_SIZE(heb->heb_text); i++) {
+      htsmsg_add_msg(m, htsp_event_batch_text[i], heb->heb_text[i]);
+      heb->heb_text[i] = NULL;
+    }
+    if (heb->heb_extra) {
+      htsmsg_add_msg(m, "extra", heb->heb_extra);
+      heb->heb_extra = NULL;
+    }
+  }
+
+  for (i = 0; i < ARRAY_SIZE(heb->heb_u32); i++)
+    sbuf_free(&heb->heb_u32[i]);
+  for (i = 0; i < ARRAY_SIZE(heb->heb_time); i++)
+    sbuf_free(&heb->heb_time[i]);
+  for (i = 0; i < ARRAY_SIZE(heb->heb_str); i++)
+    sbuf_free(&heb->heb_str[i]);
+  sbuf_free(&heb->heb_category_count);
+  sbuf_free(&heb->heb_category);
+  for (i = 0; i < ARRAY_SIZE(heb->heb_text); i++)
+    htsmsg_destroy(heb->heb_text[i]);
+  htsmsg_destroy(heb->heb_extra);
+  htsmsg_destroy(heb->heb_strings);
+  return m;
+}
+
+/**
+ * Live updates are collected to one pending batch, it is sent after
+ * HTSP_EPG_LIVE_DELAY or when HTSP_EPG_LIVE_ROWS rows are added. Only
+ * one batch is open per connection, the pending batch is sent before
+ * any other EPG message (sync page, other method, eventDelete), so the
+ * events and the dictionary updates stay in order.
+ */
+#define HTSP_EPG_LIVE_ROWS   64
+#define HTSP_EPG_LIVE_DELAY  ms2mono(100)
+
+static void
+htsp_epg_live_flush(htsp_connection_t *htsp, int send)
+{
+  htsmsg_t *m;
+
+  lock_assert(&global_lock);
+
+  if (htsp->htsp_epg_live == NULL)
+    return;
+  mtimer_disarm(&htsp->htsp_epg_live_timer);
+  m = htsp_event_batch_finish(htsp, htsp->htsp_epg_live);
+  free(htsp->htsp_epg_live);
+  htsp->htsp_epg_live = NULL;
+  if (m && send)
+    htsp_send_message(htsp, m, NULL);
+  else
+    htsmsg_destroy(m);
+}
+
+static void
+htsp_epg_live_cb(void *aux)
+{
+  htsp_epg_live_flush(aux, 1);
+}
+
+static void
+htsp_epg_live_add(htsp_connection_t *htsp, epg_broadcast_t *ebc, int update)
+{
+  htsp_event_batch_t *heb = htsp->htsp_epg_live;
+
+  if (heb && heb->heb_update != update) {
+    htsp_epg_live_flush(htsp, 1);
+    heb = NULL;
+  }
+  if (heb == NULL) {
+    heb = htsp->htsp_epg_live = malloc(sizeof(*heb));
+    htsp_event_batch_init(heb, update);
+    mtimer_arm_rel(&htsp->htsp_epg_live_timer, htsp_epg_live_cb,
+                   htsp, HTSP_EPG_LIVE_DELAY);
+  }
+  htsp_event_batch_add(htsp, heb, ebc);
+  if (heb->heb_rows >= HTSP_EPG_LIVE_ROWS)
+    htsp_epg_live_flush(htsp, 1);
+}
+
 /* **************************************************************************
  * Message handlers
  * *************************************************************************/
@@ -1335,7 +1728,7 @@ htsp_build_event
 static htsmsg_t *
 htsp_method_hello(htsp_connection_t *htsp, htsmsg_t *in)
 {
-  htsmsg_t *r;
+  htsmsg_t *r, *l;
   uint32_t v;
   const char *name, *lang;
 
@@ -1363,7 +1756,9 @@ htsp_method_hello(htsp_connection_t *htsp, htsmsg_t *in)
     htsmsg_add_str(r, "language", lang);
 
   /* Capabilities */
-  htsmsg_add_msg(r, "servercapability", tvheadend_capabilities_list(1));
+  l = tvheadend_capabilities_list(1);
+  htsmsg_add_str(l, NULL, "epgbatch");
+  htsmsg_add_msg(r, "servercapability", l);
   htsmsg_add_u32(r, "api_version", TVH_API_VERSION);
 
   /* Set version to lowest num */
@@ -1518,8 +1913,7 @@ htsp_method_async(htsp_connection_t *htsp, htsmsg_t *in)
   dvr_entry_t *de;
   dvr_autorec_entry_t *dae;
   dvr_timerec_entry_t *dte;
-  htsmsg_t *m;
-  uint32_t epg = 0;
+  uint32_t epg = 0, batch;
   int64_t lastUpdate = -1;
   int64_t epgMaxTime = 0;
   const char *lang;
@@ -1544,6 +1938,13 @@ htsp_method_async(htsp_connection_t *htsp, htsmsg_t *in)
     if (htsp->htsp_epg_window)
       htsp->htsp_epg_window = MAX(htsp->htsp_epg_window, 600);
   }
+  if (!htsmsg_get_u32(in, "epgBatch", &batch) && htsp->htsp_version >= 35) {
+    batch = batch ? 1 : 0;
+    htsp_epg_live_flush(htsp, 1);
+    if (batch && !htsp->htsp_epg_batch)
+      htsp_epg_dict_clear(htsp);
+    htsp->htsp_epg_batch = batch;
+  }
   if ((lang = htsmsg_get_str(in, "language")) != NULL) {
     if (lang[0]) {
       htsp->htsp_language = strdup(lang);
@@ -1601,17 +2002,18 @@ htsp_method_async(htsp_connection_t *htsp, htsmsg_t *in)
     if (!dvr_entry_verify(de, htsp->htsp_granted_access, 1))
       htsp_send_message(htsp, htsp_build_dvrentry(htsp, de, "dvrEntryAdd", htsp->htsp_language, 0), NULL);
 
-  /* Send EPG updates */
-  if (epg)
+  /* Insert in list so it will get all updates */
+  LIST_INSERT_HEAD(&htsp_async_connections, htsp, htsp_async_link);
+
+  /* Send all EPG events (paged) */
+  if (epg) {
+    htsp->htsp_epg_sync_initial = 1;
     htsp_epg_send_waiting(htsp, -1);
+    return NULL;
+  }
 
   /* Notify that initial sync has been completed */
-  m = htsmsg_create_map();
-  htsmsg_add_str(m, "method", "initialSyncCompleted");
-  htsp_send_message(htsp, m, NULL);
-
-  /* Insert in list so it will get all updates */
-  LIST_INSERT_HEAD(&htsp_async_connections, htsp, htsp_async_link);
+  htsp_initial_sync_completed(htsp);
 
   return NULL;
 }
@@ -2577,6 +2979,7 @@ htsp_method_subscribe(htsp_connection_t *htsp, htsmsg_t *in)
    * subscribe now...
    */
   LIST_INSERT_HEAD(&htsp->htsp_subscriptions, hs, hs_link);
+  htsp_writer_stream_update(htsp);
 
   tvhdebug(LS_HTSP, "%s - subscribe to %s using profile %s",
            htsp->htsp_logname, channel_get_name(ch, channel_blank_name),
@@ -3154,35 +3557,58 @@ htsp_authenticate(htsp_connection_t *htsp, htsmsg_t *m)
 }
 
 /**
- * timeout is in ms, 0 means infinite timeout
+ * Complete message check (see tcp_server_ops_t)
  */
+#define HTSP_MESSAGE_MAX (1024 * 1024)
+
 static int
-htsp_read_message(htsp_connection_t *htsp, htsmsg_t **mp, int timeout)
+htsp_read_ready(void *opaque)
+{
+  htsp_connection_t *htsp = opaque;
+  size_t len = tcp_input_queued(&htsp->htsp_input);
+  uint8_t data[4];
+  uint32_t mlen;
+
+  if (htsp->htsp_input_need)
+    return len >= htsp->htsp_input_need;
+  if (len < 4)
+    return 0;
+  htsbuf_peek(&htsp->htsp_input, data, 4);
+  mlen = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+  if (mlen > HTSP_MESSAGE_MAX)
+    return -1;
+  htsp->htsp_input_need = 4 + mlen;
+  return len >= htsp->htsp_input_need;
+}
+
+static htsbuf_queue_t *
+htsp_read_queue(void *opaque)
+{
+  htsp_connection_t *htsp = opaque;
+  return &htsp->htsp_input;
+}
+
+/**
+ * Take one complete message from the input queue
+ */
+static int
+htsp_read_message(htsp_connection_t *htsp, htsmsg_t **mp)
 {
   int v;
   uint32_t len;
   uint8_t data[4];
   void *buf;
 
-  v = timeout ? tcp_read_timeout(htsp->htsp_fd, data, 4, timeout) : 
-                tcp_read(htsp->htsp_fd, data, 4);
-
-  if(v != 0)
-    return v;
+  if((v = htsp_read_ready(htsp)) <= 0)
+    return v ? EMSGSIZE : EAGAIN;
 
+  htsp->htsp_input_need = 0;
+  htsbuf_read(&htsp->htsp_input, data, 4);
   len = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
-  if(len > 1024 * 1024)
-    return EMSGSIZE;
   if((buf = malloc(len)) == NULL)
     return ENOMEM;
 
-  v = timeout ? tcp_read_timeout(htsp->htsp_fd, buf, len, timeout) : 
-                tcp_read(htsp->htsp_fd, buf, len);
-  
-  if(v != 0) {
-    free(buf);
-    return v;
-  }
+  htsbuf_read(&htsp->htsp_input, buf, len);
 
   /* buf will be tied to the message (on success) */
   /* bellow fcn calls free(buf) (on failure) */
@@ -3211,242 +3637,357 @@ htsp_server_status ( void *opaque, htsmsg_t *m )
       snprintf(buf, sizeof(buf), "[%s]", htsp->htsp_username);
     htsmsg_add_str(m, "user", buf);
   }
+  tvh_mutex_lock(&htsp->htsp_out_mutex);
+  htsmsg_add_s64(m, "write_calls", htsp->htsp_write_calls);
+  htsmsg_add_s64(m, "write_msgs", htsp->htsp_write_msgs);
+  htsmsg_add_s64(m, "write_bytes", htsp->htsp_write_bytes);
+  tvh_mutex_unlock(&htsp->htsp_out_mutex);
 }
 
 /**
- *
+ * Called with global_lock held
  */
 static int
-htsp_read_loop(htsp_connection_t *htsp)
+htsp_read_begin(htsp_connection_t *htsp)
 {
-  htsmsg_t *m = NULL, *reply;
-  int run = 1, r = 0, i, streaming = 0;
-  const char *method;
-  void *tcp_id = NULL;;
-
   if(htsp_generate_challenge(htsp)) {
     tvherror(LS_HTSP, "%s: Unable to generate challenge",
 	     htsp->htsp_logname);
     return 1;
   }
 
-  tvh_mutex_lock(&global_lock);
-
   htsp->htsp_granted_access = access_get_by_addr(htsp->htsp_peer);
   htsp->htsp_granted_access->aa_rights |= ACCESS_HTSP_INTERFACE;
 
-  tcp_id = tcp_connection_launch(htsp->htsp_fd, streaming, htsp_server_status,
-                                 htsp->htsp_granted_access);
+  htsp->htsp_tcp_id = tcp_connection_launch(htsp->htsp_fd, htsp->htsp_streaming,
+                                            htsp_server_status,
+                                            htsp->htsp_granted_access);
 
-  tvh_mutex_unlock(&global_lock);
-
-  if (tcp_id == NULL)
-    return 0;
+  if (htsp->htsp_tcp_id == NULL)
+    return 1;
 
   tvhinfo(LS_HTSP, "Got connection from %s", htsp->htsp_logname);
+  return 0;
+}
 
-  /* Session main loop */
+/**
+ * Read and process one message, returns non-zero when the connection
+ * should be closed
+ */
+static int
+htsp_read_message1(htsp_connection_t *htsp)
+{
+  htsmsg_t *m = NULL, *reply = NULL;
+  int run = 1, i;
+  const char *method;
 
-  while(run && tvheadend_is_running()) {
-readmsg:
-    reply = NULL;
+  if(!tvheadend_is_running() || htsp_read_message(htsp, &m) != 0)
+    return 1;
 
-    if((r = htsp_read_message(htsp, &m, 0)) != 0)
-      break;
+  tvh_mutex_lock(&global_lock);
+  if (htsp_authenticate(htsp, m)) {
+    tcp_connection_land(htsp->htsp_tcp_id);
+    htsp->htsp_tcp_id = tcp_connection_launch(htsp->htsp_fd, htsp->htsp_streaming,
+                                              htsp_server_status,
+                                              htsp->htsp_granted_access);
+    if (htsp->htsp_tcp_id == NULL) {
+      reply = htsmsg_create_map();
+      htsmsg_add_u32(reply, "noaccess", 1);
+      htsmsg_add_u32(reply, "connlimit", 1);
+      run = 0;
+      goto send_reply_with_unlock;
+    }
+  }
 
-    tvh_mutex_lock(&global_lock);
-    if (htsp_authenticate(htsp, m)) {
-      tcp_connection_land(tcp_id);
-      tcp_id = tcp_connection_launch(htsp->htsp_fd, streaming, htsp_server_status,
-                                     htsp->htsp_granted_access);
-      if (tcp_id == NULL) {
-        reply = htsmsg_create_map();
-        htsmsg_add_u32(reply, "noaccess", 1);
-        htsmsg_add_u32(reply, "connlimit", 1);
-        run = 0;
-        goto send_reply_with_unlock;
+  if((method = htsmsg_get_str(m, "method")) != NULL) {
+    tvhtrace(LS_HTSP, "%s - method %s", htsp->htsp_logname, method);
+    if (tvhtrace_enabled())
+      htsp_trace(htsp, LS_HTSP_REQ, "request", m);
+    for(i = 0; i < NUM_METHODS; i++) {
+      if(!strcmp(method, htsp_methods[i].name)) {
+
+        if((htsp->htsp_granted_access->aa_rights &
+            htsp_methods[i].privmask) !=
+              htsp_methods[i].privmask) {
+
+          tvh_mutex_unlock(&global_lock);
+          /* Classic authentication failed delay */
+          tvh_safe_usleep(250000);
+
+          reply = htsmsg_create_map();
+          htsmsg_add_u32(reply, "noaccess", 1);
+          htsp_reply(htsp, m, reply);
+
+          htsmsg_destroy(m);
+          return 0;
+
+        } else {
+          if (!strcmp(method, "subscribe") && !htsp->htsp_streaming) {
+            tcp_connection_land(htsp->htsp_tcp_id);
+            htsp->htsp_tcp_id = tcp_connection_launch(htsp->htsp_fd, 1,
+                                                      htsp_server_status,
+                                                      htsp->htsp_granted_access);
+            if (htsp->htsp_tcp_id == NULL) {
+              reply = htsmsg_create_map();
+              htsmsg_add_u32(reply, "noaccess", 1);
+              htsmsg_add_u32(reply, "connlimit", 1);
+              goto send_reply_with_unlock;
+            }
+            htsp->htsp_streaming = 1;
+          }
+          reply = htsp_methods[i].fn(htsp, m);
+        }
+        break;
       }
     }
 
-    if((method = htsmsg_get_str(m, "method")) != NULL) {
-      tvhtrace(LS_HTSP, "%s - method %s", htsp->htsp_logname, method);
-      if (tvhtrace_enabled())
-        htsp_trace(htsp, LS_HTSP_REQ, "request", m);
-      for(i = 0; i < NUM_METHODS; i++) {
-        if(!strcmp(method, htsp_methods[i].name)) {
+    if(i == NUM_METHODS) {
+      reply = htsp_error(htsp, N_("Method not found"));
+    }
 
-          if((htsp->htsp_granted_access->aa_rights &
-              htsp_methods[i].privmask) !=
-                htsp_methods[i].privmask) {
+  } else {
+    reply = htsp_error(htsp, N_("Invalid arguments"));
+  }
 
-      	    tvh_mutex_unlock(&global_lock);
-            /* Classic authentication failed delay */
-            tvh_safe_usleep(250000);
+send_reply_with_unlock:
+  tvh_mutex_unlock(&global_lock);
 
-            reply = htsmsg_create_map();
-            htsmsg_add_u32(reply, "noaccess", 1);
-            htsp_reply(htsp, m, reply);
+  if(reply != NULL) /* Methods can do all the replying inline */
+    htsp_reply(htsp, m, reply);
 
-            htsmsg_destroy(m);
-            goto readmsg;
+  htsmsg_destroy(m);
+  return !run;
+}
 
-          } else {
-            if (!strcmp(method, "subscribe") && !streaming) {
-              tcp_connection_land(tcp_id);
-              tcp_id = tcp_connection_launch(htsp->htsp_fd, 1, htsp_server_status,
-                                             htsp->htsp_granted_access);
-              if (tcp_id == NULL) {
-                reply = htsmsg_create_map();
-                htsmsg_add_u32(reply, "noaccess", 1);
-                htsmsg_add_u32(reply, "connlimit", 1);
-                goto send_reply_with_unlock;
-              }
-              streaming = 1;
-            }
-            reply = htsp_methods[i].fn(htsp, m);
-          }
-          break;
-        }
-      }
+/**
+ * Queue the next EPG sync page when the control queue is drained
+ * enough (out mutex held)
+ */
+#define HTSP_EPG_SYNC_EVENTS  256   // events per page
+#define HTSP_EPG_SYNC_QUEUE   64    // queue length for the next page
 
-      if(i == NUM_METHODS) {
-        reply = htsp_error(htsp, N_("Method not found"));
-      }
+static void
+htsp_epg_sync_check(htsp_connection_t *htsp)
+{
+  if (htsp->htsp_epg_sync_wait && !htsp->htsp_epg_sync_busy &&
+      htsp->htsp_writer_run &&
+      htsp->htsp_hmq_ctrl.hmq_length <= HTSP_EPG_SYNC_QUEUE) {
+    htsp->htsp_epg_sync_wait = 0;
+    htsp->htsp_epg_sync_busy = 1;
+    tcp_task_submit(&htsp->htsp_epg_sync_task);
+  }
+}
 
-    } else {
-      reply = htsp_error(htsp, N_("Invalid arguments"));
-    }
+/**
+ * Take the next message to be sent (out mutex held)
+ */
+static htsp_msg_t *
+htsp_write_next(htsp_connection_t *htsp)
+{
+  htsp_msg_q_t *hmq;
+  htsp_msg_t *hm;
 
-send_reply_with_unlock:
-    tvh_mutex_unlock(&global_lock);
+  if((hmq = TAILQ_FIRST(&htsp->htsp_active_output_queues)) == NULL)
+    return NULL;
 
-    if(reply != NULL) /* Methods can do all the replying inline */
-      htsp_reply(htsp, m, reply);
+  hm = TAILQ_FIRST(&hmq->hmq_q);
+  TAILQ_REMOVE(&hmq->hmq_q, hm, hm_link);
+  hmq->hmq_length--;
+  hmq->hmq_payload -= hm->hm_payloadsize;
 
-    htsmsg_destroy(m);
+  TAILQ_REMOVE(&htsp->htsp_active_output_queues, hmq, hmq_link);
+  if(hmq->hmq_length) {
+    /* Still messages to be sent, put back in active queues */
+    if(hmq->hmq_strict_prio) {
+      TAILQ_INSERT_HEAD(&htsp->htsp_active_output_queues, hmq, hmq_link);
+    } else {
+      TAILQ_INSERT_TAIL(&htsp->htsp_active_output_queues, hmq, hmq_link);
+    }
   }
-
-  tvh_mutex_lock(&global_lock);
-  tcp_connection_land(tcp_id);
-  tvh_mutex_unlock(&global_lock);
-  return tvheadend_is_running() ? r : 0;
+  return hm;
 }
 
 /**
+ * Writer task, sends all queued messages and returns the worker
+ * back to the pool. When the connection has subscriptions, the worker
+ * is dedicated to the writer and it waits for the next messages, so
+ * the blocking send (SO_SNDTIMEO) does not take the shared workers.
+ * Without subscriptions (EPG sync), the worker is dedicated only when
+ * the socket buffer is full (slow peer) and the send would block.
  *
+ * The queued messages are taken in the same order as one by one
+ * (strict priority queues first) up to the batch limits and sent
+ * with one writev. While more messages are waiting, the socket is
+ * corked (MSG_MORE) so the small messages (audio) share the TCP
+ * segments, but not longer than HTSP_WRITE_CORK_TIME.
  */
-static void *
+#define HTSP_WRITE_BATCH_MSGS   32
+#define HTSP_WRITE_BATCH_BYTES  (256 * 1024)
+#define HTSP_WRITE_CORK_TIME    ms2mono(20)
+
+/*
+ * The last send was corked (MSG_MORE), but the queues are empty now,
+ * push the pending data
+ */
+static void
+htsp_write_uncork(htsp_connection_t *htsp)
+{
+#ifdef TCP_CORK
+  int val = 0;
+  setsockopt(htsp->htsp_fd, IPPROTO_TCP, TCP_CORK, &val, sizeof(val));
+#endif
+}
+
+/*
+ * Send without blocking, returns the number of the remaining iovecs
+ * (the iov pointer is advanced) or -1 on error
+ */
+static int
+htsp_write_nowait(int fd, struct iovec **piov, int niov, int flags)
+{
+  struct iovec *iov = *piov;
+  struct msghdr msg;
+  ssize_t c;
+
+  while (niov > 0) {
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = niov;
+    c = sendmsg(fd, &msg, flags | MSG_DONTWAIT);
+    if (c < 0) {
+      if (ERRNO_AGAIN(errno))
+        break;
+      return -1;
+    }
+    for ( ; niov > 0 && c >= iov->iov_len; iov++, niov--)
+      c -= iov->iov_len;
+    if (niov > 0) {
+      iov->iov_base = (uint8_t *)iov->iov_base + c;
+      iov->iov_len -= c;
+    }
+  }
+  *piov = iov;
+  return niov;
+}
+
+static void
 htsp_write_scheduler(void *aux)
 {
   htsp_connection_t *htsp = aux;
-  htsp_msg_q_t *hmq;
-  htsp_msg_t *hm;
-  void *dptr;
-  size_t dlen;
-  int r;
+  htsp_msg_t *hm, *batch[HTSP_WRITE_BATCH_MSGS];
+  struct iovec iov[2 * HTSP_WRITE_BATCH_MSGS], *iovp;
+  void *dptr[HTSP_WRITE_BATCH_MSGS];
+  size_t dlen, bytes;
+  int64_t corked = 0;
+  int i, n, niov, r, more;
 
   tvh_mutex_lock(&htsp->htsp_out_mutex);
 
   while(htsp->htsp_writer_run) {
 
-    if((hmq = TAILQ_FIRST(&htsp->htsp_active_output_queues)) == NULL) {
-      /* Nothing to be done, go to sleep */
+    for (n = 0, bytes = 0;
+         n < HTSP_WRITE_BATCH_MSGS && bytes < HTSP_WRITE_BATCH_BYTES; n++) {
+      if ((hm = htsp_write_next(htsp)) == NULL)
+        break;
+      batch[n] = hm;
+      bytes += hm->hm_hdrlen + hm->hm_payloadsize;
+    }
+    if (n == 0) {
+      if (corked) {
+        htsp_write_uncork(htsp);
+        corked = 0;
+      }
+      if (!htsp->htsp_writer_stream)
+        break;
+      tcp_worker_dedicate();
+      htsp->htsp_writer_wait = 1;
       tvh_cond_wait(&htsp->htsp_out_cond, &htsp->htsp_out_mutex);
+      htsp->htsp_writer_wait = 0;
       continue;
     }
+    more = !TAILQ_EMPTY(&htsp->htsp_active_output_queues);
+    htsp_epg_sync_check(htsp);
 
-    hm = TAILQ_FIRST(&hmq->hmq_q);
-    TAILQ_REMOVE(&hmq->hmq_q, hm, hm_link);
-    hmq->hmq_length--;
-    hmq->hmq_payload -= hm->hm_payloadsize;
+    tvh_mutex_unlock(&htsp->htsp_out_mutex);
 
-    TAILQ_REMOVE(&htsp->htsp_active_output_queues, hmq, hmq_link);
-    if(hmq->hmq_length) {
-      /* Still messages to be sent, put back in active queues */
-      if(hmq->hmq_strict_prio) {
-        TAILQ_INSERT_HEAD(&htsp->htsp_active_output_queues, hmq, hmq_link);
+    for (i = niov = 0, bytes = 0; i < n; i++) {
+      hm = batch[i];
+      dptr[i] = NULL;
+      if (hm->hm_hdrlen) {
+        /* muxpkt, the payload is sent directly from the packet buffer */
+        iov[niov].iov_base   = hm->hm_hdr;
+        iov[niov++].iov_len  = hm->hm_hdrlen;
+        iov[niov].iov_base   = pktbuf_ptr(hm->hm_pb);
+        iov[niov++].iov_len  = pktbuf_len(hm->hm_pb);
+        bytes += hm->hm_hdrlen + pktbuf_len(hm->hm_pb);
+      } else if (htsmsg_binary_serialize(hm->hm_msg, &dptr[i], &dlen, INT32_MAX) == 0) {
+        iov[niov].iov_base   = dptr[i];
+        iov[niov++].iov_len  = dlen;
+        bytes += dlen;
       } else {
-        TAILQ_INSERT_TAIL(&htsp->htsp_active_output_queues, hmq, hmq_link);
+        tvhwarn(LS_HTSP, "%s: failed to serialize data", htsp->htsp_logname);
       }
     }
 
-    tvh_mutex_unlock(&htsp->htsp_out_mutex);
+#ifdef MSG_MORE
+    if (more) {
+      if (corked == 0)
+        corked = mclk();
+      else if (corked + HTSP_WRITE_CORK_TIME < mclk())
+        more = 0;
+    }
+    if (!more)
+      corked = 0;
+#else
+    more = 0;
+#endif
 
-    if (htsmsg_binary_serialize(hm->hm_msg, &dptr, &dlen, INT32_MAX) != 0) {
-      tvhwarn(LS_HTSP, "%s: failed to serialize data", htsp->htsp_logname);
-      htsp_msg_destroy(hm);
-      tvh_mutex_lock(&htsp->htsp_out_mutex);
-      continue;
+    iovp = iov;
+    r = niov ? htsp_write_nowait(htsp->htsp_fd, &iovp, niov, more ? MSG_MORE : 0) : 0;
+    if (r > 0) {
+      /* slow peer, the blocking send must not take a shared worker */
+      tcp_worker_dedicate();
+      r = tvh_writev(htsp->htsp_fd, iovp, r, more ? MSG_MORE : 0);
     }
 
-    htsp_msg_destroy(hm);
+    for (i = 0; i < n; i++) {
+      free(dptr[i]);
+      htsp_msg_destroy(batch[i]);
+    }
 
-    r = tvh_write(htsp->htsp_fd, dptr, dlen);
-    free(dptr);
     tvh_mutex_lock(&htsp->htsp_out_mutex);
-    
+
+    if (niov) {
+      htsp->htsp_write_calls++;
+      htsp->htsp_write_msgs += n;
+      htsp->htsp_write_bytes += bytes;
+    }
+
     if (r) {
       tvhinfo(LS_HTSP, "%s: Write error -- %s",
               htsp->htsp_logname, strerror(errno));
+      // Shutdown socket to make receiver terminate entire HTSP connection
+      shutdown(htsp->htsp_fd, SHUT_RDWR);
+      htsp->htsp_writer_run = 0;
       break;
     }
   }
-  // Shutdown socket to make receive thread terminate entire HTSP connection
 
-  shutdown(htsp->htsp_fd, SHUT_RDWR);
+  htsp->htsp_writer_busy = 0;
+  tvh_cond_signal(&htsp->htsp_out_cond, 1);
   tvh_mutex_unlock(&htsp->htsp_out_mutex);
-  return NULL;
 }
 
 /**
- *
+ * Release the connection, called without locks
  */
 static void
-htsp_serve(int fd, void **opaque, struct sockaddr_storage *source,
-	   struct sockaddr_storage *self)
+htsp_serve_finish(htsp_connection_t *htsp)
 {
-  htsp_connection_t htsp;
-  char buf[50];
   htsp_subscription_t *s;
-  
-  // Note: global_lock held on entry
-
-  if (config.dscp >= 0)
-    socket_set_dscp(fd, config.dscp, NULL, 0);
-
-  tcp_get_str_from_ip(source, buf, 50);
-
-  memset(&htsp, 0, sizeof(htsp_connection_t));
-  *opaque = &htsp;
-
-  TAILQ_INIT(&htsp.htsp_active_output_queues);
-
-  htsp_init_queue(&htsp.htsp_hmq_ctrl, 0);
-  htsp_init_queue(&htsp.htsp_hmq_qstatus, 1);
-  htsp_init_queue(&htsp.htsp_hmq_epg, 0);
-
-  htsp.htsp_peername = strdup(buf);
-  htsp_update_logname(&htsp);
-
-  htsp.htsp_fd = fd;
-  htsp.htsp_peer = source;
-  htsp.htsp_writer_run = 1;
-
-  tvh_mutex_init(&htsp.htsp_out_mutex, NULL);
-
-  LIST_INSERT_HEAD(&htsp_connections, &htsp, htsp_link);
-  tvh_mutex_unlock(&global_lock);
-
-  tvh_thread_create(&htsp.htsp_writer_thread, NULL,
-                    htsp_write_scheduler, &htsp, "htsp-write");
-
-  /**
-   * Reader loop
-   */
-
-  htsp_read_loop(&htsp);
-
-  tvhinfo(LS_HTSP, "%s: Disconnected", htsp.htsp_logname);
+  htsp_msg_q_t *hmq;
+  htsp_msg_t *hm;
+  htsp_file_t *hf;
 
   /**
    * Ok, we're back, other end disconnected. Clean up stuff.
@@ -3454,58 +3995,137 @@ htsp_serve(int fd, void **opaque, struct sockaddr_storage *source,
 
   tvh_mutex_lock(&global_lock);
 
+  tcp_connection_land(htsp->htsp_tcp_id);
+  htsp->htsp_tcp_id = NULL;
+
   /* no async notifications from now */
-  if(htsp.htsp_async_mode)
-    LIST_REMOVE(&htsp, htsp_async_link);
+  if(htsp->htsp_async_mode)
+    LIST_REMOVE(htsp, htsp_async_link);
 
-  mtimer_disarm(&htsp.htsp_epg_timer);
+  mtimer_disarm(&htsp->htsp_epg_timer);
+  htsp->htsp_epg_sync = 0;
+  htsp_epg_live_flush(htsp, 0);
 
   /* deregister this client */
-  LIST_REMOVE(&htsp, htsp_link);
+  LIST_REMOVE(htsp, htsp_link);
 
   /* Beware! Closing subscriptions will invoke a lot of callbacks
      down in the streaming code. So we do this as early as possible
      to avoid any weird lockups */
-  while((s = LIST_FIRST(&htsp.htsp_subscriptions)) != NULL)
-    htsp_subscription_destroy(&htsp, s);
+  while((s = LIST_FIRST(&htsp->htsp_subscriptions)) != NULL)
+    htsp_subscription_destroy(htsp, s);
 
   tvh_mutex_unlock(&global_lock);
 
-  tvh_mutex_lock(&htsp.htsp_out_mutex);
-  htsp.htsp_writer_run = 0;
-  tvh_cond_signal(&htsp.htsp_out_cond, 0);
-  tvh_mutex_unlock(&htsp.htsp_out_mutex);
-
-  pthread_join(htsp.htsp_writer_thread, NULL);
-
-  while((s = LIST_FIRST(&htsp.htsp_dead_subscriptions)) != NULL)
-    htsp_subscription_free(&htsp, s);
+  tvh_mutex_lock(&htsp->htsp_out_mutex);
+  htsp->htsp_writer_run = 0;
+  htsp->htsp_writer_stream = 0;
+  tvh_cond_signal(&htsp->htsp_out_cond, 1);
+  while (htsp->htsp_writer_busy || htsp->htsp_epg_sync_busy)
+    tvh_cond_wait(&htsp->htsp_out_cond, &htsp->htsp_out_mutex);
+  tvh_mutex_unlock(&htsp->htsp_out_mutex);
 
-  htsp_msg_q_t *hmq;
+  while((s = LIST_FIRST(&htsp->htsp_dead_subscriptions)) != NULL)
+    htsp_subscription_free(htsp, s);
 
-  TAILQ_FOREACH(hmq, &htsp.htsp_active_output_queues, hmq_link) {
-    htsp_msg_t *hm;
+  TAILQ_FOREACH(hmq, &htsp->htsp_active_output_queues, hmq_link) {
     while((hm = TAILQ_FIRST(&hmq->hmq_q)) != NULL) {
       TAILQ_REMOVE(&hmq->hmq_q, hm, hm_link);
       htsp_msg_destroy(hm);
     }
   }
 
-  htsp_file_t *hf;
-  while((hf = LIST_FIRST(&htsp.htsp_files)) != NULL)
+  while((hf = LIST_FIRST(&htsp->htsp_files)) != NULL)
     htsp_file_destroy(hf);
 
-  close(fd);
-  
-  /* Free memory (leave lock in place, for parent method) */
+  htsbuf_queue_flush(&htsp->htsp_input);
+
   tvh_mutex_lock(&global_lock);
-  free(htsp.htsp_logname);
-  free(htsp.htsp_peername);
-  free(htsp.htsp_username);
-  free(htsp.htsp_clientname);
-  free(htsp.htsp_language);
-  access_destroy(htsp.htsp_granted_access);
-  *opaque = NULL;
+  free(htsp->htsp_logname);
+  free(htsp->htsp_peername);
+  free(htsp->htsp_username);
+  free(htsp->htsp_clientname);
+  free(htsp->htsp_language);
+  htsp_epg_dict_clear(htsp);
+  access_destroy(htsp->htsp_granted_access);
+  tvh_mutex_unlock(&global_lock);
+  tvh_cond_destroy(&htsp->htsp_out_cond);
+  tvh_mutex_destroy(&htsp->htsp_out_mutex);
+  free(htsp);
+}
+
+/**
+ * Event driven connection (see tcp_server_ops_t), the messages
+ * are read and processed in the tcp worker pool
+ */
+static void
+htsp_serve(int fd, void **opaque, struct sockaddr_storage *source,
+	   struct sockaddr_storage *self)
+{
+  htsp_connection_t *htsp;
+  char buf[50];
+  
+  // Note: global_lock held on entry
+
+  if (config.dscp >= 0)
+    socket_set_dscp(fd, config.dscp, NULL, 0);
+
+  tcp_get_str_from_ip(source, buf, 50);
+
+  htsp = calloc(1, sizeof(htsp_connection_t));
+
+  TAILQ_INIT(&htsp->htsp_active_output_queues);
+  htsbuf_queue_init(&htsp->htsp_input, 0);
+
+  htsp_init_queue(&htsp->htsp_hmq_ctrl, 0);
+  htsp_init_queue(&htsp->htsp_hmq_qstatus, 1);
+
+  htsp->htsp_peername = strdup(buf);
+  htsp_update_logname(htsp);
+
+  htsp->htsp_fd = fd;
+  htsp->htsp_peer = source;
+  htsp->htsp_writer_run = 1;
+
+  htsp->htsp_writer_task.tt_run = htsp_write_scheduler;
+  htsp->htsp_writer_task.tt_opaque = htsp;
+  htsp->htsp_epg_sync_task.tt_run = htsp_epg_sync_run;
+  htsp->htsp_epg_sync_task.tt_opaque = htsp;
+
+  tvh_mutex_init(&htsp->htsp_out_mutex, NULL);
+  tvh_cond_init(&htsp->htsp_out_cond, 1);
+
+  LIST_INSERT_HEAD(&htsp_connections, htsp, htsp_link);
+
+  if (htsp_read_begin(htsp)) {
+    tvh_mutex_unlock(&global_lock);
+    htsp_serve_finish(htsp);
+    tvh_mutex_lock(&global_lock);
+    htsp = NULL;
+  }
+
+  *opaque = htsp;
+}
+
+static int
+htsp_serve_input(void *opaque)
+{
+  int r;
+
+  /* the reactor read the messages to the input queue */
+  while ((r = htsp_read_ready(opaque)) > 0)
+    if (htsp_read_message1(opaque))
+      return 1;
+  return r < 0;
+}
+
+static void
+htsp_serve_done(void *opaque)
+{
+  htsp_connection_t *htsp = opaque;
+
+  tvhinfo(LS_HTSP, "%s: Disconnected", htsp->htsp_logname);
+  htsp_serve_finish(htsp);
 }
 
 /*
@@ -3530,7 +4150,11 @@ htsp_init(const char *bindaddr)
   static tcp_server_ops_t ops = {
     .start  = htsp_serve,
     .stop   = NULL,
-    .cancel = htsp_server_cancel
+    .cancel = htsp_server_cancel,
+    .input  = htsp_serve_input,
+    .input_queue = htsp_read_queue,
+    .ready  = htsp_read_ready,
+    .finish = htsp_serve_done
   };
   if (tvheadend_htsp_port > 0)
     htsp_server = tcp_server_create(LS_HTSP, "HTSP", bindaddr, tvheadend_htsp_port, &ops, NULL);
@@ -3904,35 +4528,185 @@ htsp_epg_window_cb(void *aux)
 }
 
 /**
- * Send all waiting EPG events
+ * EPG sync
+ *
+ * The events are not queued all at once. A page of events is queued
+ * to the control queue and the next page is generated from the cursor
+ * (channel id, event start) when the writer drains the queue
+ * (htsp_epg_sync_check), so the memory is bounded and the other
+ * queues (streaming) are served meanwhile. The channels are walked in
+ * the channel tree order (unsigned id, see ch_id_cmp). The event
+ * notifications for the channels and times not reached by the cursor
+ * are skipped, the sync sends the current event data later. All EPG
+ * messages share the control queue, so they stay ordered with the
+ * channel and DVR notifications.
+ *
+ * A sync request while a sync is running is merged when the running
+ * walk already covers it (same or lower start time): the cursor is
+ * kept and the window end is caught up by the window timer. A request
+ * for older events restarts the walk from the first channel, the
+ * initialSyncCompleted notification is sent when the restarted walk
+ * is done.
  */
+static int
+htsp_ebc_start_cmp(const void *a, const void *b)
+{
+  int64_t x = ((epg_broadcast_t *)a)->start, y = ((epg_broadcast_t *)b)->start;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
 static void
-htsp_epg_send_waiting(htsp_connection_t *htsp, int64_t mintime)
+htsp_initial_sync_completed(htsp_connection_t *htsp)
 {
-  epg_broadcast_t *ebc;
-  channel_t *ch;
-  int64_t maxtime;
+  htsmsg_t *m = htsmsg_create_map();
+  htsmsg_add_str(m, "method", "initialSyncCompleted");
+  htsp_send_message(htsp, m, NULL);
+}
 
-  maxtime = gclk() + htsp->htsp_epg_window;
-  htsp->htsp_epg_lastupdate = maxtime;
+static int
+htsp_epg_sync_pending(htsp_connection_t *htsp, epg_broadcast_t *ebc)
+{
+  uint32_t id;
 
-  /* Push new events */
-  CHANNEL_FOREACH(ch) {
-    if (!htsp_user_access_channel(htsp, ch)) continue;
-    RB_FOREACH(ebc, &ch->ch_epg_schedule, sched_link) {
-      if (ebc->start <= mintime) continue;
-      if (htsp->htsp_epg_window && ebc->start > maxtime) break;
-      htsmsg_t *e = htsp_build_event(ebc, "eventAdd", htsp->htsp_language, 0, htsp);
-      if (e) htsp_send_message(htsp, e, NULL);
-    }
+  if (!htsp->htsp_epg_sync || ebc->start <= htsp->htsp_epg_sync_mintime)
+    return 0;
+  id = channel_get_id(ebc->channel);
+  return id > htsp->htsp_epg_sync_chid ||
+         (id == htsp->htsp_epg_sync_chid && ebc->start > htsp->htsp_epg_sync_start);
+}
+
+static void
+htsp_epg_sync_done(htsp_connection_t *htsp)
+{
+  htsp->htsp_epg_sync = 0;
+  if (htsp->htsp_epg_sync_initial) {
+    htsp->htsp_epg_sync_initial = 0;
+    htsp_initial_sync_completed(htsp);
   }
 
   /* Keep the epg window up to date */
-  if (htsp->htsp_epg_window)
+  if (htsp->htsp_epg_window && (htsp->htsp_async_mode & HTSP_ASYNC_EPG))
     mtimer_arm_rel(&htsp->htsp_epg_timer, htsp_epg_window_cb,
                    htsp, sec2mono(HTSP_ASYNC_EPG_INTERVAL));
 }
 
+static void
+htsp_epg_sync_page(htsp_connection_t *htsp)
+{
+  epg_broadcast_t *ebc, skel;
+  channel_t *ch;
+  htsp_event_batch_t heb;
+  htsmsg_t *e;
+  int n = 0;
+
+  lock_assert(&global_lock);
+
+  if (!(htsp->htsp_async_mode & HTSP_ASYNC_EPG)) {
+    htsp_epg_sync_done(htsp);
+    return;
+  }
+
+  htsp_epg_live_flush(htsp, 1);
+  if (htsp->htsp_epg_batch)
+    htsp_event_batch_init(&heb, 0);
+
+  for (ch = channel_find_by_id_ge(htsp->htsp_epg_sync_chid); ch;
+       ch = RB_NEXT(ch, ch_link)) {
+    if (channel_get_id(ch) != htsp->htsp_epg_sync_chid) {
+      htsp->htsp_epg_sync_chid = channel_get_id(ch);
+      htsp->htsp_epg_sync_start = htsp->htsp_epg_sync_mintime;
+    }
+    if (!htsp_user_access_channel(htsp, ch)) continue;
+    skel.start = htsp->htsp_epg_sync_start;
+    ebc = RB_FIND_GT(&ch->ch_epg_schedule, &skel, sched_link, htsp_ebc_start_cmp);
+    for ( ; ebc; ebc = RB_NEXT(ebc, sched_link)) {
+      if (htsp->htsp_epg_window && ebc->start > htsp->htsp_epg_sync_maxtime) break;
+      if (n >= HTSP_EPG_SYNC_EVENTS) {
+        if (htsp->htsp_epg_batch &&
+            (e = htsp_event_batch_finish(htsp, &heb)) != NULL)
+          htsp_send_message(htsp, e, NULL);
+        /* wait for the queue drain */
+        tvh_mutex_lock(&htsp->htsp_out_mutex);
+        htsp->htsp_epg_sync_wait = 1;
+        htsp_epg_sync_check(htsp);
+        tvh_mutex_unlock(&htsp->htsp_out_mutex);
+        return;
+      }
+      htsp->htsp_epg_sync_start = ebc->start;
+      if (htsp->htsp_epg_batch) {
+        htsp_event_batch_add(htsp, &heb, ebc);
+        n++;
+        continue;
+      }
+      e = htsp_build_event(ebc, "eventAdd", htsp->htsp_language, 0, htsp);
+      if (e) {
+        htsp_send_message(htsp, e, NULL);
+        n++;
+      }
+    }
+    /* the channel is complete */
+    if (channel_get_id(ch) == UINT32_MAX)
+      break;
+    htsp->htsp_epg_sync_chid = channel_get_id(ch) + 1;
+  }
+
+  if (htsp->htsp_epg_batch) {
+    e = htsp_event_batch_finish(htsp, &heb);
+    if (e)
+      htsp_send_message(htsp, e, NULL);
+  }
+  htsp_epg_sync_done(htsp);
+}
+
+/**
+ * The next page from the tcp worker pool
+ */
+static void
+htsp_epg_sync_run(void *aux)
+{
+  htsp_connection_t *htsp = aux;
+
+  tvh_mutex_lock(&global_lock);
+  if (htsp->htsp_epg_sync)
+    htsp_epg_sync_page(htsp);
+  tvh_mutex_unlock(&global_lock);
+
+  tvh_mutex_lock(&htsp->htsp_out_mutex);
+  htsp->htsp_epg_sync_busy = 0;
+  htsp_epg_sync_check(htsp);
+  tvh_cond_signal(&htsp->htsp_out_cond, 1);
+  tvh_mutex_unlock(&htsp->htsp_out_mutex);
+}
+
+/**
+ * Send all waiting EPG events (paged)
+ */
+static void
+htsp_epg_send_waiting(htsp_connection_t *htsp, int64_t mintime)
+{
+  int64_t maxtime;
+
+  if (htsp->htsp_epg_sync && mintime >= htsp->htsp_epg_sync_mintime) {
+    htsp->htsp_epg_lastupdate = htsp->htsp_epg_sync_maxtime;
+    return;
+  }
+
+  maxtime = gclk() + htsp->htsp_epg_window;
+  htsp->htsp_epg_lastupdate = maxtime;
+
+  mtimer_disarm(&htsp->htsp_epg_timer);
+  htsp->htsp_epg_sync = 1;
+  htsp->htsp_epg_sync_chid = 0;
+  htsp->htsp_epg_sync_start = mintime;
+  htsp->htsp_epg_sync_mintime = mintime;
+  htsp->htsp_epg_sync_maxtime = maxtime;
+  /* the first page when the queued channels are drained */
+  tvh_mutex_lock(&htsp->htsp_out_mutex);
+  htsp->htsp_epg_sync_wait = 1;
+  htsp_epg_sync_check(htsp);
+  tvh_mutex_unlock(&htsp->htsp_out_mutex);
+}
+
 /**
  * Called when a event entry is updated/added
  */
@@ -3945,10 +4719,20 @@ _htsp_event_update(epg_broadcast_t *ebc, const char *method, htsmsg_t *msg)
       /* Use last update instead of window time as we do not want to push an update
        * for an event we still have to send with "htsp_epg_window_cb" */
       if (!htsp->htsp_epg_window || ebc->start <= htsp->htsp_epg_lastupdate) {
-        if (htsp_user_access_channel(htsp,ebc->channel)) {
-          htsmsg_t *m = msg ? htsmsg_copy(msg)
-                          : htsp_build_event(ebc, method, htsp->htsp_language, 0, htsp);
-          htsp_send_message(htsp, m, NULL);
+        if (htsp_user_access_channel(htsp,ebc->channel) &&
+            !htsp_epg_sync_pending(htsp, ebc)) {
+          htsmsg_t *m;
+          if (msg) {
+            htsp_epg_live_flush(htsp, 1);
+            m = htsmsg_copy(msg);
+          } else if (htsp->htsp_epg_batch) {
+            htsp_epg_live_add(htsp, ebc, strcmp(method, "eventAdd") != 0);
+            continue;
+          } else {
+            m = htsp_build_event(ebc, method, htsp->htsp_language, 0, htsp);
+          }
+          if (m)
+            htsp_send_message(htsp, m, NULL);
         }
       }
     }
@@ -3980,7 +4764,12 @@ htsp_event_update(epg_broadcast_t *ebc)
 void
 htsp_event_delete(epg_broadcast_t *ebc)
 {
+  htsp_connection_t *htsp;
   htsmsg_t *m = htsmsg_create_map();
+
+  /* the event may be in the pending batch */
+  LIST_FOREACH(htsp, &htsp_async_connections, htsp_async_link)
+    htsp_epg_live_flush(htsp, 1);
   htsmsg_add_str(m, "method", "eventDelete");
   htsmsg_add_u32(m, "eventId", ebc->id);
   htsp_async_send(m, HTSP_ASYNC_EPG, ebc);
@@ -3992,6 +4781,94 @@ static const char frametypearray[PKT_NTYPES] = {
   [PKT_B_FRAME] = 'B',
 };
 
+/**
+ * muxpkt fast path
+ *
+ * The header is serialized directly to the htsmsg binary format, the
+ * bytes are same as htsmsg_binary_serialize() gives for the map built
+ * in htsp_stream_deliver(). The constant method field is precomputed,
+ * only the numeric fields are patched. The payload is not copied, the
+ * writer sends it from the packet buffer referenced by the message.
+ */
+#define HTSP_MUXPKT_HDR_MAX 192
+
+static const uint8_t htsp_muxpkt_method[] = {
+  HMF_STR, 6, 0, 0, 0, 6,
+  'm', 'e', 't', 'h', 'o', 'd',
+  'm', 'u', 'x', 'p', 'k', 't'
+};
+
+static inline uint8_t *
+htsp_muxpkt_field(uint8_t *p, int type, const char *name, int namelen,
+                  uint32_t len)
+{
+  p[0] = type;
+  p[1] = namelen;
+  p[2] = len >> 24;
+  p[3] = len >> 16;
+  p[4] = len >> 8;
+  p[5] = len;
+  memcpy(p + 6, name, namelen);
+  return p + 6 + namelen;
+}
+
+static inline uint8_t *
+htsp_muxpkt_s64(uint8_t *p, const char *name, int namelen, int64_t s64)
+{
+  uint64_t u64 = s64;
+  int l;
+
+  for (l = 0; u64; l++)
+    u64 >>= 8;
+  p = htsp_muxpkt_field(p, HMF_S64, name, namelen, l);
+  for (u64 = s64; l > 0; l--, u64 >>= 8)
+    *p++ = u64;
+  return p;
+}
+
+#define HTSP_MUXPKT_S64(p, name, val) \
+  htsp_muxpkt_s64((p), (name), sizeof(name) - 1, (val))
+
+static void
+htsp_muxpkt_send(htsp_subscription_t *hs, th_pkt_t *pkt, int video,
+                 int64_t pts, int64_t dts, uint32_t dur)
+{
+  pktbuf_t *pb = pkt->pkt_payload;
+  size_t payloadlen = pktbuf_len(pb);
+  htsp_msg_t *hm = malloc(sizeof(htsp_msg_t) + HTSP_MUXPKT_HDR_MAX);
+  uint8_t *p = hm->hm_hdr + 4;
+  uint32_t len;
+
+  memcpy(p, htsp_muxpkt_method, sizeof(htsp_muxpkt_method));
+  p += sizeof(htsp_muxpkt_method);
+  p = HTSP_MUXPKT_S64(p, "subscriptionId", (uint32_t)hs->hs_sid);
+  if (video)
+    p = HTSP_MUXPKT_S64(p, "frametype", (uint32_t)frametypearray[pkt->v.pkt_frametype]);
+  p = HTSP_MUXPKT_S64(p, "stream", (uint32_t)pkt->pkt_componentindex);
+  p = HTSP_MUXPKT_S64(p, "com", (uint32_t)pkt->pkt_commercial);
+  if (pts != PTS_UNSET)
+    p = HTSP_MUXPKT_S64(p, "pts", pts);
+  if (dts != PTS_UNSET)
+    p = HTSP_MUXPKT_S64(p, "dts", dts);
+  p = HTSP_MUXPKT_S64(p, "duration", dur);
+  p = htsp_muxpkt_field(p, HMF_BIN, "payload", 7, payloadlen);
+
+  hm->hm_hdrlen = p - hm->hm_hdr;
+  assert(hm->hm_hdrlen <= HTSP_MUXPKT_HDR_MAX);
+  len = hm->hm_hdrlen - 4 + payloadlen;
+  hm->hm_hdr[0] = len >> 24;
+  hm->hm_hdr[1] = len >> 16;
+  hm->hm_hdr[2] = len >> 8;
+  hm->hm_hdr[3] = len;
+
+  hm->hm_msg = NULL;
+  hm->hm_pb = pb;
+  pktbuf_ref_inc(pb);
+  hm->hm_payloadsize = payloadlen;
+  hm->hm_dts = dts;
+  htsp_send_queue(hs->hs_htsp, hm, &hs->hs_q);
+}
+
 /**
  * Build a htsmsg from a th_pkt and enqueue it on our HTSP service
  */
@@ -4001,9 +4878,10 @@ htsp_stream_deliver(htsp_subscription_t *hs, th_pkt_t *pkt)
   htsmsg_t *m;
   htsp_msg_t *hm;
   htsp_connection_t *htsp = hs->hs_htsp;
-  int64_t ts;
+  int64_t ts, pts = PTS_UNSET, dts = PTS_UNSET;
   int qlen = hs->hs_q.hmq_payload;
   int video = SCT_ISVIDEO(pkt->pkt_type);
+  uint32_t dur;
   size_t payloadlen;
 
   if (pkt->pkt_err)
@@ -4029,36 +4907,41 @@ htsp_stream_deliver(htsp_subscription_t *hs, th_pkt_t *pkt)
     return;
   }
 
-  m = htsmsg_create_map();
- 
-  htsmsg_add_str(m, "method", "muxpkt");
-  htsmsg_add_u32(m, "subscriptionId", hs->hs_sid);
-  if (video)
-    htsmsg_add_u32(m, "frametype", frametypearray[pkt->v.pkt_frametype]);
+  if(pkt->pkt_pts != PTS_UNSET)
+    pts = hs->hs_90khz ? pkt->pkt_pts : ts_rescale(pkt->pkt_pts, 1000000);
+  if(pkt->pkt_dts != PTS_UNSET)
+    dts = hs->hs_90khz ? pkt->pkt_dts : ts_rescale(pkt->pkt_dts, 1000000);
+  dur = hs->hs_90khz ? pkt->pkt_duration : ts_rescale(pkt->pkt_duration, 1000000);
+  payloadlen = pktbuf_len(pkt->pkt_payload);
+
+  if (!tvhtrace_enabled()) {
+    htsp_muxpkt_send(hs, pkt, video, pts, dts, dur);
+  } else {
+    /* the traced messages use htsmsg */
+    m = htsmsg_create_map();
 
-  htsmsg_add_u32(m, "stream", pkt->pkt_componentindex);
-  htsmsg_add_u32(m, "com", pkt->pkt_commercial);
+    htsmsg_add_str(m, "method", "muxpkt");
+    htsmsg_add_u32(m, "subscriptionId", hs->hs_sid);
+    if (video)
+      htsmsg_add_u32(m, "frametype", frametypearray[pkt->v.pkt_frametype]);
 
-  if(pkt->pkt_pts != PTS_UNSET) {
-    int64_t pts = hs->hs_90khz ? pkt->pkt_pts : ts_rescale(pkt->pkt_pts, 1000000);
-    htsmsg_add_s64(m, "pts", pts);
-  }
+    htsmsg_add_u32(m, "stream", pkt->pkt_componentindex);
+    htsmsg_add_u32(m, "com", pkt->pkt_commercial);
 
-  if(pkt->pkt_dts != PTS_UNSET) {
-    int64_t dts = hs->hs_90khz ? pkt->pkt_dts : ts_rescale(pkt->pkt_dts, 1000000);
-    htsmsg_add_s64(m, "dts", dts);
-  }
+    if(pts != PTS_UNSET)
+      htsmsg_add_s64(m, "pts", pts);
+    if(dts != PTS_UNSET)
+      htsmsg_add_s64(m, "dts", dts);
 
-  uint32_t dur = hs->hs_90khz ? pkt->pkt_duration : ts_rescale(pkt->pkt_duration, 1000000);
-  htsmsg_add_u32(m, "duration", dur);
-  
-  /**
-   * Since we will serialize directly we use 'binptr' which is a binary
-   * object that just points to data, thus avoiding a copy.
-   */
-  payloadlen = pktbuf_len(pkt->pkt_payload);
-  htsmsg_add_bin_ptr(m, "payload", pktbuf_ptr(pkt->pkt_payload), payloadlen);
-  htsp_send_subscription(htsp, m, pkt->pkt_payload, hs, payloadlen);
+    htsmsg_add_u32(m, "duration", dur);
+
+    /**
+     * Since we will serialize directly we use 'binptr' which is a binary
+     * object that just points to data, thus avoiding a copy.
+     */
+    htsmsg_add_bin_ptr(m, "payload", pktbuf_ptr(pkt->pkt_payload), payloadlen);
+    htsp_send_subscription(htsp, m, pkt->pkt_payload, hs, payloadlen);
+  }
   atomic_add(&hs->hs_s_bytes_out, payloadlen);
 
   if(mono2sec(hs->hs_last_report) != mono2sec(mclk())) {
@@ -4084,10 +4967,12 @@ htsp_stream_deliver(htsp_subscription_t *hs, th_pkt_t *pkt)
     int64_t min_dts = PTS_UNSET;
     int64_t max_dts = PTS_UNSET;
     TAILQ_FOREACH(hm, &hs->hs_q.hmq_q, hm_link) {
-      if(!hm->hm_msg)
-	continue;
-      if(htsmsg_get_s64(hm->hm_msg, "dts", &ts))
-	continue;
+      if(hm->hm_msg) {
+        if(htsmsg_get_s64(hm->hm_msg, "dts", &ts))
+	  continue;
+      } else {
+        ts = hm->hm_dts;
+      }
       if(ts == PTS_UNSET)
 	continue;
   
@@ -4469,9 +5354,15 @@ htsp_streaming_input(void *opaque, streaming_message_t *sm)
     if (!hs->hs_first)
       tvhdebug(LS_HTSP, "%s - first packet", hs->hs_htsp->htsp_logname);
     hs->hs_first = 1;
-    htsp_stream_deliver(hs, sm->sm_data);
-    // reference is transfered
-    sm->sm_data = NULL;
+    if (sm->sm_refcount == 1) {
+      htsp_stream_deliver(hs, sm->sm_data);
+      // reference is transfered
+      sm->sm_data = NULL;
+    } else {
+      // shared message (read-only)
+      pkt_ref_inc(sm->sm_data);
+      htsp_stream_deliver(hs, sm->sm_data);
+    }
     break;
 
   case SMT_START:
@@ -4533,7 +5424,18 @@ htsp_streaming_input_info(void *opaque, htsmsg_t *list)
 {
   char buf[512];
   htsp_subscription_t *hs = opaque;
-  snprintf(buf, sizeof(buf), "htsp input: %s", hs->hs_htsp->htsp_logname);
+  htsp_connection_t *htsp = hs->hs_htsp;
+  uint64_t calls, msgs, bytes;
+
+  snprintf(buf, sizeof(buf), "htsp input: %s", htsp->htsp_logname);
+  htsmsg_add_str(list, NULL, buf);
+  tvh_mutex_lock(&htsp->htsp_out_mutex);
+  calls = htsp->htsp_write_calls;
+  msgs = htsp->htsp_write_msgs;
+  bytes = htsp->htsp_write_bytes;
+  tvh_mutex_unlock(&htsp->htsp_out_mutex);
+  snprintf(buf, sizeof(buf), "htsp output: %"PRIu64" writes, %"PRIu64" msgs, "
+           "%"PRIu64" bytes/write", calls, msgs, calls ? bytes / calls : 0);
   htsmsg_add_str(list, NULL, buf);
   return list;
 }
@@ -1910,130 +1910,148 @@ http_parse_args(http_arg_list_t *list, char *args)
  *
  */
 void
-http_serve_requests(http_connection_t *hc)
+http_serve_begin(http_connection_t *hc, htsbuf_queue_t *spill)
 {
-  htsbuf_queue_t spill;
-  char *argv[3], *c, *s, *cmdline = NULL, *hdrline = NULL;
-  int n, r, delim;
-
   tvh_mutex_init(&hc->hc_extra_lock, NULL);
   http_arg_init(&hc->hc_args);
   http_arg_init(&hc->hc_req_args);
-  htsbuf_queue_init(&spill, 0);
+  htsbuf_queue_init(spill, 0);
   htsbuf_queue_init(&hc->hc_reply, 0);
   htsbuf_queue_init(&hc->hc_extra, 0);
   atomic_set(&hc->hc_extra_insend, 0);
   atomic_set(&hc->hc_extra_chunks, 0);
+}
 
-  do {
-    hc->hc_no_output  = 0;
-
-    if (cmdline) free(cmdline);
+/**
+ * Read and process one request, returns non-zero when the connection
+ * should be closed
+ */
+int
+http_serve_request(http_connection_t *hc, htsbuf_queue_t *spill)
+{
+  char *argv[3], *c, *s, *cmdline = NULL, *hdrline = NULL;
+  int n, r = 1, delim;
 
-    if ((cmdline = tcp_read_line(hc->hc_fd, &spill)) == NULL)
-      goto error;
+  hc->hc_no_output  = 0;
 
-    /* PROXY Protocol v1 support
-     * Format: 'PROXY TCP4 192.168.0.1 192.168.0.11 56324 9981\r\n'
-     *                     SRC-ADDRESS DST-ADDRESS  SPORT DPORT */
-    if (config.proxy && strncmp(cmdline, "PROXY ", 6) == 0) {
-      tvhtrace(hc->hc_subsys, "[PROXY] PROXY protocol detected! cmdline='%s'", cmdline);
-
-      argv[0] = cmdline;
-      s = cmdline + 6;
-
-      if ((cmdline = tcp_read_line(hc->hc_fd, &spill)) == NULL)
-        goto error;  /* No more data after the PROXY protocol */
-        
-      delim = '.';
-      if (strncmp(s, "TCP6 ", 5) == 0) {
-        delim = ':';
-      } else if (strncmp(s, "TCP4 ", 5) != 0) {
-        goto error;
-      }
+  if ((cmdline = tcp_read_line(hc->hc_fd, spill)) == NULL)
+    goto error;
 
-      s += 5;
+  /* PROXY Protocol v1 support
+   * Format: 'PROXY TCP4 192.168.0.1 192.168.0.11 56324 9981\r\n'
+   *                     SRC-ADDRESS DST-ADDRESS  SPORT DPORT */
+  if (config.proxy && strncmp(cmdline, "PROXY ", 6) == 0) {
+    tvhtrace(hc->hc_subsys, "[PROXY] PROXY protocol detected! cmdline='%s'", cmdline);
 
-      /* Check the SRC-ADDRESS */
-      for (c = s; *c != ' '; c++) {
-        if (*c == '\0') goto error;  /* Incomplete PROXY format */
-        if (*c != delim && (*c < '0' || *c > '9')) {
-          if (delim == ':') {
-            if (*c >= 'a' && *c <= 'f') continue;
-            if (*c >= 'A' && *c <= 'F') continue;
-          }
-          goto error;  /* Not valid IP address */
-        }
-      }
-      if (*c != ' ') goto error;
-      /* Check length */
-      if ((c-s) < 7) goto error;
-      if ((c-s) > (delim == ':' ? 45 : 15)) goto error;
-      
-      /* Add null terminator */
-      *c = '\0';
+    argv[0] = cmdline;
+    s = cmdline + 6;
 
-      /* Don't care about DST-ADDRESS, SRC-PORT & DST-PORT
-         All it's OK, push the original client IP */
-      tvhtrace(hc->hc_subsys, "[PROXY] Original source='%s'", s);
-      http_arg_set(&hc->hc_args, "X-Forwarded-For", s);
+    if ((cmdline = tcp_read_line(hc->hc_fd, spill)) == NULL) {
       free(argv[0]);
+      goto error;  /* No more data after the PROXY protocol */
     }
 
-    if((n = http_tokenize(cmdline, argv, 3, -1)) != 3)
-      goto error;
-    
-    if((hc->hc_cmd = str2val(argv[0], HTTP_cmdtab)) == -1)
+    delim = '.';
+    if (strncmp(s, "TCP6 ", 5) == 0) {
+      delim = ':';
+    } else if (strncmp(s, "TCP4 ", 5) != 0) {
+      free(argv[0]);
       goto error;
+    }
 
-    hc->hc_url = argv[1];
-    if((hc->hc_version = str2val(argv[2], HTTP_versiontab)) == -1)
-      goto error;
+    s += 5;
 
-    /* parse header */
-    while(1) {
-      if (hdrline) free(hdrline);
+    /* Check the SRC-ADDRESS */
+    for (c = s; *c != ' '; c++) {
+      if (*c == '\0') goto proxy_error;  /* Incomplete PROXY format */
+      if (*c != delim && (*c < '0' || *c > '9')) {
+        if (delim == ':') {
+          if (*c >= 'a' && *c <= 'f') continue;
+          if (*c >= 'A' && *c <= 'F') continue;
+        }
+        goto proxy_error;  /* Not valid IP address */
+      }
+    }
+    if (*c != ' ') goto proxy_error;
+    /* Check length */
+    if ((c-s) < 7) goto proxy_error;
+    if ((c-s) > (delim == ':' ? 45 : 15)) goto proxy_error;
+
+    /* Add null terminator */
+    *c = '\0';
+
+    /* Don't care about DST-ADDRESS, SRC-PORT & DST-PORT
+       All it's OK, push the original client IP */
+    tvhtrace(hc->hc_subsys, "[PROXY] Original source='%s'", s);
+    http_arg_set(&hc->hc_args, "X-Forwarded-For", s);
+    free(argv[0]);
+  }
 
-      if ((hdrline = tcp_read_line(hc->hc_fd, &spill)) == NULL)
-        goto error;
+  if((n = http_tokenize(cmdline, argv, 3, -1)) != 3)
+    goto error;
 
-      if(!*hdrline)
-        break; /* header complete */
+  if((hc->hc_cmd = str2val(argv[0], HTTP_cmdtab)) == -1)
+    goto error;
 
-      if((n = http_tokenize(hdrline, argv, 2, -1)) < 2) {
-        if ((c = strchr(hdrline, ':')) != NULL) {
-          *c = '\0';
-          argv[0] = hdrline;
-          argv[1] = c + 1;
-        } else {
-          continue;
-        }
-      } else if((c = strrchr(argv[0], ':')) == NULL)
-        goto error;
+  hc->hc_url = argv[1];
+  if((hc->hc_version = str2val(argv[2], HTTP_versiontab)) == -1)
+    goto error;
 
-      *c = 0;
-      http_arg_set(&hc->hc_args, argv[0], argv[1]);
-    }
+  /* parse header */
+  while(1) {
+    if (hdrline) free(hdrline);
 
-    r = process_request(hc, &spill);
+    if ((hdrline = tcp_read_line(hc->hc_fd, spill)) == NULL)
+      goto error;
 
-    free(hc->hc_post_data);
-    hc->hc_post_data = NULL;
+    if(!*hdrline)
+      break; /* header complete */
 
-    http_arg_flush(&hc->hc_args);
-    http_arg_flush(&hc->hc_req_args);
+    if((n = http_tokenize(hdrline, argv, 2, -1)) < 2) {
+      if ((c = strchr(hdrline, ':')) != NULL) {
+        *c = '\0';
+        argv[0] = hdrline;
+        argv[1] = c + 1;
+      } else {
+        continue;
+      }
+    } else if((c = strrchr(argv[0], ':')) == NULL)
+      goto error;
 
-    htsbuf_queue_flush(&hc->hc_reply);
+    *c = 0;
+    http_arg_set(&hc->hc_args, argv[0], argv[1]);
+  }
 
-    if (r)
-      break;
+  r = process_request(hc, spill);
+
+  free(hc->hc_post_data);
+  hc->hc_post_data = NULL;
 
-  } while(hc->hc_keep_alive && atomic_get(&http_server_running));
+  http_arg_flush(&hc->hc_args);
+  http_arg_flush(&hc->hc_req_args);
+
+  htsbuf_queue_flush(&hc->hc_reply);
+
+  if (!r && (!hc->hc_keep_alive || !atomic_get(&http_server_running)))
+    r = 1;
 
 error:
   free(hdrline);
   free(cmdline);
-  htsbuf_queue_flush(&spill);
+  return r;
+
+proxy_error:
+  free(argv[0]);
+  goto error;
+}
+
+/**
+ *
+ */
+void
+http_serve_end(http_connection_t *hc, htsbuf_queue_t *spill)
+{
+  htsbuf_queue_flush(spill);
   htsbuf_queue_flush(&hc->hc_extra);
 
   free(hc->hc_nonce);
@@ -2043,36 +2061,167 @@ error:
   free(hc->hc_local_ip);
 }
 
-
 /**
  *
  */
+void
+http_serve_requests(http_connection_t *hc)
+{
+  htsbuf_queue_t spill;
+
+  http_serve_begin(hc, &spill);
+  while (!http_serve_request(hc, &spill));
+  http_serve_end(hc, &spill);
+}
+
+
+/*
+ * Event driven HTTP connection (see tcp_server_ops_t)
+ */
+typedef struct http_server_conn {
+  http_connection_t hsc_hc;     /* first, opaque for http_cancel */
+  htsbuf_queue_t    hsc_spill;
+  size_t            hsc_scan;   /* bytes checked for the header end */
+  int               hsc_eol;    /* 1 = after '\n', 2 = after "\n\r" */
+  size_t            hsc_need;   /* complete request size, 0 = unknown */
+} http_server_conn_t;
+
 static void
 http_serve(int fd, void **opaque, struct sockaddr_storage *peer, 
 	   struct sockaddr_storage *self)
 {
-  http_connection_t hc;
+  http_server_conn_t *hsc = calloc(1, sizeof(*hsc));
+  http_connection_t *hc = &hsc->hsc_hc;
 
   /* Note: global_lock held on entry */
-  tvh_mutex_unlock(&global_lock);
-  memset(&hc, 0, sizeof(http_connection_t));
-  *opaque = &hc;
+  hc->hc_subsys  = LS_HTTP;
+  hc->hc_fd      = fd;
+  hc->hc_peer    = peer;
+  hc->hc_self    = self;
+  hc->hc_paths   = &http_paths;
+  hc->hc_paths_mutex = &http_paths_mutex;
+  hc->hc_process = http_process_request;
 
-  hc.hc_subsys  = LS_HTTP;
-  hc.hc_fd      = fd;
-  hc.hc_peer    = peer;
-  hc.hc_self    = self;
-  hc.hc_paths   = &http_paths;
-  hc.hc_paths_mutex = &http_paths_mutex;
-  hc.hc_process = http_process_request;
+  http_serve_begin(hc, &hsc->hsc_spill);
+  *opaque = hsc;
+}
 
-  http_serve_requests(&hc);
+/*
+ * Complete request check - the header block and the POST data
+ *
+ * Only the bytes received since the last check are scanned for the
+ * header end, the state is reset when a request is consumed.
+ */
+#define HTTP_HEADER_MAX (64 * 1024)
 
-  close(fd);
+static size_t
+http_input_header_end(http_server_conn_t *hsc)
+{
+  htsbuf_data_t *hd;
+  size_t skip = hsc->hsc_scan, l;
+  uint8_t *p, *e, *nl;
+
+  TAILQ_FOREACH(hd, &hsc->hsc_spill.hq_q, hd_link) {
+    l = hd->hd_data_len - hd->hd_data_off;
+    if (skip >= l) {
+      skip -= l;
+      continue;
+    }
+    p = hd->hd_data + hd->hd_data_off + skip;
+    e = hd->hd_data + hd->hd_data_len;
+    skip = 0;
+    while (p < e) {
+      if (hsc->hsc_eol == 0) {
+        if ((nl = memchr(p, '\n', e - p)) == NULL) {
+          hsc->hsc_scan += e - p;
+          break;
+        }
+        hsc->hsc_scan += nl + 1 - p;
+        p = nl + 1;
+        hsc->hsc_eol = 1;
+        continue;
+      }
+      hsc->hsc_scan++;
+      if (*p == '\n')
+        return hsc->hsc_scan;
+      hsc->hsc_eol = *p == '\r' && hsc->hsc_eol == 1 ? 2 : 0;
+      p++;
+    }
+    if (hsc->hsc_scan >= HTTP_HEADER_MAX)
+      break;
+  }
+  return 0;
+}
 
-  // Note: leave global_lock held for parent
-  tvh_mutex_lock(&global_lock);
-  *opaque = NULL;
+static int
+http_input_ready(void *opaque)
+{
+  http_server_conn_t *hsc = opaque;
+  size_t len = tcp_input_queued(&hsc->hsc_spill), hlen, clen = 0;
+  char *buf, *p, *end, *cmd;
+
+  if (len == 0)
+    return 0;
+  if (hsc->hsc_need)
+    return len >= hsc->hsc_need;
+  if ((hlen = http_input_header_end(hsc)) == 0)
+    return hsc->hsc_scan >= HTTP_HEADER_MAX ? -1 : 0;
+  hsc->hsc_need = hlen;
+
+  /* the POST data length */
+  buf = malloc(hlen + 1);
+  htsbuf_peek(&hsc->hsc_spill, buf, hlen);
+  buf[hlen] = '\0';
+  end = buf + hlen;
+  cmd = buf;
+  if (strncmp(cmd, "PROXY ", 6) == 0 && (cmd = strchr(cmd, '\n')) != NULL)
+    cmd++;
+  if (cmd && strncmp(cmd, "POST ", 5) == 0) {
+    for (p = cmd; (p = memchr(p, '\n', end - p)) != NULL && ++p < end; )
+      if (strncasecmp(p, "Content-Length:", 15) == 0) {
+        clen = strtoul(p + 15, NULL, 10);
+        break;
+      }
+    /* the big POST data are refused in http_cmd_post */
+    if (clen > 16 * 1024 * 1024)
+      clen = 0;
+  }
+  free(buf);
+  hsc->hsc_need += clen;
+  return len >= hsc->hsc_need;
+}
+
+static htsbuf_queue_t *
+http_input_queue(void *opaque)
+{
+  http_server_conn_t *hsc = opaque;
+  return &hsc->hsc_spill;
+}
+
+static int
+http_input(void *opaque)
+{
+  http_server_conn_t *hsc = opaque;
+  int r;
+
+  /* the reactor read the requests to the spill queue */
+  while ((r = http_input_ready(hsc)) > 0) {
+    if (http_serve_request(&hsc->hsc_hc, &hsc->hsc_spill))
+      return 1;
+    hsc->hsc_scan = hsc->hsc_need = 0;
+    hsc->hsc_eol = 0;
+  }
+  return r < 0;
+}
+
+static void
+http_finish(void *opaque)
+{
+  http_server_conn_t *hsc = opaque;
+
+  http_serve_end(&hsc->hsc_hc, &hsc->hsc_spill);
+  tvh_mutex_destroy(&hsc->hsc_hc.hc_extra_lock);
+  free(hsc);
 }
 
 void
@@ -2095,7 +2244,11 @@ http_server_init(const char *bindaddr)
   static tcp_server_ops_t ops = {
     .start  = http_serve,
     .stop   = NULL,
-    .cancel = http_cancel
+    .cancel = http_cancel,
+    .input  = http_input,
+    .input_queue = http_input_queue,
+    .ready  = http_input_ready,
+    .finish = http_finish
   };
   RB_INIT(&http_nonces);
   if (tvheadend_webui_port > 0) {
@@ -289,6 +289,12 @@ int http_websocket_read(http_connection_t *hc, htsmsg_t **_res, int timeout);
 
 void http_serve_requests(http_connection_t *hc);
 
+void http_serve_begin(http_connection_t *hc, htsbuf_queue_t *spill);
+
+int http_serve_request(http_connection_t *hc, htsbuf_queue_t *spill);
+
+void http_serve_end(http_connection_t *hc, htsbuf_queue_t *spill);
+
 void http_cancel(void *opaque);
 
 int http_check_local_ip(http_connection_t *hc);
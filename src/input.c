@@ -143,10 +143,15 @@ tvh_input_stream_create_msg
   htsmsg_add_u32(m, "bps", st->stats.bps);
   htsmsg_add_u32(m, "te", st->stats.te);
   htsmsg_add_u32(m, "cc", st->stats.cc);
+  htsmsg_add_u32(m, "scrambled", st->stats.scrambled);
   htsmsg_add_u32(m, "ec_bit", st->stats.ec_bit);
   htsmsg_add_u32(m, "tc_bit", st->stats.tc_bit);
   htsmsg_add_u32(m, "ec_block", st->stats.ec_block);
   htsmsg_add_u32(m, "tc_block", st->stats.tc_block);
+  if (st->queue_hwm > 0) {
+    htsmsg_add_s64(m, "queue_hwm", st->queue_hwm);
+    htsmsg_add_u32(m, "queue_drops", st->queue_drops);
+  }
   return m;
 }
 
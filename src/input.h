@@ -55,6 +55,7 @@ struct tvh_input_stream_stats
   int bps;    ///< bandwidth (bps)
   int cc;     ///< number of continuity errors
   int te;     ///< number of transport errors
+  int scrambled; ///< number of scrambled packets
 
   signal_status_scale_t signal_scale;
   signal_status_scale_t snr_scale;
@@ -80,6 +81,9 @@ struct tvh_input_stream {
 
   struct mpegts_apids *pids; ///< active PID list
 
+  int64_t queue_hwm;  ///< input queue high-water mark (bytes)
+  int     queue_drops;///< dropped input chunks (queue full)
+
   tvh_input_stream_stats_t stats;
 };
 
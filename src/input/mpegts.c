@@ -22,6 +22,7 @@
 
 extern memoryinfo_t mpegts_input_queue_memoryinfo;
 extern memoryinfo_t mpegts_input_table_memoryinfo;
+extern memoryinfo_t mpegts_input_pool_memoryinfo;
 
 void
 mpegts_init ( int linuxdvb_mask, int nosatip, str_list_t *satip_client,
@@ -37,6 +38,10 @@ mpegts_init ( int linuxdvb_mask, int nosatip, str_list_t *satip_client,
   /* Memory info */
   memoryinfo_register(&mpegts_input_queue_memoryinfo);
   memoryinfo_register(&mpegts_input_table_memoryinfo);
+  memoryinfo_register(&mpegts_input_pool_memoryinfo);
+
+  /* Demux workers */
+  mpegts_demux_init();
 
   /* FastScan init */
   dvb_fastscan_init();
@@ -111,6 +116,7 @@ mpegts_done ( void )
 #if ENABLE_TSFILE
   tvhftrace(LS_MAIN, tsfile_done);
 #endif
+  tvhftrace(LS_MAIN, mpegts_demux_done);
   dvb_fastscan_done();
 }
 
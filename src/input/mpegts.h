@@ -37,6 +37,7 @@
 #define MPEGTS_FULLMUX_PID      0x2000
 #define MPEGTS_TABLES_PID       0x2001
 #define MPEGTS_PID_NONE         0xFFFF
+#define MPEGTS_PID_MAP_SIZE     (MPEGTS_TABLES_PID + 1)
 
 /* Types */
 typedef struct mpegts_apid          mpegts_apid_t;
@@ -124,15 +125,86 @@ int mpegts_pid_dump ( mpegts_apids_t *pids, char *buf, int len, int wflag, int r
  * Data / SI processing
  * *************************************************************************/
 
+#define MPEGTS_PACKET_CHUNK       (348*188) /* pooled chunk payload (~64kB) */
+#define MPEGTS_PACKET_CLASSES      3        /* chunk sizes: 1/4, 1/2, 1 */
+#define MPEGTS_PACKET_POOL_IDLE    16       /* idle chunks kept per input */
+#define MPEGTS_INPUT_QUEUE_MAX     (50*1024*1024)
+/*
+ * The input data are usually queued in at least 100 TS packets (except
+ * the slow streams, once per second), so the queue is limited by the
+ * queued bytes (MPEGTS_INPUT_QUEUE_MAX). The chunks might be smaller
+ * (5 packets - MIN_TS_SYN - after a sync loss, the tail of a split read
+ * or the CC restart even less), then the slot count is the effective
+ * limit (4095 chunks, about 3.8MB with 5 packet chunks).
+ */
+#define MPEGTS_INPUT_RING_SIZE     4096     /* must be power of two */
+
 struct mpegts_packet
 {
-  TAILQ_ENTRY(mpegts_packet)  mp_link;
+  TAILQ_ENTRY(mpegts_packet)  mp_link;  // pool idle list
+  pktbuf_t                    mp_pb;    // refcount, shares mp_data
+  struct mpegts_packet_pool  *mp_pool;
   size_t                      mp_len;
+  size_t                      mp_size;  // allocated payload
+  int                         mp_class;
   mpegts_mux_t               *mp_mux;
+  int                         mp_mux_gen;
   uint8_t                     mp_cc_restart;
   uint8_t                     mp_data[0];
 };
 
+mpegts_packet_t *mpegts_packet_alloc ( mpegts_input_t *mi, size_t len );
+
+static inline void mpegts_packet_release ( mpegts_packet_t *mp )
+  { pktbuf_ref_dec(&mp->mp_pb); }
+
+/*
+ * Service delivery batches - the runs for all services from one input
+ * chunk are collected and delivered per service (one s_stream_mutex lock
+ * per service and chunk), either inline or in the demux workers
+ *
+ * The items are chained per service (group) when added, so the delivery
+ * walks only the items of the service
+ */
+typedef struct mpegts_demux_item {
+  uint64_t                    mdi_tspos;
+  const uint8_t              *mdi_tsb;     // points to the job chunk
+  int                         mdi_len;
+  int                         mdi_next;    // next item of the group, -1 = end
+  uint16_t                    mdi_pid;
+  uint8_t                     mdi_table;
+  uint8_t                     mdi_raw;
+} mpegts_demux_item_t;
+
+typedef struct mpegts_demux_group {
+  service_t                  *mdg_service; // referenced (worker jobs only)
+  int                         mdg_first;
+  int                         mdg_last;
+} mpegts_demux_group_t;
+
+typedef struct mpegts_demux_job {
+  TAILQ_ENTRY(mpegts_demux_job) mdj_link;
+  mpegts_packet_t            *mdj_packet;  // referenced, NULL = inline
+  mpegts_demux_item_t        *mdj_items;
+  int                         mdj_count;
+  int                         mdj_alloc;
+  mpegts_demux_group_t       *mdj_groups;
+  int                         mdj_gcount;
+  int                         mdj_galloc;
+} mpegts_demux_job_t;
+
+void mpegts_demux_init ( void );
+void mpegts_demux_done ( void );
+int  mpegts_demux_assign ( void );
+void mpegts_demux_unassign ( int index );
+mpegts_demux_job_t *mpegts_demux_job_create ( mpegts_packet_t *mp );
+void mpegts_demux_job_add
+  ( mpegts_demux_job_t *mdj, service_t *s, uint64_t tspos,
+    uint16_t pid, const uint8_t *tsb, int len, int table, int raw );
+void mpegts_demux_job_submit ( int index, mpegts_demux_job_t *mdj );
+void mpegts_demux_job_run ( mpegts_demux_job_t *mdj );
+htsmsg_t *mpegts_demux_status ( void );
+
 struct mpegts_pcr {
   int64_t  pcr_first;
   int64_t  pcr_last;
@@ -207,6 +279,22 @@ typedef struct mpegts_pid
   RB_ENTRY(mpegts_pid)     mp_link;
 } mpegts_pid_t;
 
+/*
+ * Subscribed tables for one PID (dispatch), valid for mm_table_snaps_gen
+ */
+typedef struct mpegts_table_snap
+{
+  LIST_ENTRY(mpegts_table_snap) mts_link;
+  int                      mts_pid;
+  int                      mts_fast;
+  int                      mts_count;
+  struct mpegts_table     *mts_tables[0]; // referenced
+} mpegts_table_snap_t;
+
+LIST_HEAD(mpegts_table_snap_list, mpegts_table_snap);
+
+#define MPEGTS_TABLE_SNAP_MAP_SIZE (2 * 0x2000) /* pid * 2 + fast */
+
 struct mpegts_table
 {
   mpegts_psi_table_t;
@@ -493,15 +581,21 @@ struct mpegts_mux
    */
 
   uint64_t                    mm_input_pos;
+  int                         mm_input_gen; // bumped on input queue flush
+  int                         mm_demux_worker; // -1 = input thread
   RB_HEAD(, mpegts_pid)       mm_pids;
+  mpegts_pid_t              **mm_pid_map; // direct index, MPEGTS_PID_MAP_SIZE
   LIST_HEAD(, mpegts_pid_sub) mm_all_subs;
-  int                         mm_last_pid;
-  mpegts_pid_t               *mm_last_mp;
 
   int                         mm_num_tables;
   LIST_HEAD(, mpegts_table)   mm_tables;
   TAILQ_HEAD(, mpegts_table)  mm_defer_tables;
   tvh_mutex_t                 mm_tables_lock;
+  int                         mm_tables_gen; // bumped on table list change
+  struct mpegts_table_snap_list mm_table_snaps;
+  mpegts_table_snap_t       **mm_table_snap_map; // direct index, MPEGTS_TABLE_SNAP_MAP_SIZE
+  int                         mm_table_snaps_gen; // mm_tables_gen of the snaps
+  tvh_mutex_t                 mm_table_snaps_lock;
   TAILQ_HEAD(, mpegts_table)  mm_table_queue;
 
   LIST_HEAD(, caid)           mm_descrambler_caids;
@@ -622,6 +716,12 @@ struct mpegts_service
   mpegts_table_t *s_pmt_mon; ///< Table entry for monitoring PMT
   mpegts_table_t *s_cat_mon; ///< Table entry for monitoring CAT
 
+  /**
+   * Group in the demux job being built (input thread only, the index
+   * is valid when the group points to this service)
+   */
+  int s_demux_group;
+
 };
 
 /* **************************************************************************
@@ -700,13 +800,20 @@ struct mpegts_input
   int64_t mi_last_dispatch;
 
   /* Data input */
-  // Note: this section is protected by mi_input_lock
+  // Note: this section is protected by mi_input_lock (producer side),
+  //       the input thread pops from the ring without the lock
   pthread_t                       mi_input_tid;
   mtimer_t                        mi_input_thread_start;
   tvh_mutex_t                     mi_input_lock;
   tvh_cond_t                      mi_input_cond;
-  TAILQ_HEAD(,mpegts_packet)      mi_input_queue;
-  uint64_t                        mi_input_queue_size;
+  mpegts_packet_t               **mi_input_ring;
+  int                             mi_input_ring_head;
+  int                             mi_input_ring_tail;
+  int                             mi_input_sleeping;
+  struct mpegts_packet_pool      *mi_packet_pool;
+  int64_t                         mi_input_queue_size;
+  int64_t                         mi_input_queue_hwm;
+  int                             mi_input_queue_drops;
   tvhlog_limit_t                  mi_input_queue_loglimit;
   qprofile_t                      mi_qprofile;
   int                             mi_remove_scrambled_bits;
@@ -716,6 +823,9 @@ struct mpegts_input
   //       data fields (excluding the callback functions)
   tvh_mutex_t                     mi_output_lock;
 
+  /* Inline service delivery batch (no demux worker) */
+  mpegts_demux_job_t              mi_demux_batch;
+
   /* Active sources */
   LIST_HEAD(,mpegts_mux_instance) mi_mux_active;
 
@@ -971,13 +1081,17 @@ static inline int mpegts_mux_scan_state_set ( mpegts_mux_t *m, int state )
 
 mpegts_pid_t *mpegts_mux_find_pid_(mpegts_mux_t *mm, int pid, int create);
 
+void mpegts_mux_remove_pid(mpegts_mux_t *mm, mpegts_pid_t *mp);
+
 static inline mpegts_pid_t *
 mpegts_mux_find_pid(mpegts_mux_t *mm, int pid, int create)
 {
-  if (mm->mm_last_pid != pid)
-    return mpegts_mux_find_pid_(mm, pid, create);
-  else
-    return mm->mm_last_mp;
+  mpegts_pid_t *mp;
+  if (mm->mm_pid_map && pid >= 0 && pid < MPEGTS_PID_MAP_SIZE) {
+    if ((mp = mm->mm_pid_map[pid]) != NULL || !create)
+      return mp;
+  }
+  return mpegts_mux_find_pid_(mm, pid, create);
 }
 
 void mpegts_mux_update_pids ( mpegts_mux_t *mm );
@@ -988,6 +1102,22 @@ void mpegts_input_recv_packets
   (mpegts_mux_instance_t *mmi, sbuf_t *sb,
    int flags, mpegts_pcr_t *pcr);
 
+/*
+ * Direct input - the reader fills the pooled chunk (*pmp) at the tail
+ * returned by mpegts_input_recv_tail(), mpegts_input_recv_chunk() queues
+ * the chunk itself and copies only the incomplete trailing packet to the
+ * head of the next chunk
+ */
+uint8_t *mpegts_input_recv_tail
+  (mpegts_input_t *mi, mpegts_packet_t **pmp, int *space);
+
+void mpegts_input_recv_chunk
+  (mpegts_mux_instance_t *mmi, mpegts_packet_t **pmp,
+   int flags, mpegts_pcr_t *pcr);
+
+static inline void mpegts_input_recv_done ( mpegts_packet_t **pmp )
+  { if (*pmp) { mpegts_packet_release(*pmp); *pmp = NULL; } }
+
 void mpegts_input_postdemux
   ( mpegts_input_t *mi, mpegts_mux_t *mm, uint8_t *data, int len );
 
@@ -1053,6 +1183,15 @@ mpegts_table_t *mpegts_table_add
 mpegts_table_t *mpegts_table_find
   (mpegts_mux_t *mm, const char *name, void *opaque);
 void mpegts_table_flush_all(mpegts_mux_t *mm);
+mpegts_table_snap_t *mpegts_table_snap_get
+  (mpegts_mux_t *mm, int pid, int fast);
+void mpegts_table_snap_unlink
+  (mpegts_mux_t *mm, struct mpegts_table_snap_list *stale);
+void mpegts_table_snap_destroy(mpegts_table_snap_t *mts);
+void mpegts_table_snap_flush(mpegts_mux_t *mm);
+void mpegts_table_snap_expire(mpegts_mux_t *mm);
+static inline void mpegts_table_changed(mpegts_mux_t *mm)
+  { atomic_add(&mm->mm_tables_gen, 1); }
 void mpegts_table_destroy(mpegts_table_t *mt);
 static inline void mpegts_table_reset(mpegts_table_t *mt)
   { dvb_table_reset((mpegts_psi_table_t *)mt); }
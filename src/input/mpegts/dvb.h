@@ -338,6 +338,9 @@ typedef struct mpegts_psi_table
 
   tvhlog_limit_t mt_err_log;
 
+  /* Optional check of the complete section before CRC and callback */
+  int (*mt_precheck)(struct mpegts_psi_table *mt, const uint8_t *sec, int len);
+
 } mpegts_psi_table_t;
 
 /*
@@ -356,6 +359,8 @@ int dvb_table_begin
    int tableid, uint64_t extraid, int minlen,
    mpegts_psi_table_state_t **st, int *sect, int *last, int *ver,
    time_t interval);
+int dvb_table_seen
+  (mpegts_psi_table_t *mt, int tableid, uint64_t extraid, int sect, int ver);
 void dvb_table_reset (mpegts_psi_table_t *mt);
 void dvb_table_release (mpegts_psi_table_t *mt);
 
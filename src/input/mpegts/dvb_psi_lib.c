@@ -121,6 +121,12 @@ mpegts_psi_section_reassemble0
     cb = NULL;
   }
 
+  /* Already processed section - skip the CRC and parsing */
+  if(cb && mt->mt_precheck && mt->mt_precheck(mt, p, tsize)) {
+    cb = NULL;
+    crc = 0;
+  }
+
   if(crc && tvh_crc32(p, tsize, 0xffffffff)) {
     if (cb && tvhlog_limit(&mt->mt_err_log, 10)) {
       tvhwarn(mt->mt_subsys, "%s: %s: invalid checksum (len %i, errors %zi)",
@@ -403,6 +409,28 @@ dvb_table_begin
   return 1;
 }
 
+/*
+ * Check if the section would be skipped by dvb_table_begin(), returns
+ * 1 for the already seen section and 2 for the complete table (the
+ * same version), the caller decides if the completion is required
+ * (see _eit_precheck)
+ */
+int
+dvb_table_seen
+  (mpegts_psi_table_t *mt, int tableid, uint64_t extraid, int sect, int ver)
+{
+  mpegts_psi_table_state_t *st, st_cmp;
+
+  st_cmp.tableid = tableid;
+  st_cmp.extraid = extraid;
+  st = RB_FIND(&mt->mt_state, &st_cmp, link, sect_cmp);
+  if (st == NULL || st->version != ver)
+    return 0;
+  if (st->complete)
+    return st->complete == 2 ? 2 : 0;
+  return !(st->sections[sect / 32] & (0x1 << (31 - (sect % 32))));
+}
+
 void
 dvb_table_reset(mpegts_psi_table_t *mt)
 {
@@ -450,6 +450,7 @@ iptv_input_stop_mux ( mpegts_input_t *mi, mpegts_mux_instance_t *mmi )
 
   /* Free memory */
   sbuf_free(&im->mm_iptv_buffer);
+  mpegts_input_recv_done(&im->mm_iptv_chunk);
 
   /* Clear bw limit */
   ((iptv_network_t *)im->mm_network)->in_bw_limited = 0;
@@ -591,8 +592,12 @@ iptv_input_recv_flush ( iptv_mux_t *im )
 
   if (mmi == NULL)
     return;
-  mpegts_input_recv_packets(mmi, &im->mm_iptv_buffer,
+  if (im->mm_iptv_chunk)
+    mpegts_input_recv_chunk(mmi, &im->mm_iptv_chunk,
                             MPEGTS_DATA_CC_RESTART, NULL);
+  else
+    mpegts_input_recv_packets(mmi, &im->mm_iptv_buffer,
+                              MPEGTS_DATA_CC_RESTART, NULL);
 }
 
 int
@@ -603,6 +608,7 @@ iptv_input_recv_packets ( iptv_mux_t *im, ssize_t len )
   mpegts_pcr_t pcr;
   char buf[384];
   int64_t s64;
+  int flags;
 
   pcr.pcr_first = PTS_UNSET;
   pcr.pcr_last  = PTS_UNSET;
@@ -629,9 +635,11 @@ iptv_input_recv_packets ( iptv_mux_t *im, ssize_t len )
       tvhtrace(LS_IPTV_PCR, "paused");
       return 1;
     }
-    mpegts_input_recv_packets(mmi, &im->mm_iptv_buffer,
-                              in->in_remove_scrambled_bits ?
-                                MPEGTS_DATA_REMOVE_SCRAMBLED : 0, &pcr);
+    flags = in->in_remove_scrambled_bits ? MPEGTS_DATA_REMOVE_SCRAMBLED : 0;
+    if (im->mm_iptv_chunk)
+      mpegts_input_recv_chunk(mmi, &im->mm_iptv_chunk, flags, &pcr);
+    else
+      mpegts_input_recv_packets(mmi, &im->mm_iptv_buffer, flags, &pcr);
     if (pcr.pcr_first != PTS_UNSET && pcr.pcr_last != PTS_UNSET) {
       im->im_pcr_pid = pcr.pcr_pid;
       if (im->im_pcr == PTS_UNSET) {
@@ -692,8 +700,10 @@ void
 iptv_input_mux_started ( iptv_input_t *mi, iptv_mux_t *im, int reset )
 {
   /* Allocate input buffer */
-  if (reset)
+  if (reset) {
     sbuf_reset_and_alloc(&im->mm_iptv_buffer, IPTV_BUF_SIZE);
+    mpegts_input_recv_done(&im->mm_iptv_chunk);
+  }
 
   im->im_pcr = PTS_UNSET;
   im->im_pcr_pid = MPEGTS_PID_NONE;
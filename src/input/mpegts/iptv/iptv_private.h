@@ -29,6 +29,7 @@
 #define IPTV_BUF_SIZE    (300*188)
 #define IPTV_PKTS        32
 #define IPTV_PKT_PAYLOAD 1472
+#define IPTV_PKT_TS      (7*188) /* usual TS payload, read to the chunk */
 
 typedef struct iptv_input   iptv_input_t;
 typedef struct iptv_network iptv_network_t;
@@ -144,6 +145,7 @@ struct iptv_mux
   uint32_t              mm_iptv_rtp_seq;
 
   sbuf_t                mm_iptv_buffer;
+  mpegts_packet_t      *mm_iptv_chunk;  // UDP/RTP direct input
 
   uint32_t              mm_iptv_buffer_limit;
 
@@ -72,29 +72,50 @@ iptv_udp_stop
   tvh_mutex_lock(&iptv_lock);
 }
 
+/*
+ * The datagrams are received directly to the tail of the pooled input
+ * chunk (IPTV_PKT_TS bytes each), see udp_multirecv_read_split()
+ */
+static uint8_t *
+iptv_udp_chunk ( iptv_mux_t *im, int *packets )
+{
+  uint8_t *tsb;
+  int space;
+
+  tsb = mpegts_input_recv_tail(im->mm_active->mmi_input,
+                               &im->mm_iptv_chunk, &space);
+  *packets = MIN(IPTV_PKTS, space / IPTV_PKT_PAYLOAD);
+  return tsb;
+}
+
 static ssize_t
 iptv_udp_read ( iptv_input_t *mi, iptv_mux_t *im )
 {
-  int i, n;
+  int i, n, packets;
   struct iovec *iovec;
   udp_multirecv_t *um = im->im_data;
+  uint8_t *tsb, *dst, b;
   ssize_t res = 0;
 
-  n = udp_multirecv_read(um, im->mm_iptv_fd, IPTV_PKTS, &iovec);
+  tsb = iptv_udp_chunk(im, &packets);
+  n = udp_multirecv_read_split(um, im->mm_iptv_fd, packets,
+                               0, tsb, IPTV_PKT_TS, &iovec);
   if (n < 0)
     return -1;
 
   im->mm_iptv_rtp_seq &= ~0xfff;
-  for (i = 0; i < n; i++, iovec++) {
-    if (iovec->iov_len <= 0)
+  for (i = 0, dst = tsb; i < n; i++) {
+    if (iovec[i].iov_len <= 0)
       continue;
-    if (*(uint8_t *)iovec->iov_base != 0x47) {
+    udp_multirecv_split_peek(um, i, 0, 1, &b);
+    if (b != 0x47) {
       im->mm_iptv_rtp_seq++;
       continue;
     }
-    sbuf_append(&im->mm_iptv_buffer, iovec->iov_base, iovec->iov_len);
-    res += iovec->iov_len;
+    dst = udp_multirecv_split_move(um, i, 0, iovec[i].iov_len, dst);
+    res += iovec[i].iov_len;
   }
+  im->mm_iptv_chunk->mp_len += dst - tsb;
 
   if (im->mm_iptv_rtp_seq < 0xffff && im->mm_iptv_rtp_seq > 0x3ff) {
     tvherror(LS_IPTV, "receving non-raw UDP data for %s!", im->mm_nicename);
@@ -109,28 +130,34 @@ iptv_rtp_read ( iptv_mux_t *im, udp_multirecv_t *um,
                 void (*pkt_cb)(iptv_mux_t *im, uint8_t *pkt, int len) )
 {
   ssize_t len, hlen;
-  uint8_t *rtp;
-  int i, n;
+  uint8_t *rtp, *tsb, *dst, ext[4];
+  int i, n, packets;
   uint32_t seq, nseq, unc = 0;
   struct iovec *iovec;
   ssize_t res = 0;
 
-  n = udp_multirecv_read(um, im->mm_iptv_fd, IPTV_PKTS, &iovec);
+  tsb = iptv_udp_chunk(im, &packets);
+  n = udp_multirecv_read_split(um, im->mm_iptv_fd, packets,
+                               12, tsb, IPTV_PKT_TS, &iovec);
   if (n < 0)
     return -1;
 
   seq = im->mm_iptv_rtp_seq;
 
-  for (i = 0; i < n; i++, iovec++) {
+  for (i = 0, dst = tsb; i < n; i++) {
 
-    /* Raw packet */
-    rtp = iovec->iov_base;
-    len = iovec->iov_len;
+    /* Raw packet (the minimal header, the rest is in the chunk) */
+    rtp = iovec[i].iov_base;
+    len = iovec[i].iov_len;
 
     /* Strip RTP header */
     if (len < 12)
       continue;
 
+    /* CSRC or extension - make the datagrams complete for the callback */
+    if (rtp[0] & 0x1f)
+      udp_multirecv_split_linear(um, i);
+
     if (pkt_cb)
       pkt_cb(im, rtp, len);
 
@@ -147,7 +174,8 @@ iptv_rtp_read ( iptv_mux_t *im, udp_multirecv_t *um,
     if (rtp[0] & 0x10) {
       if (len < hlen+4)
         continue;
-      hlen += ((rtp[hlen+2] << 8) | rtp[hlen+3]) * 4;
+      udp_multirecv_split_peek(um, i, hlen, 4, ext);
+      hlen += ((ext[2] << 8) | ext[3]) * 4;
       hlen += 4;
     }
     if (len < hlen || ((len - hlen) % 188) != 0)
@@ -165,10 +193,11 @@ iptv_rtp_read ( iptv_mux_t *im, udp_multirecv_t *um,
     }
     seq = nseq;
 
-    /* Move data */
-    sbuf_append(&im->mm_iptv_buffer, rtp + hlen, len);
+    /* Move data (usually already on the place) */
+    dst = udp_multirecv_split_move(um, i, hlen, len, dst);
     res += len;
   }
+  im->mm_iptv_chunk->mp_len += dst - tsb;
 
   im->mm_iptv_rtp_seq = seq;
   if (im->mm_active)
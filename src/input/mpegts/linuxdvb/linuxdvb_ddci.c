@@ -536,32 +536,7 @@ linuxdvb_ddci_rd_thread_statistic_clr ( linuxdvb_ddci_rd_thread_t *ddci_rd_threa
 static inline int
 ddci_ts_sync_count ( const uint8_t *tsb, int len )
 {
-  const uint8_t *start = tsb;
-
-#define LDDCI_TS_SIZE_10  (LDDCI_TS_SIZE * 10)
-
-  while (len >= LDDCI_TS_SIZE) {
-    if (len >= LDDCI_TS_SIZE_10 &&
-        tsb[0*LDDCI_TS_SIZE] == LDDCI_TS_SYNC_BYTE &&
-        tsb[1*LDDCI_TS_SIZE] == LDDCI_TS_SYNC_BYTE &&
-        tsb[2*LDDCI_TS_SIZE] == LDDCI_TS_SYNC_BYTE &&
-        tsb[3*LDDCI_TS_SIZE] == LDDCI_TS_SYNC_BYTE &&
-        tsb[4*LDDCI_TS_SIZE] == LDDCI_TS_SYNC_BYTE &&
-        tsb[5*LDDCI_TS_SIZE] == LDDCI_TS_SYNC_BYTE &&
-        tsb[6*LDDCI_TS_SIZE] == LDDCI_TS_SYNC_BYTE &&
-        tsb[7*LDDCI_TS_SIZE] == LDDCI_TS_SYNC_BYTE &&
-        tsb[8*LDDCI_TS_SIZE] == LDDCI_TS_SYNC_BYTE &&
-        tsb[9*LDDCI_TS_SIZE] == LDDCI_TS_SYNC_BYTE) {
-      len -= LDDCI_TS_SIZE_10;
-      tsb += LDDCI_TS_SIZE_10;
-    } else if (*tsb == LDDCI_TS_SYNC_BYTE) {
-      len -= LDDCI_TS_SIZE;
-      tsb += LDDCI_TS_SIZE;
-    } else {
-      break;
-    }
-  }
-  return tsb - start;
+  return mpegts_sync_count(tsb, len);
 }
 
 static int
@@ -1374,8 +1374,9 @@ linuxdvb_frontend_input_thread ( void *aux )
   size_t counter = 0;
   linuxdvb_pid_t pids[128];
   mpegts_apids_t tuned;
-  sbuf_t sb;
-  int i, dvr = -1, nfds, nodata = 4;
+  mpegts_packet_t *mp = NULL;
+  uint8_t *tsb;
+  int i, dvr = -1, nfds, nodata = 4, space, rsize;
 
   mpegts_pid_init(&tuned);
   for (i = 0; i < ARRAY_SIZE(pids); i++) {
@@ -1409,8 +1410,8 @@ linuxdvb_frontend_input_thread ( void *aux )
   ev[1].ptr    = &lfe->lfe_dvr_pipe;
   tvhpoll_add(efd, ev, 2);
 
-  /* Allocate memory */
-  sbuf_init_fixed(&sb, MINMAX(lfe->lfe_ibuf_size, 18800, 1880000));
+  /* Read size (the reads go directly to the pooled input chunks) */
+  rsize = MINMAX(lfe->lfe_ibuf_size, 18800, 1880000);
 
   /* Subscribe PIDs */
   linuxdvb_update_pids(lfe, name, &tuned, pids, ARRAY_SIZE(pids));
@@ -1443,7 +1444,8 @@ linuxdvb_frontend_input_thread ( void *aux )
     lfe->lfe_nodata = 0;
     
     /* Read */
-    if ((n = sbuf_read(&sb, dvr)) < 0) {
+    tsb = mpegts_input_recv_tail((mpegts_input_t *)lfe, &mp, &space);
+    if ((n = read(dvr, tsb, MIN(space, rsize))) < 0) {
       if (ERRNO_AGAIN(errno))
         continue;
       if (errno == EOVERFLOW) {
@@ -1459,17 +1461,19 @@ linuxdvb_frontend_input_thread ( void *aux )
     if (counter < skip) {
       counter += n;
       if (counter < skip) {
-        sbuf_cut(&sb, n);
+        n = 0;
       } else {
-        sbuf_cut(&sb, skip - (counter - n));
+        memmove(tsb, tsb + n - (counter - skip), counter - skip);
+        n = counter - skip;
       }
     }
-    
+    mp->mp_len += n;
+
     /* Process */
-    mpegts_input_recv_packets(mmi, &sb, 0, NULL);
+    mpegts_input_recv_chunk(mmi, &mp, 0, NULL);
   }
 
-  sbuf_free(&sb);
+  mpegts_input_recv_done(&mp);
   tvhpoll_destroy(efd);
   for (i = 0; i < ARRAY_SIZE(pids); i++)
     if (pids[i].fd >= 0)
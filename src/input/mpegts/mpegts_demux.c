@@ -0,0 +1,331 @@
+/*
+ *  Tvheadend - MPEGTS demux workers
+ *
+ *  Copyright (C) 2026 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tvheadend.h"
+#include "input.h"
+#include "tsdemux.h"
+#include "config.h"
+
+/*
+ * The input thread resolves the PIDs and subscribers (under mi_output_lock)
+ * and the delivery to the services (ts_recv_packet1/ts_recv_raw - parsing,
+ * descrambling, remuxing) is done in the worker threads. The muxes are
+ * assigned to the workers when started, so the order of the packets for
+ * one mux is preserved while the different muxes are processed in parallel.
+ *
+ * Without the workers, the same job structure is used inline as a batch
+ * (mi_demux_batch) to deliver the whole input chunk per service.
+ */
+
+#define MPEGTS_DEMUX_QUEUE_MAX (16*1024*1024)
+
+typedef struct mpegts_demux_worker {
+  int                             mdw_index;
+  pthread_t                       mdw_tid;
+  tvh_mutex_t                     mdw_lock;
+  tvh_cond_t                      mdw_cond;
+  TAILQ_HEAD(,mpegts_demux_job)   mdw_queue;
+  int64_t                         mdw_queue_size;
+  int                             mdw_muxes;
+  tvhlog_limit_t                  mdw_loglimit;
+  /* statistics */
+  uint64_t                        mdw_jobs;
+  uint64_t                        mdw_bytes;
+  uint64_t                        mdw_drops;
+  int64_t                         mdw_busy;
+  int64_t                         mdw_window;
+  int                             mdw_load;  // permille in last window
+} mpegts_demux_worker_t;
+
+static mpegts_demux_worker_t *mpegts_demux_workers;
+static int mpegts_demux_count;
+static int mpegts_demux_running;
+
+/*
+ * Job
+ */
+
+mpegts_demux_job_t *
+mpegts_demux_job_create ( mpegts_packet_t *mp )
+{
+  mpegts_demux_job_t *mdj = calloc(1, sizeof(*mdj));
+  mdj->mdj_packet = mp;
+  pktbuf_ref_inc(&mp->mp_pb);
+  return mdj;
+}
+
+/*
+ * The item is appended to the group of the service, the group index
+ * is cached in the service (the job is built only in the input thread)
+ */
+void
+mpegts_demux_job_add
+  ( mpegts_demux_job_t *mdj, service_t *s, uint64_t tspos,
+    uint16_t pid, const uint8_t *tsb, int len, int table, int raw )
+{
+  mpegts_service_t *ms = (mpegts_service_t *)s;
+  mpegts_demux_group_t *mdg;
+  mpegts_demux_item_t *mdi;
+  int g = ms->s_demux_group;
+
+  if (g < 0 || g >= mdj->mdj_gcount || mdj->mdj_groups[g].mdg_service != s) {
+    if (mdj->mdj_gcount >= mdj->mdj_galloc) {
+      mdj->mdj_galloc = MAX(8, mdj->mdj_galloc * 2);
+      mdj->mdj_groups = realloc(mdj->mdj_groups, mdj->mdj_galloc * sizeof(*mdg));
+    }
+    g = ms->s_demux_group = mdj->mdj_gcount++;
+    mdg = &mdj->mdj_groups[g];
+    if (mdj->mdj_packet)
+      service_ref(s);
+    mdg->mdg_service = s;
+    mdg->mdg_first   = mdj->mdj_count;
+  } else {
+    mdg = &mdj->mdj_groups[g];
+    mdj->mdj_items[mdg->mdg_last].mdi_next = mdj->mdj_count;
+  }
+  mdg->mdg_last = mdj->mdj_count;
+  if (mdj->mdj_count >= mdj->mdj_alloc) {
+    mdj->mdj_alloc = MAX(32, mdj->mdj_alloc * 2);
+    mdj->mdj_items = realloc(mdj->mdj_items, mdj->mdj_alloc * sizeof(*mdi));
+  }
+  mdi = &mdj->mdj_items[mdj->mdj_count++];
+  mdi->mdi_tspos   = tspos;
+  mdi->mdi_tsb     = tsb;
+  mdi->mdi_len     = len;
+  mdi->mdi_next    = -1;
+  mdi->mdi_pid     = pid;
+  mdi->mdi_table   = table;
+  mdi->mdi_raw     = raw;
+}
+
+static void
+mpegts_demux_job_destroy ( mpegts_demux_job_t *mdj )
+{
+  int i;
+
+  for (i = 0; i < mdj->mdj_gcount; i++)
+    service_unref(mdj->mdj_groups[i].mdg_service);
+  mpegts_packet_release(mdj->mdj_packet);
+  free(mdj->mdj_groups);
+  free(mdj->mdj_items);
+  free(mdj);
+}
+
+/*
+ * Deliver the items service by service (in the order of the first
+ * item for each service), the packet order for one service is kept
+ */
+void
+mpegts_demux_job_run ( mpegts_demux_job_t *mdj )
+{
+  mpegts_demux_group_t *mdg, *end;
+
+  for (mdg = mdj->mdj_groups, end = mdg + mdj->mdj_gcount; mdg < end; mdg++)
+    ts_recv_batch((mpegts_service_t *)mdg->mdg_service,
+                  mdj->mdj_items, mdg->mdg_first);
+}
+
+static inline int64_t
+mpegts_demux_job_size ( mpegts_demux_job_t *mdj )
+{
+  return mdj->mdj_packet->mp_len;
+}
+
+void
+mpegts_demux_job_submit ( int index, mpegts_demux_job_t *mdj )
+{
+  mpegts_demux_worker_t *mdw;
+  int64_t size = mpegts_demux_job_size(mdj);
+
+  assert(index >= 0 && index < mpegts_demux_count);
+  if (mdj->mdj_count == 0) {
+    mpegts_demux_job_destroy(mdj);
+    return;
+  }
+  mdw = &mpegts_demux_workers[index];
+  tvh_mutex_lock(&mdw->mdw_lock);
+  if (mdw->mdw_queue_size + size > MPEGTS_DEMUX_QUEUE_MAX) {
+    mdw->mdw_drops++;
+    if (tvhlog_limit(&mdw->mdw_loglimit, 10))
+      tvhwarn(LS_MPEGTS, "demux worker %d - too much queued data, discarding new",
+              mdw->mdw_index);
+    tvh_mutex_unlock(&mdw->mdw_lock);
+    mpegts_demux_job_destroy(mdj);
+    return;
+  }
+  if (TAILQ_EMPTY(&mdw->mdw_queue))
+    tvh_cond_signal(&mdw->mdw_cond, 0);
+  TAILQ_INSERT_TAIL(&mdw->mdw_queue, mdj, mdj_link);
+  mdw->mdw_queue_size += size;
+  tvh_mutex_unlock(&mdw->mdw_lock);
+}
+
+/*
+ * Worker
+ */
+
+static void *
+mpegts_demux_thread ( void *aux )
+{
+  mpegts_demux_worker_t *mdw = aux;
+  mpegts_demux_job_t *mdj;
+  int64_t t, window = getfastmonoclock(), busy = 0;
+
+  tvh_mutex_lock(&mdw->mdw_lock);
+  while (atomic_get(&mpegts_demux_running)) {
+    if ((mdj = TAILQ_FIRST(&mdw->mdw_queue)) == NULL) {
+      tvh_cond_timedwait(&mdw->mdw_cond, &mdw->mdw_lock, mclk() + sec2mono(1));
+    } else {
+      TAILQ_REMOVE(&mdw->mdw_queue, mdj, mdj_link);
+      mdw->mdw_queue_size -= mpegts_demux_job_size(mdj);
+      tvh_mutex_unlock(&mdw->mdw_lock);
+      t = getfastmonoclock();
+      mpegts_demux_job_run(mdj);
+      busy += getfastmonoclock() - t;
+      tvh_mutex_lock(&mdw->mdw_lock);
+      mdw->mdw_jobs++;
+      mdw->mdw_bytes += mpegts_demux_job_size(mdj);
+      tvh_mutex_unlock(&mdw->mdw_lock);
+      mpegts_demux_job_destroy(mdj);
+      tvh_mutex_lock(&mdw->mdw_lock);
+    }
+    t = getfastmonoclock();
+    if (t - window >= MONOCLOCK_RESOLUTION) {
+      mdw->mdw_busy += busy;
+      mdw->mdw_window = t - window;
+      mdw->mdw_load = (busy * 1000) / (t - window);
+      window = t;
+      busy = 0;
+    }
+  }
+  while ((mdj = TAILQ_FIRST(&mdw->mdw_queue)) != NULL) {
+    TAILQ_REMOVE(&mdw->mdw_queue, mdj, mdj_link);
+    mpegts_demux_job_destroy(mdj);
+  }
+  mdw->mdw_queue_size = 0;
+  tvh_mutex_unlock(&mdw->mdw_lock);
+  return NULL;
+}
+
+/*
+ * Mux assignment
+ */
+
+int
+mpegts_demux_assign ( void )
+{
+  mpegts_demux_worker_t *mdw;
+  int i, r = -1, muxes = INT_MAX;
+
+  for (i = 0; i < mpegts_demux_count; i++) {
+    mdw = &mpegts_demux_workers[i];
+    if (atomic_get(&mdw->mdw_muxes) < muxes) {
+      muxes = atomic_get(&mdw->mdw_muxes);
+      r = i;
+    }
+  }
+  if (r >= 0)
+    atomic_add(&mpegts_demux_workers[r].mdw_muxes, 1);
+  return r;
+}
+
+void
+mpegts_demux_unassign ( int index )
+{
+  if (index >= 0 && index < mpegts_demux_count)
+    atomic_dec(&mpegts_demux_workers[index].mdw_muxes, 1);
+}
+
+/*
+ * Status
+ */
+
+htsmsg_t *
+mpegts_demux_status ( void )
+{
+  mpegts_demux_worker_t *mdw;
+  htsmsg_t *l = htsmsg_create_list(), *e;
+  int i;
+
+  for (i = 0; i < mpegts_demux_count; i++) {
+    mdw = &mpegts_demux_workers[i];
+    e = htsmsg_create_map();
+    tvh_mutex_lock(&mdw->mdw_lock);
+    htsmsg_add_u32(e, "worker", mdw->mdw_index);
+    htsmsg_add_u32(e, "muxes", atomic_get(&mdw->mdw_muxes));
+    htsmsg_add_u32(e, "load", mdw->mdw_load);
+    htsmsg_add_s64(e, "queue", mdw->mdw_queue_size);
+    htsmsg_add_s64(e, "jobs", mdw->mdw_jobs);
+    htsmsg_add_s64(e, "bytes", mdw->mdw_bytes);
+    htsmsg_add_s64(e, "drops", mdw->mdw_drops);
+    htsmsg_add_s64(e, "busy", mdw->mdw_busy);
+    tvh_mutex_unlock(&mdw->mdw_lock);
+    htsmsg_add_msg(l, NULL, e);
+  }
+  return l;
+}
+
+/*
+ * Init / done
+ */
+
+void
+mpegts_demux_init ( void )
+{
+  mpegts_demux_worker_t *mdw;
+  int i;
+
+  mpegts_demux_count = MINMAX(config.demux_threads, 0, 64);
+  if (mpegts_demux_count == 0)
+    return;
+  mpegts_demux_workers = calloc(mpegts_demux_count, sizeof(*mdw));
+  atomic_set(&mpegts_demux_running, 1);
+  for (i = 0; i < mpegts_demux_count; i++) {
+    mdw = &mpegts_demux_workers[i];
+    mdw->mdw_index = i;
+    tvh_mutex_init(&mdw->mdw_lock, NULL);
+    tvh_cond_init(&mdw->mdw_cond, 1);
+    TAILQ_INIT(&mdw->mdw_queue);
+    tvh_thread_create(&mdw->mdw_tid, NULL, mpegts_demux_thread, mdw, "mi-demux");
+  }
+  tvhinfo(LS_MPEGTS, "started %d demux worker(s)", mpegts_demux_count);
+}
+
+void
+mpegts_demux_done ( void )
+{
+  mpegts_demux_worker_t *mdw;
+  int i;
+
+  if (mpegts_demux_count == 0)
+    return;
+  atomic_set(&mpegts_demux_running, 0);
+  for (i = 0; i < mpegts_demux_count; i++) {
+    mdw = &mpegts_demux_workers[i];
+    tvh_mutex_lock(&mdw->mdw_lock);
+    tvh_cond_signal(&mdw->mdw_cond, 0);
+    tvh_mutex_unlock(&mdw->mdw_lock);
+    pthread_join(mdw->mdw_tid, NULL);
+    tvh_cond_destroy(&mdw->mdw_cond);
+    tvh_mutex_destroy(&mdw->mdw_lock);
+  }
+  mpegts_demux_count = 0;
+  free(mpegts_demux_workers);
+  mpegts_demux_workers = NULL;
+}
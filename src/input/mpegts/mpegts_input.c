@@ -26,6 +26,7 @@
 
 memoryinfo_t mpegts_input_queue_memoryinfo = { .my_name = "MPEG-TS input queue" };
 memoryinfo_t mpegts_input_table_memoryinfo = { .my_name = "MPEG-TS table queue" };
+memoryinfo_t mpegts_input_pool_memoryinfo = { .my_name = "MPEG-TS input pool" };
 
 static void
 mpegts_input_del_network ( mpegts_network_link_t *mnl );
@@ -592,10 +593,6 @@ mpegts_input_close_pid
     skel.mps_weight = -1;
     skel.mps_owner  = owner;
     mps = RB_FIND(&mp->mp_subs, &skel, mps_link, mpegts_mps_cmp);
-    if (pid == mm->mm_last_pid) {
-      mm->mm_last_pid = -1;
-      mm->mm_last_mp = NULL;
-    }
     if (mps) {
       tvhdebug(LS_MPEGTS, "%s - close PID %04X (%d) [%d/%p]",
                mm->mm_nicename, mp->mp_pid, mp->mp_pid, type, owner);
@@ -609,12 +606,7 @@ mpegts_input_close_pid
     }
   }
   if (!RB_FIRST(&mp->mp_subs)) {
-    if (mm->mm_last_pid == mp->mp_pid) {
-      mm->mm_last_pid = -1;
-      mm->mm_last_mp = NULL;
-    }
-    RB_REMOVE(&mm->mm_pids, mp, mp_link);
-    free(mp);
+    mpegts_mux_remove_pid(mm, mp);
     return 1;
   } else {
     type = 0;
@@ -988,6 +980,7 @@ mpegts_input_started_mux
     mtimer_arm_rel(&mi->mi_status_timer, mpegts_input_status_timer, mi, sec2mono(1));
 
   /* Update */
+  mm->mm_demux_worker = mpegts_demux_assign();
   mm->mm_active = mmi;
 
   /* Accept packets */
@@ -1006,6 +999,8 @@ mpegts_input_stopping_mux
   tvh_mutex_lock(&mi->mi_input_lock);
   mmi->mmi_mux->mm_active = NULL;
   tvh_mutex_unlock(&mi->mi_input_lock);
+  mpegts_demux_unassign(mmi->mmi_mux->mm_demux_worker);
+  mmi->mmi_mux->mm_demux_worker = -1;
   tvh_mutex_unlock(&mi->mi_output_lock);
 }
 
@@ -1068,6 +1063,147 @@ mpegts_input_error ( mpegts_input_t *mi, mpegts_mux_t *mm, int tss_flags )
   tvh_mutex_unlock(&mi->mi_output_lock);
 }
 
+/* **************************************************************************
+ * Input chunk pool
+ * *************************************************************************/
+
+/*
+ * The pool is refcounted separately from the input, because the chunks
+ * might be still referenced (as SMT_MPEGTS pktbuf) when the input is gone.
+ *
+ * The chunks are allocated in the size classes (1/4, 1/2 and the full
+ * MPEGTS_PACKET_CHUNK), so the small reads (IPTV, SAT>IP) do not hold
+ * the full chunk. Each class has own idle list.
+ */
+typedef struct mpegts_packet_pool {
+  int                         mpp_refcount;
+  int                         mpp_idle_max;
+  int                         mpp_idle_count[MPEGTS_PACKET_CLASSES];
+  tvh_mutex_t                 mpp_lock;
+  TAILQ_HEAD(,mpegts_packet)  mpp_idle[MPEGTS_PACKET_CLASSES];
+} mpegts_packet_pool_t;
+
+static inline size_t
+mpegts_packet_class_size ( int c )
+{
+  return (MPEGTS_PACKET_CHUNK / 188 >> (MPEGTS_PACKET_CLASSES - 1 - c)) * 188;
+}
+
+static inline int
+mpegts_packet_class ( size_t len )
+{
+  int c;
+
+  for (c = 0; c < MPEGTS_PACKET_CLASSES - 1; c++)
+    if (len <= mpegts_packet_class_size(c))
+      break;
+  return c;
+}
+
+static mpegts_packet_pool_t *
+mpegts_packet_pool_create ( void )
+{
+  mpegts_packet_pool_t *mpp = calloc(1, sizeof(*mpp));
+  int c;
+
+  mpp->mpp_refcount = 1;
+  mpp->mpp_idle_max = MPEGTS_PACKET_POOL_IDLE;
+  tvh_mutex_init(&mpp->mpp_lock, NULL);
+  for (c = 0; c < MPEGTS_PACKET_CLASSES; c++)
+    TAILQ_INIT(&mpp->mpp_idle[c]);
+  return mpp;
+}
+
+static void
+mpegts_packet_pool_release ( mpegts_packet_pool_t *mpp )
+{
+  int c;
+
+  if (atomic_dec(&mpp->mpp_refcount, 1) > 1)
+    return;
+  for (c = 0; c < MPEGTS_PACKET_CLASSES; c++)
+    assert(TAILQ_EMPTY(&mpp->mpp_idle[c]));
+  tvh_mutex_destroy(&mpp->mpp_lock);
+  free(mpp);
+}
+
+static void
+mpegts_packet_pool_destroy ( mpegts_packet_pool_t *mpp )
+{
+  mpegts_packet_t *mp;
+  int c;
+
+  tvh_mutex_lock(&mpp->mpp_lock);
+  mpp->mpp_idle_max = 0;
+  for (c = 0; c < MPEGTS_PACKET_CLASSES; c++) {
+    while ((mp = TAILQ_FIRST(&mpp->mpp_idle[c])) != NULL) {
+      TAILQ_REMOVE(&mpp->mpp_idle[c], mp, mp_link);
+      memoryinfo_free(&mpegts_input_pool_memoryinfo, sizeof(*mp) + mp->mp_size);
+      free(mp);
+    }
+    mpp->mpp_idle_count[c] = 0;
+  }
+  tvh_mutex_unlock(&mpp->mpp_lock);
+  mpegts_packet_pool_release(mpp);
+}
+
+static void
+mpegts_packet_pb_free ( pktbuf_t *pb )
+{
+  mpegts_packet_t *mp = (mpegts_packet_t *)((uint8_t *)pb - offsetof(mpegts_packet_t, mp_pb));
+  mpegts_packet_pool_t *mpp = mp->mp_pool;
+
+  int c = mp->mp_class;
+
+  tvh_mutex_lock(&mpp->mpp_lock);
+  if (mpp->mpp_idle_count[c] < mpp->mpp_idle_max) {
+    TAILQ_INSERT_HEAD(&mpp->mpp_idle[c], mp, mp_link);
+    mpp->mpp_idle_count[c]++;
+    mp = NULL;
+  }
+  tvh_mutex_unlock(&mpp->mpp_lock);
+  if (mp) {
+    memoryinfo_free(&mpegts_input_pool_memoryinfo, sizeof(*mp) + mp->mp_size);
+    free(mp);
+  }
+  mpegts_packet_pool_release(mpp);
+}
+
+mpegts_packet_t *
+mpegts_packet_alloc ( mpegts_input_t *mi, size_t len )
+{
+  mpegts_packet_pool_t *mpp = mi->mi_packet_pool;
+  mpegts_packet_t *mp;
+  int c = mpegts_packet_class(len);
+
+  assert(len <= MPEGTS_PACKET_CHUNK);
+  tvh_mutex_lock(&mpp->mpp_lock);
+  if ((mp = TAILQ_FIRST(&mpp->mpp_idle[c])) != NULL) {
+    TAILQ_REMOVE(&mpp->mpp_idle[c], mp, mp_link);
+    mpp->mpp_idle_count[c]--;
+  }
+  tvh_mutex_unlock(&mpp->mpp_lock);
+  if (mp == NULL) {
+    mp = malloc(sizeof(*mp) + mpegts_packet_class_size(c));
+    mp->mp_class = c;
+    mp->mp_size  = mpegts_packet_class_size(c);
+    memoryinfo_alloc(&mpegts_input_pool_memoryinfo, sizeof(*mp) + mp->mp_size);
+  }
+  atomic_add(&mpp->mpp_refcount, 1);
+  mp->mp_pool          = mpp;
+  mp->mp_pb.pb_refcount = 1;
+  mp->mp_pb.pb_err     = 0;
+  mp->mp_pb.pb_class   = 0;
+  mp->mp_pb.pb_head    = 0;
+  mp->mp_pb.pb_data    = mp->mp_data;
+  mp->mp_pb.pb_size    = 0;
+  mp->mp_pb.pb_free    = mpegts_packet_pb_free;
+  mp->mp_len           = 0;
+  mp->mp_mux           = NULL;
+  mp->mp_cc_restart    = 0;
+  return mp;
+}
+
 /* **************************************************************************
  * Data processing
  * *************************************************************************/
@@ -1144,27 +1280,33 @@ get_pcr ( const uint8_t *tsb, int64_t *rpcr )
   return 1;
 }
 
+/*
+ * Input ring (single consumer - the input thread)
+ *
+ * The producers are serialized using mi_input_lock, the consumer pops
+ * the chunks without any lock. The lock is taken by the consumer only
+ * when the ring is empty to wait for the producer's wakeup.
+ */
 static inline int
-ts_sync_count ( const uint8_t *tsb, int len )
-{
-  const uint8_t *start = tsb;
-  while (len >= 188) {
-    if (len >= 1880 &&
-        tsb[0*188] == 0x47 && tsb[1*188] == 0x47 &&
-        tsb[2*188] == 0x47 && tsb[3*188] == 0x47 &&
-        tsb[4*188] == 0x47 && tsb[5*188] == 0x47 &&
-        tsb[6*188] == 0x47 && tsb[7*188] == 0x47 &&
-        tsb[8*188] == 0x47 && tsb[9*188] == 0x47) {
-      len -= 1880;
-      tsb += 1880;
-    } else if (*tsb == 0x47) {
-      len -= 188;
-      tsb += 188;
-    } else {
-      break;
-    }
-  }
-  return tsb - start;
+mpegts_input_ring_empty ( mpegts_input_t *mi )
+{
+  return atomic_get(&mi->mi_input_ring_head) == atomic_get(&mi->mi_input_ring_tail);
+}
+
+static mpegts_packet_t *
+mpegts_input_ring_pop ( mpegts_input_t *mi )
+{
+  mpegts_packet_t *mp;
+  int tail = atomic_get(&mi->mi_input_ring_tail);
+
+  if (tail == atomic_get(&mi->mi_input_ring_head))
+    return NULL;
+  mp = mi->mi_input_ring[tail];
+  mi->mi_input_ring[tail] = NULL;
+  atomic_set(&mi->mi_input_ring_tail, (tail + 1) & (MPEGTS_INPUT_RING_SIZE - 1));
+  atomic_dec_s64(&mi->mi_input_queue_size, mp->mp_len);
+  memoryinfo_free(&mpegts_input_queue_memoryinfo, sizeof(mpegts_packet_t) + mp->mp_size);
+  return mp;
 }
 
 static void
@@ -1173,64 +1315,160 @@ mpegts_input_queue_packets
 {
   mpegts_input_t *mi = mmi->mmi_input;
   const char *id = SRCLINEID();
-  int len = mp->mp_len;
+  int len = mp->mp_len, head, next;
+  int64_t size;
 
   tvh_mutex_lock(&mi->mi_input_lock);
   if (mmi->mmi_mux->mm_active == mmi) {
-    if (mi->mi_input_queue_size < 50*1024*1024) {
-      mi->mi_input_queue_size += len;
-      memoryinfo_alloc(&mpegts_input_queue_memoryinfo, sizeof(mpegts_packet_t) + len);
+    head = atomic_get(&mi->mi_input_ring_head);
+    next = (head + 1) & (MPEGTS_INPUT_RING_SIZE - 1);
+    if (next != atomic_get(&mi->mi_input_ring_tail) &&
+        atomic_get_s64(&mi->mi_input_queue_size) < MPEGTS_INPUT_QUEUE_MAX) {
+      size = atomic_pre_add_s64_peak(&mi->mi_input_queue_size, len,
+                                     &mi->mi_input_queue_hwm);
+      memoryinfo_alloc(&mpegts_input_queue_memoryinfo, sizeof(mpegts_packet_t) + mp->mp_size);
       mpegts_mux_grab(mp->mp_mux);
-      TAILQ_INSERT_TAIL(&mi->mi_input_queue, mp, mp_link);
+      mp->mp_mux_gen = atomic_get(&mp->mp_mux->mm_input_gen);
+      mi->mi_input_ring[head] = mp;
+      atomic_set(&mi->mi_input_ring_head, next);
       tprofile_queue_add(&mi->mi_qprofile, id, len);
-      tprofile_queue_set(&mi->mi_qprofile, id, mi->mi_input_queue_size);
-      tvh_cond_signal(&mi->mi_input_cond, 0);
+      tprofile_queue_set(&mi->mi_qprofile, id, size);
+      if (atomic_get(&mi->mi_input_sleeping))
+        tvh_cond_signal(&mi->mi_input_cond, 0);
     } else {
-      if (tvhlog_limit(&mi->mi_input_queue_loglimit, 10))
-        tvhwarn(LS_MPEGTS, "too much queued input data (over 50MB) for %s, discarding new", mi->mi_name);
+      if (tvhlog_limit(&mi->mi_input_queue_loglimit, 10)) {
+        if (next == atomic_get(&mi->mi_input_ring_tail))
+          tvhwarn(LS_MPEGTS, "too many queued input chunks (%d) for %s, discarding new",
+                  MPEGTS_INPUT_RING_SIZE - 1, mi->mi_name);
+        else
+          tvhwarn(LS_MPEGTS, "too much queued input data (over %dMB) for %s, discarding new",
+                  MPEGTS_INPUT_QUEUE_MAX / (1024*1024), mi->mi_name);
+      }
+      atomic_add(&mi->mi_input_queue_drops, 1);
       tprofile_queue_drop(&mi->mi_qprofile, id, len);
-      free(mp);
+      mpegts_packet_release(mp);
     }
   } else {
-    free(mp);
+    mpegts_packet_release(mp);
   }
   tvh_mutex_unlock(&mi->mi_input_lock);
 }
 
+#define MIN_TS_PKT 100 /* see MPEGTS_INPUT_RING_SIZE */
+#define MIN_TS_SYN (5*188)
+
+/*
+ * Wait for more data (slow streams are passed once per second)
+ */
+static inline int
+mpegts_input_recv_wait ( mpegts_input_t *mi, int len, int flags )
+{
+  if (len < (MIN_TS_PKT * 188) && (flags & MPEGTS_DATA_CC_RESTART) == 0) {
+    /* For slow streams, check also against the clock */
+    if (monocmpfastsec(mclk(), atomic_add_s64(&mi->mi_last_dispatch, 0)))
+      return 1;
+  }
+  atomic_set_s64(&mi->mi_last_dispatch, mclk());
+  return 0;
+}
+
+/*
+ * Find the synced packets, returns their length (*off is the start)
+ */
+static int
+mpegts_input_recv_sync
+  ( mpegts_mux_instance_t *mmi, const uint8_t *tsb, int len, int *off )
+{
+  int len2 = 0, o = 0;
+
+  while ( (len >= MIN_TS_SYN) &&
+          ((len2 = mpegts_sync_count(tsb, len)) < MIN_TS_SYN) ) {
+    atomic_add(&mmi->tii_stats.unc, 1);
+    --len;
+    ++tsb;
+    ++o;
+  }
+  *off = o;
+  return len2;
+}
+
+static void
+mpegts_input_recv_pcr ( const uint8_t *tsb, int len2, mpegts_pcr_t *pcr )
+{
+  const uint8_t *tmp, *end;
+  uint16_t pid;
+
+  for (tmp = tsb, end = tsb + len2; tmp < end; tmp += 188) {
+    pid = ((tmp[1] & 0x1f) << 8) | tmp[2];
+    if (pcr->pcr_pid == MPEGTS_PID_NONE || pcr->pcr_pid == pid) {
+      if (get_pcr(tmp, &pcr->pcr_first)) {
+        pcr->pcr_pid = pid;
+        break;
+      }
+    }
+  }
+  if (pcr->pcr_pid != MPEGTS_PID_NONE) {
+    for (tmp = tsb + len2 - 188; tmp >= tsb; tmp -= 188) {
+      pid = ((tmp[1] & 0x1f) << 8) | tmp[2];
+      if (pcr->pcr_pid == pid) {
+        if (get_pcr(tmp, &pcr->pcr_last)) {
+          pcr->pcr_pid = pid;
+          break;
+        }
+      }
+    }
+  }
+}
+
+/*
+ * Queue the chunk with the synced packets
+ */
+static void
+mpegts_input_recv_queue
+  ( mpegts_mux_instance_t *mmi, mpegts_packet_t *mp,
+    int flags, int cc_restart )
+{
+  mpegts_input_t *mi = mmi->mmi_input;
+
+  mp->mp_mux        = mmi->mmi_mux;
+  mp->mp_cc_restart = cc_restart;
+
+  if (mi->mi_remove_scrambled_bits || (flags & MPEGTS_DATA_REMOVE_SCRAMBLED) != 0) {
+    uint8_t *tmp, *end;
+    for (tmp = mp->mp_data, end = mp->mp_data + mp->mp_len; tmp < end; tmp += 188)
+      tmp[3] &= ~0xc0;
+  }
+
+  if (!cc_restart && data_noise(mp)) {
+    mpegts_packet_release(mp);
+    return;
+  }
+
+  mpegts_input_queue_packets(mmi, mp);
+}
+
 void
 mpegts_input_recv_packets
   ( mpegts_mux_instance_t *mmi, sbuf_t *sb,
     int flags, mpegts_pcr_t *pcr )
 {
   mpegts_input_t *mi = mmi->mmi_input;
-  int len, len2, off;
+  int len, len2, len3, off, cc_restart;
   mpegts_packet_t *mp;
   uint8_t *tsb;
-#define MIN_TS_PKT 100
-#define MIN_TS_SYN (5*188)
 
   if (sb->sb_ptr == 0)
     return;
 retry:
-  len2 = 0;
-  off  = 0;
   tsb  = sb->sb_data;
   len  = sb->sb_ptr;
-  if (len < (MIN_TS_PKT * 188) && (flags & MPEGTS_DATA_CC_RESTART) == 0) {
-    /* For slow streams, check also against the clock */
-    if (monocmpfastsec(mclk(), atomic_add_s64(&mi->mi_last_dispatch, 0)))
-      return;
-  }
-  atomic_set_s64(&mi->mi_last_dispatch, mclk());
+  if (mpegts_input_recv_wait(mi, len, flags))
+    return;
 
   /* Check for sync */
-  while ( (len >= MIN_TS_SYN) &&
-          ((len2 = ts_sync_count(tsb, len)) < MIN_TS_SYN) ) {
-    atomic_add(&mmi->tii_stats.unc, 1);
-    --len;
-    ++tsb;
-    ++off;
-  }
+  len2 = mpegts_input_recv_sync(mmi, tsb, len, &off);
+  tsb += off;
+  len -= off;
 
   // Note: we check for sync here so that the buffer can always be
   //       processed in its entirety inside the processing thread
@@ -1238,58 +1476,27 @@ retry:
   //       require per mmi buffers, where this is generally not required)
 
   /* Extract PCR on demand */
-  if (pcr) {
-    uint8_t *tmp, *end;
-    uint16_t pid;
-    for (tmp = tsb, end = tsb + len2; tmp < end; tmp += 188) {
-      pid = ((tmp[1] & 0x1f) << 8) | tmp[2];
-      if (pcr->pcr_pid == MPEGTS_PID_NONE || pcr->pcr_pid == pid) {
-        if (get_pcr(tmp, &pcr->pcr_first)) {
-          pcr->pcr_pid = pid;
-          break;
-        }
-      }
-    }
-    if (pcr->pcr_pid != MPEGTS_PID_NONE) {
-      for (tmp = tsb + len2 - 188; tmp >= tsb; tmp -= 188) {
-        pid = ((tmp[1] & 0x1f) << 8) | tmp[2];
-        if (pcr->pcr_pid == pid) {
-          if (get_pcr(tmp, &pcr->pcr_last)) {
-            pcr->pcr_pid = pid;
-            break;
-          }
-        }
-      }
-    }
-  }
+  if (pcr)
+    mpegts_input_recv_pcr(tsb, len2, pcr);
 
-  /* Pass */
+  /* Pass (split to the pooled chunks) */
   if (len2 >= MIN_TS_SYN || (flags & MPEGTS_DATA_CC_RESTART)) {
-    mp = malloc(sizeof(mpegts_packet_t) + len2);
-    mp->mp_mux        = mmi->mmi_mux;
-    mp->mp_len        = len2;
-    mp->mp_cc_restart = (flags & MPEGTS_DATA_CC_RESTART) ? 1 : 0;
-
-    memcpy(mp->mp_data, tsb, len2);
-    if (mi->mi_remove_scrambled_bits || (flags & MPEGTS_DATA_REMOVE_SCRAMBLED) != 0) {
-      uint8_t *tmp, *end;
-      for (tmp = mp->mp_data, end = mp->mp_data + len2; tmp < end; tmp += 188)
-        tmp[3] &= ~0xc0;
-    }
-
     len -= len2;
     off += len2;
-
-    if ((flags & MPEGTS_DATA_CC_RESTART) == 0 && data_noise(mp)) {
-      free(mp);
-      goto end;
-    }
-
-    mpegts_input_queue_packets(mmi, mp);
+    cc_restart = (flags & MPEGTS_DATA_CC_RESTART) ? 1 : 0;
+    do {
+      len3 = MIN(len2, MPEGTS_PACKET_CHUNK);
+      mp = mpegts_packet_alloc(mi, len3);
+      mp->mp_len = len3;
+      memcpy(mp->mp_data, tsb, len3);
+      tsb  += len3;
+      len2 -= len3;
+      mpegts_input_recv_queue(mmi, mp, flags, cc_restart);
+      cc_restart = 0;
+    } while (len2 > 0);
   }
 
   /* Adjust buffer */
-end:
   if (len && (flags & MPEGTS_DATA_CC_RESTART) == 0) {
     sbuf_cut(sb, off); // cut off the bottom
     if (sb->sb_ptr >= MIN_TS_PKT * 188)
@@ -1298,36 +1505,107 @@ end:
     sb->sb_ptr = 0;    // clear
 }
 
+uint8_t *
+mpegts_input_recv_tail
+  ( mpegts_input_t *mi, mpegts_packet_t **pmp, int *space )
+{
+  mpegts_packet_t *mp = *pmp;
+
+  if (mp == NULL)
+    *pmp = mp = mpegts_packet_alloc(mi, MPEGTS_PACKET_CHUNK);
+  *space = mp->mp_size - mp->mp_len;
+  return mp->mp_data + mp->mp_len;
+}
+
+void
+mpegts_input_recv_chunk
+  ( mpegts_mux_instance_t *mmi, mpegts_packet_t **pmp,
+    int flags, mpegts_pcr_t *pcr )
+{
+  mpegts_input_t *mi = mmi->mmi_input;
+  mpegts_packet_t *mp = *pmp, *mp2;
+  int len, len2, off;
+  uint8_t *tsb;
+
+  if (mp == NULL || mp->mp_len == 0)
+    return;
+retry:
+  tsb = mp->mp_data;
+  len = mp->mp_len;
+  if (mpegts_input_recv_wait(mi, len, flags))
+    return;
+
+  /* Check for sync */
+  len2 = mpegts_input_recv_sync(mmi, tsb, len, &off);
+  len -= off;
+
+  /* Extract PCR on demand */
+  if (pcr)
+    mpegts_input_recv_pcr(tsb + off, len2, pcr);
+
+  if (len2 < MIN_TS_SYN && (flags & MPEGTS_DATA_CC_RESTART) == 0) {
+    /* Keep the unsynced rest for the next read */
+    if (off) {
+      memmove(tsb, tsb + off, len);
+      mp->mp_len = len;
+    }
+    return;
+  }
+
+  /*
+   * Pass the chunk itself, only the rest (usually the incomplete
+   * trailing packet) is copied to the head of the next chunk
+   */
+  len -= len2;
+  mp2 = NULL;
+  if (len && (flags & MPEGTS_DATA_CC_RESTART) == 0) {
+    mp2 = mpegts_packet_alloc(mi, MPEGTS_PACKET_CHUNK);
+    memcpy(mp2->mp_data, tsb + off + len2, len);
+    mp2->mp_len = len;
+  }
+  if (off) /* after a sync loss */
+    memmove(tsb, tsb + off, len2);
+  mp->mp_len = len2;
+  mpegts_input_recv_queue(mmi, mp, flags,
+                          (flags & MPEGTS_DATA_CC_RESTART) ? 1 : 0);
+
+  *pmp = mp = mp2;
+  if (mp && mp->mp_len >= MIN_TS_PKT * 188)
+    goto retry;
+}
+
 static void
 mpegts_input_table_dispatch
   ( mpegts_mux_t *mm, const char *logprefix, const uint8_t *tsb, int tsb_len, int fast )
 {
-  int i, len = 0, c = 0;
+  int i, len, gen;
   const uint8_t *tsb2, *tsb2_end;
   uint16_t pid = ((tsb[1] & 0x1f) << 8) | tsb[2];
   mpegts_table_t *mt, **vec;
+  mpegts_table_snap_t *mts;
+  struct mpegts_table_snap_list stale;
 
   /* Collate - tables may be removed during callbacks */
-  tvh_mutex_lock(&mm->mm_tables_lock);
-  i = mm->mm_num_tables;
-  vec = alloca(i * sizeof(mpegts_table_t *));
-  LIST_FOREACH(mt, &mm->mm_tables, mt_link) {
-    c++;
-    if (mt->mt_destroyed || !mt->mt_subscribed || mt->mt_pid != pid)
-      continue;
-    if (fast && (mt->mt_flags & MT_FAST) == 0)
-      continue;
-    if (!fast && (mt->mt_flags & MT_FAST) != 0)
-      continue;
+  LIST_INIT(&stale);
+  gen = atomic_get(&mm->mm_tables_gen);
+  tvh_mutex_lock(&mm->mm_table_snaps_lock);
+  if (mm->mm_table_snaps_gen != gen) {
+    mpegts_table_snap_unlink(mm, &stale);
+    mm->mm_table_snaps_gen = gen;
+  }
+  mts = mpegts_table_snap_get(mm, pid, fast);
+  len = mts->mts_count;
+  vec = alloca(len * sizeof(mpegts_table_t *));
+  for (i = 0; i < len; i++) {
+    vec[i] = mt = mts->mts_tables[i];
     mpegts_table_grab(mt);
     tprofile_start(&mt->mt_profile, "dispatch");
-    if (len < i)
-      vec[len++] = mt;
   }
-  tvh_mutex_unlock(&mm->mm_tables_lock);
-  if (i != c) {
-    tvherror(LS_TBL, "tables count inconsistency (num %d, list %d)", i, c);
-    assert(0);
+  tvh_mutex_unlock(&mm->mm_table_snaps_lock);
+
+  while ((mts = LIST_FIRST(&stale)) != NULL) {
+    LIST_REMOVE(mts, mts_link);
+    mpegts_table_snap_destroy(mts);
   }
 
   /* Process */
@@ -1390,6 +1668,7 @@ mpegts_input_table_waiting ( mpegts_input_t *mi, mpegts_mux_t *mm )
       mt->mt_defer_cmd = 0;
       if (!mt->mt_subscribed) {
         mt->mt_subscribed = 1;
+        mpegts_table_changed(mm);
         tvh_mutex_unlock(&mm->mm_tables_lock);
         mpegts_input_open_pid(mi, mm, mt->mt_pid, mpegts_table_type(mt), mt->mt_weight, mt, 0);
       } else {
@@ -1399,6 +1678,7 @@ mpegts_input_table_waiting ( mpegts_input_t *mi, mpegts_mux_t *mm )
       mt->mt_defer_cmd = 0;
       if (mt->mt_subscribed) {
         mt->mt_subscribed = 0;
+        mpegts_table_changed(mm);
         tvh_mutex_unlock(&mm->mm_tables_lock);
         mpegts_input_close_pid(mi, mm, mt->mt_pid, mpegts_table_type(mt), mt);
       } else {
@@ -1412,6 +1692,7 @@ mpegts_input_table_waiting ( mpegts_input_t *mi, mpegts_mux_t *mm )
   }
   mpegts_table_consistency_check(mm);
   tvh_mutex_unlock(&mm->mm_tables_lock);
+  mpegts_table_snap_expire(mm);
 }
 
 static int
@@ -1419,9 +1700,10 @@ mpegts_input_process
   ( mpegts_input_t *mi, mpegts_packet_t *mpkt )
 {
   uint16_t pid, pid2;
-  uint8_t cc, cc2;
-  uint8_t *tsb = mpkt->mp_data, *tsb2, *tsb2_end;
+  uint8_t cc;
+  uint8_t *tsb = mpkt->mp_data;
   int len = mpkt->mp_len, llen;
+  int te = 0, cc_errors = 0, scrambled = 0, errors;
   int type = 0, f;
   mpegts_pid_t *mp;
   mpegts_pid_sub_t *mps;
@@ -1431,6 +1713,7 @@ mpegts_input_process
   mpegts_mux_t *mm = mpkt->mp_mux;
   mpegts_mux_instance_t *mmi;
   mpegts_table_feed_t *mtf;
+  mpegts_demux_job_t *mdj;
   uint64_t tspos;
 
   if (mm == NULL || (mmi = mm->mm_active) == NULL)
@@ -1439,9 +1722,12 @@ mpegts_input_process
   assert(mm == mmi->mmi_mux);
 
   if (mpkt->mp_cc_restart) {
-    LIST_FOREACH(s, &mm->mm_transports, s_active_link)
+    LIST_FOREACH(s, &mm->mm_transports, s_active_link) {
+      tvh_mutex_lock(&s->s_stream_mutex);
       TAILQ_FOREACH(st, &s->s_components.set_all, es_link)
         st->es_cc = -1;
+      tvh_mutex_unlock(&s->s_stream_mutex);
+    }
     RB_FOREACH(mp, &mm->mm_pids, mp_link) {
       mp->mp_cc = 0xff;
       if (mp->mp_type & MPS_FTABLE) {
@@ -1453,6 +1739,15 @@ mpegts_input_process
     }
   }
 
+  /*
+   * Service delivery is batched per chunk and done in the demux worker
+   * assigned to this mux or inline when the chunk is processed
+   */
+  if (mm->mm_demux_worker >= 0)
+    mdj = mpegts_demux_job_create(mpkt);
+  else
+    mdj = &mi->mi_demux_batch;
+
   /* Process */
   tspos = mm->mm_input_pos;
   assert((len % 188) == 0);
@@ -1474,7 +1769,7 @@ mpegts_input_process
     /* Transport error */
     if (pid & 0x8000) {
       if ((pid & 0x1FFF) != 0x1FFF)
-        atomic_add(&mmi->tii_stats.te, 1);
+        te += llen / 188;
     }
 
     pid &= 0x1FFF;
@@ -1489,31 +1784,29 @@ mpegts_input_process
     /* Find PID */
     if ((mp = mpegts_mux_find_pid(mm, pid, 0))) {
 
-      /* Low level CC check */
+      /* Low level CC check, the whole run has the same header flags */
       if (tsb[3] & 0x10) {
-        for (tsb2 = tsb, tsb2_end = tsb + llen, cc2 = mp->mp_cc;
-             tsb2 < tsb2_end; tsb2 += 188) {
-          cc = tsb2[3] & 0x0f;
-          if (cc2 != 0xff && cc2 != cc) {
-            tvhtrace(LS_MPEGTS, "%s: pid %04X cc err %2d != %2d", mm->mm_nicename, pid, cc, cc2);
-            atomic_add(&mmi->tii_stats.cc, 1);
-          }
-          cc2 = (cc + 1) & 0xF;
+        cc = mp->mp_cc;
+        if ((errors = mpegts_cc_check(tsb, llen, &cc)) != 0) {
+          tvhtrace(LS_MPEGTS, "%s: pid %04X cc err %d", mm->mm_nicename, pid, errors);
+          cc_errors += errors;
         }
-        mp->mp_cc = cc2;
+        mp->mp_cc = cc;
       }
+      if (tsb[3] & 0xC0)
+        scrambled += llen / 188;
 
       type = mp->mp_type;
       
       /* Stream all PIDs */
       LIST_FOREACH(mps, &mm->mm_all_subs, mps_svcraw_link)
         if ((mps->mps_type & MPS_ALL) || (type & (MPS_TABLE|MPS_FTABLE)))
-          ts_recv_raw((mpegts_service_t *)mps->mps_owner, tspos, tsb, llen);
+          mpegts_demux_job_add(mdj, mps->mps_owner, tspos, 0, tsb, llen, 0, 1);
 
       /* Stream raw PIDs */
       if (type & MPS_RAW) {
         LIST_FOREACH(mps, &mp->mp_raw_subs, mps_raw_link)
-          ts_recv_raw((mpegts_service_t *)mps->mps_owner, tspos, tsb, llen);
+          mpegts_demux_job_add(mdj, mps->mps_owner, tspos, 0, tsb, llen, 0, 1);
       }
 
       /* Stream service data */
@@ -1523,7 +1816,7 @@ mpegts_input_process
           f = (type & (MPS_TABLE|MPS_FTABLE)) ||
               (pid == s->s_components.set_pmt_pid) ||
               (pid == s->s_components.set_pcr_pid);
-          ts_recv_packet1((mpegts_service_t*)s, tspos, pid, tsb, llen, f);
+          mpegts_demux_job_add(mdj, s, tspos, pid, tsb, llen, f, 0);
         }
       } else
       /* Stream table data */
@@ -1533,7 +1826,7 @@ mpegts_input_process
           f = (type & (MPS_TABLE|MPS_FTABLE)) ||
               (pid == s->s_components.set_pmt_pid) ||
               (pid == s->s_components.set_pcr_pid);
-          ts_recv_packet1((mpegts_service_t*)s, tspos, pid, tsb, llen, f);
+          mpegts_demux_job_add(mdj, s, tspos, pid, tsb, llen, f, 0);
         }
       }
 
@@ -1579,7 +1872,7 @@ mpegts_input_process
 
       /* Stream to all fullmux subscribers */
       LIST_FOREACH(mps, &mm->mm_all_subs, mps_svcraw_link)
-        ts_recv_raw((mpegts_service_t *)mps->mps_owner, tspos, tsb, llen);
+        mpegts_demux_job_add(mdj, mps->mps_owner, tspos, 0, tsb, llen, 0, 1);
 
     }
 
@@ -1594,7 +1887,15 @@ done:
       LIST_FIRST(&mmi->mmi_streaming_pad.sp_targets) != NULL) {
 
     streaming_message_t sm;
-    pktbuf_t *pb = pktbuf_alloc(mpkt->mp_data, tsb - mpkt->mp_data);
+    pktbuf_t *pb;
+    /* the descramblers decrypt the chunk in place (demux job) */
+    if (scrambled) {
+      pb = pktbuf_alloc(mpkt->mp_data, tsb - mpkt->mp_data);
+    } else {
+      pb = &mpkt->mp_pb;
+      pb->pb_size = tsb - mpkt->mp_data;
+      pktbuf_ref_inc(pb);
+    }
     memset(&sm, 0, sizeof(sm));
     sm.sm_type = SMT_MPEGTS;
     sm.sm_data = pb;
@@ -1602,10 +1903,26 @@ done:
     pktbuf_ref_dec(pb);
   }
 
+  /* Deliver the service data or pass it to the demux worker */
+  if (mdj->mdj_packet) {
+    mpegts_demux_job_submit(mm->mm_demux_worker, mdj);
+  } else {
+    mpegts_demux_job_run(mdj);
+    mdj->mdj_count = mdj->mdj_gcount = 0;
+  }
+
   /* Wake table */
   if (table_wakeup)
     tvh_cond_signal(&mi->mi_table_cond, 0);
 
+  /* Statistics */
+  if (te)
+    atomic_add(&mmi->tii_stats.te, te);
+  if (cc_errors)
+    atomic_add(&mmi->tii_stats.cc, cc_errors);
+  if (scrambled)
+    atomic_add(&mmi->tii_stats.scrambled, scrambled);
+
   /* Bandwidth monitoring */
   llen = tsb - mpkt->mp_data;
   atomic_add(&mmi->tii_stats.bps, llen);
@@ -1712,23 +2029,29 @@ mpegts_input_thread ( void * p )
 
   tprofile_init(&tprofile, buf);
 
-  tvh_mutex_lock(&mi->mi_input_lock);
   while (atomic_get(&mi->mi_running)) {
 
     /* Wait for a packet */
-    if (!(mp = TAILQ_FIRST(&mi->mi_input_queue))) {
+    if (!(mp = mpegts_input_ring_pop(mi))) {
       if (bytes) {
         tvhtrace(LS_MPEGTS, "input %s got %zu bytes", buf, bytes);
         bytes = 0;
       }
-      tvh_cond_wait(&mi->mi_input_cond, &mi->mi_input_lock);
+      tvh_mutex_lock(&mi->mi_input_lock);
+      atomic_set(&mi->mi_input_sleeping, 1);
+      if (mpegts_input_ring_empty(mi) && atomic_get(&mi->mi_running))
+        tvh_cond_wait(&mi->mi_input_cond, &mi->mi_input_lock);
+      atomic_set(&mi->mi_input_sleeping, 0);
+      tvh_mutex_unlock(&mi->mi_input_lock);
       continue;
     }
-    mi->mi_input_queue_size -= mp->mp_len;
-    memoryinfo_free(&mpegts_input_queue_memoryinfo, sizeof(mpegts_packet_t) + mp->mp_len);
-    TAILQ_REMOVE(&mi->mi_input_queue, mp, mp_link);
-    tvh_mutex_unlock(&mi->mi_input_lock);
-      
+
+    /* Flushed (mpegts_input_flush_mux) */
+    if (mp->mp_mux && mp->mp_mux_gen != atomic_get(&mp->mp_mux->mm_input_gen)) {
+      mpegts_mux_release(mp->mp_mux);
+      mp->mp_mux = NULL;
+    }
+
     /* Process */
     tvh_mutex_lock(&mi->mi_output_lock);
     mpegts_input_table_waiting(mi, mp->mp_mux);
@@ -1753,7 +2076,7 @@ mpegts_input_thread ( void * p )
     /* Cleanup */
     if (mp->mp_mux)
       mpegts_mux_release(mp->mp_mux);
-    free(mp);
+    mpegts_packet_release(mp);
 
 #if ENABLE_TSDEBUG
     {
@@ -1761,21 +2084,17 @@ mpegts_input_thread ( void * p )
       tsdebugcw_go();
     }
 #endif
-
-    tvh_mutex_lock(&mi->mi_input_lock);
   }
 
   tvhtrace(LS_MPEGTS, "input %s got %zu bytes (finish)", buf, bytes);
 
   /* Flush */
-  while ((mp = TAILQ_FIRST(&mi->mi_input_queue))) {
-    memoryinfo_free(&mpegts_input_queue_memoryinfo, sizeof(mpegts_packet_t) + mp->mp_len);
-    TAILQ_REMOVE(&mi->mi_input_queue, mp, mp_link);
+  tvh_mutex_lock(&mi->mi_input_lock);
+  while ((mp = mpegts_input_ring_pop(mi))) {
     if (mp->mp_mux)
       mpegts_mux_release(mp->mp_mux);
-    free(mp);
+    mpegts_packet_release(mp);
   }
-  mi->mi_input_queue_size = 0;
   tvh_mutex_unlock(&mi->mi_input_lock);
 
   tprofile_done(&tprofile);
@@ -1837,7 +2156,6 @@ mpegts_input_flush_mux
   ( mpegts_input_t *mi, mpegts_mux_t *mm )
 {
   mpegts_table_feed_t *mtf;
-  mpegts_packet_t *mp;
 
   lock_assert(&global_lock);
 
@@ -1845,14 +2163,9 @@ mpegts_input_flush_mux
   //       remove things from the Q, we simply invalidate by clearing
   //       the mux pointer and allow the threads to deal with the deletion
 
-  /* Flush input Q */
+  /* Flush input Q (the chunks are dropped in the input thread) */
   tvh_mutex_lock(&mi->mi_input_lock);
-  TAILQ_FOREACH(mp, &mi->mi_input_queue, mp_link) {
-    if (mp->mp_mux == mm) {
-      mpegts_mux_release(mm);
-      mp->mp_mux = NULL;
-    }
-  }
+  atomic_add(&mm->mm_input_gen, 1);
   tvh_mutex_unlock(&mi->mi_input_lock);
 
   /* Flush table Q */
@@ -1893,6 +2206,8 @@ mpegts_input_stream_status
   st->stream_name = strdup(buf);
   st->subs_count  = s;
   st->max_weight  = w;
+  st->queue_hwm   = atomic_get_s64(&mi->mi_input_queue_hwm);
+  st->queue_drops = atomic_get(&mi->mi_input_queue_drops);
 
   st->pids = mpegts_pid_alloc();
   RB_FOREACH(mp, &mm->mm_pids, mp_link) {
@@ -1918,6 +2233,7 @@ mpegts_input_stream_status
   st->stats.unc   = atomic_get(&mmi->tii_stats.unc);
   st->stats.cc    = atomic_get(&mmi->tii_stats.cc);
   st->stats.te    = atomic_get(&mmi->tii_stats.te);
+  st->stats.scrambled = atomic_get(&mmi->tii_stats.scrambled);
   st->stats.bps   = atomic_exchange(&mmi->tii_stats.bps, 0) * 8;
 }
 
@@ -1973,11 +2289,14 @@ mpegts_input_clear_stats ( tvh_input_t *i )
   tvh_input_instance_t *mmi_;
   mpegts_mux_instance_t *mmi;
 
+  atomic_set_s64(&mi->mi_input_queue_hwm, atomic_get_s64(&mi->mi_input_queue_size));
+  atomic_set(&mi->mi_input_queue_drops, 0);
   tvh_mutex_lock(&mi->mi_output_lock);
   LIST_FOREACH(mmi_, &mi->mi_mux_instances, tii_input_link) {
     mmi = (mpegts_mux_instance_t *)mmi_;
     atomic_set(&mmi->tii_stats.unc, 0);
     atomic_set(&mmi->tii_stats.cc, 0);
+    atomic_set(&mmi->tii_stats.scrambled, 0);
     tvh_mutex_lock(&mmi->tii_stats_mutex);
     mmi->tii_stats.te = 0;
     mmi->tii_stats.ec_block = 0;
@@ -2103,7 +2422,8 @@ mpegts_input_create0
   /* Init input/output structures */
   tvh_mutex_init(&mi->mi_input_lock, NULL);
   tvh_cond_init(&mi->mi_input_cond, 1);
-  TAILQ_INIT(&mi->mi_input_queue);
+  mi->mi_input_ring = calloc(MPEGTS_INPUT_RING_SIZE, sizeof(mpegts_packet_t *));
+  mi->mi_packet_pool = mpegts_packet_pool_create();
 
   tvh_mutex_init(&mi->mi_output_lock, NULL);
   tvh_cond_init(&mi->mi_table_cond, 1);
@@ -2168,6 +2488,10 @@ mpegts_input_delete ( mpegts_input_t *mi, int delconf )
   mpegts_input_thread_stop(mi);
 
   tprofile_queue_done(&mi->mi_qprofile);
+  mpegts_packet_pool_destroy(mi->mi_packet_pool);
+  free(mi->mi_input_ring);
+  free(mi->mi_demux_batch.mdj_items);
+  free(mi->mi_demux_batch.mdj_groups);
   tvh_mutex_destroy(&mi->mi_output_lock);
   tvh_cond_destroy(&mi->mi_table_cond);
   free(mi->mi_name);
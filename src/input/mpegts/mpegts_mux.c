@@ -761,6 +761,8 @@ mpegts_mux_do_stop ( mpegts_mux_t *mm, int delconf )
 void
 mpegts_mux_free ( mpegts_mux_t *mm )
 {
+  mpegts_table_snap_flush(mm);
+  free(mm->mm_pid_map);
   free(mm->mm_provider_network_name);
   free(mm->mm_crid_authority);
   free(mm->mm_charset);
@@ -891,8 +893,6 @@ mpegts_mux_stop ( mpegts_mux_t *mm, int force, int reason )
 
   /* Ensure PIDs are cleared */
   tvh_mutex_lock(&mi->mi_output_lock);
-  mm->mm_last_pid = -1;
-  mm->mm_last_mp = NULL;
   while ((mp = RB_FIRST(&mm->mm_pids))) {
     assert(mi);
     if (mp->mp_pid == MPEGTS_FULLMUX_PID ||
@@ -918,8 +918,7 @@ mpegts_mux_stop ( mpegts_mux_t *mm, int force, int reason )
         free(mps);
       }
     }
-    RB_REMOVE(&mm->mm_pids, mp, mp_link);
-    free(mp);
+    mpegts_mux_remove_pid(mm, mp);
   }
   tvh_mutex_unlock(&mi->mi_output_lock);
 
@@ -970,6 +969,7 @@ mpegts_mux_open_table ( mpegts_mux_t *mm, mpegts_table_t *mt, int subscribe )
     mt->mt_subscribed = 0;
     LIST_INSERT_HEAD(&mm->mm_tables, mt, mt_link);
     mm->mm_num_tables++;
+    mpegts_table_changed(mm);
     return;
   }
   if (mt->mt_flags & MT_DEFER) {
@@ -985,6 +985,7 @@ mpegts_mux_open_table ( mpegts_mux_t *mm, mpegts_table_t *mt, int subscribe )
   mi = mm->mm_active->mmi_input;
   LIST_INSERT_HEAD(&mm->mm_tables, mt, mt_link);
   mm->mm_num_tables++;
+  mpegts_table_changed(mm);
   if (subscribe && !mt->mt_subscribed) {
     mpegts_table_grab(mt);
     mt->mt_subscribed = 1;
@@ -1008,6 +1009,7 @@ mpegts_mux_unsubscribe_table ( mpegts_mux_t *mm, mpegts_table_t *mt )
   if (mt->mt_subscribed) {
     mpegts_table_grab(mt);
     mt->mt_subscribed = 0;
+    mpegts_table_changed(mm);
     tvh_mutex_unlock(&mm->mm_tables_lock);
     tvh_mutex_lock(&mi->mi_output_lock);
     mpegts_input_close_pid(mi, mm, mt->mt_pid, mpegts_table_type(mt), mt);
@@ -1037,6 +1039,7 @@ mpegts_mux_close_table ( mpegts_mux_t *mm, mpegts_table_t *mt )
     mt->mt_subscribed = 0;
     LIST_REMOVE(mt, mt_link);
     mm->mm_num_tables--;
+    mpegts_table_changed(mm);
     return;
   }
   if (mt->mt_flags & MT_DEFER) {
@@ -1044,6 +1047,7 @@ mpegts_mux_close_table ( mpegts_mux_t *mm, mpegts_table_t *mt )
       return;
     LIST_REMOVE(mt, mt_link);
     mm->mm_num_tables--;
+    mpegts_table_changed(mm);
     if (mt->mt_defer_cmd == MT_DEFER_OPEN_PID) {
       TAILQ_REMOVE(&mm->mm_defer_tables, mt, mt_defer_link);
       mt->mt_defer_cmd = 0;
@@ -1057,6 +1061,7 @@ mpegts_mux_close_table ( mpegts_mux_t *mm, mpegts_table_t *mt )
   }
   LIST_REMOVE(mt, mt_link);
   mm->mm_num_tables--;
+  mpegts_table_changed(mm);
   mm->mm_unsubscribe_table(mm, mt);
 }
 
@@ -1214,6 +1219,7 @@ mpegts_mux_create0
   }
 
   mm->mm_refcount            = 1;
+  mm->mm_demux_worker        = -1;
 
   /* Enabled by default */
   mm->mm_enabled             = MM_ENABLE;
@@ -1244,6 +1250,7 @@ mpegts_mux_create0
   mm->mm_unsubscribe_table   = mpegts_mux_unsubscribe_table;
   mm->mm_close_table         = mpegts_mux_close_table;
   tvh_mutex_init(&mm->mm_tables_lock, NULL);
+  tvh_mutex_init(&mm->mm_table_snaps_lock, NULL);
   TAILQ_INIT(&mm->mm_table_queue);
   TAILQ_INIT(&mm->mm_defer_tables);
   LIST_INIT(&mm->mm_descrambler_caids);
@@ -1251,7 +1258,6 @@ mpegts_mux_create0
   TAILQ_INIT(&mm->mm_descrambler_emms);
   tvh_mutex_init(&mm->mm_descrambler_lock, NULL);
 
-  mm->mm_last_pid            = -1;
   mm->mm_created             = gclk();
 
   /* Configuration */
@@ -1509,6 +1515,22 @@ static int mp_cmp ( mpegts_pid_t *a, mpegts_pid_t *b )
   return a->mp_pid - b->mp_pid;
 }
 
+/*
+ * The direct index is optional, without it (allocation failure)
+ * the PIDs are looked up in the tree
+ */
+static void
+mpegts_mux_pid_map_create ( mpegts_mux_t *mm )
+{
+  mpegts_pid_t *mp;
+
+  mm->mm_pid_map = calloc(MPEGTS_PID_MAP_SIZE, sizeof(mpegts_pid_t *));
+  if (mm->mm_pid_map == NULL)
+    return;
+  RB_FOREACH(mp, &mm->mm_pids, mp_link)
+    mm->mm_pid_map[mp->mp_pid] = mp;
+}
+
 mpegts_pid_t *
 mpegts_mux_find_pid_ ( mpegts_mux_t *mm, int pid, int create )
 {
@@ -1531,12 +1553,29 @@ mpegts_mux_find_pid_ ( mpegts_mux_t *mm, int pid, int create )
     }
   }
   if (mp) {
-    mm->mm_last_pid = pid;
-    mm->mm_last_mp = mp;
+    /* Keep the direct index in sync with the tree */
+    if (mm->mm_pid_map == NULL)
+      mpegts_mux_pid_map_create(mm);
+    if (mm->mm_pid_map)
+      mm->mm_pid_map[pid] = mp;
   }
   return mp;
 }
 
+void
+mpegts_mux_remove_pid ( mpegts_mux_t *mm, mpegts_pid_t *mp )
+{
+  RB_REMOVE(&mm->mm_pids, mp, mp_link);
+  if (mm->mm_pid_map) {
+    mm->mm_pid_map[mp->mp_pid] = NULL;
+    if (RB_FIRST(&mm->mm_pids) == NULL) {
+      free(mm->mm_pid_map);
+      mm->mm_pid_map = NULL;
+    }
+  }
+  free(mp);
+}
+
 /* **************************************************************************
  * Misc
  * *************************************************************************/
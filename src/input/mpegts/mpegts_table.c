@@ -158,6 +158,7 @@ mpegts_table_destroy ( mpegts_table_t *mt )
   if (!mt->mt_destroyed)
     mpegts_table_destroy_(mt);
   tvh_mutex_unlock(&mm->mm_tables_lock);
+  mpegts_table_snap_expire(mm);
 }
 
 /**
@@ -223,6 +224,7 @@ mpegts_table_add
       mt->mt_pid        = pid;
       mt->mt_weight     = weight;
       mt->mt_table      = tableid;
+      mpegts_table_changed(mm);
       mm->mm_open_table(mm, mt, 1);
     } else if (pid >= 0) {
       if (mt->mt_pid != pid)
@@ -304,8 +306,156 @@ mpegts_table_flush_all ( mpegts_mux_t *mm )
   assert(TAILQ_FIRST(&mm->mm_defer_tables) == NULL);
   assert(LIST_FIRST(&mm->mm_tables) == NULL);
   tvh_mutex_unlock(&mm->mm_tables_lock);
+  mpegts_table_snap_flush(mm);
 }
 
+/**
+ * Subscribed tables for one PID
+ *
+ * The snapshot is kept in mm_table_snaps and reused until the table
+ * list or the table subscriptions change (mm_tables_gen), then all
+ * snapshots are released (mpegts_table_snap_expire).
+ */
+static mpegts_table_snap_t *
+mpegts_table_snap_create ( mpegts_mux_t *mm, int pid, int fast )
+{
+  mpegts_table_snap_t *mts;
+  mpegts_table_t *mt;
+  int i, c = 0, count = 0;
+
+  tvh_mutex_lock(&mm->mm_tables_lock);
+  i = mm->mm_num_tables;
+  LIST_FOREACH(mt, &mm->mm_tables, mt_link) {
+    c++;
+    if (mt->mt_destroyed || !mt->mt_subscribed || mt->mt_pid != pid)
+      continue;
+    if (!fast != !(mt->mt_flags & MT_FAST))
+      continue;
+    count++;
+  }
+  if (i != c) {
+    tvherror(LS_TBL, "tables count inconsistency (num %d, list %d)", i, c);
+    assert(0);
+  }
+  mts = malloc(sizeof(*mts) + count * sizeof(mpegts_table_t *));
+  mts->mts_pid = pid;
+  mts->mts_fast = fast;
+  mts->mts_count = 0;
+  LIST_FOREACH(mt, &mm->mm_tables, mt_link) {
+    if (mt->mt_destroyed || !mt->mt_subscribed || mt->mt_pid != pid)
+      continue;
+    if (!fast != !(mt->mt_flags & MT_FAST))
+      continue;
+    mpegts_table_grab(mt);
+    mts->mts_tables[mts->mts_count++] = mt;
+  }
+  tvh_mutex_unlock(&mm->mm_tables_lock);
+  return mts;
+}
+
+static inline int
+mpegts_table_snap_index ( int pid, int fast )
+{
+  return (pid & 0x1fff) * 2 + !!fast;
+}
+
+/*
+ * Find or create the snapshot (mm_table_snaps_lock held), the snapshots
+ * are indexed by PID, without the index (allocation failure) the list
+ * is scanned
+ */
+mpegts_table_snap_t *
+mpegts_table_snap_get ( mpegts_mux_t *mm, int pid, int fast )
+{
+  mpegts_table_snap_t *mts;
+  int idx = mpegts_table_snap_index(pid, fast);
+
+  if (mm->mm_table_snap_map == NULL)
+    mm->mm_table_snap_map = calloc(MPEGTS_TABLE_SNAP_MAP_SIZE,
+                                   sizeof(mpegts_table_snap_t *));
+  if (mm->mm_table_snap_map) {
+    if ((mts = mm->mm_table_snap_map[idx]) != NULL)
+      return mts;
+  } else {
+    LIST_FOREACH(mts, &mm->mm_table_snaps, mts_link)
+      if (mts->mts_pid == pid && mts->mts_fast == fast)
+        return mts;
+  }
+  mts = mpegts_table_snap_create(mm, pid, fast);
+  LIST_INSERT_HEAD(&mm->mm_table_snaps, mts, mts_link);
+  if (mm->mm_table_snap_map)
+    mm->mm_table_snap_map[idx] = mts;
+  return mts;
+}
+
+/*
+ * Move all snapshots to the stale list (mm_table_snaps_lock held)
+ */
+void
+mpegts_table_snap_unlink
+  ( mpegts_mux_t *mm, struct mpegts_table_snap_list *stale )
+{
+  mpegts_table_snap_t *mts;
+
+  while ((mts = LIST_FIRST(&mm->mm_table_snaps)) != NULL) {
+    LIST_REMOVE(mts, mts_link);
+    if (mm->mm_table_snap_map)
+      mm->mm_table_snap_map[mpegts_table_snap_index(mts->mts_pid, mts->mts_fast)] = NULL;
+    LIST_INSERT_HEAD(stale, mts, mts_link);
+  }
+}
+
+void
+mpegts_table_snap_destroy ( mpegts_table_snap_t *mts )
+{
+  int i;
+
+  for (i = 0; i < mts->mts_count; i++)
+    mpegts_table_release(mts->mts_tables[i]);
+  free(mts);
+}
+
+void
+mpegts_table_snap_flush ( mpegts_mux_t *mm )
+{
+  struct mpegts_table_snap_list stale;
+  mpegts_table_snap_t *mts;
+
+  LIST_INIT(&stale);
+  tvh_mutex_lock(&mm->mm_table_snaps_lock);
+  mpegts_table_snap_unlink(mm, &stale);
+  free(mm->mm_table_snap_map);
+  mm->mm_table_snap_map = NULL;
+  tvh_mutex_unlock(&mm->mm_table_snaps_lock);
+  while ((mts = LIST_FIRST(&stale)) != NULL) {
+    LIST_REMOVE(mts, mts_link);
+    mpegts_table_snap_destroy(mts);
+  }
+}
+
+/*
+ * Release all snapshots (and the table references) when the tables
+ * were changed
+ */
+void
+mpegts_table_snap_expire ( mpegts_mux_t *mm )
+{
+  struct mpegts_table_snap_list stale;
+  mpegts_table_snap_t *mts;
+  int gen = atomic_get(&mm->mm_tables_gen);
+
+  LIST_INIT(&stale);
+  tvh_mutex_lock(&mm->mm_table_snaps_lock);
+  if (mm->mm_table_snaps_gen != gen) {
+    mpegts_table_snap_unlink(mm, &stale);
+    mm->mm_table_snaps_gen = gen;
+  }
+  tvh_mutex_unlock(&mm->mm_table_snaps_lock);
+  while ((mts = LIST_FIRST(&stale)) != NULL) {
+    LIST_REMOVE(mts, mts_link);
+    mpegts_table_snap_destroy(mts);
+  }
+}
 
 /******************************************************************************
  * Editor Configuration
@@ -1450,6 +1450,49 @@ satip_frontend_close_rtsp
   http_client_close(rtsp);
 }
 
+/*
+ * The RTP over UDP payloads go to the pooled input chunk, the
+ * interleaved (TCP) data to sf_sbuf
+ */
+static void
+satip_frontend_rtp_write
+  ( satip_frontend_t *lfe, uint32_t *_unc, uint8_t *data, int len )
+{
+  mpegts_packet_t *mp = lfe->sf_chunk;
+
+  if (mp == NULL) {
+    sbuf_append(&lfe->sf_sbuf, data, len);
+  } else if (mp->mp_len + len <= mp->mp_size) {
+    memcpy(mp->mp_data + mp->mp_len, data, len);
+    mp->mp_len += len;
+  } else {
+    *_unc += len / 188;
+  }
+}
+
+/*
+ * The plain RTP header (no CSRC and extension) in the sequence, the
+ * payload can stay where it was received
+ */
+static int
+satip_frontend_rtp_direct
+  ( satip_frontend_t *lfe, uint32_t *_seq, uint8_t *p, int c )
+{
+  int nseq;
+
+  if (c < 12 || (p[0] & 0xdf) != 0x80 || (p[1] & 0x7f) != 33 ||
+      ((c - 12) % 188) != 0)
+    return 0;
+  if (*_seq == (uint32_t)-1 || lfe->sf_skip_ts > 0 ||
+      !TAILQ_EMPTY(&lfe->sf_udp_packets))
+    return 0;
+  nseq = (p[2] << 8) | p[3];
+  if (((*_seq + 1) & 0xffff) != nseq)
+    return 0;
+  *_seq = nseq;
+  return 1;
+}
+
 static int
 satip_frontend_rtp_decode
   ( satip_frontend_t *lfe, uint32_t *_seq, uint32_t *_unc,
@@ -1504,7 +1547,7 @@ satip_frontend_rtp_decode
     }
   } else {
 wrdata:
-    sbuf_append(&lfe->sf_sbuf, p + pos, len);
+    satip_frontend_rtp_write(lfe, _unc, p + pos, len);
   }
 next:
   up = TAILQ_FIRST(&lfe->sf_udp_packets);
@@ -1571,6 +1614,8 @@ satip_frontend_input_thread ( void *aux )
 #define RTP_PKTS      64
 #define UDP_PKT_SIZE  1472         /* this is maximum UDP payload (standard ethernet) */
 #define RTP_PKT_SIZE  (UDP_PKT_SIZE - 12)             /* minus RTP minimal RTP header */
+#define RTP_TS_SIZE   (7*188)            /* usual TS payload, read to the chunk */
+#define RTP_REORDER   8                  /* chunk room for the requeued packets */
 #define HTTP_CMD_NONE 9874
   satip_frontend_t *lfe = aux, *lfe_master;
   satip_tune_req_t *tr = NULL;
@@ -1580,9 +1625,10 @@ satip_frontend_input_thread ( void *aux )
   dvb_mux_t *lm;
   char buf[256];
   struct iovec *iovec;
-  uint8_t b[2048], session[32];
+  uint8_t b[2048], session[32], *tsb, *p;
   sbuf_t *sb;
-  int nfds, i, r, tc, rtp_port, start = 0;
+  mpegts_packet_t *mp;
+  int nfds, i, r, tc, rtp_port, start = 0, space;
   size_t c;
   tvhpoll_event_t ev[3];
   tvhpoll_t *efd;
@@ -1618,6 +1664,7 @@ new_tune:
 
   udp_rtp_packet_destroy_all(lfe);
   sbuf_free(sb);
+  mpegts_input_recv_done(&lfe->sf_chunk);
   udp_multirecv_free(&um);
   udp_close(rtcp);
   udp_close(rtp);
@@ -2078,7 +2125,9 @@ new_tune:
     if (ev[0].ptr != rtp)
       continue;     
 
-    tc = udp_multirecv_read(&um, rtp->fd, RTP_PKTS, &iovec);
+    tsb = mpegts_input_recv_tail((mpegts_input_t *)lfe, &lfe->sf_chunk, &space);
+    tc = udp_multirecv_read_split(&um, rtp->fd, space / RTP_PKT_SIZE - RTP_REORDER,
+                                  12, tsb, RTP_TS_SIZE, &iovec);
 
     if (tc < 0) {
       if (ERRNO_AGAIN(errno))
@@ -2094,20 +2143,30 @@ new_tune:
       lfe->sf_last_activity_tstamp = mclk();
     }
 
+    mp = lfe->sf_chunk;
     for (i = 0, unc = 0; i < tc; i++) {
-      if (satip_frontend_rtp_decode(lfe, &seq, &unc, iovec[i].iov_base, iovec[i].iov_len) == 0)
+      p = iovec[i].iov_base;
+      c = iovec[i].iov_len;
+      if (satip_frontend_rtp_direct(lfe, &seq, p, c)) {
+        tsb = udp_multirecv_split_move(&um, i, 12, c - 12, mp->mp_data + mp->mp_len);
+        mp->mp_len = tsb - mp->mp_data;
         continue;
+      }
+      /* the rest is processed from the complete datagrams */
+      udp_multirecv_split_linear(&um, i);
+      satip_frontend_rtp_decode(lfe, &seq, &unc, p, c);
     }
     tvh_mutex_lock(&lfe->sf_dvr_lock);
     if (lfe->sf_req == lfe->sf_req_thread) {
       atomic_add(&mmi->tii_stats.unc, unc);
-      mpegts_input_recv_packets(mmi, sb, 0, NULL);
+      mpegts_input_recv_chunk(mmi, &lfe->sf_chunk, 0, NULL);
     } else
       fatal = 1;
     tvh_mutex_unlock(&lfe->sf_dvr_lock);
   }
 
   sbuf_free(sb);
+  mpegts_input_recv_done(&lfe->sf_chunk);
   udp_rtp_packet_destroy_all(lfe);
   udp_multirecv_free(&um);
   lfe->sf_curmux = NULL;
@@ -2132,6 +2191,7 @@ done:
   udp_close(rtcp);
   udp_close(rtp);
   rtcp = rtp = NULL;
+  mpegts_input_recv_done(&lfe->sf_chunk);
 
   if (lfe->sf_teardown_delay && lfe_master) {
     tvh_mutex_lock(&lfe->sf_device->sd_tune_mutex);
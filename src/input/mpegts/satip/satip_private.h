@@ -169,6 +169,7 @@ struct satip_frontend
   satip_tune_req_t          *sf_req;
   satip_tune_req_t          *sf_req_thread;
   sbuf_t                     sf_sbuf;
+  mpegts_packet_t           *sf_chunk;   // UDP direct input
   int                        sf_skip_ts;
   const char *               sf_display_name;
   uint32_t                   sf_seq;
@@ -142,16 +142,17 @@ skip_cc:
 
 /**
  * Process service stream packets, optionally descramble
+ *
+ * Called with s_stream_mutex held for a running service
  */
-int
-ts_recv_packet1
-  (mpegts_service_t *t, uint64_t tspos, uint16_t pid,
+static int
+ts_recv_packet1_locked
+  (mpegts_service_t *t, elementary_stream_t *st, uint16_t pid,
    const uint8_t *tsb, int len, int table)
 {
-  elementary_stream_t *st;
   uint_fast8_t scrambled, error = 0;
   int r;
-  
+
   /* Error */
   if (tsb[1] & 0x80)
     error = 1;
@@ -161,14 +162,6 @@ ts_recv_packet1
          tsb[0], tsb[1], tsb[2], tsb[3], tsb[4], tsb[5]);
 #endif
 
-  tvh_mutex_lock(&t->s_stream_mutex);
-
-  /* Service inactive - ignore */
-  if(t->s_status != SERVICE_RUNNING) {
-    tvh_mutex_unlock(&t->s_stream_mutex);
-    return 0;
-  }
-
   service_set_streaming_status_flags((service_t*)t, TSS_INPUT_HARDWARE);
 
   if(error) {
@@ -178,12 +171,8 @@ ts_recv_packet1
               service_nicename((service_t*)t), t->s_tei_log.count);
   }
 
-  st = elementary_stream_find(&t->s_components, pid);
-
-  if((st == NULL) && (pid != t->s_components.set_pcr_pid) && !table) {
-    tvh_mutex_unlock(&t->s_stream_mutex);
+  if((st == NULL) && (pid != t->s_components.set_pcr_pid) && !table)
     return 0;
-  }
 
   if(!error)
     service_set_streaming_status_flags((service_t*)t, TSS_INPUT_SERVICE);
@@ -199,10 +188,8 @@ ts_recv_packet1
 
     /* scrambled stream */
     r = descrambler_descramble((service_t *)t, st, tsb, len);
-    if(r > 0) {
-      tvh_mutex_unlock(&t->s_stream_mutex);
+    if(r > 0)
       return 1;
-    }
 
     if(!error && service_is_encrypted((service_t*)t)) {
       if(r == 0) {
@@ -215,10 +202,27 @@ ts_recv_packet1
   } else {
     ts_recv_packet0(t, st, tsb, len);
   }
-  tvh_mutex_unlock(&t->s_stream_mutex);
   return 1;
 }
 
+/**
+ * Process service stream packets, optionally descramble
+ */
+int
+ts_recv_packet1
+  (mpegts_service_t *t, uint64_t tspos, uint16_t pid,
+   const uint8_t *tsb, int len, int table)
+{
+  int r = 0;
+
+  tvh_mutex_lock(&t->s_stream_mutex);
+  /* Service inactive - ignore */
+  if(t->s_status == SERVICE_RUNNING)
+    r = ts_recv_packet1_locked(t, elementary_stream_find(&t->s_components, pid),
+                               pid, tsb, len, table);
+  tvh_mutex_unlock(&t->s_stream_mutex);
+  return r;
+}
 
 /*
  * Process transport stream packets, simple version
@@ -257,12 +261,11 @@ ts_skip_packet2(mpegts_service_t *t, const uint8_t *tsb, int len)
 /*
  *
  */
-void
-ts_recv_raw(mpegts_service_t *t, uint64_t tspos, const uint8_t *tsb, int len)
+static void
+ts_recv_raw_locked(mpegts_service_t *t, const uint8_t *tsb, int len)
 {
   int pid, parent = 0;
 
-  tvh_mutex_lock(&t->s_stream_mutex);
   service_set_streaming_status_flags((service_t*)t, TSS_MUX_PACKETS);
   if (!idnode_set_empty(&t->s_slaves)) {
     /* If PID is owned by a slave service, let parent service to
@@ -282,6 +285,55 @@ ts_recv_raw(mpegts_service_t *t, uint64_t tspos, const uint8_t *tsb, int len)
       t->s_streaming_live |= TSS_LIVE;
     }
   }
+}
+
+void
+ts_recv_raw(mpegts_service_t *t, uint64_t tspos, const uint8_t *tsb, int len)
+{
+  tvh_mutex_lock(&t->s_stream_mutex);
+  ts_recv_raw_locked(t, tsb, len);
+  tvh_mutex_unlock(&t->s_stream_mutex);
+}
+
+/*
+ * Deliver all items for the service from one input chunk batch
+ *
+ * The items of the service are chained from the first one (see
+ * mpegts_demux_job_add). The stream mutex is taken only once for the
+ * whole batch and the elementary stream is resolved once for the
+ * consecutive items of the same PID. The descrambler might drop the
+ * stream mutex (ECM reset), so the resolved stream is used only while
+ * the stream set did not change and the service state is checked for
+ * each item (the raw items too, the service might be stopped after
+ * the job was queued).
+ */
+void
+ts_recv_batch(mpegts_service_t *t, mpegts_demux_item_t *items, int first)
+{
+  mpegts_demux_item_t *mdi;
+  elementary_set_t *set = &t->s_components;
+  elementary_stream_t *st = NULL;
+  uint32_t gen = 0;
+  int i, pid = -1;
+
+  tvh_mutex_lock(&t->s_stream_mutex);
+  for (i = first; i >= 0; i = mdi->mdi_next) {
+    mdi = &items[i];
+    /* Service inactive - ignore */
+    if (t->s_status != SERVICE_RUNNING)
+      continue;
+    if (mdi->mdi_raw) {
+      ts_recv_raw_locked(t, mdi->mdi_tsb, mdi->mdi_len);
+      continue;
+    }
+    if (mdi->mdi_pid != pid || set->set_index_gen != gen) {
+      pid = mdi->mdi_pid;
+      st = elementary_stream_find(set, pid);
+      gen = set->set_index_gen;
+    }
+    ts_recv_packet1_locked(t, st, pid, mdi->mdi_tsb,
+                           mdi->mdi_len, mdi->mdi_table);
+  }
   tvh_mutex_unlock(&t->s_stream_mutex);
 }
 
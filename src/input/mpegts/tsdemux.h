@@ -35,4 +35,7 @@ void ts_skip_packet2(struct mpegts_service *t, const uint8_t *tsb, int len);
 void ts_recv_raw
   (struct mpegts_service *t, uint64_t tspos, const uint8_t *tsb, int len);
 
+void ts_recv_batch
+  (struct mpegts_service *t, struct mpegts_demux_item *items, int first);
+
 #endif /* TSDEMUX_H */
@@ -1104,6 +1104,7 @@ main(int argc, char **argv)
     log_debug  = opt_log_debug;
 
   tvh_thread_init(opt_thread_debug);
+  tvh_crc32_init();
 
   tvhlog_init(log_level, log_options, opt_logpath);
   tvhlog_set_debug(log_debug);
@@ -1264,6 +1265,7 @@ main(int argc, char **argv)
   memoryinfo_register(&pkt_memoryinfo);
   memoryinfo_register(&pktbuf_memoryinfo);
   memoryinfo_register(&pktref_memoryinfo);
+  pkt_init();
 
   /**
    * Initialize subsystems
@@ -1428,6 +1430,7 @@ main(int argc, char **argv)
   tvhftrace(LS_MAIN, intlconv_done);
   tvhftrace(LS_MAIN, urlparse_done);
   tvhftrace(LS_MAIN, streaming_done);
+  tvhftrace(LS_MAIN, pkt_done);
   tvhftrace(LS_MAIN, idnode_done);
   tvhftrace(LS_MAIN, notify_done);
   tvhftrace(LS_MAIN, spawn_done);
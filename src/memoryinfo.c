@@ -80,6 +80,22 @@ const idclass_t memoryinfo_class = {
       .off      = offsetof(memoryinfo_t, my_peak_count),
       .opts     = PO_RDONLY | PO_NOSAVE,
     },
+    {
+      .type     = PT_S64_ATOMIC,
+      .id       = "cached_size",
+      .name     = N_("Cached size"),
+      .desc     = N_("Size of the free objects kept in the slab caches."),
+      .off      = offsetof(memoryinfo_t, my_cached_size),
+      .opts     = PO_RDONLY | PO_NOSAVE,
+    },
+    {
+      .type     = PT_S64_ATOMIC,
+      .id       = "cached_count",
+      .name     = N_("Cached objects"),
+      .desc     = N_("Count of the free objects kept in the slab caches."),
+      .off      = offsetof(memoryinfo_t, my_cached_count),
+      .opts     = PO_RDONLY | PO_NOSAVE,
+    },
     {}
   }
 };
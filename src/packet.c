@@ -23,6 +23,7 @@
 #include "string.h"
 #include "atomic.h"
 #include "memoryinfo.h"
+#include "slab.h"
 
 #ifndef PKTBUF_DATA_ALIGN
 #define PKTBUF_DATA_ALIGN 64
@@ -32,6 +33,82 @@ memoryinfo_t pkt_memoryinfo = { .my_name = "Packets" };
 memoryinfo_t pktbuf_memoryinfo = { .my_name = "Packet buffers" };
 memoryinfo_t pktref_memoryinfo = { .my_name = "Packet references" };
 
+/*
+ * Slab caches, the payloads use the power of two size classes (the
+ * larger buffers and the buffers passed to pktbuf_make are on heap),
+ * the memory info counts the class size
+ */
+static tvh_slab_t pkt_slab = TVH_SLAB("packet", sizeof(th_pkt_t), 64);
+static tvh_slab_t pktref_slab = TVH_SLAB("packet reference", sizeof(th_pktref_t), 64);
+static tvh_slab_t pktbuf_slab = TVH_SLAB("packet buffer", sizeof(pktbuf_t), 64);
+static tvh_slab_t pktbuf_data_slab[] = {
+  TVH_SLAB("packet data 256", 256, 64),
+  TVH_SLAB("packet data 512", 512, 64),
+  TVH_SLAB("packet data 1k", 1024, 64),
+  TVH_SLAB("packet data 2k", 2048, 32),
+  TVH_SLAB("packet data 4k", 4096, 32),
+  TVH_SLAB("packet data 8k", 8192, 16),
+  TVH_SLAB("packet data 16k", 16384, 8),
+  TVH_SLAB("packet data 32k", 32768, 4),
+  TVH_SLAB("packet data 64k", 65536, 4),
+  /* the video frames, keep only few buffers in the depot */
+  { .sl_name = "packet data 128k", .sl_size = 131072,  .sl_batch = 1, .sl_depot_max = 8 },
+  { .sl_name = "packet data 256k", .sl_size = 262144,  .sl_batch = 1, .sl_depot_max = 4 },
+  { .sl_name = "packet data 512k", .sl_size = 524288,  .sl_batch = 1, .sl_depot_max = 4 },
+  { .sl_name = "packet data 1M",   .sl_size = 1048576, .sl_batch = 1, .sl_depot_max = 2 },
+  { .sl_name = "packet data 2M",   .sl_size = 2097152, .sl_batch = 1, .sl_depot_max = 2 },
+};
+
+/*
+ * Allocate the payload buffer from the size class, the allocated size
+ * is returned in alloc (if not NULL)
+ */
+uint8_t *
+pktbuf_data_alloc(size_t size, uint8_t *class, size_t *alloc)
+{
+  int i;
+
+  for (i = 0; i < ARRAY_SIZE(pktbuf_data_slab); i++)
+    if (size <= pktbuf_data_slab[i].sl_size) {
+      *class = i + 1;
+      if (alloc)
+        *alloc = pktbuf_data_slab[i].sl_size;
+      return tvh_slab_alloc(&pktbuf_data_slab[i]);
+    }
+  *class = 0;
+  if (alloc)
+    *alloc = size;
+  return malloc(size);
+}
+
+void
+pktbuf_data_free(uint8_t *data, uint8_t class)
+{
+  if (class)
+    tvh_slab_free(&pktbuf_data_slab[class - 1], data);
+  else
+    free(data);
+}
+
+size_t
+pktbuf_data_class_size(uint8_t class)
+{
+  if (class == 0 || class > ARRAY_SIZE(pktbuf_data_slab))
+    return 0;
+  return pktbuf_data_slab[class - 1].sl_size;
+}
+
+/*
+ * Allocated size of the buffer (memory info)
+ */
+static inline size_t
+pktbuf_mem_size(pktbuf_t *pb)
+{
+  if (pb->pb_class)
+    return sizeof(*pb) + pktbuf_data_class_size(pb->pb_class);
+  return sizeof(*pb) + pb->pb_head + pb->pb_size;
+}
+
 /*
  *
  */
@@ -42,7 +119,7 @@ pkt_destroy(th_pkt_t *pkt)
     pktbuf_ref_dec(pkt->pkt_payload);
     pktbuf_ref_dec(pkt->pkt_meta);
 
-    free(pkt);
+    tvh_slab_free(&pkt_slab, pkt);
     memoryinfo_free(&pkt_memoryinfo, sizeof(*pkt));
   }
 }
@@ -67,8 +144,9 @@ pkt_alloc(streaming_component_type_t type, const uint8_t *data, size_t datalen,
     payload = NULL;
   }
 
-  pkt = calloc(1, sizeof(th_pkt_t));
+  pkt = tvh_slab_alloc(&pkt_slab);
   if (pkt) {
+    memset(pkt, 0, sizeof(*pkt));
     pkt->pkt_type = type;
     pkt->pkt_payload = payload;
     pkt->pkt_dts = dts;
@@ -90,7 +168,7 @@ pkt_alloc(streaming_component_type_t type, const uint8_t *data, size_t datalen,
 th_pkt_t *
 pkt_copy_shallow(th_pkt_t *pkt)
 {
-  th_pkt_t *n = malloc(sizeof(th_pkt_t));
+  th_pkt_t *n = tvh_slab_alloc(&pkt_slab);
 
   if (n) {
     blacklisted_memcpy(n, pkt, sizeof(*pkt));
@@ -113,7 +191,7 @@ pkt_copy_shallow(th_pkt_t *pkt)
 th_pkt_t *
 pkt_copy_nodata(th_pkt_t *pkt)
 {
-  th_pkt_t *n = malloc(sizeof(th_pkt_t));
+  th_pkt_t *n = tvh_slab_alloc(&pkt_slab);
 
   if (n) {
     blacklisted_memcpy(n, pkt, sizeof(*pkt));
@@ -212,7 +290,7 @@ pktref_clear_queue(struct th_pktref_queue *q)
     while((pr = TAILQ_FIRST(q)) != NULL) {
       TAILQ_REMOVE(q, pr, pr_link);
       pkt_ref_dec(pr->pr_pkt);
-      free(pr);
+      tvh_slab_free(&pktref_slab, pr);
       memoryinfo_free(&pktref_memoryinfo, sizeof(*pr));
     }
   }
@@ -225,7 +303,7 @@ pktref_clear_queue(struct th_pktref_queue *q)
 void
 pktref_enqueue(struct th_pktref_queue *q, th_pkt_t *pkt)
 {
-  th_pktref_t *pr = malloc(sizeof(th_pktref_t));
+  th_pktref_t *pr = tvh_slab_alloc(&pktref_slab);
   if (pr) {
     pr->pr_pkt = pkt;
     TAILQ_INSERT_TAIL(q, pr, pr_link);
@@ -241,7 +319,7 @@ void
 pktref_enqueue_sorted(struct th_pktref_queue *q, th_pkt_t *pkt,
                       int (*cmp)(const void *, const void *))
 {
-  th_pktref_t *pr = malloc(sizeof(th_pktref_t));
+  th_pktref_t *pr = tvh_slab_alloc(&pktref_slab);
   if (pr) {
     pr->pr_pkt = pkt;
     TAILQ_INSERT_SORTED(q, pr, pr_link, cmp);
@@ -260,7 +338,7 @@ pktref_remove(struct th_pktref_queue *q, th_pktref_t *pr)
     if (q)
       TAILQ_REMOVE(q, pr, pr_link);
     pkt_ref_dec(pr->pr_pkt);
-    free(pr);
+    tvh_slab_free(&pktref_slab, pr);
     memoryinfo_free(&pktref_memoryinfo, sizeof(*pr));
   }
 }
@@ -292,7 +370,7 @@ pktref_get_first(struct th_pktref_queue *q)
   if (pr) {
     pkt = pr->pr_pkt;
     TAILQ_REMOVE(q, pr, pr_link);
-    free(pr);
+    tvh_slab_free(&pktref_slab, pr);
     memoryinfo_free(&pktref_memoryinfo, sizeof(*pr));
     return pkt;
   }
@@ -317,7 +395,7 @@ pktref_insert_head(struct th_pktref_queue *q, th_pkt_t *pkt)
 th_pktref_t *
 pktref_create(th_pkt_t *pkt)
 {
-  th_pktref_t *pr = malloc(sizeof(th_pktref_t));
+  th_pktref_t *pr = tvh_slab_alloc(&pktref_slab);
   if (pr) {
     pr->pr_pkt = pkt;
     memoryinfo_alloc(&pktref_memoryinfo, sizeof(*pr));
@@ -333,9 +411,13 @@ void
 pktbuf_destroy(pktbuf_t *pb)
 {
   if (pb) {
-    memoryinfo_free(&pktbuf_memoryinfo, sizeof(*pb) + pb->pb_size);
-    free(pb->pb_data);
-    free(pb);
+    if (pb->pb_free) {
+      pb->pb_free(pb);
+      return;
+    }
+    memoryinfo_free(&pktbuf_memoryinfo, pktbuf_mem_size(pb));
+    pktbuf_data_free(pb->pb_data - pb->pb_head, pb->pb_class);
+    tvh_slab_free(&pktbuf_slab, pb);
   }
 }
 
@@ -344,9 +426,13 @@ pktbuf_ref_dec(pktbuf_t *pb)
 {
   if (pb) {
     if((atomic_add(&pb->pb_refcount, -1)) == 1) {
-      memoryinfo_free(&pktbuf_memoryinfo, sizeof(*pb) + pb->pb_size);
-      free(pb->pb_data);
-      free(pb);
+      if (pb->pb_free) {
+        pb->pb_free(pb);
+        return;
+      }
+      memoryinfo_free(&pktbuf_memoryinfo, pktbuf_mem_size(pb));
+      pktbuf_data_free(pb->pb_data - pb->pb_head, pb->pb_class);
+      tvh_slab_free(&pktbuf_slab, pb);
     }
   }
 }
@@ -365,37 +451,66 @@ pktbuf_t *
 pktbuf_alloc(const uint8_t *data, size_t size)
 {
   pktbuf_t *pb;
-  uint8_t *buffer;
+  uint8_t *buffer, class = 0;
 
-  buffer = size > 0 ? malloc(size) : NULL;
-  if (buffer) {\
+  buffer = size > 0 ? pktbuf_data_alloc(size, &class, NULL) : NULL;
+  if (buffer) {
     if (data != NULL)
       memcpy(buffer, data, size);
   } else if (size > 0) {
     return NULL;
   }
-  pb = malloc(sizeof(pktbuf_t));
+  pb = tvh_slab_alloc(&pktbuf_slab);
   if (pb == NULL) {
-    free(buffer);
+    pktbuf_data_free(buffer, class);
     return NULL;
   }
   pb->pb_refcount = 1;
   pb->pb_data = buffer;
   pb->pb_size = size;
   pb->pb_err = 0;
-  memoryinfo_alloc(&pktbuf_memoryinfo, sizeof(*pb) + size);
+  pb->pb_class = class;
+  pb->pb_head = 0;
+  pb->pb_free = NULL;
+  memoryinfo_alloc(&pktbuf_memoryinfo, pktbuf_mem_size(pb));
   return pb;
 }
 
 pktbuf_t *
 pktbuf_make(void *data, size_t size)
 {
-  pktbuf_t *pb = malloc(sizeof(pktbuf_t));
+  pktbuf_t *pb = tvh_slab_alloc(&pktbuf_slab);
   if (pb) {
     pb->pb_refcount = 1;
     pb->pb_size = size;
     pb->pb_data = data;
-    memoryinfo_alloc(&pktbuf_memoryinfo, sizeof(*pb) + pb->pb_size);
+    pb->pb_err = 0;
+    pb->pb_class = 0;
+    pb->pb_head = 0;
+    pb->pb_free = NULL;
+    memoryinfo_alloc(&pktbuf_memoryinfo, pktbuf_mem_size(pb));
+  }
+  return pb;
+}
+
+/*
+ * Take over the buffer from pktbuf_data_alloc (or malloc for class 0),
+ * the payload starts at data + head
+ */
+pktbuf_t *
+pktbuf_make_data(uint8_t *data, size_t head, size_t size, uint8_t class)
+{
+  pktbuf_t *pb = tvh_slab_alloc(&pktbuf_slab);
+  if (pb) {
+    assert(head <= UINT16_MAX);
+    pb->pb_refcount = 1;
+    pb->pb_size = size;
+    pb->pb_data = data + head;
+    pb->pb_err = 0;
+    pb->pb_class = class;
+    pb->pb_head = head;
+    pb->pb_free = NULL;
+    memoryinfo_alloc(&pktbuf_memoryinfo, pktbuf_mem_size(pb));
   }
   return pb;
 }
@@ -403,19 +518,61 @@ pktbuf_make(void *data, size_t size)
 pktbuf_t *
 pktbuf_append(pktbuf_t *pb, const void *data, size_t size)
 {
-  void *ndata;
+  uint8_t *ndata, class;
+  size_t mem;
   if (pb == NULL)
     return pktbuf_alloc(data, size);
-  ndata = realloc(pb->pb_data, pb->pb_size + size);
+  mem = pktbuf_mem_size(pb);
+  if (pb->pb_class || pb->pb_head) {
+    /* slab payload, move to the next size class or to heap */
+    ndata = pktbuf_data_alloc(pb->pb_size + size, &class, NULL);
+    if (ndata) {
+      memcpy(ndata, pb->pb_data, pb->pb_size);
+      pktbuf_data_free(pb->pb_data - pb->pb_head, pb->pb_class);
+      pb->pb_class = class;
+      pb->pb_head = 0;
+    }
+  } else {
+    ndata = realloc(pb->pb_data, pb->pb_size + size);
+  }
   if (ndata) {
     pb->pb_data = ndata;
     memcpy(ndata + pb->pb_size, data, size);
     pb->pb_size += size;
-    memoryinfo_append(&pktbuf_memoryinfo, size);
+    memoryinfo_free(&pktbuf_memoryinfo, mem);
+    memoryinfo_alloc(&pktbuf_memoryinfo, pktbuf_mem_size(pb));
   }
   return pb;
 }
 
+/*
+ *
+ */
+
+void
+pkt_init(void)
+{
+  int i;
+
+  tvh_slab_init(&pkt_slab, &pkt_memoryinfo);
+  tvh_slab_init(&pktref_slab, &pktref_memoryinfo);
+  tvh_slab_init(&pktbuf_slab, &pktbuf_memoryinfo);
+  for (i = 0; i < ARRAY_SIZE(pktbuf_data_slab); i++)
+    tvh_slab_init(&pktbuf_data_slab[i], &pktbuf_memoryinfo);
+}
+
+void
+pkt_done(void)
+{
+  int i;
+
+  tvh_slab_done(&pkt_slab);
+  tvh_slab_done(&pktref_slab);
+  tvh_slab_done(&pktbuf_slab);
+  for (i = 0; i < ARRAY_SIZE(pktbuf_data_slab); i++)
+    tvh_slab_done(&pktbuf_data_slab[i]);
+}
+
 /*
  *
  */
@@ -29,8 +29,11 @@ struct memoryinfo;
 typedef struct pktbuf {
   int pb_refcount;
   int pb_err;
+  uint8_t pb_class;    // payload slab size class, 0 = heap
+  uint16_t pb_head;    // unused bytes before pb_data in the allocation
   uint8_t *pb_data;
   size_t pb_size;
+  void (*pb_free)(struct pktbuf *pb); // owner release, NULL = heap
 } pktbuf_t;
 
 /**
@@ -161,6 +164,14 @@ pktbuf_t *pktbuf_alloc(const uint8_t *data, size_t size);
 
 pktbuf_t *pktbuf_make(void *data, size_t size);
 
+pktbuf_t *pktbuf_make_data(uint8_t *data, size_t head, size_t size, uint8_t class);
+
+uint8_t *pktbuf_data_alloc(size_t size, uint8_t *class, size_t *alloc);
+
+void pktbuf_data_free(uint8_t *data, uint8_t class);
+
+size_t pktbuf_data_class_size(uint8_t class);
+
 pktbuf_t *pktbuf_append(pktbuf_t *pb, const void *data, size_t size);
 
 static inline size_t   pktbuf_len(pktbuf_t *pb) { return pb ? pb->pb_size : 0; }
@@ -197,4 +208,8 @@ static inline int pts_is_greater_or_equal(int64_t base, int64_t value)
 
 const char *pts_to_string(int64_t pts, char *buf);
 
+void pkt_init(void);
+
+void pkt_done(void);
+
 #endif /* PACKET_H_ */
@@ -258,6 +258,8 @@ static void parser_clean_es(parser_es_t *pes)
 
   sbuf_free(&pes->es_buf);
   sbuf_free(&pes->es_buf_a);
+  pes->es_buf_pooled = NULL;
+  pes->es_buf_head = 0;
 
   if(pes->es_curpkt != NULL) {
     pkt_ref_dec(pes->es_curpkt);
@@ -299,17 +301,65 @@ static void parser_input_start(parser_t *prs, streaming_message_t *sm)
   if (elementary_stream_has_no_audio(set, 1))
     prs->prs_pcr_boundary = 6*90000;
 
-  streaming_target_deliver2(prs->prs_output, sm);
+  parser_output_deliver(prs, sm);
 }
 
 /**
+ * Deliver to the subscription chain
  *
+ * The chain expects the service stream lock (s_stream_mutex) which is
+ * held by the delivering (input) thread in the inline mode. The parser
+ * threads collect the output of one processed message and deliver it
+ * with one lock (parser_output_flush), the parsing runs unlocked.
  */
-static void
-parser_input(void *opaque, streaming_message_t *sm)
+void
+parser_output_deliver(parser_t *prs, streaming_message_t *sm)
 {
-  parser_t *prs = opaque;
+  if (prs->prs_worker)
+    TAILQ_INSERT_TAIL(&prs->prs_output_queue, sm, sm_link);
+  else
+    streaming_target_deliver2(prs->prs_output, sm);
+}
 
+/**
+ * Deliver the collected output and the stream parameter updates,
+ * called from the parser thread
+ */
+void
+parser_output_flush(parser_t *prs)
+{
+  service_t *t = prs->prs_service;
+  elementary_stream_t *es;
+  parser_es_t *pes;
+  streaming_message_t *sm;
+
+  if (TAILQ_EMPTY(&prs->prs_output_queue) && !prs->prs_update_service)
+    return;
+  tvh_mutex_lock(&t->s_stream_mutex);
+  if (prs->prs_update_service) {
+    prs->prs_update_service = 0;
+    TAILQ_FOREACH(es, &prs->prs_components.set_all, es_link) {
+      pes = (parser_es_t *)es;
+      if (pes->es_update_service) {
+        pes->es_update_service = 0;
+        service_update_elementary_stream(t, es);
+      }
+    }
+  }
+  while ((sm = TAILQ_FIRST(&prs->prs_output_queue)) != NULL) {
+    TAILQ_REMOVE(&prs->prs_output_queue, sm, sm_link);
+    streaming_target_deliver2(prs->prs_output, sm);
+  }
+  tvh_mutex_unlock(&t->s_stream_mutex);
+}
+
+/**
+ * Process one message, called from the delivering thread or from
+ * the parser thread
+ */
+void
+parser_process(parser_t *prs, streaming_message_t *sm)
+{
   switch(sm->sm_type) {
   case SMT_MPEGTS:
     parser_input_mpegts(prs, (pktbuf_t *)sm->sm_data);
@@ -319,11 +369,38 @@ parser_input(void *opaque, streaming_message_t *sm)
     parser_input_start(prs, sm);
     break;
   default:
-    streaming_target_deliver2(prs->prs_output, sm);
+    parser_output_deliver(prs, sm);
     break;
   }
 }
 
+/**
+ * The TS data were dropped from the parser thread queue, mark
+ * the partial frames as erroneous
+ */
+void
+parser_process_drops(parser_t *prs, int count)
+{
+  elementary_stream_t *es;
+
+  TAILQ_FOREACH(es, &prs->prs_components.set_all, es_link)
+    sbuf_err(&((parser_es_t *)es)->es_buf, count);
+}
+
+/**
+ *
+ */
+static void
+parser_input(void *opaque, streaming_message_t *sm)
+{
+  parser_t *prs = opaque;
+
+  if (prs->prs_worker)
+    parser_worker_queue(prs, streaming_msg_unshare(sm));
+  else
+    parser_process(prs, sm);
+}
+
 static htsmsg_t *
 parser_input_info(void *opaque, htsmsg_t *list)
 {
@@ -334,8 +411,9 @@ parser_input_info(void *opaque, htsmsg_t *list)
 }
 
 static streaming_ops_t parser_input_ops = {
-  .st_cb   = parser_input,
-  .st_info = parser_input_info
+  .st_cb     = parser_input,
+  .st_info   = parser_input_info,
+  .st_shared = 1
 };
 
 /**
@@ -360,6 +438,9 @@ parser_create(streaming_target_t *output, th_subscription_t *ts)
   prs->prs_subscription = ts;
   prs->prs_service = t;
   elementary_set_init(&prs->prs_components, LS_PARSER, service_nicename(t), t);
+  TAILQ_INIT(&prs->prs_queue);
+  TAILQ_INIT(&prs->prs_output_queue);
+  prs->prs_worker = parser_worker_assign();
   streaming_target_init(&prs->prs_input, &parser_input_ops, prs, 0);
   return &prs->prs_input;
 
@@ -375,6 +456,8 @@ parser_destroy(streaming_target_t *pad)
   elementary_stream_t *es;
   parser_es_t *pes;
 
+  if (prs->prs_worker)
+    parser_worker_release(prs);
   TAILQ_FOREACH(es, &prs->prs_components.set_all, es_link) {
     pes = (parser_es_t *)es;
     parser_clean_es(pes);
@@ -24,48 +24,10 @@
 #include "parser_h264.h"
 #include "bitstream.h"
 
-static const uint8_t *
-avc_find_startcode_internal(const uint8_t *p, const uint8_t *end)
-{
-  const uint8_t *a = p + 4 - ((intptr_t)p & 3);
-
-  for (end -= 3; p < a && p < end; p++) {
-    if (p[0] == 0 && p[1] == 0 && p[2] == 1)
-      return p;
-  }
-
-  for (end -= 3; p < end; p += 4) {
-    uint32_t x = *(const uint32_t*)p;
-//  if ((x - 0x01000100) & (~x) & 0x80008000) // little endian
-//  if ((x - 0x00010001) & (~x) & 0x00800080) // big endian
-    if ((x - 0x01010101) & (~x) & 0x80808080) { // generic
-      if (p[1] == 0) {
-	if (p[0] == 0 && p[2] == 1)
-	  return p;
-	if (p[2] == 0 && p[3] == 1)
-	  return p+1;
-      }
-      if (p[3] == 0) {
-	if (p[2] == 0 && p[4] == 1)
-	  return p+2;
-	if (p[4] == 0 && p[5] == 1)
-	  return p+3;
-      }
-    }
-  }
-
-  for (end += 3; p < end; p++) {
-    if (p[0] == 0 && p[1] == 0 && p[2] == 1)
-      return p;
-  }
-
-  return end + 3;
-}
-
 const uint8_t *
 avc_find_startcode(const uint8_t *p, const uint8_t *end)
 {
-    const uint8_t *out= avc_find_startcode_internal(p, end);
+    const uint8_t *out= tvh_find_startcode(p, end);
     while(p<out && out<end && !out[-1]) out--;
     return out;
 }
@@ -43,35 +43,28 @@
 void *
 h264_nal_deescape(bitstream_t *bs, const uint8_t *data, int size)
 {
-  uint_fast8_t c;
   uint8_t *d;
-  const uint8_t *end, *end2;
+  const uint8_t *end, *q;
+  size_t l;
 
   bs->rdata = d = malloc(size);
   bs->offset = 0;
 
-  end2 = data + size;
-
-  if (size > 2) {
-
-    /* Escape 0x000003 into 0x0000 */
-
-    end = end2 - 2;
-    while (data < end) {
-      c = *data++;
-      if (c || *data || *(data + 1) != 3) {
-        *d++ = c;
-      } else {
-        *d++ = 0;
-        *d++ = 0;
-        data += 2;
-      }
-    }
+  end = data + size;
 
+  /* Escape 0x000003 into 0x0000 */
+  while ((q = tvh_find_emulation(data, end)) != end) {
+    l = q - data;
+    memcpy(d, data, l);
+    d += l;
+    *d++ = 0;
+    *d++ = 0;
+    data = q + 3;
   }
 
-  while (data < end2)
-    *d++ = *data++;
+  l = end - data;
+  memcpy(d, data, l);
+  d += l;
 
   bs->len = (d - bs->rdata) * 8;
   return (void *)bs->rdata;
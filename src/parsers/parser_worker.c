@@ -0,0 +1,310 @@
+/*
+ *  Packet parsing functions - parser threads
+ *  Copyright (C) 2026 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "parsers.h"
+#include "config.h"
+
+/*
+ * The input (demux) thread only queues the messages for the parser
+ * (the MPEG-TS runs from the service remux buffer and the control
+ * messages) and the elementary stream parsing and the delivery to the
+ * subscription chain is done in the parser thread. Each parser is bound
+ * to one thread when created, so the message order is preserved while
+ * the different subscriptions are parsed in parallel.
+ *
+ * The queue for one parser is limited, the new MPEG-TS data are dropped
+ * when the parser does not keep up (the control messages are always
+ * queued) and the partial frames are marked as erroneous.
+ *
+ * The parser output is delivered with the service stream lock held,
+ * so the subscription chain sees the same locking as in the inline mode.
+ * The lock is taken once for the output of one queued message.
+ */
+
+/*
+ * The limit covers the parser thread stalls only (the parsed data are
+ * queued in the subscription chain): about 4 seconds of a 16Mbit/s HD
+ * service or 1 second of a 64Mbit/s UHD service. The inline mode
+ * (no parser thread) blocks the input thread instead.
+ */
+#define PARSER_QUEUE_MAX (8*1024*1024)
+
+struct parser_worker {
+  int                             pw_index;
+  pthread_t                       pw_tid;
+  tvh_mutex_t                     pw_lock;
+  tvh_cond_t                      pw_cond;      // parser is ready
+  tvh_cond_t                      pw_idle_cond; // parser was processed
+  TAILQ_HEAD(,parser)             pw_ready;
+  int64_t                         pw_queue_size;
+  int                             pw_parsers;
+  /* statistics */
+  uint64_t                        pw_msgs;
+  uint64_t                        pw_bytes;
+  uint64_t                        pw_drops;
+  int64_t                         pw_busy;
+  int                             pw_load;  // permille in last window
+};
+
+static parser_worker_t *parser_workers;
+static int parser_workers_count;
+static int parser_workers_running;
+
+/*
+ * Queue
+ */
+
+static inline int64_t
+parser_msg_size(streaming_message_t *sm)
+{
+  return sm->sm_type == SMT_MPEGTS ? pktbuf_len(sm->sm_data) : 0;
+}
+
+/*
+ * Called from the delivering thread (service stream lock held),
+ * the message must not be shared
+ */
+void
+parser_worker_queue(parser_t *prs, streaming_message_t *sm)
+{
+  parser_worker_t *pw = prs->prs_worker;
+  int64_t size = parser_msg_size(sm);
+
+  tvh_mutex_lock(&pw->pw_lock);
+  if (size > 0 && prs->prs_queue_size + size > PARSER_QUEUE_MAX) {
+    prs->prs_queue_drops += size / 188;
+    pw->pw_drops += size / 188;
+    if (tvhlog_limit(&prs->prs_queue_log, 10))
+      tvhwarn(LS_PARSER, "%s: parser thread %d - too much queued data, discarding new",
+              service_nicename(prs->prs_service), pw->pw_index);
+    tvh_mutex_unlock(&pw->pw_lock);
+    streaming_msg_free(sm);
+    return;
+  }
+  TAILQ_INSERT_TAIL(&prs->prs_queue, sm, sm_link);
+  prs->prs_queue_size += size;
+  pw->pw_queue_size += size;
+  if (!prs->prs_queued) {
+    if (TAILQ_EMPTY(&pw->pw_ready))
+      tvh_cond_signal(&pw->pw_cond, 0);
+    TAILQ_INSERT_TAIL(&pw->pw_ready, prs, prs_worker_link);
+    prs->prs_queued = 1;
+  }
+  tvh_mutex_unlock(&pw->pw_lock);
+}
+
+/*
+ * Worker
+ */
+
+static void *
+parser_worker_thread(void *aux)
+{
+  parser_worker_t *pw = aux;
+  parser_t *prs;
+  streaming_message_t *sm;
+  struct streaming_message_queue q;
+  int64_t t, size, window = getfastmonoclock(), busy = 0;
+  int drops, msgs;
+
+  tvh_mutex_lock(&pw->pw_lock);
+  while (atomic_get(&parser_workers_running)) {
+    if ((prs = TAILQ_FIRST(&pw->pw_ready)) == NULL) {
+      tvh_cond_timedwait(&pw->pw_cond, &pw->pw_lock, mclk() + sec2mono(1));
+    } else {
+      TAILQ_REMOVE(&pw->pw_ready, prs, prs_worker_link);
+      prs->prs_queued = 0;
+      prs->prs_running = 1;
+      TAILQ_MOVE(&q, &prs->prs_queue, sm_link);
+      size = prs->prs_queue_size;
+      prs->prs_queue_size = 0;
+      pw->pw_queue_size -= size;
+      drops = prs->prs_queue_drops;
+      prs->prs_queue_drops = 0;
+      tvh_mutex_unlock(&pw->pw_lock);
+      t = getfastmonoclock();
+      if (drops)
+        parser_process_drops(prs, drops);
+      for (msgs = 0; (sm = TAILQ_FIRST(&q)) != NULL; msgs++) {
+        TAILQ_REMOVE(&q, sm, sm_link);
+        parser_process(prs, sm);
+        parser_output_flush(prs);
+      }
+      busy += getfastmonoclock() - t;
+      tvh_mutex_lock(&pw->pw_lock);
+      prs->prs_running = 0;
+      tvh_cond_signal(&pw->pw_idle_cond, 1);
+      pw->pw_msgs += msgs;
+      pw->pw_bytes += size;
+    }
+    t = getfastmonoclock();
+    if (t - window >= MONOCLOCK_RESOLUTION) {
+      pw->pw_busy += busy;
+      pw->pw_load = (busy * 1000) / (t - window);
+      window = t;
+      busy = 0;
+    }
+  }
+  tvh_mutex_unlock(&pw->pw_lock);
+  return NULL;
+}
+
+/*
+ * Parser assignment
+ */
+
+parser_worker_t *
+parser_worker_assign(void)
+{
+  parser_worker_t *pw;
+  int i, r = -1, parsers = INT_MAX;
+
+  for (i = 0; i < parser_workers_count; i++) {
+    pw = &parser_workers[i];
+    if (atomic_get(&pw->pw_parsers) < parsers) {
+      parsers = atomic_get(&pw->pw_parsers);
+      r = i;
+    }
+  }
+  if (r < 0)
+    return NULL;
+  atomic_add(&parser_workers[r].pw_parsers, 1);
+  return &parser_workers[r];
+}
+
+/*
+ * Detach the parser from the thread, the parser input must be
+ * already disconnected from the service. The remaining control
+ * messages (like STOP) are processed in the caller thread with
+ * the service stream lock held (like in the inline mode).
+ */
+void
+parser_worker_release(parser_t *prs)
+{
+  parser_worker_t *pw = prs->prs_worker;
+  service_t *t = prs->prs_service;
+  streaming_message_t *sm;
+  struct streaming_message_queue q;
+
+  tvh_mutex_lock(&pw->pw_lock);
+  while (prs->prs_running)
+    tvh_cond_wait(&pw->pw_idle_cond, &pw->pw_lock);
+  if (prs->prs_queued) {
+    TAILQ_REMOVE(&pw->pw_ready, prs, prs_worker_link);
+    prs->prs_queued = 0;
+  }
+  TAILQ_MOVE(&q, &prs->prs_queue, sm_link);
+  pw->pw_queue_size -= prs->prs_queue_size;
+  prs->prs_queue_size = 0;
+  prs->prs_worker = NULL;
+  tvh_mutex_unlock(&pw->pw_lock);
+  atomic_dec(&pw->pw_parsers, 1);
+
+  if (TAILQ_EMPTY(&q))
+    return;
+  tvh_mutex_lock(&t->s_stream_mutex);
+  while ((sm = TAILQ_FIRST(&q)) != NULL) {
+    TAILQ_REMOVE(&q, sm, sm_link);
+    if (sm->sm_type == SMT_MPEGTS)
+      streaming_msg_free(sm);
+    else
+      parser_process(prs, sm);
+  }
+  tvh_mutex_unlock(&t->s_stream_mutex);
+}
+
+/*
+ * Status
+ */
+
+htsmsg_t *
+parser_workers_status(void)
+{
+  parser_worker_t *pw;
+  htsmsg_t *l = htsmsg_create_list(), *e;
+  int i;
+
+  for (i = 0; i < parser_workers_count; i++) {
+    pw = &parser_workers[i];
+    e = htsmsg_create_map();
+    tvh_mutex_lock(&pw->pw_lock);
+    htsmsg_add_u32(e, "worker", pw->pw_index);
+    htsmsg_add_u32(e, "parsers", atomic_get(&pw->pw_parsers));
+    htsmsg_add_u32(e, "load", pw->pw_load);
+    htsmsg_add_s64(e, "queue", pw->pw_queue_size);
+    htsmsg_add_s64(e, "msgs", pw->pw_msgs);
+    htsmsg_add_s64(e, "bytes", pw->pw_bytes);
+    htsmsg_add_s64(e, "drops", pw->pw_drops);
+    htsmsg_add_s64(e, "busy", pw->pw_busy);
+    tvh_mutex_unlock(&pw->pw_lock);
+    htsmsg_add_msg(l, NULL, e);
+  }
+  return l;
+}
+
+/*
+ * Init / done
+ */
+
+void
+parser_workers_init(void)
+{
+  parser_worker_t *pw;
+  int i;
+
+  parser_workers_count = MINMAX(config.parser_threads, 0, 64);
+  if (parser_workers_count == 0)
+    return;
+  parser_workers = calloc(parser_workers_count, sizeof(*pw));
+  atomic_set(&parser_workers_running, 1);
+  for (i = 0; i < parser_workers_count; i++) {
+    pw = &parser_workers[i];
+    pw->pw_index = i;
+    tvh_mutex_init(&pw->pw_lock, NULL);
+    tvh_cond_init(&pw->pw_cond, 1);
+    tvh_cond_init(&pw->pw_idle_cond, 1);
+    TAILQ_INIT(&pw->pw_ready);
+    tvh_thread_create(&pw->pw_tid, NULL, parser_worker_thread, pw, "parser");
+  }
+  tvhinfo(LS_PARSER, "started %d parser thread(s)", parser_workers_count);
+}
+
+void
+parser_workers_done(void)
+{
+  parser_worker_t *pw;
+  int i;
+
+  if (parser_workers_count == 0)
+    return;
+  atomic_set(&parser_workers_running, 0);
+  for (i = 0; i < parser_workers_count; i++) {
+    pw = &parser_workers[i];
+    tvh_mutex_lock(&pw->pw_lock);
+    tvh_cond_signal(&pw->pw_cond, 0);
+    tvh_mutex_unlock(&pw->pw_lock);
+    pthread_join(pw->pw_tid, NULL);
+    assert(TAILQ_EMPTY(&pw->pw_ready));
+    tvh_cond_destroy(&pw->pw_idle_cond);
+    tvh_cond_destroy(&pw->pw_cond);
+    tvh_mutex_destroy(&pw->pw_lock);
+  }
+  parser_workers_count = 0;
+  free(parser_workers);
+  parser_workers = NULL;
+}
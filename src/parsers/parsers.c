@@ -63,6 +63,22 @@ typedef void (aparser_t)(parser_t *t, parser_es_t *st, th_pkt_t *pkt);
 
 static void parser_deliver(parser_t *t, parser_es_t *st, th_pkt_t *pkt);
 
+/**
+ * Save the detected stream parameters to the service, the parser
+ * threads do not hold the service stream lock - the update is done
+ * with the output delivery (parser_output_flush)
+ */
+static void
+parser_update_service(parser_es_t *st)
+{
+  if (st->es_parser->prs_worker) {
+    st->es_update_service = 1;
+    st->es_parser->prs_update_service = 1;
+  } else {
+    service_update_elementary_stream(st->es_service, (elementary_stream_t *)st);
+  }
+}
+
 /**
  *
  */
@@ -135,7 +151,7 @@ deliver:
   }
 
   /* Forward packet */
-  streaming_target_deliver2(t->prs_output, streaming_msg_create_pkt(pkt));
+  parser_output_deliver(t, streaming_msg_create_pkt(pkt));
 
   /* Decrease our own reference to the packet */
   pkt_ref_dec(pkt);
@@ -333,6 +349,144 @@ parse_pes_header(parser_t *t, parser_es_t *st,
   return -1;
 }
 
+/**
+ * Frame reassembly buffer
+ *
+ * The buffer for the next frame is taken from the payload size classes
+ * using the average frame size. When a larger frame (keyframe) does not
+ * fit, the buffer grows at once to the recent peak frame size, so the
+ * keyframe is copied only once. The space for the global data (moved
+ * out from the frame by parser_global_data_move) is reserved before
+ * the frame, so the complete frame including the global data becomes
+ * the packet payload without copying.
+ */
+#define PARSER_BUF_HEAD_MAX 1024
+
+static inline uint8_t
+parser_buf_class(parser_es_t *st)
+{
+  sbuf_t *sb = &st->es_buf;
+
+  /* the pooled buffer might be reallocated by sbuf_append */
+  if (st->es_buf_pooled != NULL && st->es_buf_pooled == sb->sb_data &&
+      sb->sb_size == pktbuf_data_class_size(st->es_buf_class))
+    return st->es_buf_class;
+  return 0;
+}
+
+static inline void
+parser_buf_hint(parser_es_t *st, size_t len)
+{
+  if (st->es_buf_hint)
+    st->es_buf_hint = (st->es_buf_hint * 7 + len) / 8;
+  else
+    st->es_buf_hint = len;
+  /* the peak decays slowly, the keyframes refresh it every GOP */
+  st->es_buf_peak = MAX(len, st->es_buf_peak - st->es_buf_peak / 256);
+}
+
+static void
+parser_buf_grow(parser_es_t *st, size_t need)
+{
+  sbuf_t *sb = &st->es_buf;
+  size_t size, alloc;
+  uint8_t *data, class;
+
+  size = MAX(need, st->es_buf_head + st->es_buf_peak + st->es_buf_peak / 4);
+  size = MAX(size, (size_t)sb->sb_size + sb->sb_size / 2);
+  data = pktbuf_data_alloc(size, &class, &alloc);
+  if (data == NULL) {
+    fprintf(stderr, "Unable to allocate %zu bytes\n", size);
+    abort();
+  }
+  if (sb->sb_data) {
+    memcpy(data, sb->sb_data, sb->sb_ptr);
+    if (parser_buf_class(st))
+      pktbuf_data_free(sb->sb_data, st->es_buf_class);
+    else
+      free(sb->sb_data);
+  }
+  sb->sb_data = data;
+  sb->sb_size = alloc;
+  st->es_buf_pooled = class ? data : NULL;
+  st->es_buf_class = class;
+}
+
+static inline void
+parser_buf_append(parser_es_t *st, const uint8_t *data, int len)
+{
+  sbuf_t *sb = &st->es_buf;
+
+  if (sb->sb_ptr + len > sb->sb_size)
+    parser_buf_grow(st, sb->sb_ptr + len);
+  memcpy(sb->sb_data + sb->sb_ptr, data, len);
+  sb->sb_ptr += len;
+}
+
+static void
+parser_buf_start(parser_es_t *st, uint32_t sc)
+{
+  sbuf_t *sb = &st->es_buf;
+  size_t head = st->es_buf_reserve, size, alloc;
+  uint8_t class;
+
+  if (sb->sb_data && sb->sb_ptr > st->es_buf_head)
+    parser_buf_hint(st, sb->sb_ptr - st->es_buf_head);
+  size = head + MAX(256, st->es_buf_hint + st->es_buf_hint / 4);
+  if (sb->sb_data == NULL || sb->sb_size < size || sb->sb_size > 4 * size) {
+    if ((class = parser_buf_class(st)) != 0)
+      pktbuf_data_free(sb->sb_data, class);
+    else
+      free(sb->sb_data);
+    sb->sb_data = pktbuf_data_alloc(size, &class, &alloc);
+    if (sb->sb_data == NULL) {
+      fprintf(stderr, "Unable to allocate %zu bytes\n", size);
+      abort();
+    }
+    sb->sb_size = alloc;
+    st->es_buf_pooled = class ? sb->sb_data : NULL;
+    st->es_buf_class = class;
+  }
+  sb->sb_ptr = head;
+  sb->sb_err = 0;
+  st->es_buf_head = head;
+  sbuf_put_be32(sb, sc);
+}
+
+/**
+ * Complete frame (without the trailing start code) to the payload,
+ * the global data are placed before the frame
+ */
+static pktbuf_t *
+parser_buf_payload(parser_es_t *st, pktbuf_t *meta)
+{
+  sbuf_t *sb = &st->es_buf;
+  size_t head = st->es_buf_head, len = sb->sb_ptr - 4 - head;
+  size_t metalen = pktbuf_len(meta);
+  pktbuf_t *pb;
+
+  parser_buf_hint(st, len);
+  if (metalen > head) {
+    /* no space, reserve it for the next frames */
+    st->es_buf_reserve = MIN((metalen + 63) & ~63, PARSER_BUF_HEAD_MAX);
+    pb = pktbuf_alloc(NULL, metalen + len);
+    if (pb) {
+      memcpy(pktbuf_ptr(pb), pktbuf_ptr(meta), metalen);
+      memcpy(pktbuf_ptr(pb) + metalen, sb->sb_data + head, len);
+    }
+    /* do not count this frame twice in parser_buf_start */
+    sb->sb_ptr = head;
+    return pb;
+  }
+  if (metalen)
+    memcpy(sb->sb_data + head - metalen, pktbuf_ptr(meta), metalen);
+  pb = pktbuf_make_data(sb->sb_data, head - metalen, metalen + len,
+                        parser_buf_class(st));
+  sbuf_steal_data(sb);
+  st->es_buf_pooled = NULL;
+  return pb;
+}
+
 /**
  * Generic PES parser
  *
@@ -344,6 +498,7 @@ parse_pes(parser_t *t, parser_es_t *st, const uint8_t *data, int len,
           int start, packet_parser_t *vp)
 {
   uint_fast32_t sc = st->es_startcond;
+  const uint8_t *p, *end;
   uint16_t plen;
   int i, j, r, hlen, tmp, off;
 
@@ -397,7 +552,7 @@ parse_pes(parser_t *t, parser_es_t *st, const uint8_t *data, int len,
 
       st->es_header_mode = 0;
       st->es_buf.sb_ptr = off;
-      if(off > 2)
+      if(off > st->es_buf_head + 2)
         sc = st->es_buf.sb_data[off-3] << 16 |
              st->es_buf.sb_data[off-2] << 8 |
              st->es_buf.sb_data[off-1];
@@ -405,18 +560,30 @@ parse_pes(parser_t *t, parser_es_t *st, const uint8_t *data, int len,
       continue;
     }
 
-    /* quick loop to find startcode */
+    /* quick loop to find startcode, the first bytes may complete */
+    /* the startcode from the previous data */
     j = i;
-    do {
+    for (tmp = MIN(len, i + 3); i < tmp; ) {
       sc = (sc << 8) | data[i++];
       if((sc & 0xffffff00) == 0x00000100)
         goto found;
-    } while (i < len);
-    sbuf_append(&st->es_buf, data + j, len - j);
+    }
+    if (i < len) {
+      /* the vector scan, the startcode must be followed by one byte */
+      end = data + len - 1;
+      p = tvh_find_startcode(data + i - 3, end);
+      tmp = p < end ? p - data + 4 : len;
+      /* shift only the bytes which remain in sc */
+      for (i = MAX(i, tmp - (int)sizeof(sc)); i < tmp; )
+        sc = (sc << 8) | data[i++];
+      if (p < end)
+        goto found;
+    }
+    parser_buf_append(st, data + j, len - j);
     break;
 
 found:
-    sbuf_append(&st->es_buf, data + j, i - j);
+    parser_buf_append(st, data + j, i - j);
 
     if(sc == 0x100 && (len-i)>2) {
       if (data[0] == 0 && data[i+1] == 0x01 && data[i+2] == 0xe0)
@@ -455,8 +622,7 @@ found:
         /* Reset packet parser upon length error or if parser
            tells us so */
         parser_deliver_error(t, st);
-        sbuf_reset_and_alloc(&st->es_buf, 256);
-        sbuf_put_be32(&st->es_buf, sc);
+        parser_buf_start(st, sc);
       }
       assert(st->es_buf.sb_data != NULL);
       st->es_startcode = sc;
@@ -804,7 +970,7 @@ ok:
         tvhtrace(LS_PARSER, "mpeg audio version change %02d: val=%d (old=%d)",
                  st->es_index, layer, st->es_audio_version);
         st->es_audio_version = layer;
-        service_update_elementary_stream(st->es_service, (elementary_stream_t *)st);
+        parser_update_service(st);
       }
       makeapkt(t, st, buf + i, fsize, dts, duration,
                channels, mpa_sri[(buf[i+2] >> 2) & 3]);
@@ -1109,7 +1275,7 @@ parser_set_stream_vparam(parser_es_t *st, int width, int height,
     st->es_width = width;
     st->es_height = height;
     st->es_frame_duration = duration;
-    service_update_elementary_stream(st->es_service, (elementary_stream_t *)st);
+    parser_update_service(st);
   }
 }
 
@@ -1295,7 +1461,6 @@ parse_mpeg2video(parser_t *t, parser_es_t *st, size_t len,
     if(next_startcode == 0x100 || next_startcode > 0x1af) {
       /* Last picture slice (because next not a slice) */
       th_pkt_t *pkt = st->es_curpkt;
-      size_t metalen = 0;
       if(pkt == NULL) {
         /* no packet, may've been discarded by sanity checks here */
         return PARSER_RESET;
@@ -1303,7 +1468,7 @@ parse_mpeg2video(parser_t *t, parser_es_t *st, size_t len,
 
       if(st->es_global_data) {
         pkt->pkt_meta = pktbuf_make(st->es_global_data,
-                                    metalen = st->es_global_data_len);
+                                    st->es_global_data_len);
         st->es_global_data = NULL;
         st->es_global_data_len = 0;
       }
@@ -1312,15 +1477,7 @@ parse_mpeg2video(parser_t *t, parser_es_t *st, size_t len,
         pkt->pkt_err = st->es_buf.sb_err;
         st->es_buf.sb_err = 0;
       }
-      if (metalen) {
-        pkt->pkt_payload = pktbuf_alloc(NULL, metalen + st->es_buf.sb_ptr - 4);
-        memcpy(pktbuf_ptr(pkt->pkt_payload), pktbuf_ptr(pkt->pkt_meta), metalen);
-        memcpy(pktbuf_ptr(pkt->pkt_payload) + metalen, st->es_buf.sb_data, st->es_buf.sb_ptr - 4);
-      } else {
-        pkt->pkt_payload = pktbuf_make(st->es_buf.sb_data,
-                                       st->es_buf.sb_ptr - 4);
-        sbuf_steal_data(&st->es_buf);
-      }
+      pkt->pkt_payload = parser_buf_payload(st, pkt->pkt_meta);
       pkt->pkt_duration = st->es_frame_duration;
 
       if (st->es_priv) {
@@ -1559,12 +1716,11 @@ parse_h264(parser_t *t, parser_es_t *st, size_t len,
     if (st->es_incomplete)
       return PARSER_HEADER;
     pkt = st->es_curpkt;
-    size_t metalen = 0;
 
     if(pkt != NULL && pkt->pkt_payload == NULL) {
       if(st->es_global_data) {
         pkt->pkt_meta = pktbuf_make(st->es_global_data,
-                                    metalen = st->es_global_data_len);
+                                    st->es_global_data_len);
         st->es_global_data = NULL;
         st->es_global_data_len = 0;
       }
@@ -1573,15 +1729,7 @@ parse_h264(parser_t *t, parser_es_t *st, size_t len,
         pkt->pkt_err = st->es_buf.sb_err;
         st->es_buf.sb_err = 0;
       }
-      if (metalen) {
-        pkt->pkt_payload = pktbuf_alloc(NULL, metalen + st->es_buf.sb_ptr - 4);
-        memcpy(pktbuf_ptr(pkt->pkt_payload), pktbuf_ptr(pkt->pkt_meta), metalen);
-        memcpy(pktbuf_ptr(pkt->pkt_payload) + metalen, st->es_buf.sb_data, st->es_buf.sb_ptr - 4);
-      } else {
-        pkt->pkt_payload = pktbuf_make(st->es_buf.sb_data,
-                                       st->es_buf.sb_ptr - 4);
-        sbuf_steal_data(&st->es_buf);
-      }
+      pkt->pkt_payload = parser_buf_payload(st, pkt->pkt_meta);
     }
     return PARSER_RESET;
   }
@@ -1731,12 +1879,11 @@ parse_hevc(parser_t *t, parser_es_t *st, size_t len,
     if (st->es_incomplete)
       return PARSER_HEADER;
     th_pkt_t *pkt = st->es_curpkt;
-    size_t metalen = 0;
 
     if(pkt != NULL && pkt->pkt_payload == NULL) {
       if(st->es_global_data) {
         pkt->pkt_meta = pktbuf_make(st->es_global_data,
-                                    metalen = st->es_global_data_len);
+                                    st->es_global_data_len);
         st->es_global_data = NULL;
         st->es_global_data_len = 0;
       }
@@ -1745,15 +1892,7 @@ parse_hevc(parser_t *t, parser_es_t *st, size_t len,
         pkt->pkt_err = st->es_buf.sb_err;
         st->es_buf.sb_err = 0;
       }
-      if (metalen) {
-        pkt->pkt_payload = pktbuf_alloc(NULL, metalen + st->es_buf.sb_ptr - 4);
-        memcpy(pktbuf_ptr(pkt->pkt_payload), pktbuf_ptr(pkt->pkt_meta), metalen);
-        memcpy(pktbuf_ptr(pkt->pkt_payload) + metalen, st->es_buf.sb_data, st->es_buf.sb_ptr - 4);
-      } else {
-        pkt->pkt_payload = pktbuf_make(st->es_buf.sb_data,
-                                       st->es_buf.sb_ptr - 4);
-        sbuf_steal_data(&st->es_buf);
-      }
+      pkt->pkt_payload = parser_buf_payload(st, pkt->pkt_meta);
     }
     return PARSER_RESET;
   }
@@ -27,6 +27,7 @@
 
 typedef struct parser_es parser_es_t;
 typedef struct parser parser_t;
+typedef struct parser_worker parser_worker_t;
 
 struct th_subscription;
 
@@ -41,6 +42,12 @@ struct parser_es {
   /* State */
   parse_callback_t *es_parse_callback;
   sbuf_t    es_buf;
+  uint8_t  *es_buf_pooled;    /* es_buf data from the payload size class */
+  uint8_t   es_buf_class;
+  uint32_t  es_buf_head;      /* reserved bytes before the current frame */
+  uint32_t  es_buf_reserve;   /* reserve for the next frames (global data) */
+  uint32_t  es_buf_hint;      /* frame size estimate */
+  uint32_t  es_buf_peak;      /* recent peak frame size (keyframes) */
   uint8_t   es_incomplete;
   uint8_t   es_header_mode;
   uint32_t  es_header_offset;
@@ -50,6 +57,7 @@ struct parser_es {
   int       es_parser_state;
   int       es_parser_ptr;
   int       es_meta_change;
+  uint8_t   es_update_service; /* parser thread: update at the delivery */
   void     *es_priv;          /* Parser private data */
   sbuf_t    es_buf_a;         /* Audio packet reassembly */
   uint8_t  *es_global_data;
@@ -98,6 +106,18 @@ struct parser {
   commercial_advice_t prs_tt_commercial_advice;
   time_t prs_tt_clock;   /* Network clock as determined by teletext decoder */
 
+  /* Parser thread (NULL = parse in the delivering thread) */
+  parser_worker_t *prs_worker;
+  TAILQ_ENTRY(parser) prs_worker_link;
+  struct streaming_message_queue prs_queue;
+  int64_t  prs_queue_size;  /* queued MPEG-TS bytes */
+  int      prs_queue_drops; /* dropped TS packets, not seen by parser yet */
+  uint8_t  prs_queued;      /* in the worker ready list */
+  uint8_t  prs_running;     /* the worker processes the messages */
+  uint8_t  prs_update_service; /* some es_update_service is set */
+  struct streaming_message_queue prs_output_queue; /* parsed, not delivered */
+  tvhlog_limit_t prs_queue_log;
+
 };
 
 static inline int64_t
@@ -127,6 +147,27 @@ void parser_destroy(streaming_target_t *pad);
 
 streaming_target_t * parser_output(streaming_target_t *pad);
 
+void parser_output_deliver(parser_t *prs, streaming_message_t *sm);
+
+void parser_output_flush(parser_t *prs);
+
+void parser_process(parser_t *prs, streaming_message_t *sm);
+
+void parser_process_drops(parser_t *prs, int count);
+
+/* Parser threads */
+void parser_workers_init(void);
+
+void parser_workers_done(void);
+
+parser_worker_t *parser_worker_assign(void);
+
+void parser_worker_queue(parser_t *prs, streaming_message_t *sm);
+
+void parser_worker_release(parser_t *prs);
+
+htsmsg_t *parser_workers_status(void);
+
 void parse_mpeg_ts(parser_t *t, parser_es_t *st, const uint8_t *data,
                    int len, int start, int err);
 
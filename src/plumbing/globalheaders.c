@@ -426,8 +426,9 @@ globalheaders_input_info(void *opaque, htsmsg_t *list)
 }
 
 static streaming_ops_t globalheaders_input_ops = {
-  .st_cb   = globalheaders_input,
-  .st_info = globalheaders_input_info
+  .st_cb     = globalheaders_input,
+  .st_info   = globalheaders_input_info,
+  .st_shared = 1
 };
 
 
@@ -677,8 +677,9 @@ tsfix_input_info(void *opaque, htsmsg_t *list)
 }
 
 static streaming_ops_t tsfix_input_ops = {
-  .st_cb   = tsfix_input,
-  .st_info = tsfix_input_info
+  .st_cb     = tsfix_input,
+  .st_info   = tsfix_input_info,
+  .st_shared = 1
 };
 
 
@@ -769,7 +769,9 @@ profile_sharer_deliver(profile_chain_t *prch, streaming_message_t *sm)
         pkt->pkt_dts >= prch->prch_ts_delta &&
         pkt->pkt_pcr >= prch->prch_ts_delta) {
       th_pkt_t *n = pkt_copy_shallow(pkt);
-      pkt_ref_dec(pkt);
+      /* the message may be shared with other chains */
+      sm = streaming_msg_unshare(sm);
+      pkt_ref_dec(sm->sm_data);
       n->pkt_pts -= prch->prch_ts_delta;
       n->pkt_dts -= prch->prch_ts_delta;
       n->pkt_pcr -= prch->prch_ts_delta;
@@ -787,45 +789,51 @@ deliver:
 /*
  *
  */
+static inline int
+profile_sharer_want(profile_sharer_t *prsh, profile_chain_t *prch,
+                    streaming_message_t *sm)
+{
+  if (prch == prsh->prsh_master || sm->sm_type == SMT_STOP)
+    return 1;
+  if (sm->sm_type != SMT_PACKET && sm->sm_type != SMT_MPEGTS)
+    return 0;
+  return !prch->prch_stop;
+}
+
 static void
 profile_sharer_input(void *opaque, streaming_message_t *sm)
 {
   profile_sharer_t *prsh = opaque;
-  profile_chain_t *prch, *next, *run = NULL;
+  profile_chain_t *prch, *next;
+  int count = 0;
 
   if (sm->sm_type == SMT_STOP) {
     if (prsh->prsh_start_msg)
       streaming_start_unref(prsh->prsh_start_msg);
     prsh->prsh_start_msg = NULL;
   }
-  for (prch = LIST_FIRST(&prsh->prsh_chains); prch; prch = next) {
+  if (sm->sm_type == SMT_START && prsh->prsh_master) {
+    if (prsh->prsh_start_msg)
+      streaming_start_unref(prsh->prsh_start_msg);
+    prsh->prsh_start_msg = streaming_start_copy(sm->sm_data);
+  }
+  LIST_FOREACH(prch, &prsh->prsh_chains, prch_sharer_link)
+    count += profile_sharer_want(prsh, prch, sm);
+  if (count == 0) {
+    streaming_msg_free(sm);
+    return;
+  }
+
+  /* one message for all chains, see profile_sharer_deliver */
+  streaming_msg_share(sm, count - 1);
+  for (prch = LIST_FIRST(&prsh->prsh_chains); prch && count > 0; prch = next) {
     next = LIST_NEXT(prch, prch_sharer_link);
-    if (prch == prsh->prsh_master) {
-      if (sm->sm_type == SMT_START) {
-        if (prsh->prsh_start_msg)
-          streaming_start_unref(prsh->prsh_start_msg);
-        prsh->prsh_start_msg = streaming_start_copy(sm->sm_data);
-      }
-      if (run)
-        profile_sharer_deliver(run, streaming_msg_clone(sm));
-      run = prch;
+    if (!profile_sharer_want(prsh, prch, sm))
       continue;
-    } else if (sm->sm_type == SMT_STOP) {
-      run = prch;
-      continue;
-    }
-    if (sm->sm_type != SMT_PACKET && sm->sm_type != SMT_MPEGTS)
-      continue;
-    if (prch->prch_stop)
-      continue;
-    if (run)
-      profile_sharer_deliver(run, streaming_msg_clone(sm));
-    run = prch;
+    count--;
+    profile_sharer_deliver(prch, sm);
   }
-
-  if (run)
-    profile_sharer_deliver(run, sm);
-  else
+  for ( ; count > 0; count--)
     streaming_msg_free(sm);
 }
 
@@ -837,8 +845,9 @@ profile_sharer_input_info(void *opaque, htsmsg_t *list)
 }
 
 static streaming_ops_t profile_sharer_input_ops = {
-  .st_cb   = profile_sharer_input,
-  .st_info = profile_sharer_input_info
+  .st_cb     = profile_sharer_input,
+  .st_info   = profile_sharer_input_info,
+  .st_shared = 1
 };
 
 /*
@@ -388,7 +388,7 @@ satip_rtp_thread(void *aux)
 
   tvh_mutex_lock(&sq->sq_mutex);
   while (rtp->sq && !fatal) {
-    sm = TAILQ_FIRST(&sq->sq_queue);
+    sm = streaming_queue_first(sq);
     if (sm == NULL) {
       if (tcp) {
         r = satip_rtp_flush_tcp_data(rtp);
@@ -399,7 +399,7 @@ satip_rtp_thread(void *aux)
         fatal = 1;
         continue;
       }
-      tvh_cond_wait(&sq->sq_cond, &sq->sq_mutex);
+      streaming_queue_wait(sq);
       continue;
     }
     streaming_queue_remove(sq, sm);
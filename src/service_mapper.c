@@ -436,14 +436,14 @@ service_mapper_thread ( void *aux )
 
       /* Wait for message */
       tvh_mutex_lock(&sq->sq_mutex);
-      while((sm = TAILQ_FIRST(&sq->sq_queue)) == NULL) {
-        tvh_cond_wait(&sq->sq_cond, &sq->sq_mutex);
+      while((sm = streaming_queue_first(sq)) == NULL) {
+        streaming_queue_wait(sq);
         if (!tvheadend_is_running())
           break;
       }
+      tvh_mutex_unlock(&sq->sq_mutex);
       if (sm)
         streaming_queue_remove(sq, sm);
-      tvh_mutex_unlock(&sq->sq_mutex);
       if (!tvheadend_is_running())
         break;
 
@@ -475,9 +475,7 @@ service_mapper_thread ( void *aux )
     if (!tvheadend_is_running())
       break;
 
-    tvh_mutex_lock(&sq->sq_mutex);
-    streaming_queue_clear(&sq->sq_queue);
-    tvh_mutex_unlock(&sq->sq_mutex);
+    streaming_queue_purge(sq);
  
     tvh_mutex_lock(&global_lock);
     subscription_unsubscribe(sub, UNSUBSCRIBE_FINAL);
@@ -0,0 +1,235 @@
+/*
+ *  tvheadend, slab caches for the small hot objects
+ *  Copyright (C) 2026 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tvheadend.h"
+#include "memoryinfo.h"
+#include "slab.h"
+
+#define TVH_SLAB_MAX       32
+#define TVH_SLAB_DEPOT_MAX 8
+
+/* the free objects are linked through the first word, the depot */
+/* batches through the second word of the first object */
+#define SLAB_NEXT(p)  (((void **)(p))[0])
+#define SLAB_BATCH(p) (((void **)(p))[1])
+
+typedef struct tvh_slab_tcache {
+  void *head;
+  int   count;
+} tvh_slab_tcache_t;
+
+static tvh_slab_t *tvh_slabs[TVH_SLAB_MAX];
+static int tvh_slab_count;
+static pthread_key_t tvh_slab_key;
+static pthread_once_t tvh_slab_key_once = PTHREAD_ONCE_INIT;
+static __thread tvh_slab_tcache_t tvh_slab_tcache[TVH_SLAB_MAX];
+static __thread int tvh_slab_thread_registered;
+
+/*
+ *
+ */
+static inline void
+tvh_slab_cached(tvh_slab_t *sl, int count)
+{
+  memoryinfo_t *my = sl->sl_memoryinfo;
+
+  if (my) {
+    atomic_add_s64(&my->my_cached_size, (int64_t)count * sl->sl_size);
+    atomic_add_s64(&my->my_cached_count, count);
+  }
+}
+
+/*
+ * Move count objects from the thread cache to the depot, the partial
+ * batches (thread exit) and the batches above the depot limit are
+ * released to the system.
+ */
+static void
+tvh_slab_flush(tvh_slab_t *sl, tvh_slab_tcache_t *tc, int count)
+{
+  void *head = tc->head, *p = head, *next;
+  int i;
+
+  for (i = 1; i < count; i++)
+    p = SLAB_NEXT(p);
+  tc->head = SLAB_NEXT(p);
+  tc->count -= count;
+  SLAB_NEXT(p) = NULL;
+
+  if (count == sl->sl_batch) {
+    tvh_mutex_lock(&sl->sl_lock);
+    if (sl->sl_enabled && sl->sl_depot_count < sl->sl_depot_max) {
+      SLAB_BATCH(head) = sl->sl_depot;
+      sl->sl_depot = head;
+      sl->sl_depot_count++;
+      head = NULL;
+    }
+    tvh_mutex_unlock(&sl->sl_lock);
+  }
+
+  if (head) {
+    for (p = head; p; p = next) {
+      next = SLAB_NEXT(p);
+      free(p);
+    }
+    tvh_slab_cached(sl, -count);
+  }
+}
+
+static void
+tvh_slab_thread_exit(void *aux)
+{
+  tvh_slab_tcache_t *tc;
+  tvh_slab_t *sl;
+  int i;
+
+  tvh_slab_thread_registered = 0;
+  for (i = 0; i < TVH_SLAB_MAX; i++) {
+    if ((sl = tvh_slabs[i]) == NULL)
+      continue;
+    tc = &tvh_slab_tcache[i];
+    while (tc->count >= sl->sl_batch)
+      tvh_slab_flush(sl, tc, sl->sl_batch);
+    if (tc->count > 0)
+      tvh_slab_flush(sl, tc, tc->count);
+  }
+}
+
+static void
+tvh_slab_key_init(void)
+{
+  pthread_key_create(&tvh_slab_key, tvh_slab_thread_exit);
+}
+
+static void
+tvh_slab_thread_register(void)
+{
+  tvh_slab_thread_registered = 1;
+  pthread_setspecific(tvh_slab_key, (void *)1);
+}
+
+/*
+ *
+ */
+void *
+tvh_slab_alloc(tvh_slab_t *sl)
+{
+  tvh_slab_tcache_t *tc;
+  void *p;
+
+  if (!atomic_get(&sl->sl_enabled))
+    return malloc(sl->sl_size);
+  tc = &tvh_slab_tcache[sl->sl_index];
+  if (tc->head == NULL) {
+    /* unlocked peek, do not serialize the misses */
+    if (atomic_get(&sl->sl_depot_count) <= 0)
+      return malloc(sl->sl_size);
+    tvh_mutex_lock(&sl->sl_lock);
+    if ((p = sl->sl_depot) != NULL) {
+      sl->sl_depot = SLAB_BATCH(p);
+      sl->sl_depot_count--;
+    }
+    tvh_mutex_unlock(&sl->sl_lock);
+    if (p == NULL)
+      return malloc(sl->sl_size);
+    if (!tvh_slab_thread_registered)
+      tvh_slab_thread_register();
+    tc->head = p;
+    tc->count = sl->sl_batch;
+  }
+  p = tc->head;
+  tc->head = SLAB_NEXT(p);
+  tc->count--;
+  tvh_slab_cached(sl, -1);
+  return p;
+}
+
+void
+tvh_slab_free(tvh_slab_t *sl, void *ptr)
+{
+  tvh_slab_tcache_t *tc;
+
+  if (ptr == NULL)
+    return;
+  if (!atomic_get(&sl->sl_enabled)) {
+    free(ptr);
+    return;
+  }
+  if (!tvh_slab_thread_registered)
+    tvh_slab_thread_register();
+  tc = &tvh_slab_tcache[sl->sl_index];
+  SLAB_NEXT(ptr) = tc->head;
+  tc->head = ptr;
+  tc->count++;
+  tvh_slab_cached(sl, 1);
+  /* batch 1 - the large objects are not kept in the thread caches */
+  if (tc->count >= 2 * sl->sl_batch || sl->sl_batch == 1)
+    tvh_slab_flush(sl, tc, sl->sl_batch);
+}
+
+/*
+ *
+ */
+void
+tvh_slab_init(tvh_slab_t *sl, memoryinfo_t *my)
+{
+  assert(sl->sl_size >= 2 * sizeof(void *));
+  assert(sl->sl_batch > 0);
+  assert(tvh_slab_count < TVH_SLAB_MAX);
+  pthread_once(&tvh_slab_key_once, tvh_slab_key_init);
+  tvh_mutex_init(&sl->sl_lock, NULL);
+  sl->sl_memoryinfo = my;
+  sl->sl_depot = NULL;
+  sl->sl_depot_count = 0;
+  if (sl->sl_depot_max <= 0)
+    sl->sl_depot_max = TVH_SLAB_DEPOT_MAX;
+  sl->sl_index = tvh_slab_count;
+  tvh_slabs[tvh_slab_count++] = sl;
+  atomic_set(&sl->sl_enabled, 1);
+}
+
+void
+tvh_slab_done(tvh_slab_t *sl)
+{
+  tvh_slab_tcache_t *tc;
+  void *batch, *p, *next, *next2;
+  int count = 0;
+
+  tvh_mutex_lock(&sl->sl_lock);
+  atomic_set(&sl->sl_enabled, 0);
+  batch = sl->sl_depot;
+  sl->sl_depot = NULL;
+  sl->sl_depot_count = 0;
+  tvh_mutex_unlock(&sl->sl_lock);
+  tc = &tvh_slab_tcache[sl->sl_index];
+  p = tc->head;
+  tc->head = NULL;
+  tc->count = 0;
+  for ( ; p; p = next, count++) {
+    next = SLAB_NEXT(p);
+    free(p);
+  }
+  for ( ; batch; batch = next) {
+    next = SLAB_BATCH(batch);
+    for (p = batch; p; p = next2, count++) {
+      next2 = SLAB_NEXT(p);
+      free(p);
+    }
+  }
+  tvh_slab_cached(sl, -count);
+}
@@ -0,0 +1,59 @@
+/*
+ *  tvheadend, slab caches for the small hot objects
+ *  Copyright (C) 2026 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TVH_SLAB_H__
+#define __TVH_SLAB_H__
+
+#include "tvh_thread.h"
+
+struct memoryinfo;
+
+/*
+ * Fixed size object cache
+ *
+ * Each thread keeps a private free list per cache, the full batches
+ * of the free objects are exchanged with the shared depot, so the
+ * objects allocated in one thread and released in another thread
+ * (the usual packet flow) return to the producer without the lock
+ * per object. The name, size and batch are set statically, before
+ * init and after done, the plain malloc/free is used. With batch 1,
+ * the freed objects go directly to the depot (large objects).
+ */
+typedef struct tvh_slab {
+  const char          *sl_name;
+  size_t               sl_size;     /* object size */
+  int                  sl_batch;    /* objects in one depot batch */
+  int                  sl_depot_max;/* maximal batches in depot */
+  int                  sl_index;    /* thread cache index */
+  int                  sl_enabled;
+  struct memoryinfo   *sl_memoryinfo;
+  tvh_mutex_t          sl_lock;
+  void                *sl_depot;    /* chain of batches */
+  int                  sl_depot_count;
+} tvh_slab_t;
+
+#define TVH_SLAB(name, size, batch) \
+  { .sl_name = (name), .sl_size = (size), .sl_batch = (batch) }
+
+void tvh_slab_init(tvh_slab_t *sl, struct memoryinfo *my);
+void tvh_slab_done(tvh_slab_t *sl);
+
+void *tvh_slab_alloc(tvh_slab_t *sl);
+void tvh_slab_free(tvh_slab_t *sl, void *ptr);
+
+#endif /* __TVH_SLAB_H__ */
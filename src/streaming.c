@@ -25,8 +25,11 @@
 #include "atomic.h"
 #include "service.h"
 #include "timeshift.h"
+#include "slab.h"
 
 static memoryinfo_t streaming_msg_memoryinfo = { .my_name = "Streaming message" };
+static tvh_slab_t streaming_msg_slab =
+  TVH_SLAB("streaming message", sizeof(streaming_message_t), 64);
 
 void
 streaming_pad_init(streaming_pad_t *sp)
@@ -34,6 +37,11 @@ streaming_pad_init(streaming_pad_t *sp)
   LIST_INIT(&sp->sp_targets);
   sp->sp_ntargets = 0;
   sp->sp_reject_filter = ~0;
+  sp->sp_deliveries = 0;
+  sp->sp_fanout = 0;
+  sp->sp_shared = 0;
+  sp->sp_fanout_max = 0;
+  memset(sp->sp_latency, 0, sizeof(sp->sp_latency));
 }
 
 /**
@@ -66,6 +74,14 @@ streaming_message_data_size(streaming_message_t *sm)
   return 0;
 }
 
+/*
+ * The producers push the messages to the lock-free inbox (LIFO linked
+ * through sm_link.tqe_next) and take sq_mutex only to wake up the
+ * sleeping consumer. The consumer moves the whole inbox to sq_queue
+ * in one step and processes the batch without any locking.
+ */
+#define SM_INBOX_NEXT(sm) ((sm)->sm_link.tqe_next)
+
 /**
  *
  */
@@ -73,19 +89,49 @@ static void
 streaming_queue_deliver(void *opauqe, streaming_message_t *sm)
 {
   streaming_queue_t *sq = opauqe;
-
-  tvh_mutex_lock(&sq->sq_mutex);
+  void *head;
 
   /* queue size protection */
-  if (sq->sq_maxsize && sq->sq_maxsize < sq->sq_size) {
+  if (sq->sq_maxsize && (int64_t)sq->sq_maxsize < atomic_get_s64(&sq->sq_size)) {
     streaming_msg_free(sm);
-  } else {
-    TAILQ_INSERT_TAIL(&sq->sq_queue, sm, sm_link);
-    sq->sq_size += streaming_message_data_size(sm);
+    return;
   }
 
-  tvh_cond_signal(&sq->sq_cond, 0);
-  tvh_mutex_unlock(&sq->sq_mutex);
+  atomic_add_s64(&sq->sq_size, streaming_message_data_size(sm));
+  do {
+    head = sq->sq_inbox;
+    SM_INBOX_NEXT(sm) = head;
+  } while (!atomic_cas_ptr((atomic_refptr_t)&sq->sq_inbox, head, sm));
+
+  if (atomic_get(&sq->sq_waiting)) {
+    tvh_mutex_lock(&sq->sq_mutex);
+    tvh_cond_signal(&sq->sq_cond, 0);
+    tvh_mutex_unlock(&sq->sq_mutex);
+  }
+}
+
+/**
+ * Move the inbox to sq_queue (consumer only)
+ */
+static int
+streaming_queue_drain(streaming_queue_t *sq)
+{
+  streaming_message_t *sm, *next, *prev = NULL;
+
+  sm = atomic_exchange_ptr((atomic_refptr_t)&sq->sq_inbox, NULL);
+  if (sm == NULL)
+    return 0;
+  /* reverse to the delivery order */
+  for ( ; sm; sm = next) {
+    next = SM_INBOX_NEXT(sm);
+    SM_INBOX_NEXT(sm) = prev;
+    prev = sm;
+  }
+  for (sm = prev; sm; sm = next) {
+    next = SM_INBOX_NEXT(sm);
+    TAILQ_INSERT_TAIL(&sq->sq_queue, sm, sm_link);
+  }
+  return 1;
 }
 
 /**
@@ -95,26 +141,72 @@ static htsmsg_t *
 streaming_queue_info(void *opaque, htsmsg_t *list)
 {
   streaming_queue_t *sq = opaque;
-  size_t size;
   char buf[256];
-  tvh_mutex_lock(&sq->sq_mutex);
-  size = sq->sq_size;
-  tvh_mutex_unlock(&sq->sq_mutex);
-  snprintf(buf, sizeof(buf), "streaming queue %p size %zd", sq, size);
+  snprintf(buf, sizeof(buf), "streaming queue %p size %"PRId64,
+           sq, atomic_get_s64(&sq->sq_size));
   htsmsg_add_str(list, NULL, buf);
   return list;
 }
 
+/**
+ * Get the first message, the inbox is drained in one batch when
+ * the consumer queue is empty
+ */
+streaming_message_t *
+streaming_queue_first(streaming_queue_t *sq)
+{
+  streaming_message_t *sm = TAILQ_FIRST(&sq->sq_queue);
+
+  if (sm == NULL && streaming_queue_drain(sq))
+    sm = TAILQ_FIRST(&sq->sq_queue);
+  return sm;
+}
+
+/**
+ * Wait for the new messages, sq_mutex must be held, mono == 0 means
+ * no timeout. Returns the tvh_cond_(timed)wait code.
+ */
+int
+streaming_queue_timedwait(streaming_queue_t *sq, int64_t mono)
+{
+  int r = 0;
+
+  atomic_add(&sq->sq_waiting, 1);
+  if (sq->sq_inbox == NULL) {
+    if (mono)
+      r = tvh_cond_timedwait(&sq->sq_cond, &sq->sq_mutex, mono);
+    else
+      r = tvh_cond_wait(&sq->sq_cond, &sq->sq_mutex);
+  }
+  atomic_dec(&sq->sq_waiting, 1);
+  return r;
+}
+
 /**
  *
  */
 void
 streaming_queue_remove(streaming_queue_t *sq, streaming_message_t *sm)
 {
-  sq->sq_size -= streaming_message_data_size(sm);
+  atomic_dec_s64(&sq->sq_size, streaming_message_data_size(sm));
   TAILQ_REMOVE(&sq->sq_queue, sm, sm_link);
 }
 
+/**
+ * Free all queued messages (consumer only)
+ */
+void
+streaming_queue_purge(streaming_queue_t *sq)
+{
+  streaming_message_t *sm;
+
+  streaming_queue_drain(sq);
+  while ((sm = TAILQ_FIRST(&sq->sq_queue)) != NULL) {
+    streaming_queue_remove(sq, sm);
+    streaming_msg_free(sm);
+  }
+}
+
 /**
  *
  */
@@ -134,6 +226,8 @@ streaming_queue_init(streaming_queue_t *sq, int reject_filter, size_t maxsize)
 
   sq->sq_maxsize = maxsize;
   sq->sq_size = 0;
+  sq->sq_inbox = NULL;
+  sq->sq_waiting = 0;
 }
 
 /**
@@ -142,6 +236,7 @@ streaming_queue_init(streaming_queue_t *sq, int reject_filter, size_t maxsize)
 void
 streaming_queue_deinit(streaming_queue_t *sq)
 {
+  streaming_queue_drain(sq);
   sq->sq_size = 0;
   streaming_queue_clear(&sq->sq_queue);
   tvh_mutex_destroy(&sq->sq_mutex);
@@ -201,9 +296,10 @@ streaming_target_disconnect(streaming_pad_t *sp, streaming_target_t *st)
 streaming_message_t *
 streaming_msg_create(streaming_message_type_t type)
 {
-  streaming_message_t *sm = malloc(sizeof(streaming_message_t));
+  streaming_message_t *sm = tvh_slab_alloc(&streaming_msg_slab);
   memoryinfo_alloc(&streaming_msg_memoryinfo, sizeof(*sm));
   sm->sm_type = type;
+  sm->sm_refcount = 1;
 #if ENABLE_TIMESHIFT
   sm->sm_time = 0;
 #endif
@@ -255,12 +351,13 @@ streaming_msg_create_code(streaming_message_type_t type, int code)
 streaming_message_t *
 streaming_msg_clone(streaming_message_t *src)
 {
-  streaming_message_t *dst = malloc(sizeof(streaming_message_t));
+  streaming_message_t *dst = tvh_slab_alloc(&streaming_msg_slab);
   streaming_start_t *ss;
 
   memoryinfo_alloc(&streaming_msg_memoryinfo, sizeof(*dst));
 
   dst->sm_type      = src->sm_type;
+  dst->sm_refcount  = 1;
 #if ENABLE_TIMESHIFT
   dst->sm_time      = src->sm_time;
 #endif
@@ -320,6 +417,32 @@ streaming_msg_clone(streaming_message_t *src)
   return dst;
 }
 
+/**
+ * Add count references for the fan-out, the sole owner does not
+ * need the atomic operation
+ */
+void
+streaming_msg_share(streaming_message_t *sm, int count)
+{
+  if (count <= 0)
+    return;
+  if (sm->sm_refcount == 1)
+    sm->sm_refcount += count;
+  else
+    atomic_add(&sm->sm_refcount, count);
+}
+
+/**
+ * Return the private copy of the shared message
+ */
+streaming_message_t *
+streaming_msg_unshare_(streaming_message_t *sm)
+{
+  streaming_message_t *dst = streaming_msg_clone(sm);
+  streaming_msg_free(sm);
+  return dst;
+}
+
 
 /**
  *
@@ -348,6 +471,9 @@ streaming_msg_free(streaming_message_t *sm)
   if (!sm)
     return;
 
+  if (sm->sm_refcount != 1 && atomic_dec(&sm->sm_refcount, 1) != 1)
+    return;
+
   switch(sm->sm_type) {
   case SMT_PACKET:
     if(sm->sm_data)
@@ -386,7 +512,7 @@ streaming_msg_free(streaming_message_t *sm)
     abort();
   }
   memoryinfo_free(&streaming_msg_memoryinfo, sizeof(*sm));
-  free(sm);
+  tvh_slab_free(&streaming_msg_slab, sm);
 }
 
 /**
@@ -402,26 +528,68 @@ streaming_target_deliver2(streaming_target_t *st, streaming_message_t *sm)
 }
 
 /**
- *
+ * The message is delivered to all targets without copying, the targets
+ * which modify or queue the messages get the private copy in
+ * streaming_target_deliver()
  */
 void
 streaming_pad_deliver(streaming_pad_t *sp, streaming_message_t *sm)
 {
-  streaming_target_t *st, *next, *run = NULL;
+  streaming_target_t *st, *next;
+  int64_t t;
+  int i, mask = SMT_TO_MASK(sm->sm_type), count = 0, n, shared = 0;
 
-  for (st = LIST_FIRST(&sp->sp_targets); st; st = next) {
+  LIST_FOREACH(st, &sp->sp_targets, st_link)
+    if ((st->st_reject_filter & mask) == 0)
+      count++;
+  if (count == 0) {
+    streaming_msg_free(sm);
+    return;
+  }
+
+  t = getmonoclock();
+  streaming_msg_share(sm, count - 1);
+  n = count;
+  for (st = LIST_FIRST(&sp->sp_targets); st && count > 0; st = next) {
     next = LIST_NEXT(st, st_link);
     assert(next != st);
-    if (st->st_reject_filter & SMT_TO_MASK(sm->sm_type))
+    if (st->st_reject_filter & mask)
       continue;
-    if (run)
-      streaming_target_deliver(run, streaming_msg_clone(sm));
-    run = st;
+    shared += st->st_ops.st_shared;
+    count--;
+    streaming_target_deliver(st, sm);
   }
-  if (run)
-    streaming_target_deliver(run, sm);
-  else
+  /* the targets disconnected in the callbacks */
+  for (n -= count; count > 0; count--)
     streaming_msg_free(sm);
+  t = getmonoclock() - t;
+
+  for (i = 0; i < STREAMING_PAD_LATENCY_SLOTS - 1 && t >= (1 << i); i++);
+  sp->sp_latency[i]++;
+  sp->sp_deliveries++;
+  sp->sp_fanout += n;
+  sp->sp_shared += shared;
+  if (n > sp->sp_fanout_max)
+    sp->sp_fanout_max = n;
+}
+
+/**
+ *
+ */
+htsmsg_t *
+streaming_pad_stats(streaming_pad_t *sp)
+{
+  htsmsg_t *m = htsmsg_create_map(), *l = htsmsg_create_list();
+  int i;
+
+  htsmsg_add_s64(m, "deliveries", sp->sp_deliveries);
+  htsmsg_add_s64(m, "fanout", sp->sp_fanout);
+  htsmsg_add_s64(m, "shared", sp->sp_shared);
+  htsmsg_add_u32(m, "fanout_max", sp->sp_fanout_max);
+  for (i = 0; i < STREAMING_PAD_LATENCY_SLOTS; i++)
+    htsmsg_add_u32(l, NULL, sp->sp_latency[i]);
+  htsmsg_add_msg(m, "latency", l);
+  return m;
 }
 
 /**
@@ -636,6 +804,7 @@ const char *signal2str(signal_state_t st)
 void streaming_init(void)
 {
   memoryinfo_register(&streaming_msg_memoryinfo);
+  tvh_slab_init(&streaming_msg_slab, &streaming_msg_memoryinfo);
 }
 
 void streaming_done(void)
@@ -643,4 +812,5 @@ void streaming_done(void)
   tvh_mutex_lock(&global_lock);
   memoryinfo_unregister(&streaming_msg_memoryinfo);
   tvh_mutex_unlock(&global_lock);
+  tvh_slab_done(&streaming_msg_slab);
 }
\ No newline at end of file
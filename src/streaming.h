@@ -148,10 +148,19 @@ struct streaming_skip
  * is why we have the callback target.
  *
  */
+#define STREAMING_PAD_LATENCY_SLOTS 16
+
 struct streaming_pad {
   struct streaming_target_list sp_targets;
   int sp_ntargets;
   int sp_reject_filter;
+  /* statistics (protected by the pad owner lock) */
+  uint64_t sp_deliveries;   /* delivered messages */
+  uint64_t sp_fanout;       /* delivered messages * targets */
+  uint64_t sp_shared;       /* deliveries without the envelope copy */
+  int      sp_fanout_max;
+  /* delivery time, slot n counts the times below 2^n us */
+  uint32_t sp_latency[STREAMING_PAD_LATENCY_SLOTS];
 };
 
 /**
@@ -316,10 +325,16 @@ const char * signal2str ( signal_state_t st );
 
 /**
  * Streaming messages are sent from the pad to its receivers
+ *
+ * One message can be delivered to more targets (sm_refcount > 1),
+ * the shared message is immutable and it cannot be linked to a queue.
+ * The targets which are not marked with st_shared in ops receive
+ * a private copy (see streaming_msg_unshare).
  */
 struct streaming_message {
   TAILQ_ENTRY(streaming_message) sm_link;
   streaming_message_type_t sm_type;
+  int sm_refcount;
 #if ENABLE_TIMESHIFT
   int64_t sm_time;
 #endif
@@ -337,6 +352,7 @@ typedef void (st_callback_t)(void *opaque, streaming_message_t *sm);
 struct streaming_ops {
   st_callback_t *st_cb;
   htsmsg_t *(*st_info)(void *opaque, htsmsg_t *list);
+  int st_shared;  /* st_cb does not modify nor queue the message */
 };
 
 typedef struct streaming_target {
@@ -354,13 +370,16 @@ struct streaming_queue {
 
   streaming_target_t sq_st;
 
-  tvh_mutex_t sq_mutex;    /* Protects sp_queue */
+  tvh_mutex_t sq_mutex;    /* Protects the consumer sleep */
   tvh_cond_t  sq_cond;     /* Condvar for signalling new packets */
 
   size_t      sq_maxsize;  /* Max queue size (bytes) */
-  size_t      sq_size;     /* Actual queue size (bytes) - only data */
+  int64_t     sq_size;     /* Actual queue size (bytes) - only data, atomic */
 
-  struct streaming_message_queue sq_queue;
+  void       *sq_inbox;    /* Delivered messages (MPSC, LIFO), atomic */
+  int         sq_waiting;  /* Consumer sleeps on sq_cond, atomic */
+
+  struct streaming_message_queue sq_queue; /* Drained messages (consumer) */
 
 };
 
@@ -434,18 +453,37 @@ void streaming_queue_deinit(streaming_queue_t *sq);
 
 void streaming_queue_remove(streaming_queue_t *sq, streaming_message_t *sm);
 
+streaming_message_t *streaming_queue_first(streaming_queue_t *sq);
+
+int streaming_queue_timedwait(streaming_queue_t *sq, int64_t mono);
+
+static inline void streaming_queue_wait(streaming_queue_t *sq)
+  { streaming_queue_timedwait(sq, 0); }
+
+void streaming_queue_purge(streaming_queue_t *sq);
+
 void streaming_target_connect(streaming_pad_t *sp, streaming_target_t *st);
 
 void streaming_target_disconnect(streaming_pad_t *sp, streaming_target_t *st);
 
 void streaming_pad_deliver(streaming_pad_t *sp, streaming_message_t *sm);
 
+htsmsg_t *streaming_pad_stats(streaming_pad_t *sp);
+
 void streaming_service_deliver(struct service *t, streaming_message_t *sm);
 
 void streaming_msg_free(streaming_message_t *sm);
 
 streaming_message_t *streaming_msg_clone(streaming_message_t *src);
 
+void streaming_msg_share(streaming_message_t *sm, int count);
+
+streaming_message_t *streaming_msg_unshare_(streaming_message_t *sm);
+
+static inline streaming_message_t *
+streaming_msg_unshare(streaming_message_t *sm)
+  { return sm->sm_refcount == 1 ? sm : streaming_msg_unshare_(sm); }
+
 streaming_message_t *streaming_msg_create(streaming_message_type_t type);
 
 streaming_message_t *streaming_msg_create_data(streaming_message_type_t type, 
@@ -458,7 +496,11 @@ streaming_message_t *streaming_msg_create_pkt(th_pkt_t *pkt);
 
 static inline void
 streaming_target_deliver(streaming_target_t *st, streaming_message_t *sm)
-  { st->st_ops.st_cb(st->st_opaque, sm); }
+{
+  if (!st->st_ops.st_shared)
+    sm = streaming_msg_unshare(sm);
+  st->st_ops.st_cb(st->st_opaque, sm);
+}
 
 void streaming_target_deliver2(streaming_target_t *st, streaming_message_t *sm);
 
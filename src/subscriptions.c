@@ -522,8 +522,9 @@ subscription_input_null_info(void *opaque, htsmsg_t *list)
 }
 
 static streaming_ops_t subscription_input_null_ops = {
-  .st_cb   = subscription_input_null,
-  .st_info = subscription_input_null_info
+  .st_cb     = subscription_input_null,
+  .st_info   = subscription_input_null_info,
+  .st_shared = 1
 };
 
 /**
@@ -558,8 +559,9 @@ subscription_input_direct_info(void *opaque, htsmsg_t *list)
 }
 
 static streaming_ops_t subscription_input_direct_ops = {
-  .st_cb   = subscription_input_direct,
-  .st_info = subscription_input_direct_info
+  .st_cb     = subscription_input_direct,
+  .st_info   = subscription_input_direct_info,
+  .st_shared = 1
 };
 
 /**
@@ -582,7 +584,8 @@ subscription_input(void *opaque, streaming_message_t *sm)
 
     if(sm->sm_type == SMT_START) {
       streaming_msg_free(s->ths_start_message);
-      s->ths_start_message = sm;
+      /* kept for the later delivery, the pad message is shared */
+      s->ths_start_message = streaming_msg_unshare(sm);
       return;
     }
 
@@ -645,8 +648,9 @@ subscription_input_info(void *opaque, htsmsg_t *list)
 }
 
 static streaming_ops_t subscription_input_ops = {
-  .st_cb   = subscription_input,
-  .st_info = subscription_input_info
+  .st_cb     = subscription_input,
+  .st_info   = subscription_input_info,
+  .st_shared = 1
 };
 
 
@@ -1061,6 +1065,7 @@ subscription_create_msg(th_subscription_t *s, const char *lang)
       }
       htsmsg_add_str(m, "descramble", buf);
     }
+    htsmsg_add_msg(m, "pad", streaming_pad_stats(&t->s_streaming_pad));
     tvh_mutex_unlock(&t->s_stream_mutex);
 
     if (t->s_pid_list) {
@@ -1139,6 +1144,7 @@ subscription_status_callback ( void *p )
 void
 subscription_init(void)
 {
+  parser_workers_init();
   subscription_status_callback(NULL);
   dbus_register_rpc_s64("postpone", NULL, subscription_set_postpone);
 }
@@ -1155,6 +1161,7 @@ subscription_done(void)
   subscription_reschedule();
   tvh_mutex_unlock(&global_lock);
   assert(LIST_FIRST(&subscriptions) == NULL);
+  parser_workers_done();
 }
 
 /* **************************************************************************
@@ -275,7 +275,7 @@ tcp_write_queue(int fd, htsbuf_queue_t *q)
 
 
 /**
- *
+ * EAGAIN is returned when the receive timeout (SO_RCVTIMEO) expires
  */
 static int
 tcp_fill_htsbuf_from_fd(int fd, htsbuf_queue_t *hq)
@@ -291,7 +291,7 @@ tcp_fill_htsbuf_from_fd(int fd, htsbuf_queue_t *hq)
 
       do {
         r = read(fd, hd->hd_data + hd->hd_data_len, c);
-      } while (r < 0 && ERRNO_AGAIN(errno));
+      } while (r < 0 && errno == EINTR);
       if(r < 1)
 	return -1;
 
@@ -308,7 +308,7 @@ tcp_fill_htsbuf_from_fd(int fd, htsbuf_queue_t *hq)
 
   do {
     r = read(fd, hd->hd_data, hd->hd_data_size);
-  } while (r < 0 && ERRNO_AGAIN(errno));
+  } while (r < 0 && errno == EINTR);
   if(r < 1) {
     free(hd->hd_data);
     free(hd);
@@ -431,6 +431,21 @@ tcp_read_timeout(int fd, void *buf, size_t len, int timeout)
 
 }
 
+/**
+ * Bytes in the input queue (hq_size is not exact for the partially
+ * filled blocks, count the blocks)
+ */
+size_t
+tcp_input_queued(htsbuf_queue_t *q)
+{
+  htsbuf_data_t *hd;
+  size_t r = 0;
+
+  TAILQ_FOREACH(hd, &q->hq_q, hd_link)
+    r += hd->hd_data_len - hd->hd_data_off;
+  return r;
+}
+
 /**
  *
  */
@@ -522,6 +537,10 @@ typedef struct tcp_server_launch {
   uint32_t id;
   int fd;
   int streaming;
+  uint8_t reactor;   // event driven (ops.input)
+  uint8_t launched;  // ops.start was called
+  uint8_t closing;   // input error or timeout, close in the worker
+  int64_t partial;   // parked with a partial request since (tcp_workers_lock)
   tcp_server_ops_t ops;
   void *opaque;
   char *representative;
@@ -532,6 +551,8 @@ typedef struct tcp_server_launch {
   LIST_ENTRY(tcp_server_launch) link;
   LIST_ENTRY(tcp_server_launch) alink;
   LIST_ENTRY(tcp_server_launch) jlink;
+  LIST_ENTRY(tcp_server_launch) plink;
+  tcp_task_t task;
 } tcp_server_launch_t;
 
 static LIST_HEAD(, tcp_server) tcp_server_delete_list = { 0 };
@@ -539,6 +560,60 @@ static LIST_HEAD(, tcp_server_launch) tcp_server_launches = { 0 };
 static LIST_HEAD(, tcp_server_launch) tcp_server_active = { 0 };
 static LIST_HEAD(, tcp_server_launch) tcp_server_join = { 0 };
 
+/*
+ * Event driven connections
+ *
+ * The servers with the input callback do not own a thread for each
+ * connection. An idle connection is parked in the reactor poll, the
+ * reactor reads the data without blocking to the connection input
+ * queue and the input callback is called from the worker pool when
+ * a complete request is queued, so the workers never wait for a slow
+ * peer to send. The pool runs also the other short tasks (HTSP output).
+ *
+ * The pool keeps TCP_WORKERS_IDLE_MIN idle workers and it grows up to
+ * TCP_WORKERS_MAX on demand. The long running tasks (streaming,
+ * comet, HTSP writer with subscriptions or blocked by a slow peer)
+ * dedicate their worker (tcp_worker_dedicate), such workers are not
+ * counted. When the queue
+ * does not move, the reactor adds up to TCP_WORKERS_SURPLUS workers
+ * above the limit (handlers blocked for a long time). The surplus
+ * idle workers exit.
+ *
+ * A partial request must be completed in TCP_INPUT_TIMEOUT seconds,
+ * otherwise the reactor closes the connection.
+ */
+#define TCP_WORKERS_IDLE_MIN    4
+#define TCP_WORKERS_MAX         16
+#define TCP_WORKERS_SURPLUS     16
+#define TCP_WORKERS_IDLE_TIME   sec2mono(30)
+#define TCP_WORKERS_STALL_MS    250
+#define TCP_INPUT_TIMEOUT       30
+#define TCP_INPUT_READ          (64 * 1024)
+
+typedef struct tcp_worker {
+  pthread_t tw_tid;
+  int       tw_dedicated;
+  LIST_ENTRY(tcp_worker) tw_link;
+} tcp_worker_t;
+
+static tvhpoll_t *tcp_reactor_poll;
+static th_pipe_t tcp_reactor_pipe;
+static pthread_t tcp_reactor_tid;
+static tvh_mutex_t tcp_workers_lock;
+static tvh_cond_t tcp_workers_cond;
+static TAILQ_HEAD(, tcp_task) tcp_workers_queue;
+static LIST_HEAD(, tcp_worker) tcp_workers_exited;
+static __thread tcp_worker_t *tcp_worker_self;
+static int tcp_workers_running;
+static int tcp_workers_count;     // all workers
+static int tcp_workers_idle;      // workers without task
+static int tcp_workers_dedicated; // workers serving streaming connections
+static int tcp_workers_queued;    // tasks waiting for a worker
+static int tcp_workers_max;       // statistics
+static int tcp_workers_parked;    // idle connections in the reactor poll
+static LIST_HEAD(, tcp_server_launch) tcp_workers_partial; // parked, partial request
+static uint64_t tcp_workers_tasks;
+
 /**
  *
  */
@@ -622,6 +697,8 @@ try_again:
   res->representative = aa->aa_representative ? strdup(aa->aa_representative) : NULL;
   res->status = status;
   res->streaming = streaming;
+  if (streaming && res->reactor)
+    tcp_worker_dedicate();
   LIST_INSERT_HEAD(&tcp_server_launches, res, link);
   notify_reload("connections");
   return res;
@@ -683,45 +760,65 @@ tcp_connection_cancel_all(void)
 /*
  *
  */
-static void *
-tcp_server_start(void *aux)
+static void
+tcp_server_socket_setup(int fd)
 {
-  tcp_server_launch_t *tsl = aux;
   struct timeval to;
   int val;
-  char c = 'J';
 
   val = 1;
-  setsockopt(tsl->fd, SOL_SOCKET, SO_KEEPALIVE, &val, sizeof(val));
+  setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &val, sizeof(val));
   
 #ifdef TCP_KEEPIDLE
   val = 30;
-  setsockopt(tsl->fd, IPPROTO_TCP, TCP_KEEPIDLE, &val, sizeof(val));
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &val, sizeof(val));
 #endif
 
 #ifdef TCP_KEEPINVL
   val = 15;
-  setsockopt(tsl->fd, IPPROTO_TCP, TCP_KEEPINTVL, &val, sizeof(val));
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &val, sizeof(val));
 #endif
 
 #ifdef TCP_KEEPCNT
   val = 5;
-  setsockopt(tsl->fd, IPPROTO_TCP, TCP_KEEPCNT, &val, sizeof(val));
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &val, sizeof(val));
 #endif
 
   val = 1;
-  setsockopt(tsl->fd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val));
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val));
 
   to.tv_sec  = 30;
   to.tv_usec =  0;
-  setsockopt(tsl->fd, SOL_SOCKET, SO_SNDTIMEO, &to, sizeof(to));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &to, sizeof(to));
+}
 
-  /* Start */
-  time(&tsl->started);
-  tvh_mutex_lock(&global_lock);
+/*
+ * Called with global_lock held
+ */
+static void
+tcp_server_launch_start(tcp_server_launch_t *tsl)
+{
   tsl->id = ++tcp_server_launch_id;
   if (!tsl->id) tsl->id = ++tcp_server_launch_id;
+  tsl->launched = 1;
   tsl->ops.start(tsl->fd, &tsl->opaque, &tsl->peer, &tsl->self);
+}
+
+/*
+ *
+ */
+static void *
+tcp_server_start(void *aux)
+{
+  tcp_server_launch_t *tsl = aux;
+  char c = 'J';
+
+  tcp_server_socket_setup(tsl->fd);
+
+  /* Start */
+  time(&tsl->started);
+  tvh_mutex_lock(&global_lock);
+  tcp_server_launch_start(tsl);
 
   /* Stop */
   if (tsl->ops.stop) tsl->ops.stop(tsl->opaque);
@@ -734,6 +831,365 @@ tcp_server_start(void *aux)
 }
 
 
+/*
+ * Worker pool
+ */
+static void *tcp_worker_thread(void *aux);
+
+static void
+tcp_worker_spawn(void)
+{
+  tcp_worker_t *tw = calloc(1, sizeof(*tw));
+
+  lock_assert(&tcp_workers_lock);
+  tcp_workers_count++;
+  tcp_workers_idle++;
+  if (tcp_workers_count > tcp_workers_max) {
+    tcp_workers_max = tcp_workers_count;
+    tvhtrace(LS_TCP, "worker pool size %d", tcp_workers_max);
+  }
+  tvh_thread_create(&tw->tw_tid, NULL, tcp_worker_thread, tw, "tcp-worker");
+}
+
+static inline void
+tcp_worker_spawn_check(void)
+{
+  if (tcp_workers_idle < tcp_workers_queued &&
+      tcp_workers_count - tcp_workers_dedicated < TCP_WORKERS_MAX)
+    tcp_worker_spawn();
+}
+
+void
+tcp_task_submit(tcp_task_t *tt)
+{
+  tvh_mutex_lock(&tcp_workers_lock);
+  TAILQ_INSERT_TAIL(&tcp_workers_queue, tt, tt_link);
+  tcp_workers_queued++;
+  if (tcp_workers_idle > 0)
+    tvh_cond_signal(&tcp_workers_cond, 0);
+  tcp_worker_spawn_check();
+  tvh_mutex_unlock(&tcp_workers_lock);
+}
+
+/*
+ * The current task will block the worker for a long time
+ */
+void
+tcp_worker_dedicate(void)
+{
+  tcp_worker_t *tw = tcp_worker_self;
+
+  if (tw == NULL || tw->tw_dedicated)
+    return;
+  tvh_mutex_lock(&tcp_workers_lock);
+  tw->tw_dedicated = 1;
+  tcp_workers_dedicated++;
+  tcp_worker_spawn_check();
+  tvh_mutex_unlock(&tcp_workers_lock);
+}
+
+static void *
+tcp_worker_thread(void *aux)
+{
+  tcp_worker_t *tw = aux;
+  tcp_task_t *tt;
+  int64_t idle = mclk();
+  char c = 'W';
+
+  tcp_worker_self = tw;
+  tvh_mutex_lock(&tcp_workers_lock);
+  while (1) {
+    if ((tt = TAILQ_FIRST(&tcp_workers_queue)) == NULL) {
+      if (!atomic_get(&tcp_workers_running))
+        break;
+      if (tcp_workers_idle > TCP_WORKERS_IDLE_MIN &&
+          idle + TCP_WORKERS_IDLE_TIME < mclk())
+        break;
+      tvh_cond_timedwait(&tcp_workers_cond, &tcp_workers_lock, mclk() + sec2mono(5));
+      continue;
+    }
+    TAILQ_REMOVE(&tcp_workers_queue, tt, tt_link);
+    tcp_workers_queued--;
+    tcp_workers_idle--;
+    tvh_mutex_unlock(&tcp_workers_lock);
+    tt->tt_run(tt->tt_opaque);
+    tvh_mutex_lock(&tcp_workers_lock);
+    if (tw->tw_dedicated) {
+      tw->tw_dedicated = 0;
+      tcp_workers_dedicated--;
+    }
+    tcp_workers_idle++;
+    tcp_workers_tasks++;
+    idle = mclk();
+  }
+  tcp_workers_idle--;
+  tcp_workers_count--;
+  LIST_INSERT_HEAD(&tcp_workers_exited, tw, tw_link);
+  tvh_mutex_unlock(&tcp_workers_lock);
+  if (atomic_get(&tcp_workers_running))
+    tvh_write(tcp_reactor_pipe.wr, &c, 1);
+  return NULL;
+}
+
+static void
+tcp_workers_join(void)
+{
+  tcp_worker_t *tw;
+
+  tvh_mutex_lock(&tcp_workers_lock);
+  while ((tw = LIST_FIRST(&tcp_workers_exited)) != NULL) {
+    LIST_REMOVE(tw, tw_link);
+    tvh_mutex_unlock(&tcp_workers_lock);
+    pthread_join(tw->tw_tid, NULL);
+    free(tw);
+    tvh_mutex_lock(&tcp_workers_lock);
+  }
+  tvh_mutex_unlock(&tcp_workers_lock);
+}
+
+/*
+ * Event driven connection
+ */
+static void
+tcp_connection_partial(tcp_server_launch_t *tsl, int partial)
+{
+  lock_assert(&tcp_workers_lock);
+  if (partial && !tsl->partial) {
+    tsl->partial = mclk();
+    LIST_INSERT_HEAD(&tcp_workers_partial, tsl, plink);
+  } else if (!partial && tsl->partial) {
+    tsl->partial = 0;
+    LIST_REMOVE(tsl, plink);
+  }
+}
+
+static void
+tcp_connection_park(tcp_server_launch_t *tsl)
+{
+  int r;
+
+  atomic_add(&tcp_workers_parked, 1);
+  /* the reactor must not see the connection before the partial mark */
+  tvh_mutex_lock(&tcp_workers_lock);
+  tcp_connection_partial(tsl, tcp_input_queued(tsl->ops.input_queue(tsl->opaque)) > 0);
+  r = tvhpoll_add1(tcp_reactor_poll, tsl->fd, TVHPOLL_IN, tsl);
+  if (r < 0)
+    tcp_connection_partial(tsl, 0);
+  tvh_mutex_unlock(&tcp_workers_lock);
+  if (r < 0) {
+    atomic_dec(&tcp_workers_parked, 1);
+    tvherror(LS_TCP, "unable to add connection to the reactor: %s", strerror(errno));
+    tsl->closing = 1;
+    tcp_task_submit(&tsl->task);
+  }
+}
+
+static void
+tcp_connection_close(tcp_server_launch_t *tsl)
+{
+  tvh_mutex_lock(&global_lock);
+  LIST_REMOVE(tsl, alink);
+  tvh_mutex_unlock(&global_lock);
+  if (tsl->opaque)
+    tsl->ops.finish(tsl->opaque);
+  close(tsl->fd);
+  free(tsl);
+}
+
+static void
+tcp_connection_run(void *aux)
+{
+  tcp_server_launch_t *tsl = aux;
+  struct timeval to;
+  int r;
+
+  if (tsl->closing) {
+    tcp_connection_close(tsl);
+    return;
+  }
+  if (!tsl->launched) {
+    tcp_server_socket_setup(tsl->fd);
+    to.tv_sec  = TCP_INPUT_TIMEOUT;
+    to.tv_usec = 0;
+    setsockopt(tsl->fd, SOL_SOCKET, SO_RCVTIMEO, &to, sizeof(to));
+    time(&tsl->started);
+    tvh_mutex_lock(&global_lock);
+    tcp_server_launch_start(tsl);
+    tvh_mutex_unlock(&global_lock);
+    r = tsl->opaque == NULL;
+  } else {
+    r = tsl->ops.input(tsl->opaque);
+  }
+  if (r == 0 && atomic_get(&tcp_server_running))
+    tcp_connection_park(tsl);
+  else
+    tcp_connection_close(tsl);
+}
+
+/*
+ * Reactor - read the data for the parked connections, returns non-zero
+ * when the connection should be passed to a worker
+ */
+static int
+tcp_reactor_input(tcp_server_launch_t *tsl, uint8_t *buf)
+{
+  ssize_t r;
+  int ready;
+
+  r = recv(tsl->fd, buf, TCP_INPUT_READ, MSG_DONTWAIT);
+  if (r < 0 && ERRNO_AGAIN(errno))
+    return 0;
+  if (r <= 0) {
+    tsl->closing = 1;
+    return 1;
+  }
+  htsbuf_append(tsl->ops.input_queue(tsl->opaque), buf, r);
+  ready = tsl->ops.ready(tsl->opaque);
+  if (ready < 0) {
+    tvhdebug(LS_TCP, "invalid request from connection %u", tsl->id);
+    tsl->closing = 1;
+  }
+  if (ready == 0) {
+    tvh_mutex_lock(&tcp_workers_lock);
+    tcp_connection_partial(tsl, 1);
+    tvh_mutex_unlock(&tcp_workers_lock);
+  }
+  return ready != 0;
+}
+
+static void
+tcp_reactor_submit(tcp_server_launch_t *tsl)
+{
+  tvh_mutex_lock(&tcp_workers_lock);
+  tcp_connection_partial(tsl, 0);
+  tvhpoll_rem1(tcp_reactor_poll, tsl->fd);
+  tvh_mutex_unlock(&tcp_workers_lock);
+  atomic_dec(&tcp_workers_parked, 1);
+  tcp_task_submit(&tsl->task);
+}
+
+/*
+ * Close the connections with a partial request older than TCP_INPUT_TIMEOUT
+ */
+static void
+tcp_reactor_expire(void)
+{
+  tcp_server_launch_t *tsl;
+  int64_t limit = mclk() - sec2mono(TCP_INPUT_TIMEOUT);
+
+  tvh_mutex_lock(&tcp_workers_lock);
+  while (1) {
+    LIST_FOREACH(tsl, &tcp_workers_partial, plink)
+      if (tsl->partial < limit)
+        break;
+    if (tsl == NULL)
+      break;
+    tvh_mutex_unlock(&tcp_workers_lock);
+    tvhdebug(LS_TCP, "connection %u: request not completed in %d seconds",
+             tsl->id, TCP_INPUT_TIMEOUT);
+    tsl->closing = 1;
+    tcp_reactor_submit(tsl);
+    tvh_mutex_lock(&tcp_workers_lock);
+  }
+  tvh_mutex_unlock(&tcp_workers_lock);
+}
+
+static void
+tcp_reactor_stall_check(void)
+{
+  static uint64_t last;
+
+  tvh_mutex_lock(&tcp_workers_lock);
+  if (tcp_workers_queued > 0 && tcp_workers_idle == 0 &&
+      last == tcp_workers_tasks) {
+    tvhtrace(LS_TCP, "worker pool stalled (%d workers, %d dedicated, %d queued)",
+             tcp_workers_count, tcp_workers_dedicated, tcp_workers_queued);
+    if (tcp_workers_count - tcp_workers_dedicated < TCP_WORKERS_MAX + TCP_WORKERS_SURPLUS)
+      tcp_worker_spawn();
+  }
+  last = tcp_workers_tasks;
+  tvh_mutex_unlock(&tcp_workers_lock);
+}
+
+static void *
+tcp_reactor_loop(void *aux)
+{
+  tvhpoll_event_t ev[32];
+  tcp_server_launch_t *tsl;
+  uint8_t *buf = malloc(TCP_INPUT_READ);
+  int i, r;
+  char c;
+
+  while (atomic_get(&tcp_workers_running)) {
+    r = tvhpoll_wait(tcp_reactor_poll, ev, ARRAY_SIZE(ev), TCP_WORKERS_STALL_MS);
+    if (r < 0) {
+      if (ERRNO_AGAIN(errno))
+        continue;
+      tvherror(LS_TCP, "tcp_reactor_loop: tvhpoll_wait: %s", strerror(errno));
+      continue;
+    }
+    for (i = 0; i < r; i++) {
+      if (ev[i].ptr == &tcp_reactor_pipe) {
+        while (read(tcp_reactor_pipe.rd, &c, 1) > 0);
+        tcp_workers_join();
+        continue;
+      }
+      tsl = ev[i].ptr;
+      if (tcp_reactor_input(tsl, buf))
+        tcp_reactor_submit(tsl);
+    }
+    tcp_reactor_expire();
+    tcp_reactor_stall_check();
+  }
+  free(buf);
+  tvhtrace(LS_TCP, "reactor thread finished");
+  return NULL;
+}
+
+static void
+tcp_workers_init(void)
+{
+  int i;
+
+  tvh_mutex_init(&tcp_workers_lock, NULL);
+  tvh_cond_init(&tcp_workers_cond, 1);
+  TAILQ_INIT(&tcp_workers_queue);
+  LIST_INIT(&tcp_workers_partial);
+  tvh_pipe(O_NONBLOCK, &tcp_reactor_pipe);
+  tcp_reactor_poll = tvhpoll_create(256);
+  tvhpoll_add1(tcp_reactor_poll, tcp_reactor_pipe.rd, TVHPOLL_IN, &tcp_reactor_pipe);
+  atomic_set(&tcp_workers_running, 1);
+  tvh_thread_create(&tcp_reactor_tid, NULL, tcp_reactor_loop, NULL, "tcp-reactor");
+  tvh_mutex_lock(&tcp_workers_lock);
+  for (i = 0; i < TCP_WORKERS_IDLE_MIN; i++)
+    tcp_worker_spawn();
+  tvh_mutex_unlock(&tcp_workers_lock);
+}
+
+static void
+tcp_workers_done(void)
+{
+  char c = 'E';
+
+  atomic_set(&tcp_workers_running, 0);
+  tvh_write(tcp_reactor_pipe.wr, &c, 1);
+  pthread_join(tcp_reactor_tid, NULL);
+  tvh_mutex_lock(&tcp_workers_lock);
+  while (tcp_workers_count > 0) {
+    tvh_cond_signal(&tcp_workers_cond, 1);
+    tvh_mutex_unlock(&tcp_workers_lock);
+    tcp_workers_join();
+    tvh_safe_usleep(20000);
+    tvh_mutex_lock(&tcp_workers_lock);
+  }
+  tvh_mutex_unlock(&tcp_workers_lock);
+  tcp_workers_join();
+  tvhpoll_destroy(tcp_reactor_poll);
+  tvh_pipe_close(&tcp_reactor_pipe);
+  tvh_cond_destroy(&tcp_workers_cond);
+  tvh_mutex_destroy(&tcp_workers_lock);
+}
+
 /**
  *
  */
@@ -793,6 +1249,10 @@ next:
       tsl->opaque         = ts->opaque;
       tsl->status         = NULL;
       tsl->representative = NULL;
+      tsl->reactor        = ts->ops.input != NULL;
+      tsl->launched       = 0;
+      tsl->closing        = 0;
+      tsl->partial        = 0;
       slen = sizeof(struct sockaddr_storage);
 
       tsl->fd = accept(ts->serverfd, 
@@ -814,7 +1274,12 @@ next:
       tvh_mutex_lock(&global_lock);
       LIST_INSERT_HEAD(&tcp_server_active, tsl, alink);
       tvh_mutex_unlock(&global_lock);
-      tvh_thread_create(&tsl->tid, NULL, tcp_server_start, tsl, "tcp-start");
+      if (tsl->reactor) {
+        tsl->task.tt_run = tcp_connection_run;
+        tsl->task.tt_opaque = tsl;
+        tcp_task_submit(&tsl->task);
+      } else
+        tvh_thread_create(&tsl->tid, NULL, tcp_server_start, tsl, "tcp-start");
     }
   }
   tvhtrace(LS_TCP, "server thread finished");
@@ -1153,6 +1618,12 @@ tcp_server_connections ( void )
   m = htsmsg_create_map();
   htsmsg_add_msg(m, "entries", l);
   htsmsg_add_u32(m, "totalCount", c);
+  tvh_mutex_lock(&tcp_workers_lock);
+  htsmsg_add_u32(m, "workers", tcp_workers_count);
+  htsmsg_add_u32(m, "workers_idle", tcp_workers_idle);
+  htsmsg_add_u32(m, "workers_max", tcp_workers_max);
+  tvh_mutex_unlock(&tcp_workers_lock);
+  htsmsg_add_u32(m, "parked", atomic_get(&tcp_workers_parked));
   return m;
 }
 
@@ -1177,6 +1648,7 @@ tcp_server_init(void)
   tvhpoll_add1(tcp_server_poll, tcp_server_pipe.rd, TVHPOLL_IN, &tcp_server_pipe);
 
   atomic_set(&tcp_server_running, 1);
+  tcp_workers_init();
   tvh_thread_create(&tcp_server_tid, NULL, tcp_server_loop, NULL, "tcp-loop");
 }
 
@@ -1197,7 +1669,8 @@ tcp_server_done(void)
       tsl->ops.cancel(tsl->opaque);
     if (tsl->fd >= 0)
       shutdown(tsl->fd, SHUT_RDWR);
-    tvh_thread_kill(tsl->tid, SIGTERM);
+    if (!tsl->reactor)
+      tvh_thread_kill(tsl->tid, SIGTERM);
   }
   tvh_mutex_unlock(&global_lock);
 
@@ -1221,6 +1694,9 @@ tcp_server_done(void)
     free(tsl);
     tvh_mutex_lock(&global_lock);
   }
+  tvh_mutex_unlock(&global_lock);
+  tcp_workers_done();
+  tvh_mutex_lock(&global_lock);
   while ((ts = LIST_FIRST(&tcp_server_delete_list)) != NULL) {
     LIST_REMOVE(ts, link);
     free(ts);
@@ -47,6 +47,18 @@
       ((struct sockaddr_in  *)&(storage))->sin_port  = (port); \
   } while (0)
 
+/*
+ * Without the input callback, start serves the whole connection in
+ * a thread created for it. With the input callback (event driven),
+ * start only sets up the connection (opaque) and returns. The reactor
+ * reads the incoming data without blocking to the queue returned by
+ * input_queue, ready checks the queue: positive when a complete request
+ * is queued, zero to wait for more data, negative for invalid data
+ * (the connection is closed). The input callback is called from the
+ * worker pool only with a complete request, it processes the queued
+ * requests and returns zero to wait for more data. Finish releases
+ * the connection (no lock held), the socket is closed by the server code.
+ */
 typedef struct tcp_server_ops
 {
   void (*start)  (int fd, void **opaque,
@@ -54,8 +66,31 @@ typedef struct tcp_server_ops
                      struct sockaddr_storage *self);
   void (*stop)   (void *opaque);
   void (*cancel) (void *opaque);
+  int  (*input)  (void *opaque);
+  htsbuf_queue_t *(*input_queue) (void *opaque);
+  int  (*ready)  (void *opaque);
+  void (*finish) (void *opaque);
 } tcp_server_ops_t;
 
+/*
+ * Worker pool task, the task must not be submitted again before
+ * its run callback is called
+ */
+typedef struct tcp_task {
+  TAILQ_ENTRY(tcp_task) tt_link;
+  void (*tt_run)(void *opaque);
+  void *tt_opaque;
+} tcp_task_t;
+
+void tcp_task_submit(tcp_task_t *tt);
+
+/*
+ * The current task will block the worker for a long time (streaming,
+ * long poll), the worker is not counted to the pool size until the
+ * task returns
+ */
+void tcp_worker_dedicate(void);
+
 extern int tcp_preferred_address_family;
 
 void tcp_server_preinit(int opt_ipv6);
@@ -146,6 +181,8 @@ int tcp_write_queue(int fd, htsbuf_queue_t *q);
 
 int tcp_read_timeout(int fd, void *buf, size_t len, int timeout);
 
+size_t tcp_input_queued(htsbuf_queue_t *q);
+
 char *tcp_get_str_from_ip(const struct sockaddr_storage *sa, char *dst, size_t maxlen);
 
 struct sockaddr_storage *tcp_get_ip_from_str(const char *str, struct sockaddr_storage *sa);
@@ -402,24 +402,20 @@ void *timeshift_writer ( void *aux )
   streaming_queue_t *sq = &ts->wr_queue;
   streaming_message_t *sm;
 
-  tvh_mutex_lock(&sq->sq_mutex);
-
   while (run) {
 
     /* Get message */
-    sm = TAILQ_FIRST(&sq->sq_queue);
+    sm = streaming_queue_first(sq);
     if (sm == NULL) {
-      tvh_cond_wait(&sq->sq_cond, &sq->sq_mutex);
+      tvh_mutex_lock(&sq->sq_mutex);
+      streaming_queue_wait(sq);
+      tvh_mutex_unlock(&sq->sq_mutex);
       continue;
     }
     streaming_queue_remove(sq, sm);
-    tvh_mutex_unlock(&sq->sq_mutex);
 
     _process_msg(ts, sm, &run);
-
-    tvh_mutex_lock(&sq->sq_mutex);
   }
 
-  tvh_mutex_unlock(&sq->sq_mutex);
   return NULL;
 }
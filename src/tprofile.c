@@ -21,6 +21,7 @@
 #include "tvhlog.h"
 #include "clock.h"
 #include "tprofile.h"
+#include "atomic.h"
 
 int tprofile_running;
 static tvh_mutex_t tprofile_mutex;
@@ -116,6 +117,12 @@ void tprofile_finish1(tprofile_t *tprof)
   }
 }
 
+/* called for each section (all muxes), so only the atomic counters */
+void tprofile_hit1(tprofile_t *tprof, int hit)
+{
+  atomic_add_u64(hit ? &tprof->hits : &tprof->misses, 1);
+}
+
 void tprofile_queue_init1(qprofile_t *qprof, const char *name)
 {
   memset(qprof, 0, sizeof(*qprof));
@@ -202,17 +209,32 @@ void tprofile_queue_drop1(qprofile_t *qprof, const char *id, uint64_t count)
 static void tprofile_log_tstats(void)
 {
   tprofile_t *tprof, *tprof_next;
+  uint64_t hits, misses;
 
   tvh_mutex_lock(&tprofile_mutex);
   for (tprof = LIST_FIRST(&tprofile_all); tprof; tprof = tprof_next) {
     tprof_next = LIST_NEXT(tprof, link);
-    if (tprof->changed == 0) continue;
-    tvhtrace(LS_TPROF, "%s: max/avg/cnt=%"PRIu64"ms/%"PRIu64"ms/%"PRIu64" (max=%s)%s",
-             tprof->name,
-             mono2ms(tprof->tmax.t),
-             mono2ms(tprof->tavg.avg), tprof->tavg.count,
-             tprof->tmax.id ?: "?",
-             tprof->finish ? " destroyed" : "");
+    hits = atomic_get_u64(&tprof->hits);
+    misses = atomic_get_u64(&tprof->misses);
+    if (tprof->changed == 0 &&
+        hits == tprof->hits_logged && misses == tprof->misses_logged) continue;
+    tprof->hits_logged = hits;
+    tprof->misses_logged = misses;
+    if (hits || misses)
+      tvhtrace(LS_TPROF, "%s: max/avg/cnt=%"PRIu64"ms/%"PRIu64"ms/%"PRIu64" (max=%s) hit/miss=%"PRIu64"/%"PRIu64"%s",
+               tprof->name,
+               mono2ms(tprof->tmax.t),
+               mono2ms(tprof->tavg.avg), tprof->tavg.count,
+               tprof->tmax.id ?: "?",
+               hits, misses,
+               tprof->finish ? " destroyed" : "");
+    else
+      tvhtrace(LS_TPROF, "%s: max/avg/cnt=%"PRIu64"ms/%"PRIu64"ms/%"PRIu64" (max=%s)%s",
+               tprof->name,
+               mono2ms(tprof->tmax.t),
+               mono2ms(tprof->tavg.avg), tprof->tavg.count,
+               tprof->tmax.id ?: "?",
+               tprof->finish ? " destroyed" : "");
     if (tprof->finish) {
       LIST_REMOVE(tprof, link);
       tprofile_destroy(tprof);
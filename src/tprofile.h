@@ -45,6 +45,10 @@ struct tprofile {
   char *name;
   tprofile_time_t tmax;
   tprofile_avg_t tavg;
+  uint64_t hits;          /* atomic, without tprofile_mutex */
+  uint64_t misses;
+  uint64_t hits_logged;
+  uint64_t misses_logged;
   uint64_t start;
   char *start_id;
   uint8_t changed;
@@ -77,6 +81,7 @@ void tprofile_init1(tprofile_t *tprof, const char *name);
 void tprofile_done1(tprofile_t *tprof);
 void tprofile_start1(tprofile_t *tprof, const char *id);
 void tprofile_finish1(tprofile_t *tprof);
+void tprofile_hit1(tprofile_t *tprof, int hit);
 
 static inline void tprofile_init(tprofile_t *tprof, const char *name)
   { if (tprofile_running) tprofile_init1(tprof, name); }
@@ -86,6 +91,8 @@ static inline void tprofile_start(tprofile_t *tprof, const char *id)
   { if (tprofile_running) tprofile_start1(tprof, id); }
 static inline void tprofile_finish(tprofile_t *tprof)
   { if (tprofile_running) tprofile_finish1(tprof); }
+static inline void tprofile_hit(tprofile_t *tprof, int hit)
+  { if (tprofile_running) tprofile_hit1(tprof, hit); }
 
 void tprofile_queue_init1(qprofile_t *qprof, const char *name);
 void tprofile_queue_done1(qprofile_t *qprof);
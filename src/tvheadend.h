@@ -245,12 +245,23 @@ void tvh_pipe_close(th_pipe_t *pipe);
 
 int tvh_write(int fd, const void *buf, size_t len);
 
+struct iovec;
+int tvh_writev(int fd, struct iovec *iov, int iovcnt, int flags);
+
 int tvh_nonblock_write(int fd, const void *buf, size_t len);
 
 FILE *tvh_fopen(const char *filename, const char *mode);
 
 void hexdump(const char *pfx, const uint8_t *data, int len);
 
+enum {
+  TVH_CRC32_BYTE,
+  TVH_CRC32_SLICE8,
+  TVH_CRC32_CLMUL
+};
+
+void tvh_crc32_init(void);
+int tvh_crc32_select(int variant);
 uint32_t tvh_crc32(const uint8_t *data, size_t datalen, uint32_t crc);
 
 int base64_decode(uint8_t *out, const char *in, int out_size);
@@ -295,6 +306,17 @@ char *url_encode(const char *str);
 void http_deescape(char *str);
 
 int mpegts_word_count(const uint8_t *tsb, int len, uint32_t mask);
+int mpegts_sync_count(const uint8_t *tsb, int len);
+int mpegts_cc_check(const uint8_t *tsb, int len, uint8_t *cc);
+
+enum {
+  TVH_FIND_BYTE,
+  TVH_FIND_VECTOR
+};
+
+int tvh_find_select(int variant);
+const uint8_t *tvh_find_startcode(const uint8_t *p, const uint8_t *end);
+const uint8_t *tvh_find_emulation(const uint8_t *p, const uint8_t *end);
 
 int deferred_unlink(const char *filename, const char *rootdir);
 void dvr_cutpoint_delete_files (const char *s);
@@ -611,6 +611,7 @@ udp_multirecv_init( udp_multirecv_t *um, int packets, int psize )
   um->um_data    = malloc(packets * psize);
   um->um_iovec   = malloc(packets * sizeof(struct iovec));
   um->um_riovec  = malloc(packets * sizeof(struct iovec));
+  um->um_siovec  = malloc(packets * 3 * sizeof(struct iovec));
   um->um_msg     = calloc(packets,  sizeof(struct mmsghdr));
   for (i = 0; i < packets; i++) {
     ((struct mmsghdr *)um->um_msg)[i].msg_hdr.msg_iov    = &um->um_iovec[i];
@@ -628,24 +629,19 @@ udp_multirecv_free( udp_multirecv_t *um )
     return;
   free(um->um_msg);    um->um_msg   = NULL;
   free(um->um_riovec); um->um_riovec = NULL;
+  free(um->um_siovec); um->um_siovec = NULL;
   free(um->um_iovec);  um->um_iovec = NULL;
   free(um->um_data);   um->um_data  = NULL;
   um->um_psize   = 0;
   um->um_packets = 0;
 }
 
-int
-udp_multirecv_read( udp_multirecv_t *um, int fd, int packets,
-                    struct iovec **iovec )
+static int
+udp_multirecv_recv( udp_multirecv_t *um, int fd, int packets )
 {
   static char use_emul = 0;
-  int n, i;
-  if (um == NULL || iovec == NULL) {
-    errno = EINVAL;
-    return -1;
-  }
-  if (packets > um->um_packets)
-    packets = um->um_packets;
+  int n;
+
   if (!use_emul) {
     n = recvmmsg(fd, (struct mmsghdr *)um->um_msg, packets, MSG_DONTWAIT, NULL);
   } else {
@@ -656,6 +652,21 @@ udp_multirecv_read( udp_multirecv_t *um, int fd, int packets,
     use_emul = 1;
     n = recvmmsg_i(fd, (struct mmsghdr *)um->um_msg, packets, MSG_DONTWAIT);
   }
+  return n;
+}
+
+int
+udp_multirecv_read( udp_multirecv_t *um, int fd, int packets,
+                    struct iovec **iovec )
+{
+  int n, i;
+  if (um == NULL || iovec == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (packets > um->um_packets)
+    packets = um->um_packets;
+  n = udp_multirecv_recv(um, fd, packets);
   if (n > 0) {
     for (i = 0; i < n; i++)
       um->um_riovec[i].iov_len = ((struct mmsghdr *)um->um_msg)[i].msg_len;
@@ -664,6 +675,140 @@ udp_multirecv_read( udp_multirecv_t *um, int fd, int packets,
   return n;
 }
 
+/*
+ * Split receive - the payload area of the datagram i (dlen bytes after
+ * the hlen bytes of the header) is received directly to data + i * dlen.
+ * The header and the bytes over dlen stay in the own slot on their
+ * positions, so the slot is the linear datagram with a hole.
+ */
+int
+udp_multirecv_read_split( udp_multirecv_t *um, int fd, int packets,
+                          int hlen, uint8_t *data, int dlen,
+                          struct iovec **iovec )
+{
+  struct mmsghdr *msg = um ? (struct mmsghdr *)um->um_msg : NULL;
+  struct iovec *v;
+  uint8_t *slot;
+  int n, i, c;
+
+  if (um == NULL || iovec == NULL || hlen + dlen > um->um_psize) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (packets > um->um_packets)
+    packets = um->um_packets;
+  for (i = 0; i < packets; i++) {
+    slot = um->um_data + i * um->um_psize;
+    v = um->um_siovec + i * 3;
+    c = 0;
+    if (hlen > 0) {
+      v[c].iov_base = slot;
+      v[c++].iov_len = hlen;
+    }
+    v[c].iov_base = data + i * dlen;
+    v[c++].iov_len = dlen;
+    if (um->um_psize > hlen + dlen) {
+      v[c].iov_base = slot + hlen + dlen;
+      v[c++].iov_len = um->um_psize - hlen - dlen;
+    }
+    msg[i].msg_hdr.msg_iov    = v;
+    msg[i].msg_hdr.msg_iovlen = c;
+  }
+  n = udp_multirecv_recv(um, fd, packets);
+  for (i = 0; i < packets; i++) {
+    msg[i].msg_hdr.msg_iov    = &um->um_iovec[i];
+    msg[i].msg_hdr.msg_iovlen = 1;
+  }
+  um->um_split_hlen = hlen;
+  um->um_split_data = data;
+  um->um_split_dlen = dlen;
+  um->um_split_n    = MAX(n, 0);
+  um->um_split_lin  = um->um_split_n;
+  if (n > 0) {
+    for (i = 0; i < n; i++)
+      um->um_riovec[i].iov_len = msg[i].msg_len;
+    *iovec = um->um_riovec;
+  }
+  return n;
+}
+
+/*
+ * Fill the holes of the datagrams from the index 'from', the own slots
+ * are the complete datagrams then
+ */
+void
+udp_multirecv_split_linear( udp_multirecv_t *um, int from )
+{
+  int i, l;
+
+  for (i = from; i < um->um_split_lin; i++) {
+    l = MIN((int)um->um_riovec[i].iov_len - um->um_split_hlen, um->um_split_dlen);
+    if (l > 0)
+      memcpy(um->um_data + i * um->um_psize + um->um_split_hlen,
+             um->um_split_data + i * um->um_split_dlen, l);
+  }
+  if (from < um->um_split_lin)
+    um->um_split_lin = from;
+}
+
+static inline void
+udp_multirecv_split_copy( udp_multirecv_t *um, int i, int off, int len,
+                          uint8_t *dst, int move )
+{
+  uint8_t *slot = um->um_data + i * um->um_psize;
+  int hlen = um->um_split_hlen, dlen = um->um_split_dlen, l;
+
+  if (i >= um->um_split_lin) {
+    memcpy(dst, slot + off, len);
+    return;
+  }
+  if (off < hlen) {
+    l = MIN(len, hlen - off);
+    memcpy(dst, slot + off, l);
+    dst += l; off += l; len -= l;
+  }
+  if (len > 0 && off < hlen + dlen) {
+    l = MIN(len, hlen + dlen - off);
+    if (move) {
+      if (dst != um->um_split_data + i * dlen + off - hlen)
+        memmove(dst, um->um_split_data + i * dlen + off - hlen, l);
+    } else {
+      memcpy(dst, um->um_split_data + i * dlen + off - hlen, l);
+    }
+    dst += l; off += l; len -= l;
+  }
+  if (len > 0)
+    memcpy(dst, slot + off, len);
+}
+
+/*
+ * Copy the bytes off..off+len of the datagram i to a separate buffer
+ */
+void
+udp_multirecv_split_peek( udp_multirecv_t *um, int i, int off, int len,
+                          uint8_t *dst )
+{
+  udp_multirecv_split_copy(um, i, off, len, dst, 0);
+}
+
+/*
+ * Move the bytes off..off+len of the datagram i to dst in the data area,
+ * the datagrams must be moved in the receive order and dst must not be
+ * over the datagram's own payload area. The data already on the place
+ * are not moved. Returns the new dst.
+ */
+uint8_t *
+udp_multirecv_split_move( udp_multirecv_t *um, int i, int off, int len,
+                          uint8_t *dst )
+{
+  /* the datagram is longer than dlen, keep the next ones in the own slots */
+  if (i + 1 < um->um_split_lin &&
+      dst + len > um->um_split_data + (i + 1) * um->um_split_dlen)
+    udp_multirecv_split_linear(um, i + 1);
+  udp_multirecv_split_copy(um, i, off, len, dst, 1);
+  return dst + len;
+}
+
 /*
  * UDP multi packet send support
  */
@@ -72,7 +72,13 @@ typedef struct udp_multirecv {
   uint8_t        *um_data;
   struct iovec   *um_iovec;
   struct iovec   *um_riovec;
+  struct iovec   *um_siovec;
   struct mmsghdr *um_msg;
+  uint8_t        *um_split_data;
+  int             um_split_hlen;
+  int             um_split_dlen;
+  int             um_split_n;
+  int             um_split_lin;
 } udp_multirecv_t;
 
 void
@@ -82,6 +88,18 @@ udp_multirecv_free( udp_multirecv_t *um );
 int
 udp_multirecv_read( udp_multirecv_t *um, int fd, int packets,
                     struct iovec **iovec );
+int
+udp_multirecv_read_split( udp_multirecv_t *um, int fd, int packets,
+                          int hlen, uint8_t *data, int dlen,
+                          struct iovec **iovec );
+void
+udp_multirecv_split_linear( udp_multirecv_t *um, int from );
+void
+udp_multirecv_split_peek( udp_multirecv_t *um, int i, int off, int len,
+                          uint8_t *dst );
+uint8_t *
+udp_multirecv_split_move( udp_multirecv_t *um, int i, int off, int len,
+                          uint8_t *dst );
 
 typedef struct udp_multisend {
   int             um_psize;
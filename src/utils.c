@@ -85,8 +85,10 @@ static uint32_t crc_tab[256] = {
   0xbcb4666d, 0xb8757bda, 0xb5365d03, 0xb1f740b4
 };
 
-uint32_t
-tvh_crc32(const uint8_t *data, size_t datalen, uint32_t crc)
+static uint32_t crc_tab8[8][256];
+
+static uint32_t
+tvh_crc32_byte(const uint8_t *data, size_t datalen, uint32_t crc)
 {
   while(datalen--)
     crc = (crc << 8) ^ crc_tab[((crc >> 24) ^ *data++) & 0xff];
@@ -94,6 +96,157 @@ tvh_crc32(const uint8_t *data, size_t datalen, uint32_t crc)
   return crc;
 }
 
+/*
+ * Slice-by-8, crc_tab8[k] advances the crc of one byte over k zero bytes
+ */
+static uint32_t
+tvh_crc32_slice8(const uint8_t *data, size_t datalen, uint32_t crc)
+{
+  uint32_t w;
+
+  for ( ; datalen >= 8; datalen -= 8, data += 8) {
+    w = crc ^ (((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+               ((uint32_t)data[2] << 8) | data[3]);
+    crc = crc_tab8[7][w >> 24] ^ crc_tab8[6][(w >> 16) & 0xff] ^
+          crc_tab8[5][(w >> 8) & 0xff] ^ crc_tab8[4][w & 0xff] ^
+          crc_tab8[3][data[4]] ^ crc_tab8[2][data[5]] ^
+          crc_tab8[1][data[6]] ^ crc_tab8[0][data[7]];
+  }
+  return tvh_crc32_byte(data, datalen, crc);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TVH_CRC32_HAVE_CLMUL 1
+#include <immintrin.h>
+
+/*
+ * Carry-less multiplication folding (non-reflected CRC), the 128-bit
+ * blocks are byte swapped so bit 127 is the first message bit. Four
+ * accumulators are folded by 512 bits, then merged and the remaining
+ * blocks are folded by 128 bits. The last block and the tail are
+ * reduced using the slice-by-8 code.
+ */
+static uint64_t crc_clmul_k[8]; /* x^(n) mod P for 512+64, 512, 448, 384, 320, 256, 192, 128 */
+
+static uint32_t
+crc32_xpow_mod(int n)
+{
+  uint32_t r = 0x80000000; /* x^31 */
+  for (n -= 31; n > 0; n--)
+    r = (r << 1) ^ ((r & 0x80000000) ? 0x04c11db7 : 0);
+  return r;
+}
+
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i
+crc32_clmul_fold(__m128i a, __m128i k, __m128i b)
+{
+  return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(a, k, 0x11),
+                                     _mm_clmulepi64_si128(a, k, 0x00)), b);
+}
+
+__attribute__((target("pclmul,ssse3")))
+static uint32_t
+tvh_crc32_clmul(const uint8_t *data, size_t datalen, uint32_t crc)
+{
+  const __m128i swap = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                     7, 6, 5, 4, 3, 2, 1, 0);
+  __m128i a0, a1, a2, a3, k;
+  uint8_t buf[16];
+
+  if (datalen < 64)
+    return tvh_crc32_slice8(data, datalen, crc);
+
+  a0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), swap);
+  a0 = _mm_xor_si128(a0, _mm_set_epi32(crc, 0, 0, 0));
+  data += 16;
+  datalen -= 16;
+
+  if (datalen >= 112) {
+    a1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), swap);
+    a2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), swap);
+    a3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), swap);
+    data += 48;
+    datalen -= 48;
+    k = _mm_set_epi64x(crc_clmul_k[0], crc_clmul_k[1]);
+    for ( ; datalen >= 64; datalen -= 64, data += 64) {
+      a0 = crc32_clmul_fold(a0, k, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), swap));
+      a1 = crc32_clmul_fold(a1, k, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), swap));
+      a2 = crc32_clmul_fold(a2, k, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), swap));
+      a3 = crc32_clmul_fold(a3, k, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), swap));
+    }
+    a3 = crc32_clmul_fold(a2, _mm_set_epi64x(crc_clmul_k[6], crc_clmul_k[7]), a3);
+    a3 = crc32_clmul_fold(a1, _mm_set_epi64x(crc_clmul_k[4], crc_clmul_k[5]), a3);
+    a0 = crc32_clmul_fold(a0, _mm_set_epi64x(crc_clmul_k[2], crc_clmul_k[3]), a3);
+  }
+
+  k = _mm_set_epi64x(crc_clmul_k[6], crc_clmul_k[7]);
+  for ( ; datalen >= 16; datalen -= 16, data += 16)
+    a0 = crc32_clmul_fold(a0, k, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), swap));
+
+  _mm_storeu_si128((__m128i *)buf, _mm_shuffle_epi8(a0, swap));
+  crc = tvh_crc32_slice8(buf, 16, 0);
+  return tvh_crc32_slice8(data, datalen, crc);
+}
+#endif
+
+static uint32_t (*tvh_crc32_fcn)(const uint8_t *data, size_t datalen, uint32_t crc) =
+  tvh_crc32_byte;
+
+void
+tvh_crc32_init(void)
+{
+  static const int clmul_pow[8] = { 512+64, 512, 448, 384, 320, 256, 192, 128 };
+  uint32_t c;
+  int i, k;
+
+  for (i = 0; i < 256; i++) {
+    crc_tab8[0][i] = c = crc_tab[i];
+    for (k = 1; k < 8; k++) {
+      c = (c << 8) ^ crc_tab[c >> 24];
+      crc_tab8[k][i] = c;
+    }
+  }
+#if TVH_CRC32_HAVE_CLMUL
+  for (i = 0; i < 8; i++)
+    crc_clmul_k[i] = crc32_xpow_mod(clmul_pow[i]);
+  __builtin_cpu_init();
+#endif
+  if (tvh_crc32_select(TVH_CRC32_CLMUL))
+    tvh_crc32_select(TVH_CRC32_SLICE8);
+}
+
+/*
+ * Select the variant (after tvh_crc32_init), returns -1 when
+ * the variant is not supported
+ */
+int
+tvh_crc32_select(int variant)
+{
+  switch (variant) {
+  case TVH_CRC32_BYTE:
+    tvh_crc32_fcn = tvh_crc32_byte;
+    return 0;
+  case TVH_CRC32_SLICE8:
+    tvh_crc32_fcn = tvh_crc32_slice8;
+    return 0;
+#if TVH_CRC32_HAVE_CLMUL
+  case TVH_CRC32_CLMUL:
+    if (!__builtin_cpu_supports("pclmul") || !__builtin_cpu_supports("ssse3"))
+      break;
+    tvh_crc32_fcn = tvh_crc32_clmul;
+    return 0;
+#endif
+  }
+  return -1;
+}
+
+uint32_t
+tvh_crc32(const uint8_t *data, size_t datalen, uint32_t crc)
+{
+  return tvh_crc32_fcn(data, datalen, crc);
+}
+
 
 /**
  *
@@ -417,7 +570,8 @@ sbuf_alloc_(sbuf_t *sb, int len)
     sb->sb_data = malloc(sb->sb_size);
     return;
   } else {
-    sb->sb_size += len * 4;
+    /* grow geometrically, the large frames are assembled here */
+    sb->sb_size += MAX(len * 4, sb->sb_size / 2);
     sb->sb_data = realloc(sb->sb_data, sb->sb_size);
   }
 
@@ -835,17 +989,25 @@ static inline uint32_t mpegts_word32( const uint8_t *tsb )
   return *(uint32_t *)tsb;
 }
 
-int
-mpegts_word_count ( const uint8_t *tsb, int len, uint32_t mask )
-{
-  uint32_t val;
-  int r = 0;
+/*
+ * Count the bytes of the consecutive TS packets with the same masked
+ * header word. The AVX2 variant gathers the header words of 8 packets
+ * (188 bytes stride) at once and leaves the exact end of the run to
+ * the scalar tail. Note that SSE2/NEON have no gather, the lane inserts
+ * are slower than the unrolled scalar loop. The variant is selected at
+ * the first call using the runtime CPU detection.
+ */
 
-#if BYTE_ORDER == LITTLE_ENDIAN
-  mask = bswap_32(mask);
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MPEGTS_WORD_X86 1
+#include <immintrin.h>
 #endif
 
-  val  = mpegts_word32(tsb) & mask;
+static inline int
+mpegts_word_count_tail
+  ( const uint8_t *tsb, int len, uint32_t mask, uint32_t val )
+{
+  int r = 0;
 
   while (len >= 188) {
     if (len >= 4*188 &&
@@ -868,6 +1030,321 @@ mpegts_word_count ( const uint8_t *tsb, int len, uint32_t mask )
   return r;
 }
 
+static int
+mpegts_word_count_c ( const uint8_t *tsb, int len, uint32_t mask )
+{
+  return mpegts_word_count_tail(tsb, len, mask, mpegts_word32(tsb) & mask);
+}
+
+#if MPEGTS_WORD_X86
+__attribute__((target("avx2")))
+static int
+mpegts_word_count_avx2 ( const uint8_t *tsb, int len, uint32_t mask )
+{
+  const uint32_t val = mpegts_word32(tsb) & mask;
+  const __m256i vidx = _mm256_setr_epi32(0*188, 1*188, 2*188, 3*188,
+                                         4*188, 5*188, 6*188, 7*188);
+  const __m256i vmask = _mm256_set1_epi32(mask);
+  const __m256i vval = _mm256_set1_epi32(val);
+  __m256i w;
+  int r = 0;
+
+  while (len >= 16*188) {
+    w = _mm256_i32gather_epi32((const int *)tsb, vidx, 1);
+    w = _mm256_cmpeq_epi32(_mm256_and_si256(w, vmask), vval);
+    if ((uint32_t)_mm256_movemask_epi8(w) != 0xffffffff)
+      break;
+    w = _mm256_i32gather_epi32((const int *)(tsb + 8*188), vidx, 1);
+    w = _mm256_cmpeq_epi32(_mm256_and_si256(w, vmask), vval);
+    if ((uint32_t)_mm256_movemask_epi8(w) != 0xffffffff)
+      break;
+    r   += 16*188;
+    len -= 16*188;
+    tsb += 16*188;
+  }
+
+  return r + mpegts_word_count_tail(tsb, len, mask, val);
+}
+#endif
+
+static int mpegts_word_count_init ( const uint8_t *tsb, int len, uint32_t mask );
+
+static int (*mpegts_word_count_fcn)( const uint8_t *tsb, int len, uint32_t mask ) =
+  mpegts_word_count_init;
+
+static int
+mpegts_word_count_init ( const uint8_t *tsb, int len, uint32_t mask )
+{
+  int (*fcn)( const uint8_t *tsb, int len, uint32_t mask ) = mpegts_word_count_c;
+
+#if MPEGTS_WORD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    fcn = mpegts_word_count_avx2;
+#endif
+  mpegts_word_count_fcn = fcn;
+  return fcn(tsb, len, mask);
+}
+
+int
+mpegts_word_count ( const uint8_t *tsb, int len, uint32_t mask )
+{
+  if (len < 188)
+    return 0;
+
+#if BYTE_ORDER == LITTLE_ENDIAN
+  mask = bswap_32(mask);
+#endif
+
+  return mpegts_word_count_fcn(tsb, len, mask);
+}
+
+int
+mpegts_sync_count ( const uint8_t *tsb, int len )
+{
+  if (len < 188 || tsb[0] != 0x47)
+    return 0;
+  return mpegts_word_count(tsb, len, 0xFF000000);
+}
+
+/*
+ * Continuity counter check for a run of the packets with the same PID,
+ * *cc holds the next expected counter (0xff = unknown). Returns the
+ * count of the continuity errors.
+ */
+static inline int
+mpegts_cc_check_tail ( const uint8_t *tsb, int len, uint8_t *_cc )
+{
+  uint8_t cc, cc2 = *_cc;
+  int errors = 0;
+
+  for ( ; len >= 188; tsb += 188, len -= 188) {
+    cc = tsb[3] & 0x0f;
+    if (cc2 != 0xff && cc2 != cc)
+      errors++;
+    cc2 = (cc + 1) & 0x0f;
+  }
+  *_cc = cc2;
+  return errors;
+}
+
+#if MPEGTS_WORD_X86
+__attribute__((target("avx2,popcnt")))
+static int
+mpegts_cc_check_avx2 ( const uint8_t *tsb, int len, uint8_t *_cc )
+{
+  const __m256i vidx = _mm256_setr_epi32(0*188, 1*188, 2*188, 3*188,
+                                         4*188, 5*188, 6*188, 7*188);
+  const __m256i vperm = _mm256_setr_epi32(7, 0, 1, 2, 3, 4, 5, 6);
+  const __m256i vnib = _mm256_set1_epi32(0x0f);
+  const __m256i vone = _mm256_set1_epi32(1);
+  __m256i cur, prev, last;
+  int errors = 0;
+
+  if (*_cc == 0xff) {
+    errors = mpegts_cc_check_tail(tsb, 188, _cc);
+    tsb += 188;
+    len -= 188;
+  }
+  /* lane 7 carries the expected counter minus one */
+  last = _mm256_set1_epi32((*_cc - 1) & 0x0f);
+  while (len >= 8*188) {
+    cur = _mm256_i32gather_epi32((const int *)(tsb + 3), vidx, 1);
+    cur = _mm256_and_si256(cur, vnib);
+    prev = _mm256_blend_epi32(_mm256_permutevar8x32_epi32(cur, vperm),
+                              _mm256_permutevar8x32_epi32(last, vperm), 0x01);
+    prev = _mm256_and_si256(_mm256_add_epi32(prev, vone), vnib);
+    errors += 8 - __builtin_popcount(_mm256_movemask_ps(
+                     _mm256_castsi256_ps(_mm256_cmpeq_epi32(cur, prev))));
+    last = cur;
+    tsb += 8*188;
+    len -= 8*188;
+  }
+  *_cc = (_mm256_extract_epi32(last, 7) + 1) & 0x0f;
+  return errors + mpegts_cc_check_tail(tsb, len, _cc);
+}
+#endif
+
+static int mpegts_cc_check_init ( const uint8_t *tsb, int len, uint8_t *cc );
+
+static int (*mpegts_cc_check_fcn)( const uint8_t *tsb, int len, uint8_t *cc ) =
+  mpegts_cc_check_init;
+
+static int
+mpegts_cc_check_c ( const uint8_t *tsb, int len, uint8_t *cc )
+{
+  return mpegts_cc_check_tail(tsb, len, cc);
+}
+
+static int
+mpegts_cc_check_init ( const uint8_t *tsb, int len, uint8_t *cc )
+{
+  int (*fcn)( const uint8_t *tsb, int len, uint8_t *cc ) = mpegts_cc_check_c;
+
+#if MPEGTS_WORD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+    fcn = mpegts_cc_check_avx2;
+#endif
+  mpegts_cc_check_fcn = fcn;
+  return fcn(tsb, len, cc);
+}
+
+int
+mpegts_cc_check ( const uint8_t *tsb, int len, uint8_t *cc )
+{
+  if (len < 8*188)
+    return mpegts_cc_check_tail(tsb, len, cc);
+  return mpegts_cc_check_fcn(tsb, len, cc);
+}
+
+/*
+ * Find the first 00 00 xx byte sequence (MPEG start code for xx = 01,
+ * H.264/HEVC emulation prevention for xx = 03) which fits before end.
+ * Returns end when not found. The vector variants compare three shifted
+ * loads at once (16 bytes for SSE2/NEON, 32 bytes for AVX2) and leave
+ * the last bytes to the scalar tail.
+ */
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define TVH_FIND_NEON 1
+#include <arm_neon.h>
+#endif
+
+static inline const uint8_t *
+tvh_find_seq3_tail ( const uint8_t *p, const uint8_t *end, uint8_t x )
+{
+  for (end -= 2; p < end; p++)
+    if (p[2] == x && p[1] == 0 && p[0] == 0)
+      return p;
+  return end + 2;
+}
+
+#if TVH_FIND_NEON
+static const uint8_t *
+tvh_find_seq3_neon ( const uint8_t *p, const uint8_t *end, uint8_t x )
+{
+  const uint8x16_t vzero = vdupq_n_u8(0);
+  const uint8x16_t vx = vdupq_n_u8(x);
+  uint8x16_t m;
+  uint64_t bits;
+
+  for ( ; end - p >= 16 + 2; p += 16) {
+    m = vandq_u8(vceqq_u8(vld1q_u8(p), vzero), vceqq_u8(vld1q_u8(p + 1), vzero));
+    m = vandq_u8(m, vceqq_u8(vld1q_u8(p + 2), vx));
+    /* narrow to 4 bits per byte */
+    bits = vget_lane_u64(vreinterpret_u64_u8(
+             vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+    if (bits)
+      return p + (__builtin_ctzll(bits) >> 2);
+  }
+  return tvh_find_seq3_tail(p, end, x);
+}
+#endif
+
+#if MPEGTS_WORD_X86 && defined(__SSE2__)
+static const uint8_t *
+tvh_find_seq3_sse2 ( const uint8_t *p, const uint8_t *end, uint8_t x )
+{
+  const __m128i vzero = _mm_setzero_si128();
+  const __m128i vx = _mm_set1_epi8(x);
+  __m128i m;
+  uint32_t bits;
+
+  for ( ; end - p >= 16 + 2; p += 16) {
+    m = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), vzero);
+    m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 1)), vzero));
+    m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 2)), vx));
+    bits = _mm_movemask_epi8(m);
+    if (bits)
+      return p + __builtin_ctz(bits);
+  }
+  return tvh_find_seq3_tail(p, end, x);
+}
+#endif
+
+#if MPEGTS_WORD_X86
+__attribute__((target("avx2")))
+static const uint8_t *
+tvh_find_seq3_avx2 ( const uint8_t *p, const uint8_t *end, uint8_t x )
+{
+  const __m256i vzero = _mm256_setzero_si256();
+  const __m256i vx = _mm256_set1_epi8(x);
+  __m256i m;
+  uint32_t bits;
+
+  for ( ; end - p >= 32 + 2; p += 32) {
+    m = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), vzero);
+    m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 1)), vzero));
+    m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 2)), vx));
+    bits = _mm256_movemask_epi8(m);
+    if (bits)
+      return p + __builtin_ctz(bits);
+  }
+  return tvh_find_seq3_tail(p, end, x);
+}
+#endif
+
+static const uint8_t *
+tvh_find_seq3_c ( const uint8_t *p, const uint8_t *end, uint8_t x )
+{
+  return tvh_find_seq3_tail(p, end, x);
+}
+
+static const uint8_t *tvh_find_seq3_init ( const uint8_t *p, const uint8_t *end, uint8_t x );
+
+static const uint8_t *(*tvh_find_seq3_fcn)( const uint8_t *p, const uint8_t *end, uint8_t x ) =
+  tvh_find_seq3_init;
+
+/*
+ * Select the variant (the benchmarks), returns -1 when no vector
+ * variant is available
+ */
+int
+tvh_find_select ( int variant )
+{
+  const uint8_t *(*fcn)( const uint8_t *p, const uint8_t *end, uint8_t x ) = tvh_find_seq3_c;
+
+  if (variant == TVH_FIND_VECTOR) {
+#if TVH_FIND_NEON
+    fcn = tvh_find_seq3_neon;
+#endif
+#if MPEGTS_WORD_X86
+#if defined(__SSE2__)
+    fcn = tvh_find_seq3_sse2;
+#endif
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+      fcn = tvh_find_seq3_avx2;
+#endif
+  }
+  tvh_find_seq3_fcn = fcn;
+  return variant == TVH_FIND_VECTOR && fcn == tvh_find_seq3_c ? -1 : 0;
+}
+
+static const uint8_t *
+tvh_find_seq3_init ( const uint8_t *p, const uint8_t *end, uint8_t x )
+{
+  tvh_find_select(TVH_FIND_VECTOR);
+  return tvh_find_seq3_fcn(p, end, x);
+}
+
+const uint8_t *
+tvh_find_startcode ( const uint8_t *p, const uint8_t *end )
+{
+  if (end - p < 3)
+    return end;
+  return tvh_find_seq3_fcn(p, end, 0x01);
+}
+
+const uint8_t *
+tvh_find_emulation ( const uint8_t *p, const uint8_t *end )
+{
+  if (end - p < 3)
+    return end;
+  return tvh_find_seq3_fcn(p, end, 0x03);
+}
+
 static void
 deferred_unlink_cb(void *s, int dearmed)
 {
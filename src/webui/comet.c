@@ -317,8 +317,10 @@ comet_mailbox_poll(http_connection_t *hc, const char *remain, void *opaque)
   int64_t mono;
   htsmsg_t *m;
 
-  if(!im)
+  if(!im) {
+    tcp_worker_dedicate(); /* long poll */
     tvh_safe_usleep(100000); /* Always sleep 0.1 sec to avoid comet storms */
+  }
 
   tvh_mutex_lock(&comet_mutex);
   cmb = comet_find_mailbox(hc, cometid, lang, 1);
@@ -428,6 +430,7 @@ comet_mailbox_ws(http_connection_t *hc, const char *remain, void *opaque)
   const char *lang = hc->hc_access->aa_lang_ui;
   comet_mailbox_t *cmb;
 
+  tcp_worker_dedicate();
   res = http_send_header_websocket(hc, "tvheadend-comet");
 
   tvh_mutex_lock(&comet_mutex);
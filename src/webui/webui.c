@@ -361,12 +361,12 @@ http_stream_run(http_connection_t *hc, profile_chain_t *prch,
   }
 
   while(!hc->hc_shutdown && run && tvheadend_is_running()) {
-    tvh_mutex_lock(&sq->sq_mutex);
-    sm = TAILQ_FIRST(&sq->sq_queue);
+    sm = streaming_queue_first(sq);
     if(sm == NULL) {
       mono = mclk() + sec2mono(1);
+      tvh_mutex_lock(&sq->sq_mutex);
       do {
-        r = tvh_cond_timedwait(&sq->sq_cond, &sq->sq_mutex, mono);
+        r = streaming_queue_timedwait(sq, mono);
         if (r == ETIMEDOUT) {
           /* Check socket status */
           if (tcp_socket_dead(hc->hc_fd)) {
@@ -385,7 +385,6 @@ http_stream_run(http_connection_t *hc, profile_chain_t *prch,
     }
 
     streaming_queue_remove(sq, sm);
-    tvh_mutex_unlock(&sq->sq_mutex);
 
     switch(sm->sm_type) {
     case SMT_MPEGTS:
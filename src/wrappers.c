@@ -2,6 +2,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include "tvheadend.h"
 #include "tvhregex.h"
@@ -87,6 +88,46 @@ tvh_write(int fd, const void *buf, size_t len)
   return len ? 1 : 0;
 }
 
+/*
+ * Note: the iov array is modified (partial writes), the non-zero
+ * flags (send flags like MSG_MORE) can be used only for sockets
+ */
+int
+tvh_writev(int fd, struct iovec *iov, int iovcnt, int flags)
+{
+  int64_t limit = mclk() + sec2mono(25);
+  struct msghdr msg;
+  ssize_t c;
+
+  while (iovcnt > 0) {
+    if (flags) {
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = iov;
+      msg.msg_iovlen = MIN(iovcnt, IOV_MAX);
+      c = sendmsg(fd, &msg, flags);
+    } else {
+      c = writev(fd, iov, MIN(iovcnt, IOV_MAX));
+    }
+    if (c < 0) {
+      if (ERRNO_AGAIN(errno)) {
+        if (mclk() > limit)
+          break;
+        tvh_safe_usleep(100);
+        continue;
+      }
+      break;
+    }
+    for ( ; iovcnt > 0 && c >= iov->iov_len; iov++, iovcnt--)
+      c -= iov->iov_len;
+    if (iovcnt > 0) {
+      iov->iov_base = (uint8_t *)iov->iov_base + c;
+      iov->iov_len -= c;
+    }
+  }
+
+  return iovcnt ? 1 : 0;
+}
+
 int
 tvh_nonblock_write(int fd, const void *buf, size_t len)
 {
@@ -0,0 +1,130 @@
+/*
+ *  Tvheadend - AES-128 ECB descrambler microbenchmark
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * aes128_decrypt_packets() on input sized chunks (348 packets) with
+ * mixed parity and adaptation fields, compared with the per block
+ * AES_ecb_encrypt() loop (the previous implementation). The output of
+ * both must be identical.
+ *
+ * usage: aes128 [megabytes]
+ */
+
+#include "tvheadend.h"
+#include "descrambler/algo/libaes128dec.h"
+#include "openssl/aes.h"
+#include "bench.h"
+
+#define AES_PKTS 348
+
+static const uint8_t aes_even[16] = "0123456789abcdef";
+static const uint8_t aes_odd[16]  = "fedcba9876543210";
+
+static void
+aes_chunk_make(uint8_t *tsb)
+{
+  uint8_t *pkt;
+  int i;
+
+  bench_fill(tsb, AES_PKTS * 188, 7);
+  for (i = 0, pkt = tsb; i < AES_PKTS; i++, pkt += 188) {
+    pkt[0] = 0x47;
+    pkt[1] = 0x01;
+    pkt[2] = 0x00;
+    /* scrambled, even/odd runs, every 8th with an adaptation field */
+    pkt[3] = ((i / 64) & 1 ? 0xc0 : 0x80) | 0x10 | (i & 15);
+    if ((i & 7) == 0) {
+      pkt[3] |= 0x20;
+      pkt[4] = i % 100;
+    }
+  }
+}
+
+static void
+aes_legacy_decrypt(AES_KEY *keys, uint8_t *tsb, int len)
+{
+  uint8_t *pkt, *end = tsb + len;
+  uint_fast8_t xc0, offset;
+  AES_KEY *k;
+
+  for (pkt = tsb; pkt < end; pkt += 188) {
+    if (((xc0 = pkt[3]) & 0x80) == 0)
+      continue;
+    k = &keys[(xc0 & 0x40) >> 6];
+    pkt[3] = xc0 & 0x3f;
+    if (xc0 & 0x20) {
+      offset = 4 + pkt[4] + 1;
+      if (offset + 16 > 188)
+        continue;
+    } else {
+      offset = 4;
+    }
+    for (; offset <= (188 - 16); offset += 16)
+      AES_ecb_encrypt(pkt + offset, pkt + offset, k, AES_DECRYPT);
+  }
+}
+
+int
+main(int argc, char **argv)
+{
+  size_t total = (argc > 1 ? atoi(argv[1]) : 256) * 1000000UL;
+  size_t i, n = total / (AES_PKTS * 188);
+  uint8_t *src, *buf1, *buf2;
+  AES_KEY keys[2];
+  void *priv;
+  double t;
+
+  src  = malloc(AES_PKTS * 188);
+  buf1 = malloc(AES_PKTS * 188);
+  buf2 = malloc(AES_PKTS * 188);
+  aes_chunk_make(src);
+
+  AES_set_decrypt_key(aes_even, 128, &keys[0]);
+  AES_set_decrypt_key(aes_odd, 128, &keys[1]);
+  priv = aes128_get_priv_struct();
+  aes128_set_control_words(priv, aes_even, aes_odd);
+
+  memcpy(buf1, src, AES_PKTS * 188);
+  aes_legacy_decrypt(keys, buf1, AES_PKTS * 188);
+  memcpy(buf2, src, AES_PKTS * 188);
+  if (aes128_decrypt_packets(priv, buf2, AES_PKTS * 188) < 0 ||
+      memcmp(buf1, buf2, AES_PKTS * 188)) {
+    printf("AES output mismatch\n");
+    return 1;
+  }
+
+  /* the copy is included, the descrambler decrypts a copy too */
+  t = bench_now();
+  for (i = 0; i < n / 16; i++) {
+    memcpy(buf1, src, AES_PKTS * 188);
+    aes_legacy_decrypt(keys, buf1, AES_PKTS * 188);
+  }
+  bench_report("AES_ecb_encrypt per block", n / 16 * AES_PKTS * 188, bench_now() - t);
+
+  t = bench_now();
+  for (i = 0; i < n; i++) {
+    memcpy(buf2, src, AES_PKTS * 188);
+    aes128_decrypt_packets(priv, buf2, AES_PKTS * 188);
+  }
+  bench_report("aes128_decrypt_packets", n * AES_PKTS * 188, bench_now() - t);
+
+  aes128_free_priv_struct(priv);
+  free(src);
+  free(buf1);
+  free(buf2);
+  return 0;
+}
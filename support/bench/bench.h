@@ -0,0 +1,59 @@
+/*
+ *  Tvheadend - microbenchmark helpers
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The benchmarks are built by 'make bench' into $(BUILDDIR)/bench,
+ * they are linked with the server objects and call the real code.
+ */
+
+#ifndef TVH_BENCH_H
+#define TVH_BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static inline double
+bench_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* repeatable pseudo random data (xorshift) */
+static inline void
+bench_fill(uint8_t *data, size_t len, uint32_t seed)
+{
+  uint32_t x = seed ?: 1;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    data[i] = x;
+  }
+}
+
+static inline void
+bench_report(const char *name, size_t bytes, double secs)
+{
+  printf("%-32s %10.1f MB/s\n", name, bytes / secs / 1e6);
+}
+
+#endif /* TVH_BENCH_H */
@@ -0,0 +1,100 @@
+/*
+ *  Tvheadend - CRC32 (PSI sections) microbenchmark
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The tvh_crc32() variants (byte loop, slice-by-8, PCLMUL) selected one
+ * by one, on the section sizes and on the odd and tail lengths (the
+ * slice-by-8 and PCLMUL tails, the PCLMUL 64 byte minimum). The results
+ * of all variants are compared with the byte loop.
+ *
+ * usage: crc32 [megabytes]
+ */
+
+#include "tvheadend.h"
+#include "bench.h"
+
+static const size_t crc32_sizes[] = {
+  15, 63, 64, 77, 127, 128, 188, 191, 1021, 1024, 4096, 4099
+};
+
+static const struct {
+  int         variant;
+  const char *name;
+  int         div;      /* less data for the slow variants */
+} crc32_variants[] = {
+  { TVH_CRC32_BYTE,   "byte",   8 },
+  { TVH_CRC32_SLICE8, "slice8", 1 },
+  { TVH_CRC32_CLMUL,  "pclmul", 1 },
+};
+
+#define CRC32_BUFS 256
+#define CRC32_MAX  4099
+
+static double
+crc32_run(const uint8_t *data, size_t size, size_t total, uint32_t *res)
+{
+  size_t i, n = total / size;
+  uint32_t crc = 0;
+  double t = bench_now();
+
+  for (i = 0; i < n; i++)
+    crc ^= tvh_crc32(data + (i % CRC32_BUFS) * size, size, 0xffffffff);
+  *res = crc;
+  return bench_now() - t;
+}
+
+int
+main(int argc, char **argv)
+{
+  size_t total = (argc > 1 ? atoi(argv[1]) : 256) * 1000000UL;
+  uint32_t ref[ARRAY_SIZE(crc32_sizes)], crc;
+  double t;
+  uint8_t *data;
+  char name[64];
+  int i, v, fail = 0;
+
+  data = malloc(CRC32_BUFS * CRC32_MAX);
+  bench_fill(data, CRC32_BUFS * CRC32_MAX, 1);
+
+  tvh_crc32_init();
+
+  /* the reference results (a short run with the byte loop) */
+  tvh_crc32_select(TVH_CRC32_BYTE);
+  for (i = 0; i < ARRAY_SIZE(crc32_sizes); i++)
+    crc32_run(data, crc32_sizes[i], CRC32_BUFS * crc32_sizes[i], &ref[i]);
+
+  for (v = 0; v < ARRAY_SIZE(crc32_variants); v++) {
+    if (tvh_crc32_select(crc32_variants[v].variant)) {
+      printf("%s not supported\n", crc32_variants[v].name);
+      continue;
+    }
+    for (i = 0; i < ARRAY_SIZE(crc32_sizes); i++) {
+      crc32_run(data, crc32_sizes[i], CRC32_BUFS * crc32_sizes[i], &crc);
+      if (crc != ref[i]) {
+        printf("%s CRC mismatch for size %zu\n",
+               crc32_variants[v].name, crc32_sizes[i]);
+        fail = 1;
+      }
+      t = crc32_run(data, crc32_sizes[i], total / crc32_variants[v].div, &crc);
+      snprintf(name, sizeof(name), "%s %zu", crc32_variants[v].name, crc32_sizes[i]);
+      bench_report(name, total / crc32_variants[v].div / crc32_sizes[i] * crc32_sizes[i], t);
+    }
+  }
+
+  free(data);
+  return fail;
+}
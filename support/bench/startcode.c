@@ -0,0 +1,341 @@
+/*
+ *  Tvheadend - start code scanner microbenchmark
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * tvh_find_startcode() and h264_nal_deescape() on an elementary stream
+ * like buffer (a start code every ~50kB, emulation prevention bytes
+ * every ~4kB), compared with the byte loops. The found positions and
+ * the deescaped data must be identical.
+ *
+ * With a TS file, the video of the first program (H.264 or HEVC) is
+ * sent through the parser (parse_pes() and the NAL parsers) with the
+ * byte loop and with the vector scan (tvh_find_select). The file is
+ * repeated up to the given size, the delivered frames must be identical.
+ *
+ * usage: startcode [megabytes]
+ *        startcode file.ts [megabytes]
+ */
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "tvheadend.h"
+#include "service.h"
+#include "parsers/parsers.h"
+#include "parsers/parser_h264.h"
+#include "parsers/bitstream.h"
+#include "bench.h"
+
+#define SC_NAL_SIZE 65536
+#define SC_TS_CHUNK (348 * 188)
+
+static void
+sc_buf_make(uint8_t *data, size_t len)
+{
+  size_t i;
+
+  bench_fill(data, len, 3);
+  /* no start codes from the random data */
+  for (i = 2; i < len; i++)
+    if (data[i - 2] == 0 && data[i - 1] == 0 && data[i] <= 3)
+      data[i] = 0x80;
+  for (i = 0; i + 4 < len; i += 50000 + (data[i] & 0x3ff)) {
+    data[i] = data[i + 1] = 0;
+    data[i + 2] = 1;
+  }
+  for (i = 2048; i + 4 < len; i += 4096 + (data[i] & 0xff)) {
+    data[i] = data[i + 1] = 0;
+    data[i + 2] = 3;
+  }
+}
+
+static const uint8_t *
+sc_find_byte(const uint8_t *p, const uint8_t *end)
+{
+  for (end -= 2; p < end; p++)
+    if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+      return p;
+  return end + 2;
+}
+
+static int
+sc_deescape_byte(uint8_t *d, const uint8_t *data, int size)
+{
+  const uint8_t *end = data + size - 2, *end2 = data + size;
+  uint8_t *d0 = d;
+  uint_fast8_t c;
+
+  if (size > 2) {
+    while (data < end) {
+      c = *data++;
+      if (c || *data || *(data + 1) != 3) {
+        *d++ = c;
+      } else {
+        *d++ = 0;
+        *d++ = 0;
+        data += 2;
+      }
+    }
+  }
+  while (data < end2)
+    *d++ = *data++;
+  return d - d0;
+}
+
+static size_t
+sc_scan(const uint8_t *(*find)(const uint8_t *, const uint8_t *),
+        const uint8_t *data, size_t len, size_t *sum)
+{
+  const uint8_t *p = data, *end = data + len;
+  size_t count = 0;
+
+  *sum = 0;
+  while ((p = find(p, end)) < end) {
+    *sum += p - data;
+    count++;
+    p += 3;
+  }
+  return count;
+}
+
+/*
+ * The video PID of the first program (one packet PAT and PMT)
+ */
+static int
+sc_ts_video(const uint8_t *data, size_t len, int *type, int *pcr)
+{
+  const uint8_t *tsb, *s, *end;
+  int pid, pmt = -1, off, n;
+  size_t i;
+
+  for (i = 0; i + 188 <= len; i += 188) {
+    tsb = data + i;
+    if (tsb[0] != 0x47 || (tsb[1] & 0x40) == 0)
+      continue;
+    pid = (tsb[1] & 0x1f) << 8 | tsb[2];
+    if (pid != 0 && pid != pmt)
+      continue;
+    off = tsb[3] & 0x20 ? tsb[4] + 5 : 4;
+    if (off + 4 >= 188 || off + 1 + tsb[off] + 3 >= 188)
+      continue;
+    s = tsb + off + 1 + tsb[off];
+    end = s + (((s[1] & 0x0f) << 8 | s[2]) + 3) - 4;
+    if (end > tsb + 188 - 4)
+      continue;
+    if (pid == 0 && s[0] == 0x00 && pmt < 0) {
+      for (s += 8; s + 4 <= end; s += 4)
+        if (s[0] || s[1]) {
+          pmt = (s[2] & 0x1f) << 8 | s[3];
+          break;
+        }
+    } else if (pid == pmt && s[0] == 0x02) {
+      *pcr = (s[8] & 0x1f) << 8 | s[9];
+      n = (s[10] & 0x0f) << 8 | s[11];
+      for (s += 12 + n; s + 5 <= end; s += 5 + n) {
+        n = (s[3] & 0x0f) << 8 | s[4];
+        if (s[0] == 0x1b || s[0] == 0x24) {
+          *type = s[0] == 0x1b ? SCT_H264 : SCT_HEVC;
+          return (s[1] & 0x1f) << 8 | s[2];
+        }
+      }
+      return -1;
+    }
+  }
+  return -1;
+}
+
+/*
+ * The parser output, the frames are counted and checksummed
+ */
+typedef struct sc_sink {
+  streaming_target_t st;
+  size_t   frames;
+  size_t   bytes;
+  uint32_t crc;
+} sc_sink_t;
+
+static void
+sc_sink_cb(void *opaque, streaming_message_t *sm)
+{
+  sc_sink_t *sink = opaque;
+  th_pkt_t *pkt;
+
+  if (sm->sm_type == SMT_PACKET) {
+    pkt = sm->sm_data;
+    if (pkt->pkt_payload) {
+      sink->frames++;
+      sink->bytes += pktbuf_len(pkt->pkt_payload);
+      sink->crc = tvh_crc32(pktbuf_ptr(pkt->pkt_payload),
+                            pktbuf_len(pkt->pkt_payload), sink->crc);
+    }
+  }
+  streaming_msg_free(sm);
+}
+
+static streaming_ops_t sc_sink_ops = {
+  .st_cb = sc_sink_cb
+};
+
+static double
+sc_ts_run(const uint8_t *data, size_t len, int passes,
+          int pid, int type, int pcr, sc_sink_t *sink)
+{
+  service_t *t = calloc(1, sizeof(*t));
+  parser_t *prs = calloc(1, sizeof(*prs));
+  streaming_start_t *ss;
+  streaming_start_component_t *ssc;
+  size_t i, l;
+  double t0;
+  int n;
+
+  memset(sink, 0, sizeof(*sink));
+  streaming_target_init(&sink->st, &sc_sink_ops, sink, 0);
+  prs->prs_output = &sink->st;
+  prs->prs_service = t;
+  elementary_set_init(&prs->prs_components, LS_PARSER, "bench", t);
+  TAILQ_INIT(&prs->prs_queue);
+
+  /* the video and the PCR streams */
+  ss = calloc(1, sizeof(*ss) + 2 * sizeof(*ssc));
+  ss->ss_refcount = 1;
+  ss->ss_pcr_pid = pcr;
+  for (n = 0; n < (pcr != pid ? 2 : 1); n++) {
+    ssc = &ss->ss_components[n];
+    ssc->es_index = n + 1;
+    ssc->es_pid = n ? pcr : pid;
+    ssc->es_type = n ? SCT_UNKNOWN : type;
+  }
+  ss->ss_num_components = n;
+  parser_process(prs, streaming_msg_create_data(SMT_START, ss));
+
+  t0 = bench_now();
+  for (n = 0; n < passes; n++)
+    for (i = 0; i < len; i += l) {
+      l = MIN(SC_TS_CHUNK, len - i);
+      parser_process(prs, streaming_msg_create_data(SMT_MPEGTS,
+                                                    pktbuf_alloc(data + i, l)));
+    }
+  t0 = bench_now() - t0;
+
+  parser_destroy(&prs->prs_input);
+  free(t);
+  return t0;
+}
+
+static int
+sc_ts(const char *filename, size_t total)
+{
+  static const char *names[] = { "parse_pes byte loop", "parse_pes vector scan" };
+  sc_sink_t sink[2];
+  struct stat st;
+  uint8_t *data;
+  size_t len;
+  double t;
+  int fd, pid, type = 0, pcr = 0, passes, v;
+
+  if ((fd = open(filename, O_RDONLY)) < 0 || fstat(fd, &st)) {
+    printf("unable to open %s\n", filename);
+    return 1;
+  }
+  len = st.st_size / 188 * 188;
+  data = malloc(len);
+  if (read(fd, data, len) != len) {
+    printf("unable to read %s\n", filename);
+    return 1;
+  }
+  close(fd);
+  if ((pid = sc_ts_video(data, len, &type, &pcr)) < 0) {
+    printf("no H.264 or HEVC video in the first program\n");
+    return 1;
+  }
+  passes = MAX(1, total / len);
+  printf("%s video PID %d, PCR PID %d, %d passes\n",
+         type == SCT_H264 ? "H.264" : "HEVC", pid, pcr, passes);
+
+  for (v = TVH_FIND_BYTE; v <= TVH_FIND_VECTOR; v++) {
+    if (tvh_find_select(v)) {
+      printf("no vector scan\n");
+      break;
+    }
+    t = sc_ts_run(data, len, passes, pid, type, pcr, &sink[v]);
+    bench_report(names[v], len * passes, t);
+  }
+  tvh_find_select(TVH_FIND_VECTOR);
+  printf("%zu frames, %zu bytes\n", sink[0].frames, sink[0].bytes);
+  if (v > TVH_FIND_VECTOR &&
+      (sink[0].frames != sink[1].frames || sink[0].bytes != sink[1].bytes ||
+       sink[0].crc != sink[1].crc)) {
+    printf("frame mismatch (%zu/%zu)\n", sink[0].frames, sink[1].frames);
+    return 1;
+  }
+  free(data);
+  return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+  size_t len;
+  size_t i, n1, n2, sum1, sum2;
+  uint8_t *data, *out;
+  bitstream_t bs;
+  double t;
+  int l1;
+
+  tvh_crc32_init();
+  if (argc > 1 && !isdigit(argv[1][0]))
+    return sc_ts(argv[1], (argc > 2 ? atoi(argv[2]) : 256) * 1000000UL);
+
+  len = (argc > 1 ? atoi(argv[1]) : 64) * 1000000UL;
+  data = malloc(len);
+  out = malloc(SC_NAL_SIZE);
+  sc_buf_make(data, len);
+
+  t = bench_now();
+  n1 = sc_scan(sc_find_byte, data, len, &sum1);
+  bench_report("start code byte loop", len, bench_now() - t);
+  t = bench_now();
+  n2 = sc_scan(tvh_find_startcode, data, len, &sum2);
+  bench_report("tvh_find_startcode", len, bench_now() - t);
+  if (n1 != n2 || sum1 != sum2) {
+    printf("start code mismatch (%zu/%zu)\n", n1, n2);
+    return 1;
+  }
+
+  /* the NAL sized pieces, the parsers deescape the NAL units */
+  t = bench_now();
+  for (i = 0; i + SC_NAL_SIZE <= len; i += SC_NAL_SIZE)
+    sc_deescape_byte(out, data + i, SC_NAL_SIZE);
+  bench_report("deescape byte loop", len, bench_now() - t);
+  t = bench_now();
+  for (i = 0; i + SC_NAL_SIZE <= len; i += SC_NAL_SIZE)
+    free(h264_nal_deescape(&bs, data + i, SC_NAL_SIZE));
+  bench_report("h264_nal_deescape", len, bench_now() - t);
+  for (i = 0; i + SC_NAL_SIZE <= len; i += SC_NAL_SIZE) {
+    l1 = sc_deescape_byte(out, data + i, SC_NAL_SIZE);
+    h264_nal_deescape(&bs, data + i, SC_NAL_SIZE);
+    if (bs.len / 8 != l1 || memcmp(bs.rdata, out, l1)) {
+      printf("deescape mismatch at %zu\n", i);
+      return 1;
+    }
+    free((void *)bs.rdata);
+  }
+
+  free(data);
+  free(out);
+  return 0;
+}
@@ -0,0 +1,298 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2026 Tvheadend Foundation CIC
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, version 3 of the License.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Compare the initial EPG sync with the eventAdd maps and with the
+eventBatch messages (enableAsyncMetadata epgBatch=1): the message bytes
+per event, the sync time and the decoded events (must be identical).
+
+With --update (requires --generate), both clients stay connected, the
+EPG is imported again with the changed titles and the live updates
+(eventAdd/eventUpdate maps and eventBatch update=1) are compared.
+
+The server should have the EPG loaded, or use --generate to create the
+channels (HTTP API) and a synthetic EPG (XMLTV written to the socket of
+the enabled "External: XMLTV" grabber), e.g. for 100 channels and 14 days:
+
+  htsp-epgbatch.py --generate 100 --days 14 \
+    --xmltv-sock ~/.hts/tvheadend/epggrab/xmltv.sock
+"""
+
+# System imports
+import os, sys, struct, time, json, socket
+import urllib.request, urllib.parse
+from optparse import OptionParser
+
+# System path
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..', 'lib', 'py'))
+import tvh
+
+# TVH imports
+import tvh.htsp
+from tvh.htsp import HTSPClient
+import tvh.htsmsg as htsmsg
+
+# eventBatch requires HTSP v35
+tvh.htsp.HTSP_PROTO_VERSION = max(tvh.htsp.HTSP_PROTO_VERSION, 35)
+
+# Columns
+U32_COLS = ('eventId', 'channelId', 'contentType', 'nextEventId',
+            'seasonNumber', 'episodeNumber')
+STR_COLS = ('title', 'subtitle')
+
+def u32s(b):
+  return struct.unpack('>%dI' % (len(b) // 4), b) if b else ()
+
+def s64s(b):
+  return struct.unpack('>%dq' % (len(b) // 8), b) if b else ()
+
+# Read one message, returns (message, size, remaining data)
+def recv_raw(sock, buf):
+  while len(buf) < 4 or len(buf) < 4 + htsmsg.bin2int(buf[:4]):
+    d = sock.recv(1 << 16)
+    if not d:
+      raise Exception('connection closed')
+    buf += d
+  l = htsmsg.bin2int(buf[:4])
+  return htsmsg.deserialize0(buf[4:4+l]), 4 + l, buf[4+l:]
+
+# Decode the eventBatch rows to the eventAdd maps
+def batch_events(m, strings, events):
+  if m.get('dictReset'):
+    strings.clear()
+  for i, s in enumerate(m.get('strings', [])):
+    strings[m['dictIndex'] + i] = s
+  cols = {}
+  for k in U32_COLS + STR_COLS:
+    cols[k] = u32s(m.get(k))
+  start, stop = s64s(m.get('start')), s64s(m.get('stop'))
+  catcount, cat, ci = bytes(m.get('categoryCount', b'')), u32s(m.get('category')), 0
+  extra = {}
+  for x in m.get('extra', []):
+    extra[x['row']] = x
+  for r in range(m['count']):
+    e = {}
+    for k in U32_COLS:
+      if cols[k][r]: e[k] = cols[k][r]
+    e['start'], e['stop'] = start[r], stop[r]
+    for k in STR_COLS:
+      if cols[k][r]: e[k] = strings[cols[k][r]]
+    if catcount[r]:
+      e['category'] = [strings[x] for x in cat[ci:ci+catcount[r]]]
+    ci += catcount[r]
+    for k in ('summary', 'description'):
+      if m[k][r]: e[k] = m[k][r]
+    if r in extra:
+      x = dict(extra[r])
+      del x['row']
+      e.update(x)
+    events[e['eventId']] = e
+
+# HTTP API call
+def api(opts, path, **kw):
+  url = 'http://%s:%d/api/%s' % (opts.host, opts.http_port, path)
+  data = urllib.parse.urlencode({k: v if isinstance(v, str) else json.dumps(v)
+                                 for k, v in kw.items()}).encode()
+  if opts.user:
+    pm = urllib.request.HTTPPasswordMgrWithDefaultRealm()
+    pm.add_password(None, url, opts.user, opts.passwd)
+    opener = urllib.request.build_opener(urllib.request.HTTPDigestAuthHandler(pm),
+                                         urllib.request.HTTPBasicAuthHandler(pm))
+  else:
+    opener = urllib.request.build_opener()
+  return json.loads(opener.open(url, data).read() or b'{}')
+
+# XMLTV EPG (30/60 minute programmes)
+def xmltv(opts, now, suffix=''):
+  def ts(t):
+    return time.strftime('%Y%m%d%H%M%S +0000', time.gmtime(t))
+  out = ['<?xml version="1.0" encoding="UTF-8"?>', '<tv>']
+  for i in range(opts.generate):
+    out.append('<channel id="epgbatch%d"><display-name>epgbatch %d</display-name></channel>' % (i, i))
+  for i in range(opts.generate):
+    t, k = now, 0
+    while t < now + opts.days * 86400:
+      d = 1800 if k % 3 else 3600
+      out.append('<programme start="%s" stop="%s" channel="epgbatch%d">'
+                 '<title lang="en">Show %d%s</title>'
+                 '<sub-title lang="en">Episode %d</sub-title>'
+                 '<desc lang="en">A description of show %d on the channel %d, repeated text for the size.</desc>'
+                 '<category lang="en">Movie</category>'
+                 '<episode-num system="xmltv_ns">%d.%d.</episode-num>'
+                 '</programme>' % (ts(t), ts(t + d), i, k % 40, suffix, k, k % 40, i, k % 5, k % 20))
+      t, k = t + d, k + 1
+  out.append('</tv>')
+  return '\n'.join(out).encode()
+
+# Write the XMLTV data to the grabber socket, returns the event count
+def push(opts, data):
+  sock = os.path.expanduser(opts.xmltv_sock)
+  for i in range(50):
+    if os.path.exists(sock):
+      break
+    time.sleep(0.2)
+  s = socket.socket(socket.AF_UNIX)
+  s.connect(sock)
+  s.sendall(data)
+  s.close()
+  # wait until the grabber has processed the data
+  count = -1
+  while True:
+    time.sleep(2)
+    n = api(opts, 'epg/events/grid', limit=1)['totalCount']
+    if n == count:
+      return count
+    count = n
+
+# Create the channels and push the XMLTV EPG, returns the EPG start
+def generate(opts):
+  for m in api(opts, 'epggrab/module/list')['entries']:
+    if m.get('title', '').startswith('External: XMLTV'):
+      api(opts, 'idnode/save', node={'uuid': m['uuid'], 'enabled': True})
+  # HTSP passes only the channels with a service (wait for the scan)
+  for i in range(40):
+    svc = api(opts, 'mpegts/service/grid', limit=1)['entries']
+    if svc:
+      break
+    time.sleep(1)
+  else:
+    raise Exception('no service for the channels')
+  names = set(e['val'] for e in api(opts, 'channel/list')['entries'])
+  for i in range(opts.generate):
+    if 'epgbatch %d' % i not in names:
+      api(opts, 'channel/create', conf={'name': 'epgbatch %d' % i,
+                                        'number': 10000 + i, 'epgauto': True,
+                                        'services': [svc[0]['uuid']]})
+  now = int(time.time()) // 1800 * 1800 - 3600
+  data = xmltv(opts, now)
+  # the first import maps the new channels, the events of the second one
+  # are added to them
+  for i in range(2):
+    count = push(opts, data)
+  print('generated  %8d events (%d channels, %d days, %d bytes XMLTV)' %
+        (count, opts.generate, opts.days, len(data)))
+  return now
+
+# Initial sync, returns (events, bytes, time, state for update)
+def sync(opts, batch):
+  htsp = HTSPClient((opts.host, opts.port), 'epgbatch' if batch else 'legacy')
+  resp = htsp.hello()
+  if batch and 'epgbatch' not in resp.get('servercapability', []):
+    raise Exception('no epgbatch server capability')
+  if opts.user:
+    htsp.authenticate(opts.user, opts.passwd)
+  args = { 'epg': 1 }
+  if batch:
+    args['epgBatch'] = 1
+  htsp.enableAsyncMetadata(args)
+  events, strings, size, buf = {}, {}, 0, b''
+  t = time.time()
+  while True:
+    m, l, buf = recv_raw(htsp._sock, buf)
+    method = m.get('method')
+    if method == 'initialSyncCompleted':
+      break
+    if method == 'eventAdd':
+      del m['method']
+      events[m['eventId']] = m
+      size += l
+    elif method == 'eventBatch':
+      batch_events(m, strings, events)
+      size += l
+  t = time.time() - t
+  return events, size, t, (htsp, strings, buf)
+
+# Live updates until the connection is quiet, returns (events, bytes, messages)
+def update(state):
+  htsp, strings, buf = state
+  events, size, msgs = {}, 0, 0
+  htsp._sock.settimeout(3)
+  try:
+    while True:
+      m, l, buf = recv_raw(htsp._sock, buf)
+      method = m.get('method')
+      if method in ('eventAdd', 'eventUpdate'):
+        del m['method']
+        events[m['eventId']] = m
+      elif method == 'eventBatch':
+        batch_events(m, strings, events)
+      else:
+        continue
+      size += l
+      msgs += 1
+  except socket.timeout:
+    pass
+  htsp.disconnect()
+  return events, size, msgs
+
+# Command line
+optp = OptionParser()
+optp.add_option('-a', '--host', default='localhost',
+                help='Specify HTSP server hostname')
+optp.add_option('-o', '--port', default=9982, type='int',
+                help='Specify HTSP server port')
+optp.add_option('--http-port', default=9981, type='int',
+                help='Specify HTTP server port (--generate)')
+optp.add_option('-g', '--generate', default=0, type='int',
+                help='Create the channels and the EPG for the count of channels')
+optp.add_option('-d', '--days', default=14, type='int',
+                help='Specify the EPG days (--generate)')
+optp.add_option('-x', '--xmltv-sock', default='~/.hts/tvheadend/epggrab/xmltv.sock',
+                help='Specify the XMLTV grabber socket (--generate)')
+optp.add_option('-U', '--update', default=False, action='store_true',
+                help='Compare the live updates (--generate)')
+optp.add_option('-u', '--user', default=None,
+                help='Specify HTSP authentication username')
+optp.add_option('-p', '--passwd', default=None,
+                help='Specify HTSP authentication password')
+(opts, args) = optp.parse_args()
+
+if opts.update and not opts.generate:
+  optp.error('--update requires --generate')
+
+if opts.generate:
+  now = generate(opts)
+
+a, la, ta, sa = sync(opts, False)
+b, lb, tb, sb = sync(opts, True)
+if not a:
+  print('no events')
+  sys.exit(1)
+print('eventAdd   %8d events %10d bytes %6.1f bytes/event %6.2fs' % (len(a), la, la / len(a), ta))
+print('eventBatch %8d events %10d bytes %6.1f bytes/event %6.2fs' % (len(b), lb, lb / max(len(b), 1), tb))
+print('reduction  %.1f%%' % (100.0 * (la - lb) / la))
+diff = [k for k in a if a[k] != b.get(k)]
+if diff or len(a) != len(b):
+  print('event mismatch (%d)' % len(diff))
+  sys.exit(1)
+
+if opts.update:
+  push(opts, xmltv(opts, now, ' (updated)'))
+  a, la, ma = update(sa)
+  b, lb, mb = update(sb)
+  if not a:
+    print('no updates')
+    sys.exit(1)
+  print('update     %8d events %10d bytes %6.1f bytes/event %6d messages' % (len(a), la, la / len(a), ma))
+  print('batch      %8d events %10d bytes %6.1f bytes/event %6d messages' % (len(b), lb, lb / max(len(b), 1), mb))
+  print('reduction  %.1f%%' % (100.0 * (la - lb) / la))
+  diff = [k for k in a if a[k] != b.get(k)]
+  if diff or len(a) != len(b):
+    print('update mismatch (%d)' % len(diff))
+    sys.exit(1)
+else:
+  sa[0].disconnect()
+  sb[0].disconnect()